@@ -61,6 +61,19 @@ class TaskSetTbb;
 class GenericTask;
 class TbbContextId;
 
+/*! Totals of the tasksets of one name over the traced frames, see
+    GetTraceStages.  All times are in milliseconds.
+*/
+struct TraceStageTimes
+{
+    CHAR                    szName[ MAX_TRACE_NAMELENGTH ];
+    UINT                    uSets;
+    UINT                    uTasks;
+    double                  dSpan;      //  ready to last task end, summed over the sets
+    double                  dBusy;      //  summed task time
+    double                  dCritical;  //  span of the sets on a frame's critical path
+};
+
 /*! The TaskMgrTbb allows the user to schedule tasksets that run on top of
     TBB.  All TaskMgrTbb functions are NOT threadsafe.  TaskMgrTbb is 
     designed to be called only from the main thread.  Multi-threading is 
@@ -147,6 +160,72 @@ public:
         IsSetComplete( TASKSETHANDLE hSet     // Taskset to check completion of
                        );
 
+    /*! Task tracing records the begin and end time of every task and
+        taskset into a ring per thread, the threads never share a ring so
+        recording takes no locks.  Once a ring is full the oldest events
+        are overwritten.  DumpTrace writes the recorded events as Chrome
+        trace event JSON (chrome://tracing, Perfetto).  It must only be
+        called while no tasksets are running, e.g. after WaitForAll.
+    */
+    VOID
+        EnableTrace( BOOL bEnable             // Start or stop recording
+                     );
+
+    BOOL
+        DumpTrace( LPCWSTR szFileName         // JSON file to write
+                   );
+
+    /*! Marks the start of a frame in the trace.  The tasksets created
+        after the mark belong to the frame, which is what AnalyzeTrace 
+        reports on.  Only the main thread may call it.
+    */
+    VOID
+        TraceFrame();
+
+    /*! Writes a text report of the traced frames: the critical path of
+        every frame through the taskset dependencies and, per taskset
+        name, the parallel efficiency and the worker time lost waiting 
+        for the slowest tasks of the set.  Same rules as DumpTrace.
+    */
+    BOOL
+        AnalyzeTrace( LPCWSTR szFileName      // report file to write
+                      );
+
+    /*! Same analysis as AnalyzeTrace for the app to report itself.  Fills
+        up to uMaxStages stage totals sorted by taskset name and returns
+        the number of taskset names traced.  The trace ends with Shutdown,
+        a task manager initialized again starts a new one.
+    */
+    UINT
+        GetTraceStages( TraceStageTimes* pStages, // Stage totals to fill
+                        UINT uMaxStages,          // Size of pStages
+                        UINT* puFrames,           // OPTIONAL frames analyzed
+                        double* pdFrameTime       // OPTIONAL summed frame time, ms
+                        );
+
+    /*! With tracing enabled, hardware counters (cycles, instructions, 
+        last level cache and L1 data cache misses) are read around every
+        task and summed per taskset name.  On Linux they come from 
+        perf_event, on Windows built with USE_PCM from Intel PCM, which
+        must be able to program the counters when counting is enabled.
+        Elsewhere only time stamp counter cycles are counted.
+        TraceWork adds the work done by the tasksets of a name, e.g. the
+        triangles rasterized, CounterReport writes the totals per taskset
+        name with the IPC and the counts per unit of work.
+    */
+    VOID
+        EnableTraceCounters( BOOL bEnable     // Start or stop counting
+                             );
+
+    VOID
+        TraceWork( LPCSTR szSetName,          // Taskset name
+                   UINT uUnits                // Units of work done by the sets
+                   );
+
+    BOOL
+        CounterReport( LPCWSTR szFileName     // report file to write
+                       );
+
     //  DEMO ONLY: set variable before calling init to the
     //  number of threads tbb should create.  Changing this value will
     //  result in inaccurate performance timings.
@@ -180,6 +259,8 @@ private:
     //  Pointer to the observer class that assigned context ids.
     TbbContextId* mpTbbContextId;
 
+    UINT muNextTraceId;
+
     //  Pointer to the tbb structure to start tbb.
     void* mpTbbInit;
 
@@ -33,6 +33,24 @@ typedef unsigned int        TASKSETHANDLE;
 //  Variables to control the memory size and performance of the TaskMgr
 //  class.  See header comment for details.
 //
-#define MAX_SUCCESSORS                  5
-#define MAX_TASKSETS                    256
-#define MAX_TASKSETNAMELENGTH           512
\ No newline at end of file
+#define MAX_SUCCESSORS                  8
+#define MAX_TASKSETS                    1024
+#define MAX_TASKSETNAMELENGTH           512
+
+//
+//  Size of the task tracing rings.  Every thread that runs tasks gets a
+//  ring of MAX_TRACE_EVENTS events, up to MAX_TRACE_THREADS threads are
+//  traced.  Trace event names are cut to MAX_TRACE_NAMELENGTH - 1 chars.
+//  The taskset dependencies and frame marks of the last MAX_TRACE_EVENTS
+//  and MAX_TRACE_FRAMES are kept for the trace analysis.
+//
+#define MAX_TRACE_THREADS               64
+#define MAX_TRACE_EVENTS                ( 1 << 16 )
+#define MAX_TRACE_NAMELENGTH            32
+#define MAX_TRACE_FRAMES                1024
+
+//
+//  Hardware counters read around every task when counting is enabled:
+//  cycles, instructions, last level cache misses, L1 data cache misses
+//
+#define TRACE_COUNTERS                  4
\ No newline at end of file
@@ -36,6 +36,20 @@
 #include <task_scheduler_observer.h>
 
 #include <strsafe.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#elif defined( USE_PCM )
+#include <cpucounters.h>
+#endif
 
 #pragma warning ( push )
 #pragma warning ( disable : 4995 ) // skip deprecated warning on intrinsics.
@@ -99,6 +113,11 @@ private:
 atomic<INT>                gContextIdCount;
 enumerable_thread_specific<INT> gContextId;
 
+//
+//  Closes the hardware counters the calling thread opened
+//
+static VOID TraceCountersClose();
+
 //
 //  INTERNAL
 //  The TbbContextId class is an internal implemetation of the
@@ -117,6 +136,13 @@ class TbbContextId : public task_scheduler_observer
         gContextId.local() = iContext;
     }
 
+    //  Threads leaving the scheduler close their hardware counters
+    void
+    on_scheduler_exit( bool /*bIsWorker*/ )
+    {
+        TraceCountersClose();
+    }
+
 public:
     TbbContextId()
     {
@@ -125,6 +151,412 @@ public:
     }
 };
 
+//
+//  INTERNAL
+//  Task tracing.  A TraceEvent is the span of one task or one taskset.
+//  Every thread records into its own TraceRing, the ring index is picked
+//  with a thread local variable the first time the thread records an
+//  event, so a ring only ever has one writer and needs no locks.  Rings
+//  are allocated by their thread and freed at shutdown.
+//
+#define TRACE_SET_EVENT         0xFFFFFFFF
+#define TRACE_WAIT_EVENT        0xFFFFFFFE
+
+struct TraceEvent
+{
+    LONGLONG                llBegin;
+    LONGLONG                llEnd;
+    UINT                    uSet;       //  taskset handle
+    UINT                    uTask;      //  task index, TRACE_SET_EVENT or TRACE_WAIT_EVENT
+    UINT                    uId;        //  unique id of the taskset
+    CHAR                    szName[ MAX_TRACE_NAMELENGTH ];
+};
+
+struct TraceRing
+{
+    UINT                    muCount;    //  events recorded, the ring holds the last MAX_TRACE_EVENTS
+    TraceEvent              mEvents[ MAX_TRACE_EVENTS ];
+};
+
+//
+//  The taskset dependencies and the frame marks are only written by the 
+//  main thread that creates the tasksets.
+//
+struct TraceEdge
+{
+    UINT                    uId;        //  taskset
+    UINT                    uDependsOn; //  taskset it waits for
+};
+
+volatile BOOL               gbTraceEnabled = FALSE;
+TraceRing*                  gpTraceRings[ MAX_TRACE_THREADS ];
+volatile LONG               glTraceRingCount = 0;
+volatile LONG               glTraceGeneration = 0;      //  bumped by Shutdown, threads then pick new rings
+__declspec( thread ) LONG   glTraceRing = -1;
+__declspec( thread ) LONG   glTraceRingGeneration = -1;
+TraceEdge                   gTraceEdges[ MAX_TRACE_EVENTS ];
+UINT                        guTraceEdgeCount = 0;
+UINT                        guTraceFrames[ MAX_TRACE_FRAMES ];  //  first taskset id of the frame
+UINT                        guTraceFrameCount = 0;
+
+static inline LONGLONG
+TraceTime()
+{
+    LARGE_INTEGER           liTime;
+
+    QueryPerformanceCounter( &liTime );
+    return liTime.QuadPart;
+}
+
+static VOID
+TraceRecord(
+    LPCSTR                  szName,
+    UINT                    uSet,
+    UINT                    uTask,
+    UINT                    uId,
+    LONGLONG                llBegin,
+    LONGLONG                llEnd )
+{
+    if( glTraceRingGeneration != glTraceGeneration )
+    {
+        //  Threads past MAX_TRACE_THREADS are not traced
+        glTraceRingGeneration = glTraceGeneration;
+        glTraceRing = _InterlockedIncrement( &glTraceRingCount ) - 1;
+        if( glTraceRing < MAX_TRACE_THREADS )
+        {
+            gpTraceRings[ glTraceRing ] = new TraceRing;
+            gpTraceRings[ glTraceRing ]->muCount = 0;
+        }
+    }
+
+    if( glTraceRing >= MAX_TRACE_THREADS )
+    {
+        return;
+    }
+
+    TraceRing*              pRing = gpTraceRings[ glTraceRing ];
+    TraceEvent*             pEvent = &pRing->mEvents[ pRing->muCount % MAX_TRACE_EVENTS ];
+
+    pEvent->llBegin = llBegin;
+    pEvent->llEnd = llEnd;
+    pEvent->uSet = uSet;
+    pEvent->uTask = uTask;
+    pEvent->uId = uId;
+    StringCbCopyA( pEvent->szName, sizeof( pEvent->szName ), szName );
+
+    pRing->muCount++;
+}
+
+//
+//  INTERNAL
+//  Hardware counters: cycles, instructions, last level cache misses and
+//  L1 data cache misses of every task.  A task takes a sample before and
+//  after its function, the difference is summed up in its taskset.
+//  - On Linux every thread opens one perf_event group the first time it
+//    samples.  The group counts the user mode events of the calling thread
+//    only and is read with a single read.
+//  - On Windows built with USE_PCM, Intel PCM programs the events on all
+//    cores when counting is enabled and a sample reads the counters of the
+//    core the task runs on.  They count everything running on that core,
+//    a task that moved to another core is not counted.
+//  - Otherwise only the time stamp counter is read.
+//  A counter that cannot be opened reads 0 and is reported as missing.
+//
+volatile BOOL               gbTraceCounters = FALSE;
+volatile BOOL               gbTraceCounterMissing[ TRACE_COUNTERS ];
+volatile BOOL               gbTraceCounterMultiplexed = FALSE;
+volatile LONG               glTraceCounterSkipped = 0;
+
+#if defined( __linux__ )
+
+static const UINT           guTraceCounterType[ TRACE_COUNTERS ] =
+{
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HW_CACHE,
+};
+
+static const ULONGLONG      gullTraceCounterConfig[ TRACE_COUNTERS ] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ),
+};
+
+//  Group leader of the thread, -2 before it opened its counters and -1 if
+//  none could be opened.  The group read returns the counters that opened
+//  in the order they were opened
+__thread INT                giTraceCounterGroup = -2;
+__thread INT                giTraceCounterFd[ TRACE_COUNTERS ];
+__thread UINT               guTraceCounterSlot[ TRACE_COUNTERS ];
+
+struct TraceCounterSample
+{
+    ULONGLONG               ullCounters[ TRACE_COUNTERS ];
+};
+
+static VOID
+TraceCountersOpen()
+{
+    UINT                    uNumOpen = 0;
+
+    giTraceCounterGroup = -1;
+    for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        struct perf_event_attr  Attr;
+
+        memset( &Attr, 0, sizeof( Attr ) );
+        Attr.size = sizeof( Attr );
+        Attr.type = guTraceCounterType[ uCounter ];
+        Attr.config = gullTraceCounterConfig[ uCounter ];
+        Attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        Attr.exclude_kernel = 1;
+        Attr.exclude_hv = 1;
+
+        INT                 iFd = (INT)syscall( __NR_perf_event_open, &Attr, 0, -1, giTraceCounterGroup, 0 );
+
+        giTraceCounterFd[ uCounter ] = iFd;
+        guTraceCounterSlot[ uCounter ] = TRACE_COUNTERS;
+        if( iFd < 0 )
+        {
+            gbTraceCounterMissing[ uCounter ] = TRUE;
+            continue;
+        }
+        if( giTraceCounterGroup < 0 )
+        {
+            giTraceCounterGroup = iFd;
+        }
+        guTraceCounterSlot[ uCounter ] = uNumOpen++;
+    }
+}
+
+static VOID
+TraceCountersClose()
+{
+    if( -2 == giTraceCounterGroup )
+    {
+        return;
+    }
+    for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        if( giTraceCounterFd[ uCounter ] >= 0 )
+        {
+            close( giTraceCounterFd[ uCounter ] );
+        }
+    }
+    giTraceCounterGroup = -2;
+}
+
+static VOID
+TraceCountersBegin(
+    TraceCounterSample&     Sample )
+{
+    //  Read layout: number of counters, time enabled, time running, counters
+    ULONGLONG               ullValues[ 3 + TRACE_COUNTERS ];
+
+    if( -2 == giTraceCounterGroup )
+    {
+        TraceCountersOpen();
+    }
+
+    memset( ullValues, 0, sizeof( ullValues ) );
+    if( giTraceCounterGroup >= 0 &&
+        read( giTraceCounterGroup, ullValues, sizeof( ullValues ) ) < (ssize_t)( 3 * sizeof( ULONGLONG ) ) )
+    {
+        memset( ullValues, 0, sizeof( ullValues ) );
+    }
+
+    //  A group that did not always fit on the core counts less than it should
+    if( ullValues[ 2 ] < ullValues[ 1 ] )
+    {
+        gbTraceCounterMultiplexed = TRUE;
+    }
+
+    for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        UINT                uSlot = guTraceCounterSlot[ uCounter ];
+
+        Sample.ullCounters[ uCounter ] = uSlot < ullValues[ 0 ] ? ullValues[ 3 + uSlot ] : 0;
+    }
+}
+
+static BOOL
+TraceCountersEnd(
+    const TraceCounterSample&   Begin,
+    ULONGLONG               ullCounters[ TRACE_COUNTERS ] )
+{
+    TraceCounterSample      End;
+
+    TraceCountersBegin( End );
+    for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        ullCounters[ uCounter ] = End.ullCounters[ uCounter ] - Begin.ullCounters[ uCounter ];
+    }
+
+    return TRUE;
+}
+
+static BOOL
+TraceCountersEnable(
+    BOOL                    bEnable )
+{
+    return bEnable;
+}
+
+#elif defined( USE_PCM )
+
+//  Core events of PCM's four general purpose counters, the ones left out
+//  count nothing.  Cycles and instructions come from the fixed counters
+static const INT            giTraceCounterEvent[ 2 ][ 2 ] =
+{
+    { 0x2E, 0x41 },         //  LONGEST_LAT_CACHE.MISS
+    { 0x51, 0x01 },         //  L1D.REPLACEMENT
+};
+
+BOOL                        gbTraceCountersProgrammed = FALSE;
+
+static VOID
+TraceCountersClose()
+{
+}
+
+struct TraceCounterSample
+{
+    CoreCounterState        State;
+    DWORD                   dwCore;
+};
+
+static VOID
+TraceCountersBegin(
+    TraceCounterSample&     Sample )
+{
+    Sample.dwCore = GetCurrentProcessorNumber();
+    Sample.State = getCoreCounterState( Sample.dwCore );
+}
+
+static BOOL
+TraceCountersEnd(
+    const TraceCounterSample&   Begin,
+    ULONGLONG               ullCounters[ TRACE_COUNTERS ] )
+{
+    DWORD                   dwCore = GetCurrentProcessorNumber();
+
+    if( dwCore != Begin.dwCore )
+    {
+        return FALSE;
+    }
+
+    CoreCounterState        End = getCoreCounterState( dwCore );
+
+    ullCounters[ 0 ] = getCycles( Begin.State, End );
+    ullCounters[ 1 ] = getInstructionsRetired( Begin.State, End );
+    ullCounters[ 2 ] = getNumberOfCustomEvents( 0, Begin.State, End );
+    ullCounters[ 3 ] = getNumberOfCustomEvents( 1, Begin.State, End );
+
+    return TRUE;
+}
+
+static BOOL
+TraceCountersEnable(
+    BOOL                    bEnable )
+{
+    PCM*                    pPcm = PCM::getInstance();
+
+    if( bEnable && !gbTraceCountersProgrammed )
+    {
+        PCM::CustomCoreEventDescription Events[ 4 ];
+
+        memset( Events, 0, sizeof( Events ) );
+        for( UINT uEvent = 0; uEvent < 2; ++uEvent )
+        {
+            Events[ uEvent ].event_number = giTraceCounterEvent[ uEvent ][ 0 ];
+            Events[ uEvent ].umask_value = giTraceCounterEvent[ uEvent ][ 1 ];
+        }
+        gbTraceCountersProgrammed = PCM::Success == pPcm->program( PCM::CUSTOM_CORE_EVENTS, Events );
+        for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+        {
+            gbTraceCounterMissing[ uCounter ] = !gbTraceCountersProgrammed;
+        }
+    }
+    else if( !bEnable && gbTraceCountersProgrammed )
+    {
+        pPcm->cleanup();
+        gbTraceCountersProgrammed = FALSE;
+    }
+
+    return gbTraceCountersProgrammed;
+}
+
+#else
+
+static VOID
+TraceCountersClose()
+{
+}
+
+struct TraceCounterSample
+{
+    ULONGLONG               ullCycles;
+};
+
+static VOID
+TraceCountersBegin(
+    TraceCounterSample&     Sample )
+{
+    Sample.ullCycles = __rdtsc();
+}
+
+static BOOL
+TraceCountersEnd(
+    const TraceCounterSample&   Begin,
+    ULONGLONG               ullCounters[ TRACE_COUNTERS ] )
+{
+    ullCounters[ 0 ] = __rdtsc() - Begin.ullCycles;
+    for( UINT uCounter = 1; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        ullCounters[ uCounter ] = 0;
+    }
+
+    return TRUE;
+}
+
+static BOOL
+TraceCountersEnable(
+    BOOL                    bEnable )
+{
+    for( UINT uCounter = 1; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        gbTraceCounterMissing[ uCounter ] = TRUE;
+    }
+
+    return bEnable;
+}
+
+#endif
+
+//
+//  INTERNAL
+//  Counter totals of all the tasksets of a name, updated once per taskset
+//  when it completes.  TraceWork adds to the same totals.
+//
+struct TraceCounterTotals
+{
+    TraceCounterTotals()
+    : ullSets( 0 )
+    , ullTasks( 0 )
+    , ullWork( 0 )
+    {
+        memset( ullCounters, 0, sizeof( ullCounters ) );
+    }
+
+    ULONGLONG               ullSets;
+    ULONGLONG               ullTasks;
+    ULONGLONG               ullWork;
+    ULONGLONG               ullCounters[ TRACE_COUNTERS ];
+};
+
 //
 //  INTERNAL
 //  GenericTask is the wrapper class for individual tbb tasks.  Tasks
@@ -144,6 +576,7 @@ public:
     , muSize( 0 )
     , mpszSetName( NULL )
     , mhTaskSet( TASKSETHANDLE_INVALID )
+    , muTraceId( 0 )
     {
     };
 
@@ -153,13 +586,15 @@ public:
         UINT                uIdx,
         UINT                uSize,
         CHAR*               pszSetName,
-        TASKSETHANDLE       hSet ) 
+        TASKSETHANDLE       hSet,
+        UINT                uTraceId ) 
     : mpFunc( pFunc )
     , mpvArg( pvArg )
     , muIdx( uIdx )
     , muSize( uSize )
     , mpszSetName( pszSetName )
     , mhTaskSet( hSet )
+    , muTraceId( uTraceId )
     {
     };
 
@@ -167,12 +602,31 @@ public:
     //  proper parameters
     task* execute()
     {
+        LONGLONG            llBegin = gbTraceEnabled ? TraceTime() : 0;
+        BOOL                bCount = gbTraceEnabled && gbTraceCounters;
+        TraceCounterSample  Begin;
+
+        if( bCount )
+        {
+            TraceCountersBegin( Begin );
+        }
+
         ProfileBeginTask( mpszSetName );
 
         mpFunc( mpvArg, gContextId.local(), muIdx, muSize );
 
         ProfileEndTask();
 
+        if( bCount )
+        {
+            CountTask( Begin );
+        }
+
+        if( gbTraceEnabled && 0 != llBegin )
+        {
+            TraceRecord( mpszSetName, mhTaskSet, muIdx, muTraceId, llBegin, TraceTime() );
+        }
+
         //  Notify the taskmgr that this set completed one of its tasks.
         gTaskMgr.CompleteTaskSet( mhTaskSet );
 
@@ -181,6 +635,9 @@ public:
 
 private:
 
+    VOID
+    CountTask( const TraceCounterSample& Begin );
+
     TASKSETFUNC             mpFunc;
     void*                   mpvArg;
     UINT                    muIdx;
@@ -188,6 +645,7 @@ private:
     CHAR*                   mpszSetName;
 
     TASKSETHANDLE           mhTaskSet;
+    UINT                    muTraceId;
 };
 
 //
@@ -206,6 +664,8 @@ public:
     , muSize( 0 )
     , mhTaskset( TASKSETHANDLE_INVALID )
     , mbHasBeenWaitedOn( FALSE )
+    , mllTraceBegin( 0 )
+    , muTraceId( 0 )
     {
         mszSetName[ 0 ] = 0;
         memset( Successors, 0, sizeof( Successors ) ) ;
@@ -217,6 +677,10 @@ public:
         //  one plus the task set count
         set_ref_count( muSize + 1 );
 
+        //  The taskset span starts once its dependencies are done
+        mllTraceBegin = gbTraceEnabled ? TraceTime() : 0;
+        memset( (void*)mllCounters, 0, sizeof( mllCounters ) );
+
         ProfileBeginTask("Taskset Spawn Tasks");
 
         //  Iterate for each task in the set and spawn a GenericTask
@@ -228,7 +692,8 @@ public:
                 uIdx, 
                 muSize,
                 mszSetName,
-                mhTaskset ) );
+                mhTaskset,
+                muTraceId ) );
         }
 
         ProfileEndTask();
@@ -252,8 +717,39 @@ public:
     SpinLock                mSuccessorsLock;
 
     CHAR                    mszSetName[ MAX_TASKSETNAMELENGTH ];
+
+    LONGLONG                mllTraceBegin;
+    UINT                    muTraceId;
+    volatile LONGLONG       mllCounters[ TRACE_COUNTERS ];
 };
 
+//
+//  Counter totals per taskset name, see TraceCounterTotals
+//
+std::map<std::string, TraceCounterTotals> gTraceCounterTotals;
+SpinLock                    gTraceCounterLock;
+
+//
+//  Sum the counters of a task up in its taskset
+//
+VOID
+GenericTask::CountTask(
+    const TraceCounterSample&   Begin )
+{
+    TaskSetTbb*             pSet = gTaskMgr.mSets[ mhTaskSet ];
+    ULONGLONG               ullCounters[ TRACE_COUNTERS ];
+
+    if( !TraceCountersEnd( Begin, ullCounters ) )
+    {
+        _InterlockedIncrement( &glTraceCounterSkipped );
+        return;
+    }
+    for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        _InterlockedExchangeAdd64( &pSet->mllCounters[ uCounter ], (LONGLONG)ullCounters[ uCounter ] );
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Implementation of TaskMgrTbb
@@ -264,6 +760,7 @@ TaskMgrTbb::TaskMgrTbb()
     : mpTbbContextId( NULL )
     , mpTbbInit( NULL )
     , miDemoModeThreadCountOverride( task_scheduler_init::automatic )
+    , muNextTraceId( 0 )
 {
     memset(
         mSets,
@@ -323,6 +820,24 @@ TaskMgrTbb::Shutdown()
     
     delete mpTbbContextId;
     delete reinterpret_cast<task_scheduler_init*>(mpTbbInit);
+
+    //
+    //  The trace ends with the task manager, one initialized again
+    //  starts a new trace with new rings for its threads
+    //
+    gbTraceEnabled = FALSE;
+    for( UINT uRing = 0; uRing < MAX_TRACE_THREADS; ++uRing )
+    {
+        delete gpTraceRings[ uRing ];
+        gpTraceRings[ uRing ] = NULL;
+    }
+    glTraceRingCount = 0;
+    guTraceEdgeCount = 0;
+    guTraceFrameCount = 0;
+    gTraceCounterTotals.clear();
+    glTraceCounterSkipped = 0;
+    gbTraceCounters = TraceCountersEnable( FALSE );
+    _InterlockedIncrement( &glTraceGeneration );
 }
 
 BOOL
@@ -381,10 +896,10 @@ TaskMgrTbb::CreateTaskSet(
     mSets[ hSet ]->muSize         = uTaskCount;
     mSets[ hSet ]->muCompletionCount = uTaskCount;
     mSets[ hSet ]->mhTaskset      = hSet;
+    mSets[ hSet ]->muTraceId      = muNextTraceId++;
 
-#ifdef PROFILEGPA
     //
-    //  Track task name if profiling is enabled
+    //  Track task name for profiling and tracing
     if( szSetName )
     {
         StringCbCopyA(
@@ -399,9 +914,6 @@ TaskMgrTbb::CreateTaskSet(
             sizeof( mSets[ hSet ]->mszSetName ),
             "Unnamed Task" );
     }
-#else
-    UNREFERENCED_PARAMETER( szSetName );
-#endif // PROFILEGPA
 
     //
     //  Iterate over the dependency list and setup the successor
@@ -421,6 +933,14 @@ TaskMgrTbb::CreateTaskSet(
         TaskSetTbb*         pDependsOn = mSets[ hDependsOn ];
         LONG                lPrevCompletion;
 
+        if( gbTraceEnabled )
+        {
+            TraceEdge*      pEdge = &gTraceEdges[ guTraceEdgeCount++ % MAX_TRACE_EVENTS ];
+
+            pEdge->uId = mSets[ hSet ]->muTraceId;
+            pEdge->uDependsOn = pDependsOn->muTraceId;
+        }
+
         //
         //  A taskset with a new successor is consider incomplete even if it
         //  already has completed.  This mechanism allows us tasksets that are
@@ -515,8 +1035,15 @@ TaskMgrTbb::WaitForSet(
     //  deadlock if waited on again.
     if( !mSets[ hSet ]->mbHasBeenWaitedOn )
     {
+        LONGLONG            llBegin = gbTraceEnabled ? TraceTime() : 0;
+
         mSets[ hSet ]->wait_for_all();
         mSets[ hSet ]->mbHasBeenWaitedOn = TRUE;
+
+        if( gbTraceEnabled && 0 != llBegin )
+        {
+            TraceRecord( mSets[ hSet ]->mszSetName, hSet, TRACE_WAIT_EVENT, mSets[ hSet ]->muTraceId, llBegin, TraceTime() );
+        }
     }
 
 }
@@ -578,6 +1105,31 @@ TaskMgrTbb::CompleteTaskSet(
 
     if( 0 == uCount )
     {
+        //
+        //  Completions for added successors run this again, only the
+        //  first completion after the tasks ran ends the taskset span.
+        //
+        if( gbTraceEnabled && 0 != pSet->mllTraceBegin )
+        {
+            TraceRecord( pSet->mszSetName, hSet, TRACE_SET_EVENT, pSet->muTraceId, pSet->mllTraceBegin, TraceTime() );
+
+            if( gbTraceCounters )
+            {
+                gTraceCounterLock.Lock();
+
+                TraceCounterTotals& Totals = gTraceCounterTotals[ pSet->mszSetName ];
+                Totals.ullSets++;
+                Totals.ullTasks += pSet->muSize;
+                for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+                {
+                    Totals.ullCounters[ uCounter ] += pSet->mllCounters[ uCounter ];
+                }
+
+                gTraceCounterLock.Unlock();
+            }
+        }
+        pSet->mllTraceBegin = 0;
+
         //
         //  The task set has completed.  We need to look at the successors
         //  and signal them that this dependency of theirs has completed.
@@ -624,4 +1176,492 @@ TaskMgrTbb::IsSetComplete(
     TaskSetTbb*             pSet = mSets[ hSet ];
 
     return 0 == pSet->muCompletionCount;
-}
\ No newline at end of file
+}
+
+VOID
+TaskMgrTbb::EnableTrace(
+    BOOL                    bEnable )
+{
+    gbTraceEnabled = bEnable;
+}
+
+BOOL
+TaskMgrTbb::DumpTrace(
+    LPCWSTR                 szFileName )
+{
+    FILE*                   pFile = NULL;
+    LARGE_INTEGER           liFrequency;
+    LONGLONG                llBase = 0;
+    BOOL                    bFirst = TRUE;
+    UINT                    uRings = min( (UINT)glTraceRingCount, (UINT)MAX_TRACE_THREADS );
+
+    if( 0 != _wfopen_s( &pFile, szFileName, L"w" ) )
+    {
+        return FALSE;
+    }
+
+    QueryPerformanceFrequency( &liFrequency );
+    double                  dToMicroseconds = 1000000.0 / (double)liFrequency.QuadPart;
+
+    //
+    //  The timeline starts at the oldest event still held in a ring
+    //
+    for( UINT uRing = 0; uRing < uRings; ++uRing )
+    {
+        TraceRing*          pRing = gpTraceRings[ uRing ];
+        UINT                uFirst = pRing->muCount > MAX_TRACE_EVENTS ? pRing->muCount - MAX_TRACE_EVENTS : 0;
+
+        for( UINT uEvent = uFirst; uEvent < pRing->muCount; ++uEvent )
+        {
+            TraceEvent*     pEvent = &pRing->mEvents[ uEvent % MAX_TRACE_EVENTS ];
+
+            if( bFirst || pEvent->llBegin < llBase )
+            {
+                llBase = pEvent->llBegin;
+                bFirst = FALSE;
+            }
+        }
+    }
+
+    //
+    //  Tasks are complete events on the thread that ran them.  Tasksets
+    //  overlap each other on a thread, they are written as async events
+    //
+    fprintf( pFile, "{\"traceEvents\":[\n" );
+    for( UINT uRing = 0; uRing < uRings; ++uRing )
+    {
+        TraceRing*          pRing = gpTraceRings[ uRing ];
+        UINT                uFirst = pRing->muCount > MAX_TRACE_EVENTS ? pRing->muCount - MAX_TRACE_EVENTS : 0;
+
+        fprintf( pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}", uRing, uRing );
+
+        for( UINT uEvent = uFirst; uEvent < pRing->muCount; ++uEvent )
+        {
+            TraceEvent*     pEvent = &pRing->mEvents[ uEvent % MAX_TRACE_EVENTS ];
+            double          dBegin = (double)( pEvent->llBegin - llBase ) * dToMicroseconds;
+            double          dEnd = (double)( pEvent->llEnd - llBase ) * dToMicroseconds;
+
+            if( TRACE_SET_EVENT == pEvent->uTask )
+            {
+                fprintf( pFile, ",\n{\"name\":\"%s\",\"cat\":\"taskset\",\"ph\":\"b\",\"id\":%u,\"ts\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"set\":%u}}",
+                    pEvent->szName, pEvent->uId, dBegin, uRing, pEvent->uSet );
+                fprintf( pFile, ",\n{\"name\":\"%s\",\"cat\":\"taskset\",\"ph\":\"e\",\"id\":%u,\"ts\":%.3f,\"pid\":0,\"tid\":%u}",
+                    pEvent->szName, pEvent->uId, dEnd, uRing );
+            }
+            else if( TRACE_WAIT_EVENT == pEvent->uTask )
+            {
+                fprintf( pFile, ",\n{\"name\":\"WaitForSet\",\"cat\":\"wait\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"set\":\"%s\",\"id\":%u}}",
+                    dBegin, dEnd - dBegin, uRing, pEvent->szName, pEvent->uId );
+            }
+            else
+            {
+                fprintf( pFile, ",\n{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"set\":%u,\"id\":%u,\"task\":%u}}",
+                    pEvent->szName, dBegin, dEnd - dBegin, uRing, pEvent->uSet, pEvent->uId, pEvent->uTask );
+            }
+        }
+        fprintf( pFile, uRing + 1 < uRings ? ",\n" : "\n" );
+    }
+    fprintf( pFile, "]}\n" );
+
+    fclose( pFile );
+
+    return TRUE;
+}
+
+VOID
+TaskMgrTbb::TraceFrame()
+{
+    if( gbTraceEnabled )
+    {
+        guTraceFrames[ guTraceFrameCount++ % MAX_TRACE_FRAMES ] = muNextTraceId;
+    }
+}
+
+//
+//  INTERNAL
+//  TraceSet gathers the trace events of one taskset for the analysis.
+//  The taskset span starts when its dependencies are done (ready) and 
+//  ends when its last task completes.
+//
+struct TraceSet
+{
+    TraceSet()
+    : llReady( 0 )
+    , llEnd( 0 )
+    , llBusy( 0 )
+    , uTasks( 0 )
+    , bSpan( FALSE )
+    {
+    }
+
+    std::string                 Name;
+    LONGLONG                    llReady;
+    LONGLONG                    llEnd;
+    LONGLONG                    llBusy;     //  summed task time
+    UINT                        uTasks;
+    BOOL                        bSpan;
+    std::vector<UINT>           Depends;
+    std::map<UINT, LONGLONG>    WorkerEnd;  //  last task end on every thread that ran tasks of the set
+};
+
+//
+//  INTERNAL
+//  Per taskset name totals over the analyzed frames
+//
+struct TraceStage
+{
+    TraceStage()
+    : uSets( 0 )
+    , uTasks( 0 )
+    , uCritical( 0 )
+    , dSpan( 0.0 )
+    , dBusy( 0.0 )
+    , dTailWait( 0.0 )
+    , dCritical( 0.0 )
+    {
+    }
+
+    UINT                        uSets;
+    UINT                        uTasks;
+    UINT                        uCritical;  //  times on a frame's critical path
+    double                      dSpan;      //  all times in milliseconds
+    double                      dBusy;
+    double                      dTailWait;
+    double                      dCritical;
+};
+
+//
+//  INTERNAL
+//  Gathers the tasksets still held in the rings and sums them up per
+//  taskset name over the frames that can be analyzed.  With a file the
+//  critical path of every frame is written to it.
+//
+static VOID
+TraceAnalyzeFrames(
+    FILE*                   pFile,
+    std::map<std::string, TraceStage>& Stages,
+    UINT&                   uFrames,
+    double&                 dFrameTime,
+    double&                 dCriticalTime )
+{
+    LARGE_INTEGER           liFrequency;
+    UINT                    uRings = min( (UINT)glTraceRingCount, (UINT)MAX_TRACE_THREADS );
+    std::map<UINT, TraceSet> Sets;
+
+    QueryPerformanceFrequency( &liFrequency );
+    double                  dToMilliseconds = 1000.0 / (double)liFrequency.QuadPart;
+
+    //
+    //  Gather the tasksets from the events still held in the rings
+    //
+    for( UINT uRing = 0; uRing < uRings; ++uRing )
+    {
+        TraceRing*          pRing = gpTraceRings[ uRing ];
+        UINT                uFirst = pRing->muCount > MAX_TRACE_EVENTS ? pRing->muCount - MAX_TRACE_EVENTS : 0;
+
+        for( UINT uEvent = uFirst; uEvent < pRing->muCount; ++uEvent )
+        {
+            TraceEvent*     pEvent = &pRing->mEvents[ uEvent % MAX_TRACE_EVENTS ];
+            TraceSet&       Set = Sets[ pEvent->uId ];
+
+            if( TRACE_SET_EVENT == pEvent->uTask )
+            {
+                Set.Name = pEvent->szName;
+                Set.llReady = pEvent->llBegin;
+                Set.llEnd = pEvent->llEnd;
+                Set.bSpan = TRUE;
+            }
+            else if( TRACE_WAIT_EVENT != pEvent->uTask )
+            {
+                Set.llBusy += pEvent->llEnd - pEvent->llBegin;
+                Set.uTasks++;
+                Set.WorkerEnd[ uRing ] = max( Set.WorkerEnd[ uRing ], pEvent->llEnd );
+            }
+        }
+    }
+
+    UINT                    uFirstEdge = guTraceEdgeCount > MAX_TRACE_EVENTS ? guTraceEdgeCount - MAX_TRACE_EVENTS : 0;
+    for( UINT uEdge = uFirstEdge; uEdge < guTraceEdgeCount; ++uEdge )
+    {
+        TraceEdge*          pEdge = &gTraceEdges[ uEdge % MAX_TRACE_EVENTS ];
+
+        Sets[ pEdge->uId ].Depends.push_back( pEdge->uDependsOn );
+    }
+
+    //
+    //  A frame is analyzed if the next frame has started and all its
+    //  tasksets are still in the rings
+    //
+    UINT                    uFirstFrame = guTraceFrameCount > MAX_TRACE_FRAMES ? guTraceFrameCount - MAX_TRACE_FRAMES : 0;
+
+    uFrames = 0;
+    dFrameTime = 0.0;
+    dCriticalTime = 0.0;
+    for( UINT uFrame = uFirstFrame; uFrame + 1 < guTraceFrameCount; ++uFrame )
+    {
+        UINT                uStart = guTraceFrames[ uFrame % MAX_TRACE_FRAMES ];
+        UINT                uEnd = guTraceFrames[ ( uFrame + 1 ) % MAX_TRACE_FRAMES ];
+        BOOL                bComplete = uStart < uEnd;
+        UINT                uLast = uStart;
+
+        for( UINT uId = uStart; uId < uEnd && bComplete; ++uId )
+        {
+            std::map<UINT, TraceSet>::iterator it = Sets.find( uId );
+
+            bComplete = it != Sets.end() && it->second.bSpan;
+            if( bComplete && it->second.llEnd > Sets[ uLast ].llEnd )
+            {
+                uLast = uId;
+            }
+        }
+        if( !bComplete )
+        {
+            continue;
+        }
+
+        LONGLONG            llFrameBegin = Sets[ uStart ].llReady;
+        for( UINT uId = uStart; uId < uEnd; ++uId )
+        {
+            TraceSet&       Set = Sets[ uId ];
+            TraceStage&     Stage = Stages[ Set.Name ];
+            double          dSpan = (double)( Set.llEnd - Set.llReady ) * dToMilliseconds;
+            double          dTailWait = 0.0;
+
+            //  Threads that finished their tasks of the set early wait for
+            //  the slowest one before the set's successors can start
+            for( std::map<UINT, LONGLONG>::iterator it = Set.WorkerEnd.begin(); it != Set.WorkerEnd.end(); ++it )
+            {
+                dTailWait += (double)( Set.llEnd - it->second ) * dToMilliseconds;
+            }
+
+            llFrameBegin = min( llFrameBegin, Set.llReady );
+            Stage.uSets++;
+            Stage.uTasks += Set.uTasks;
+            Stage.dSpan += dSpan;
+            Stage.dBusy += (double)Set.llBusy * dToMilliseconds;
+            Stage.dTailWait += dTailWait;
+        }
+
+        //
+        //  The critical path ends at the taskset that finished last.  A 
+        //  taskset became ready when the last of its dependencies ended, 
+        //  so the path is followed back through the latest dependency.
+        //
+        std::vector<UINT>   Path;
+        for( UINT uId = uLast; ; )
+        {
+            Path.push_back( uId );
+
+            TraceSet&       Set = Sets[ uId ];
+            UINT            uCritical = TASKSETHANDLE_INVALID;
+            for( size_t i = 0; i < Set.Depends.size(); ++i )
+            {
+                UINT        uDepend = Set.Depends[ i ];
+                if( uDepend >= uStart && uDepend < uEnd &&
+                    ( TASKSETHANDLE_INVALID == uCritical || Sets[ uDepend ].llEnd > Sets[ uCritical ].llEnd ) )
+                {
+                    uCritical = uDepend;
+                }
+            }
+            if( TASKSETHANDLE_INVALID == uCritical )
+            {
+                break;
+            }
+            uId = uCritical;
+        }
+
+        double              dFrame = (double)( Sets[ uLast ].llEnd - llFrameBegin ) * dToMilliseconds;
+        double              dPath = 0.0;
+
+        if( pFile )
+        {
+            fprintf( pFile, "Frame %u: %.3f ms, critical path:\n", uFrame, dFrame );
+        }
+        for( size_t i = Path.size(); i-- > 0; )
+        {
+            TraceSet&       Set = Sets[ Path[ i ] ];
+            TraceStage&     Stage = Stages[ Set.Name ];
+            double          dSpan = (double)( Set.llEnd - Set.llReady ) * dToMilliseconds;
+            double          dStart = (double)( Set.llReady - llFrameBegin ) * dToMilliseconds;
+
+            if( pFile )
+            {
+                fprintf( pFile, "    %-32s at %8.3f ms  %8.3f ms  %4u tasks\n", Set.Name.c_str(), dStart, dSpan, Set.uTasks );
+            }
+            Stage.uCritical++;
+            Stage.dCritical += dSpan;
+            dPath += dSpan;
+        }
+        if( pFile )
+        {
+            fprintf( pFile, "    on the path %.3f ms, scheduling gaps %.3f ms\n\n", dPath, dFrame - dPath );
+        }
+
+        uFrames++;
+        dFrameTime += dFrame;
+        dCriticalTime += dPath;
+    }
+}
+
+BOOL
+TaskMgrTbb::AnalyzeTrace(
+    LPCWSTR                 szFileName )
+{
+    FILE*                   pFile = NULL;
+    UINT                    uRings = min( (UINT)glTraceRingCount, (UINT)MAX_TRACE_THREADS );
+    std::map<std::string, TraceStage> Stages;
+    UINT                    uFrames;
+    double                  dFrameTime;
+    double                  dCriticalTime;
+
+    if( 0 != _wfopen_s( &pFile, szFileName, L"w" ) )
+    {
+        return FALSE;
+    }
+
+    fprintf( pFile, "Task trace analysis, %u threads\n\n", uRings );
+    TraceAnalyzeFrames( pFile, Stages, uFrames, dFrameTime, dCriticalTime );
+
+    //
+    //  Parallel efficiency: the share of the threads' time during the 
+    //  tasksets' spans that was spent running their tasks
+    //
+    if( uFrames > 0 )
+    {
+        fprintf( pFile, "%u frames, mean %.3f ms, mean critical path %.3f ms\n\n", uFrames, dFrameTime / uFrames, dCriticalTime / uFrames );
+    }
+    fprintf( pFile, "%-32s %6s %8s %10s %10s %10s %12s %14s\n",
+        "taskset", "sets", "tasks", "span ms", "busy ms", "efficiency", "tail wait ms", "critical ms(n)" );
+    for( std::map<std::string, TraceStage>::iterator it = Stages.begin(); it != Stages.end(); ++it )
+    {
+        TraceStage&         Stage = it->second;
+        double              dEfficiency = Stage.dSpan > 0.0 ? Stage.dBusy / ( Stage.dSpan * max( uRings, 1u ) ) : 0.0;
+
+        fprintf( pFile, "%-32s %6u %8u %10.3f %10.3f %9.1f%% %12.3f %9.3f(%u)\n",
+            it->first.c_str(), Stage.uSets, Stage.uTasks, Stage.dSpan, Stage.dBusy, 100.0 * dEfficiency, 
+            Stage.dTailWait, Stage.dCritical, Stage.uCritical );
+    }
+
+    fclose( pFile );
+
+    return TRUE;
+}
+
+UINT
+TaskMgrTbb::GetTraceStages(
+    TraceStageTimes*        pStages,
+    UINT                    uMaxStages,
+    UINT*                   puFrames,
+    double*                 pdFrameTime )
+{
+    std::map<std::string, TraceStage> Stages;
+    UINT                    uFrames;
+    double                  dFrameTime;
+    double                  dCriticalTime;
+    UINT                    uStage = 0;
+
+    TraceAnalyzeFrames( NULL, Stages, uFrames, dFrameTime, dCriticalTime );
+
+    for( std::map<std::string, TraceStage>::iterator it = Stages.begin(); it != Stages.end() && uStage < uMaxStages; ++it, ++uStage )
+    {
+        TraceStage&         Stage = it->second;
+        TraceStageTimes*    pStage = &pStages[ uStage ];
+
+        StringCbCopyA( pStage->szName, sizeof( pStage->szName ), it->first.c_str() );
+        pStage->uSets = Stage.uSets;
+        pStage->uTasks = Stage.uTasks;
+        pStage->dSpan = Stage.dSpan;
+        pStage->dBusy = Stage.dBusy;
+        pStage->dCritical = Stage.dCritical;
+    }
+
+    if( puFrames )
+    {
+        *puFrames = uFrames;
+    }
+    if( pdFrameTime )
+    {
+        *pdFrameTime = dFrameTime;
+    }
+
+    return (UINT)Stages.size();
+}
+
+VOID
+TaskMgrTbb::EnableTraceCounters(
+    BOOL                    bEnable )
+{
+    gbTraceCounters = TraceCountersEnable( bEnable );
+}
+
+VOID
+TaskMgrTbb::TraceWork(
+    LPCSTR                  szSetName,
+    UINT                    uUnits )
+{
+    if( gbTraceEnabled && gbTraceCounters )
+    {
+        gTraceCounterLock.Lock();
+        gTraceCounterTotals[ szSetName ].ullWork += uUnits;
+        gTraceCounterLock.Unlock();
+    }
+}
+
+BOOL
+TaskMgrTbb::CounterReport(
+    LPCWSTR                 szFileName )
+{
+    static const CHAR*      szCounterNames[ TRACE_COUNTERS ] = { "cycles", "instructions", "LLC misses", "L1D misses" };
+    FILE*                   pFile = NULL;
+
+    if( 0 != _wfopen_s( &pFile, szFileName, L"w" ) )
+    {
+        return FALSE;
+    }
+
+    fprintf( pFile, "Hardware counters per taskset name\n" );
+    for( UINT uCounter = 0; uCounter < TRACE_COUNTERS; ++uCounter )
+    {
+        if( gbTraceCounterMissing[ uCounter ] )
+        {
+            fprintf( pFile, "%s: not available, counted as 0\n", szCounterNames[ uCounter ] );
+        }
+    }
+    if( gbTraceCounterMultiplexed )
+    {
+        fprintf( pFile, "counters shared the core with other events, the counts are low\n" );
+    }
+    if( glTraceCounterSkipped > 0 )
+    {
+        fprintf( pFile, "tasks moved to another core, not counted: %d\n", glTraceCounterSkipped );
+    }
+    fprintf( pFile, "\n%-32s %8s %8s %14s %6s %12s %12s %12s %12s %10s %10s\n",
+        "taskset", "sets", "tasks", "cycles", "IPC", "LLC misses", "L1D misses", "work units", "cycles/unit", "LLC/unit", "L1D/unit" );
+
+    gTraceCounterLock.Lock();
+    for( std::map<std::string, TraceCounterTotals>::iterator it = gTraceCounterTotals.begin(); it != gTraceCounterTotals.end(); ++it )
+    {
+        TraceCounterTotals& Totals = it->second;
+        double              dCycles = (double)Totals.ullCounters[ 0 ];
+        double              dWork = (double)Totals.ullWork;
+
+        fprintf( pFile, "%-32s %8llu %8llu %14llu %6.2f %12llu %12llu %12llu",
+            it->first.c_str(), Totals.ullSets, Totals.ullTasks, Totals.ullCounters[ 0 ],
+            dCycles > 0.0 ? (double)Totals.ullCounters[ 1 ] / dCycles : 0.0,
+            Totals.ullCounters[ 2 ], Totals.ullCounters[ 3 ], Totals.ullWork );
+        if( Totals.ullWork > 0 )
+        {
+            fprintf( pFile, " %12.1f %10.3f %10.3f\n", dCycles / dWork, 
+                (double)Totals.ullCounters[ 2 ] / dWork, (double)Totals.ullCounters[ 3 ] / dWork );
+        }
+        else
+        {
+            fprintf( pFile, " %12s %10s %10s\n", "-", "-", "-" );
+        }
+    }
+    gTraceCounterLock.Unlock();
+
+    fclose( pFile );
+
+    return TRUE;
+}
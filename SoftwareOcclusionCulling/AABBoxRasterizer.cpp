@@ -19,10 +19,82 @@
 
 AABBoxRasterizer::AABBoxRasterizer()
 {
-
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mPrimaryView[i] = false;
+	}
 }
 
 AABBoxRasterizer::~AABBoxRasterizer()
 {
 
-}
\ No newline at end of file
+}
+
+//--------------------------------------------------------------------------------
+// Every view is depth tested against its own depth buffer, in the multi threaded 
+// version each view's test tasks only wait for that view's rasterization
+//--------------------------------------------------------------------------------
+void AABBoxRasterizer::TransformAABBoxAndDepthTest(CPUTCamera **ppCamera, UINT numViews, UINT idx)
+{
+	assert(numViews <= MAX_VIEWS && idx + numViews <= MAX_SLOTS);
+	for(UINT view = 0; view < numViews; view++)
+	{
+		mPrimaryView[idx + view] = (view == 0);
+		TransformAABBoxAndDepthTest(ppCamera[view], idx + view);
+	}
+}
+
+//--------------------------------------------------------------------------------
+// Rows are widened by a pixel on either side so that pixels touched by rounding
+// in the box rasterizer never fall outside the bands of the bucket
+//--------------------------------------------------------------------------------
+UINT AABBoxRasterizer::GetOccludeeBucket(float minY, float maxY)
+{
+	float bandHeight = (float)(TILE_HEIGHT_IN_PIXELS * TILE_ROWS_PER_BAND);
+	float maxBand = (float)(NUM_RASTER_BANDS - 1);
+
+	float first = floorf((minY - 1.0f) / bandHeight);
+	float last  = floorf((maxY + 1.0f) / bandHeight);
+	first = first < 0.0f ? 0.0f : (first > maxBand ? maxBand : first);
+	last  = last  < 0.0f ? 0.0f : (last  > maxBand ? maxBand : last);
+
+	UINT firstBand = (UINT)first;
+	UINT lastBand = (UINT)last;
+	if(firstBand == lastBand)
+	{
+		return firstBand;
+	}
+	else if(lastBand == firstBand + 1)
+	{
+		return NUM_RASTER_BANDS + firstBand;
+	}
+	return NUM_OCCLUDEE_BUCKETS - 1;
+}
+
+void AABBoxRasterizer::GetBucketBands(UINT bucket, UINT &firstBand, UINT &lastBand)
+{
+	if(bucket < NUM_RASTER_BANDS)
+	{
+		firstBand = lastBand = bucket;
+	}
+	else if(bucket < NUM_OCCLUDEE_BUCKETS - 1)
+	{
+		firstBand = bucket - NUM_RASTER_BANDS;
+		lastBand = firstBand + 1;
+	}
+	else
+	{
+		firstBand = 0;
+		lastBand = NUM_RASTER_BANDS - 1;
+	}
+}
+
+UINT AABBoxRasterizer::GetOccludeeTile(float centerX, float centerY)
+{
+	float tileX = floorf(centerX / (float)TILE_WIDTH_IN_PIXELS);
+	float tileY = floorf(centerY / (float)TILE_HEIGHT_IN_PIXELS);
+	tileX = tileX < 0.0f ? 0.0f : (tileX > (float)(SCREENW_IN_TILES - 1) ? (float)(SCREENW_IN_TILES - 1) : tileX);
+	tileY = tileY < 0.0f ? 0.0f : (tileY > (float)(SCREENH_IN_TILES - 1) ? (float)(SCREENH_IN_TILES - 1) : tileY);
+
+	return (UINT)tileY * SCREENW_IN_TILES + (UINT)tileX;
+}
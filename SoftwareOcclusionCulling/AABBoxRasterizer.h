@@ -21,6 +21,10 @@
 #include "CPUT_DX11.h"
 #include "TaskMgrTBB.h"
 #include "Constants.h"
+#include "CullingStats.h"
+#include "ShadowReceiverMask.h"
+
+class CullingScene;
 
 class AABBoxRasterizer
 {
@@ -28,7 +32,12 @@ class AABBoxRasterizer
 		AABBoxRasterizer();
 		virtual ~AABBoxRasterizer();
 		virtual void CreateTransformedAABBoxes(CPUTAssetSet **pAssetSet, UINT numAssetSets) = 0;
+		// Occludees of a scene without CPUT models, for the device free modes. They can be
+		// culled but not rendered
+		virtual void CreateTransformedAABBoxes(const CullingScene &scene) = 0;
 		virtual void TransformAABBoxAndDepthTest(CPUTCamera *pCamera, UINT idx) = 0;
+		// Depth test the occludees for several views, the views use slots idx .. idx + numViews - 1
+		void TransformAABBoxAndDepthTest(CPUTCamera **ppCamera, UINT numViews, UINT idx);
 		virtual void WaitForTaskToFinish(UINT idx) = 0;
 		virtual void ReleaseTaskHandles(UINT idx) = 0;
 		virtual void RenderVisible(CPUTAssetSet **pAssetSet,
@@ -39,26 +48,61 @@ class AABBoxRasterizer
 							CPUTRenderParametersDX &renderParams,
 							UINT numAssetSets,
 							UINT idx) = 0;
+		// Mark the occludees visible in view slot idx as shadow receivers
+		virtual void AddShadowReceivers(ShadowReceiverMask *pReceiverMask, UINT idx) = 0;
+		// Render the occludees visible from the light in slot idx whose shadow reaches a receiver
+		virtual void RenderShadowCasters(CPUTRenderParametersDX &renderParams,
+										 ShadowReceiverMask *pReceiverMask,
+										 UINT idx) = 0;
 
 		virtual void ResetInsideFrustum() = 0; 
 		virtual void SetViewProjMatrix(float4x4 *viewMatrix, float4x4 *projMatrix, UINT idx) = 0;
 		virtual void SetCPURenderTargetPixels(UINT *pRenderTargetPixels, UINT idx) = 0;
 		virtual void SetDepthTestTasks(UINT numTasks) = 0;
+		virtual void SetTileBinnedDepthTest(bool tileBinned) = 0;
 		virtual void SetOccludeeSizeThreshold(float occludeeSizeThreshold) = 0;
+		// Rasterize proxies of the large occludees visible in the last finished frame
+		// into the depth buffer before the occludees are tested
+		virtual void SetOccludeeProxies(bool occludeeProxies) = 0;
+		// Pick the occludee proxies from the visibility of view slot idx, once it is final
+		virtual void UpdateOccludeeProxies(UINT idx) = 0;
+		// Skip the depth tests of occludees whose visibility has been stable, re-testing
+		// them at staggered intervals
+		virtual void SetTemporalCache(bool temporalCache) = 0;
+		// Add the depth test results of view slot idx, once they are final, to the history
+		virtual void UpdateVisibilityHistory(UINT idx) = 0;
 		virtual void SetCamera(CPUTCamera *pCamera, UINT idx) = 0;
 		virtual void SetEnableFCulling(bool enableFCulling) = 0;
 
 		virtual UINT GetNumOccludees() = 0;
 		virtual UINT GetNumCulled(UINT idx) = 0;
+		virtual bool IsVisible(UINT modelId, UINT idx) = 0;
+		// Position of an occludee in the order the asset sets were loaded in, which is the
+		// same for every rasterizer
+		virtual UINT GetLoadOrderId(UINT modelId) = 0;
 		virtual double GetDepthTestTime() = 0;
+		// Depth test time of the last frame instead of the average of the last AVG_COUNTER ones
+		virtual double GetLastDepthTestTime() = 0;
 		virtual UINT GetNumTriangles() = 0;
-		virtual UINT GetNumCulledTriangles(UINT idx) = 0;
+		// Fill in the occludee half of the stats of view slot idx, once its culling is done
+		virtual void GetFrameStats(UINT idx, CullingStats *pStats) = 0;
 		virtual UINT GetNumTrisRendered() = 0;
 		virtual UINT GetNumFCullCount() = 0;
 
 	protected:
-		LARGE_INTEGER mStartTime[2][NUM_DT_TASKS];
-		LARGE_INTEGER mStopTime[2][NUM_DT_TASKS];
+		// Bucket of an occludee whose screen space bounds span rows minY .. maxY
+		static UINT GetOccludeeBucket(float minY, float maxY);
+		// The raster bands firstBand .. lastBand the depth tests of a bucket depend on
+		static void GetBucketBands(UINT bucket, UINT &firstBand, UINT &lastBand);
+		// Screen tile holding the center of an occludee's screen space bounds
+		static UINT GetOccludeeTile(float centerX, float centerY);
+
+		// Whether a slot holds the first view of the views culled together, the only
+		// view the visibility history is kept for
+		bool mPrimaryView[MAX_SLOTS];
+
+		LARGE_INTEGER mStartTime[MAX_SLOTS][NUM_DT_TASKS];
+		LARGE_INTEGER mStopTime[MAX_SLOTS][NUM_DT_TASKS];
 };
 
 #endif //AABBOXRASTERIZER_H
\ No newline at end of file
@@ -16,6 +16,15 @@
 //--------------------------------------------------------------------------------------
 
 #include "AABBoxRasterizerSSE.h"
+#include "CullingScene.h"
+
+// 0 = use min corner, 1 = use max corner
+static const UINT sBBxInd[AABB_VERTICES] = { 1, 0, 0, 1, 1, 1, 0, 0 };
+static const UINT sBByInd[AABB_VERTICES] = { 1, 1, 1, 1, 0, 0, 0, 0 };
+static const UINT sBBzInd[AABB_VERTICES] = { 1, 1, 0, 0, 0, 1, 1, 0 };
+
+// A counter block per depth test task of every bucket and one for the BVH walk
+static const UINT NUM_OCCLUDEE_COUNTERS = NUM_OCCLUDEE_BUCKETS * NUM_DT_TASKS + 1;
 
 struct AABBoxRasterizerSSE::WorldBBoxPacket
 {
@@ -33,32 +42,92 @@ struct AABBoxRasterizerSSE::WorldBBoxPacket
 	}
 };
 
+// Node of the occludee bounding volume hierarchy. The occludees are stored in
+// BVH order so every node covers the occludees mFirst .. mFirst + mCount - 1.
+// Inner nodes have their two children at mChild and mChild + 1, leaves have
+// mChild 0. mFirst is a multiple of 4 so nodes start at a box packet
+struct AABBoxRasterizerSSE::BVHNode
+{
+	float3 mCenter;
+	float3 mHalf;
+	UINT mFirst;
+	UINT mCount;
+	UINT mChild;
+	UINT mNumTriangles;	// of all the occludees in the subtree
+};
+
+// Subtree of the occludee BVH a frame starts its depth tests from. Cull nodes
+// crossing the frustum are leaves, their occludees are frustum tested one by one
+struct AABBoxRasterizerSSE::CullNode
+{
+	UINT mNode;
+	bool mInsideFrustum;
+	bool mZIn;			// the bounds are in front of the near plane and can be depth tested
+	UCHAR mBucket;
+	UCHAR mTile;
+};
+
+// Visibility history of an occludee. mStreak counts the last depth tests that
+// agreed on mVisible, 0 if there is no usable history. mTestedFrame indexes
+// the camera position of the last test in the ring of history frames. The
+// history is only usable if it was updated in the last history frame, mFrame,
+// so occludees that leave the frustum lose it without being touched
+struct AABBoxRasterizerSSE::OccludeeHistory
+{
+	UCHAR mStreak;
+	bool mVisible;
+	UCHAR mTestedFrame;
+	UINT mFrame;
+};
+
 AABBoxRasterizerSSE::AABBoxRasterizerSSE()
 	: mNumModels(0),
 	  mpTransformedAABBox(NULL),
 	  mpWorldBoxes(NULL),
+	  mpBVHNodes(NULL),
+	  mNumBVHNodes(0),
+	  mpLoadOrder(NULL),
 	  mpModels(NULL),
 	  mpNumTriangles(NULL),
 	  mNumDepthTestTasks(0),
+	  mpProxyCandidates(NULL),
+	  mNumProxyCandidates(0),
+	  mTileBinnedDepthTest(false),
+	  mOccludeeProxies(false),
+	  mTemporalCache(false),
+	  mpHistory(NULL),
+	  mHistoryFrame(0),
+	  mHistoryValid(false),
 	  mOccludeeSizeThreshold(0.0f),
 	  mTimeCounter(0),
 	  mEnableFCulling(true)
 {
-	mpCamera[0] = mpCamera[1] = NULL;
-	mpVisible[0] = mpVisible[1] = NULL;
-	
-	mViewMatrix[0] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mViewMatrix[1] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpCamera[i] = NULL;
+		mpVisible[i] = NULL;
+		mpXformedBoxes[i] = NULL;
+		mpBucket[i] = NULL;
+		mpCullNodes[i] = NULL;
+		mNumCullNodes[i] = 0;
+		mpXformedNodes[i] = NULL;
+		mpSortedCullNodes[i] = NULL;
+		mpProxyModels[i] = NULL;
+		mNumProxies[i] = 0;
+		mpXformedProxies[i] = NULL;
+		mpSlotHistory[i] = NULL;
+		mpOccludeeCounters[i] = NULL;
+		mSlotHistoryFrame[i] = 0;
+		mUseHistory[i] = false;
 
-	mProjMatrix[0] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mProjMatrix[1] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
+		mViewMatrix[i] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
+		mProjMatrix[i] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
 
-	mpInsideFrustum[0] = mpInsideFrustum[1] = NULL;
+		mpInsideFrustum[i] = NULL;
+		mpRenderTargetPixels[i] = NULL;
+		mNumCulled[i] = 0;
+	}
 
-	mpRenderTargetPixels[0] = NULL;
-	mpRenderTargetPixels[1] = NULL;
-	
-	mNumCulled[0] = mNumCulled[1] = 0;
 	for(UINT i = 0; i < AVG_COUNTER; i++)
 	{
 		mDepthTestTime[i] = 0.0;
@@ -67,20 +136,32 @@ AABBoxRasterizerSSE::AABBoxRasterizerSSE()
 
 AABBoxRasterizerSSE::~AABBoxRasterizerSSE()
 {
-	for(UINT i = 0; i < mNumModels; i++)
+	for(UINT i = 0; mpModels && i < mNumModels; i++)
 	{
 		mpModels[i]->Release();
 	}
-	_aligned_free(mViewMatrix[0]);
-	_aligned_free(mViewMatrix[1]);
-	_aligned_free(mProjMatrix[0]);
-	_aligned_free(mProjMatrix[1]);
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		_aligned_free(mViewMatrix[i]);
+		_aligned_free(mProjMatrix[i]);
+		SAFE_DELETE_ARRAY(mpVisible[i]);
+		_aligned_free(mpXformedBoxes[i]);
+		SAFE_DELETE_ARRAY(mpBucket[i]);
+		SAFE_DELETE_ARRAY(mpCullNodes[i]);
+		_aligned_free(mpXformedNodes[i]);
+		SAFE_DELETE_ARRAY(mpSortedCullNodes[i]);
+		SAFE_DELETE_ARRAY(mpProxyModels[i]);
+		_aligned_free(mpXformedProxies[i]);
+		SAFE_DELETE_ARRAY(mpSlotHistory[i]);
+		_aligned_free(mpOccludeeCounters[i]);
+		SAFE_DELETE_ARRAY(mpInsideFrustum[i]);
+	}
 	_aligned_free(mpWorldBoxes);
-	SAFE_DELETE_ARRAY(mpVisible[0]);
-	SAFE_DELETE_ARRAY(mpVisible[1]);
+	SAFE_DELETE_ARRAY(mpBVHNodes);
+	SAFE_DELETE_ARRAY(mpLoadOrder);
+	SAFE_DELETE_ARRAY(mpProxyCandidates);
+	SAFE_DELETE_ARRAY(mpHistory);
 	SAFE_DELETE_ARRAY(mpTransformedAABBox);
-	SAFE_DELETE_ARRAY(mpInsideFrustum[0]);
-	SAFE_DELETE_ARRAY(mpInsideFrustum[1]);
 	SAFE_DELETE_ARRAY(mpNumTriangles);
 	SAFE_DELETE_ARRAY(mpModels);
 }
@@ -88,6 +169,8 @@ AABBoxRasterizerSSE::~AABBoxRasterizerSSE()
 //--------------------------------------------------------------------
 // * Go through the asset set and determine the model count in it
 // * Create data structures aor all the models in the asset set
+// * Build a bounding volume hierarchy over the models' world space
+//   AABBs and store the models in its order
 // * For each model create the axis aligned bounding box triangle 
 //   vertex and index list
 //--------------------------------------------------------------------
@@ -108,20 +191,7 @@ void AABBoxRasterizerSSE::CreateTransformedAABBoxes(CPUTAssetSet **pAssetSet, UI
 		}
 	}
 
-	mpVisible[0] = new bool[mNumModels];
-	mpVisible[1] = new bool[mNumModels];
-	mpTransformedAABBox = new TransformedAABBoxSSE[mNumModels];
 	mpModels = new CPUTModelDX11 *[mNumModels];
-
-	UINT numPackets = (mNumModels + 3) / 4;
-	mpWorldBoxes = (WorldBBoxPacket *)_aligned_malloc(numPackets * sizeof(WorldBBoxPacket), 16);
-	memset(mpWorldBoxes, 0, numPackets * sizeof(WorldBBoxPacket));
-
-	mpInsideFrustum[0] = new bool[numPackets * 4];
-	mpInsideFrustum[1] = new bool[numPackets * 4];
-
-	mpNumTriangles = new UINT[mNumModels];
-	
 	for(UINT assetId = 0, modelId = 0; assetId < numAssetSets; assetId++)
 	{
 		for(UINT nodeId = 0; nodeId < pAssetSet[assetId]->GetAssetCount(); nodeId++)
@@ -136,25 +206,413 @@ void AABBoxRasterizerSSE::CreateTransformedAABBoxes(CPUTAssetSet **pAssetSet, UI
 	
 				mpModels[modelId] = pModel;
 				pModel->AddRef();
+				modelId++;
+			}
+			pRenderNode->Release();
+		}
+	}
+
+	float3 *pCenter = new float3[mNumModels];
+	float3 *pHalf = new float3[mNumModels];
+	UINT *pNumTriangles = new UINT[mNumModels];
+	for(UINT i = 0; i < mNumModels; i++)
+	{
+		mpModels[i]->GetBoundsWorldSpace(&pCenter[i], &pHalf[i]);
+		pNumTriangles[i] = 0;
+		for(int meshId = 0; meshId < mpModels[i]->GetMeshCount(); meshId++)
+		{
+			pNumTriangles[i] += mpModels[i]->GetMesh(meshId)->GetTriangleCount();
+		}
+	}
 
-				mpTransformedAABBox[modelId].CreateAABBVertexIndexList(pModel);
+	CreateOccludees(pCenter, pHalf, pNumTriangles, NULL);
 
-				float3 bbCenter, bbHalf;
-				pModel->GetBoundsWorldSpace(&bbCenter, &bbHalf);
-				mpWorldBoxes[modelId / 4].SetLane(modelId & 3, bbCenter, bbHalf);
+	SAFE_DELETE_ARRAY(pNumTriangles);
+	SAFE_DELETE_ARRAY(pHalf);
+	SAFE_DELETE_ARRAY(pCenter);
+}
 
-				mpNumTriangles[modelId] = 0;
-				for(int meshId = 0; meshId < pModel->GetMeshCount(); meshId++)
-				{
-					mpNumTriangles[modelId] += pModel->GetMesh(meshId)->GetTriangleCount();
-				}
-				modelId++;
+//--------------------------------------------------------------------
+// Same for the occludees of a scene without CPUT models, the scene
+// can be culled but not rendered
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::CreateTransformedAABBoxes(const CullingScene &scene)
+{
+	mNumModels = scene.GetNumOccludees();
+	CreateOccludees(scene.GetOccludeeCenters(), scene.GetOccludeeHalves(), scene.GetOccludeeTriangles(), &scene);
+}
+
+//--------------------------------------------------------------------
+// Create the data structures for mNumModels occludees with the given
+// world space AABBs and triangle counts, build the bounding volume
+// hierarchy and store the occludees (and mpModels, if there are CPUT
+// models, else the boxes of pScene) in its order
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::CreateOccludees(const float3 *pCenter, const float3 *pHalf, const UINT *pNumTriangles, const CullingScene *pScene)
+{
+	mpTransformedAABBox = new TransformedAABBoxSSE[mNumModels];
+
+	UINT numPackets = (mNumModels + 3) / 4;
+	mpWorldBoxes = (WorldBBoxPacket *)_aligned_malloc(numPackets * sizeof(WorldBBoxPacket), 16);
+	memset(mpWorldBoxes, 0, numPackets * sizeof(WorldBBoxPacket));
+
+	// Occludees outside a slot's cull nodes are never written, they keep this state
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpVisible[i] = new bool[mNumModels];
+		memset(mpVisible[i], false, mNumModels * sizeof(bool));
+		mpBucket[i] = new UCHAR[mNumModels];
+		memset(mpBucket[i], NO_OCCLUDEE_BUCKET, mNumModels);
+		mpInsideFrustum[i] = new bool[numPackets * 4];
+	}
+
+	mpProxyCandidates = new UINT[mNumModels];
+	mpHistory = new OccludeeHistory[mNumModels];
+	memset(mpHistory, 0, mNumModels * sizeof(OccludeeHistory));
+	mpNumTriangles = new UINT[mNumModels];
+
+	// The BVH permutation is kept so that results can be reported in load order
+	mpLoadOrder = new UINT[mNumModels];
+	for(UINT i = 0; i < mNumModels; i++)
+	{
+		mpLoadOrder[i] = i;
+	}
+
+	// Every leaf but the last one holds at least 4 occludees
+	mpBVHNodes = new BVHNode[2 * numPackets + 1];
+	mNumBVHNodes = 1;
+	if(mNumModels > 0)
+	{
+		BuildBVH(0, mpLoadOrder, pCenter, pHalf, pNumTriangles, 0, mNumModels);
+	}
+
+	CPUTModelDX11 **pModels = NULL;
+	if(mpModels)
+	{
+		pModels = new CPUTModelDX11 *[mNumModels];
+		memcpy(pModels, mpModels, mNumModels * sizeof(CPUTModelDX11 *));
+	}
+	for(UINT modelId = 0; modelId < mNumModels; modelId++)
+	{
+		UINT i = mpLoadOrder[modelId];
+		if(pModels)
+		{
+			mpModels[modelId] = pModels[i];
+			mpTransformedAABBox[modelId].CreateAABBVertexIndexList(pModels[i]);
+		}
+		else
+		{
+			mpTransformedAABBox[modelId].CreateOccludeeBox(*pScene, i);
+		}
+		mpWorldBoxes[modelId / 4].SetLane(modelId & 3, pCenter[i], pHalf[i]);
+		mpNumTriangles[modelId] = pNumTriangles[i];
+	}
+
+	SAFE_DELETE_ARRAY(pModels);
+}
+
+//--------------------------------------------------------------------
+// Bound the occludees of a node and, unless they fit in a leaf, split
+// them at the median along the longest axis of their centers. The 
+// split is rounded to a multiple of 4 to keep nodes packet aligned
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::BuildBVH(UINT node, UINT *pOrder, const float3 *pCenter, const float3 *pHalf, const UINT *pNumTriangles, UINT first, UINT count)
+{
+	float3 bbMin = pCenter[pOrder[first]] - pHalf[pOrder[first]];
+	float3 bbMax = pCenter[pOrder[first]] + pHalf[pOrder[first]];
+	float3 centerMin = pCenter[pOrder[first]];
+	float3 centerMax = centerMin;
+	for(UINT i = first + 1; i < first + count; i++)
+	{
+		const float3 &center = pCenter[pOrder[i]];
+		const float3 &half = pHalf[pOrder[i]];
+		for(UINT j = 0; j < 3; j++)
+		{
+			bbMin.f[j] = min(bbMin.f[j], center.f[j] - half.f[j]);
+			bbMax.f[j] = max(bbMax.f[j], center.f[j] + half.f[j]);
+			centerMin.f[j] = min(centerMin.f[j], center.f[j]);
+			centerMax.f[j] = max(centerMax.f[j], center.f[j]);
+		}
+	}
+
+	BVHNode &bvhNode = mpBVHNodes[node];
+	bvhNode.mCenter = (bbMax + bbMin) * 0.5f;
+	bvhNode.mHalf = (bbMax - bbMin) * 0.5f;
+	bvhNode.mFirst = first;
+	bvhNode.mCount = count;
+	bvhNode.mChild = 0;
+	bvhNode.mNumTriangles = 0;
+	if(count <= OCCLUDEE_BVH_LEAF_SIZE)
+	{
+		for(UINT i = first; i < first + count; i++)
+		{
+			bvhNode.mNumTriangles += pNumTriangles[pOrder[i]];
+		}
+		return;
+	}
+
+	float3 extent = centerMax - centerMin;
+	UINT axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	UINT half = ((count / 2) + 3) & ~3;
+	std::nth_element(pOrder + first, pOrder + first + half, pOrder + first + count,
+		[&](const UINT a, const UINT b){ return pCenter[a].f[axis] < pCenter[b].f[axis]; });
+
+	UINT child = mNumBVHNodes;
+	mNumBVHNodes += 2;
+	bvhNode.mChild = child;
+	BuildBVH(child, pOrder, pCenter, pHalf, pNumTriangles, first, half);
+	BuildBVH(child + 1, pOrder, pCenter, pHalf, pNumTriangles, first + half, count - half);
+	bvhNode.mNumTriangles = mpBVHNodes[child].mNumTriangles + mpBVHNodes[child + 1].mNumTriangles;
+}
+
+//--------------------------------------------------------------------
+// Create the screen space corner buffers for a frame slot the first 
+// time the slot is used. Cull nodes are disjoint subtrees, there are
+// no more of them than leaves and every leaf has a packet of its own
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::AllocateSlot(UINT idx)
+{
+	UINT numPackets = (mNumModels + 3) / 4;
+	UINT maxCullNodes = max(numPackets, 1U);
+	mpXformedBoxes[idx] = (__m128*)_aligned_malloc(numPackets * 4 * AABB_VERTICES * sizeof(__m128), 16);
+	mpCullNodes[idx] = new CullNode[maxCullNodes];
+	mpXformedNodes[idx] = (__m128*)_aligned_malloc(maxCullNodes * AABB_VERTICES * sizeof(__m128), 16);
+	mpSortedCullNodes[idx] = new UINT[maxCullNodes];
+	mpProxyModels[idx] = new UINT[mNumModels];
+	mpXformedProxies[idx] = (__m128*)_aligned_malloc(mNumModels * AABB_VERTICES * sizeof(__m128), 16);
+	mpSlotHistory[idx] = new OccludeeHistory[mNumModels];
+	mpOccludeeCounters[idx] = (OccludeeCounters*)_aligned_malloc(NUM_OCCLUDEE_COUNTERS * sizeof(OccludeeCounters), 64);
+}
+
+//--------------------------------------------------------------------
+// Add the depth test results of the primary view slot idx to the 
+// visibility history. Occludees that were not depth tested lose their
+// history, the ones whose test was skipped keep it. A camera cut, or
+// turning the cache off, drops the history of all the occludees. Only
+// the occludees of the slot's cull nodes are visited, the others are
+// not updated in this history frame and so lose their history too
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::UpdateVisibilityHistory(UINT idx)
+{
+	if(!mTemporalCache)
+	{
+		mHistoryValid = false;
+		return;
+	}
+	if(!mPrimaryView[idx] || mpXformedBoxes[idx] == NULL)
+	{
+		return;
+	}
+
+	float3 cameraPos = mpCamera[idx]->GetPosition();
+	UINT frame = mHistoryFrame % OCCLUDEE_HISTORY_FRAMES;
+	UINT prevFrame = (mHistoryFrame + OCCLUDEE_HISTORY_FRAMES - 1) % OCCLUDEE_HISTORY_FRAMES;
+	float3 moved = cameraPos - mHistoryCameraPos[prevFrame];
+	bool keepHistory = mHistoryValid && moved.lengthSq() <= OCCLUDEE_CACHE_CUT_DISTANCE * OCCLUDEE_CACHE_CUT_DISTANCE;
+	mHistoryCameraPos[frame] = cameraPos;
+
+	for(UINT k = 0; k < mNumCullNodes[idx]; k++)
+	{
+		const BVHNode &node = mpBVHNodes[mpCullNodes[idx][k].mNode];
+		for(UINT i = node.mFirst; i < node.mFirst + node.mCount; i++)
+		{
+			OccludeeHistory &history = mpHistory[i];
+			UCHAR bucket = mpBucket[idx][i];
+			if(bucket == NO_OCCLUDEE_BUCKET)
+			{
+				continue;
+			}
+
+			bool current = keepHistory && history.mFrame + 1 == mHistoryFrame;
+			if(bucket == CACHED_OCCLUDEE_BUCKET)
+			{
+				history.mStreak = current ? history.mStreak : 0;
+			}
+			else
+			{
+				bool visible = mpVisible[idx][i];
+				history.mStreak = (current && history.mStreak > 0 && history.mVisible == visible) ? (UCHAR)min(history.mStreak + 1, 0xFF) : 1;
+				history.mVisible = visible;
+				history.mTestedFrame = (UCHAR)frame;
+			}
+			history.mFrame = mHistoryFrame;
+		}
+	}
+
+	mHistoryFrame++;
+	mHistoryValid = true;
+}
+
+//--------------------------------------------------------------------
+// The history changes whenever a frame finishes, the frames in flight 
+// work on their own copy of it. Only the occludees of the slot's cull
+// nodes are copied, no other history is read
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::BeginVisibilityHistory(UINT idx)
+{
+	mUseHistory[idx] = mTemporalCache && mPrimaryView[idx] && mHistoryValid;
+	if(mUseHistory[idx])
+	{
+		for(UINT k = 0; k < mNumCullNodes[idx]; k++)
+		{
+			const BVHNode &node = mpBVHNodes[mpCullNodes[idx][k].mNode];
+			memcpy(&mpSlotHistory[idx][node.mFirst], &mpHistory[node.mFirst], node.mCount * sizeof(OccludeeHistory));
+		}
+		memcpy(mSlotHistoryCameraPos[idx], mHistoryCameraPos, sizeof(mHistoryCameraPos));
+		mSlotHistoryFrame[idx] = mHistoryFrame;
+	}
+}
+
+//--------------------------------------------------------------------
+// Stable occludees are re-tested when their staggered turn comes or
+// when the camera moved far enough, relative to their distance, since
+// their last test for their visibility to change
+//--------------------------------------------------------------------
+bool AABBoxRasterizerSSE::UseCachedVisibility(UINT i, const float3 &cameraPos, UINT idx)
+{
+	const OccludeeHistory &history = mpSlotHistory[idx][i];
+	if(history.mFrame + 1 != mSlotHistoryFrame[idx] || history.mStreak < OCCLUDEE_STABLE_FRAMES)
+	{
+		return false;
+	}
+
+	UINT interval = history.mVisible ? OCCLUDEE_VISIBLE_RETEST_FRAMES : OCCLUDEE_OCCLUDED_RETEST_FRAMES;
+	if((mSlotHistoryFrame[idx] + i) % interval == 0)
+	{
+		return false;
+	}
+
+	const WorldBBoxPacket &box = mpWorldBoxes[i / 4];
+	float3 center(box.mCenter[0].m128_f32[i & 3], box.mCenter[1].m128_f32[i & 3], box.mCenter[2].m128_f32[i & 3]);
+
+	float3 moved = cameraPos - mSlotHistoryCameraPos[idx][history.mTestedFrame];
+	float3 toCenter = center - cameraPos;
+	return moved.lengthSq() <= OCCLUDEE_CACHE_PARALLAX * OCCLUDEE_CACHE_PARALLAX * toCenter.lengthSq();
+}
+
+//--------------------------------------------------------------------
+// Pick the occludees that passed the depth test of view slot idx and
+// covered a large part of the screen as the occludee proxies. Called
+// once the slot's depth tests are done, the proxies are used by the
+// frames culled from then on
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::UpdateOccludeeProxies(UINT idx)
+{
+	mNumProxyCandidates = 0;
+	if(!mOccludeeProxies || mpXformedBoxes[idx] == NULL)
+	{
+		return;
+	}
+
+	for(UINT k = 0; k < mNumCullNodes[idx]; k++)
+	{
+		const BVHNode &node = mpBVHNodes[mpCullNodes[idx][k].mNode];
+		for(UINT i = node.mFirst; i < node.mFirst + node.mCount; i++)
+		{
+			// Occludees decided without a depth test have no screen space corners,
+			// occludees without an inner box cannot stand in as occluders
+			float proxyScale = mpTransformedAABBox[i].GetProxyScale();
+			if(!mpVisible[idx][i] || mpBucket[idx][i] == NO_OCCLUDEE_BUCKET || proxyScale <= 0.0f)
+			{
+				continue;
+			}
+
+			const __m128 *xformedPos = &mpXformedBoxes[idx][i * AABB_VERTICES];
+			__m128 minPos = xformedPos[0];
+			__m128 maxPos = xformedPos[0];
+			for(UINT v = 1; v < AABB_VERTICES; v++)
+			{
+				minPos = _mm_min_ps(minPos, xformedPos[v]);
+				maxPos = _mm_max_ps(maxPos, xformedPos[v]);
+			}
+			float width  = min(maxPos.m128_f32[0], (float)SCREENW) - max(minPos.m128_f32[0], 0.0f);
+			float height = min(maxPos.m128_f32[1], (float)SCREENH) - max(minPos.m128_f32[1], 0.0f);
+			if(width > 0.0f && height > 0.0f && width * height * proxyScale * proxyScale >= (float)OCCLUDEE_PROXY_MIN_AREA)
+			{
+				mpProxyCandidates[mNumProxyCandidates++] = i;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------
+// Every task fills in its own block, the blocks of tasks a frame does
+// not run must read as zero too
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::BeginOccludeeCounters(UINT idx)
+{
+	memset(mpOccludeeCounters[idx], 0, NUM_OCCLUDEE_COUNTERS * sizeof(OccludeeCounters));
+}
+
+void AABBoxRasterizerSSE::GetFrameStats(UINT idx, CullingStats *pStats)
+{
+	pStats->mNumCulled = pStats->mNumCulledTris = 0;
+	pStats->mNumBoxTests = pStats->mNumEarlyOuts = 0;
+	pStats->mNumRowsTested = pStats->mNumRowsSkipped = 0;
+	for(UINT i = 0; i < NUM_OCCLUDEE_COUNTERS; i++)
+	{
+		const OccludeeCounters &counters = mpOccludeeCounters[idx][i];
+		pStats->mNumCulled += counters.mNumCulled;
+		pStats->mNumCulledTris += counters.mNumCulledTris;
+		pStats->mNumBoxTests += counters.mNumBoxTests;
+		pStats->mNumEarlyOuts += counters.mNumEarlyOuts;
+		pStats->mNumRowsTested += counters.mNumRowsTested;
+		pStats->mNumRowsSkipped += counters.mNumRowsSkipped;
+	}
+}
+
+//--------------------------------------------------------------------
+// Copy the current occludee proxies to slot idx so that picking new
+// ones does not race with the slot's proxy rasterization
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::BeginOccludeeProxies(UINT idx)
+{
+	mNumProxies[idx] = mOccludeeProxies ? mNumProxyCandidates : 0;
+	memcpy(mpProxyModels[idx], mpProxyCandidates, mNumProxies[idx] * sizeof(UINT));
+}
+
+//--------------------------------------------------------------------
+// Transform the inner boxes of the occludee proxies to
+// screen space. Proxies crossing the near plane are collapsed to a
+// point so that they rasterize nothing
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::TransformProxies(UINT start, UINT end, UINT idx)
+{
+	BoxTestSetupSSE setup;
+	setup.Init(mViewMatrix[idx], mProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccludeeSizeThreshold);
+
+	for(UINT k = start; k < end; k++)
+	{
+		UINT i = mpProxyModels[idx][k];
+		__m128 *xformedPos = &mpXformedProxies[idx][k * AABB_VERTICES];
+		if(!mpTransformedAABBox[i].TransformAABBoxWS(xformedPos, setup, mpTransformedAABBox[i].GetProxyScale()))
+		{
+			for(UINT v = 0; v < AABB_VERTICES; v++)
+			{
+				xformedPos[v] = _mm_setzero_ps();
 			}
-			pRenderNode->Release();
 		}
 	}
 }
 
+//--------------------------------------------------------------------
+// Rasterize the occludee proxies of slot idx into one screen tile of 
+// its depth buffer, after the tile's occluders
+//--------------------------------------------------------------------
+void AABBoxRasterizerSSE::RasterizeProxies(UINT tileId, UINT idx)
+{
+	int tileStartX = (tileId % SCREENW_IN_TILES) * TILE_WIDTH_IN_PIXELS;
+	int tileEndX   = tileStartX + TILE_WIDTH_IN_PIXELS - 1;
+	int tileStartY = (tileId / SCREENW_IN_TILES) * TILE_HEIGHT_IN_PIXELS;
+	int tileEndY   = tileStartY + TILE_HEIGHT_IN_PIXELS - 1;
+
+	for(UINT k = 0; k < mNumProxies[idx]; k++)
+	{
+		UINT i = mpProxyModels[idx][k];
+		mpTransformedAABBox[i].RasterizeProxyToDepthBuffer(mpRenderTargetPixels[idx], &mpXformedProxies[idx][k * AABB_VERTICES], tileStartX, tileEndX, tileStartY, tileEndY);
+	}
+}
+
 void AABBoxRasterizerSSE::SetViewProjMatrix(float4x4 *viewMatrix, float4x4 *projMatrix, UINT idx)
 {
 	mViewMatrix[idx][0] = _mm_loadu_ps((float*)&viewMatrix->r0);
@@ -170,7 +628,8 @@ void AABBoxRasterizerSSE::SetViewProjMatrix(float4x4 *viewMatrix, float4x4 *proj
 
 //------------------------------------------------------------------------
 // Go through the list of models in the asset set and render only those 
-// models that are marked as visible by the software occlusion culling test
+// models that are marked as visible by the software occlusion culling test.
+// Only the cull nodes of the slot can hold visible models
 //------------------------------------------------------------------------
 void AABBoxRasterizerSSE::RenderVisible(CPUTAssetSet **pAssetSet,
 										CPUTRenderParametersDX &renderParams,
@@ -179,17 +638,68 @@ void AABBoxRasterizerSSE::RenderVisible(CPUTAssetSet **pAssetSet,
 {
 	int count = 0;
 
-	for(UINT modelId = 0; modelId < mNumModels; modelId++)
+	for(UINT k = 0; k < mNumCullNodes[idx]; k++)
 	{
-		if(mpVisible[idx][modelId])
+		const BVHNode &node = mpBVHNodes[mpCullNodes[idx][k].mNode];
+		for(UINT modelId = node.mFirst; modelId < node.mFirst + node.mCount; modelId++)
 		{
-			mpModels[modelId]->Render(renderParams);
-			count++;
+			if(mpVisible[idx][modelId])
+			{
+				mpModels[modelId]->Render(renderParams);
+				count++;
+			}
 		}
 	}
 	mNumCulled[idx] =  mNumModels - count;
 }
 
+//------------------------------------------------------------------------
+// Add the bounds of the models that are visible in view slot idx to the
+// light space receiver mask
+//------------------------------------------------------------------------
+void AABBoxRasterizerSSE::AddShadowReceivers(ShadowReceiverMask *pReceiverMask, UINT idx)
+{
+	float3 center, half;
+	for(UINT k = 0; k < mNumCullNodes[idx]; k++)
+	{
+		const BVHNode &node = mpBVHNodes[mpCullNodes[idx][k].mNode];
+		for(UINT modelId = node.mFirst; modelId < node.mFirst + node.mCount; modelId++)
+		{
+			if(mpVisible[idx][modelId])
+			{
+				mpModels[modelId]->GetBoundsWorldSpace(&center, &half);
+				pReceiverMask->AddReceiver(center, half);
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// Render the shadows of the models that are visible from the light in 
+// view slot idx and whose shadow volume reaches a visible receiver
+//------------------------------------------------------------------------
+void AABBoxRasterizerSSE::RenderShadowCasters(CPUTRenderParametersDX &renderParams,
+											  ShadowReceiverMask *pReceiverMask,
+											  UINT idx)
+{
+	float3 center, half;
+	for(UINT k = 0; k < mNumCullNodes[idx]; k++)
+	{
+		const BVHNode &node = mpBVHNodes[mpCullNodes[idx][k].mNode];
+		for(UINT modelId = node.mFirst; modelId < node.mFirst + node.mCount; modelId++)
+		{
+			if(mpVisible[idx][modelId])
+			{
+				mpModels[modelId]->GetBoundsWorldSpace(&center, &half);
+				if(pReceiverMask->ReachesReceiver(center, half))
+				{
+					mpModels[modelId]->RenderShadow(renderParams);
+				}
+			}
+		}
+	}
+}
+
 //------------------------------------------------------------------------
 // Go through the list of models in the asset set and render only those 
 // models that are not marked as too small by the software occlusion culling test
@@ -209,28 +719,14 @@ void AABBoxRasterizerSSE::Render(CPUTAssetSet **pAssetSet,
 
 	__m128 cumulativeMatrix[4];
 
-	for(UINT assetId = 0, modelId = 0; assetId < numAssetSets; assetId++)
+	// The occludees are kept in BVH order, not in the order of the asset sets
+	for(UINT modelId = 0; modelId < mNumModels; modelId++)
 	{
-		for(UINT nodeId = 0; nodeId < pAssetSet[assetId]->GetAssetCount(); nodeId++)
+		if(!mpTransformedAABBox[modelId].IsTooSmall(setup, cumulativeMatrix))
 		{
-			CPUTRenderNode* pRenderNode = NULL;
-			CPUTResult result = pAssetSet[assetId]->GetAssetByIndex(nodeId, &pRenderNode);
-			ASSERT((CPUT_SUCCESS == result), _L ("Failed getting asset by index")); 
-			if(pRenderNode->IsModel())
-			{
-				if(!mpTransformedAABBox[modelId].IsTooSmall(setup, cumulativeMatrix))
-				{
-					CPUTModelDX11* model = (CPUTModelDX11*)pRenderNode;
-					ASSERT((model != NULL), _L("model is NULL"));
-
-					model = (CPUTModelDX11*)pRenderNode;
-					model->Render(renderParams);
-					count++;
-					triCount +=  mpNumTriangles[modelId];
-				}
-				modelId++;			
-			}
-			pRenderNode->Release();
+			mpModels[modelId]->Render(renderParams);
+			count++;
+			triCount +=  mpNumTriangles[modelId];
 		}
 	}
 
@@ -302,4 +798,313 @@ void AABBoxRasterizerSSE::CalcInsideFrustum(CPUTFrustum *pFrustum, UINT start, U
 		visible[i*4 + 2] = (packetMask >> 2) & 1;
 		visible[i*4 + 3] = (packetMask >> 3) & 1;
 	}
-}
\ No newline at end of file
+}
+
+//------------------------------------------------------------------------
+// Reset the occludees the slot's last frame touched, then walk the
+// occludee BVH against the frustum once. Subtrees outside it are culled
+// as a whole, subtrees inside it become cull nodes once they are small
+// enough and subtrees crossing a plane are split down to their leaves
+//------------------------------------------------------------------------
+void AABBoxRasterizerSSE::CollectCullNodes(UINT idx)
+{
+	CullNode *pCullNodes = mpCullNodes[idx];
+	for(UINT k = 0; k < mNumCullNodes[idx]; k++)
+	{
+		const BVHNode &node = mpBVHNodes[pCullNodes[k].mNode];
+		memset(&mpVisible[idx][node.mFirst], false, node.mCount * sizeof(bool));
+		memset(&mpBucket[idx][node.mFirst], NO_OCCLUDEE_BUCKET, node.mCount);
+	}
+	mNumCullNodes[idx] = 0;
+	if(mNumModels == 0)
+	{
+		return;
+	}
+
+	CPUTFrustum *pFrustum = &mpCamera[idx]->mFrustum;
+	OccludeeCounters &counters = GetTraversalCounters(idx);
+
+	// Nodes inside the frustum pass it on to their subtrees
+	UINT stack[64];
+	bool stackInside[64];
+	UINT stackSize = 0;
+	stack[stackSize] = 0;
+	stackInside[stackSize++] = !mEnableFCulling;
+	while(stackSize > 0)
+	{
+		stackSize--;
+		UINT nodeId = stack[stackSize];
+		bool inside = stackInside[stackSize];
+		const BVHNode &node = mpBVHNodes[nodeId];
+
+		if(!inside)
+		{
+			bool outside = false;
+			inside = true;
+			for(UINT j = 0; j < 6; j++)
+			{
+				const float3 &normal = pFrustum->mpNormal[j];
+				float dist = dot3(normal, node.mCenter) + pFrustum->mPlanes[3*8 + j];
+				float radius = fabsf(normal.x) * node.mHalf.x + fabsf(normal.y) * node.mHalf.y + fabsf(normal.z) * node.mHalf.z;
+				if(dist - radius >= 0.0f)
+				{
+					outside = true;
+					break;
+				}
+				inside = inside && (dist + radius < 0.0f);
+			}
+			if(outside)
+			{
+				counters.AddCulled(node.mCount, node.mNumTriangles);
+				continue;
+			}
+		}
+
+		if(node.mChild == 0 || (inside && node.mCount <= OCCLUDEE_CULL_NODE_SIZE))
+		{
+			CullNode &cullNode = pCullNodes[mNumCullNodes[idx]++];
+			cullNode.mNode = nodeId;
+			cullNode.mInsideFrustum = inside;
+		}
+		else
+		{
+			stack[stackSize] = node.mChild + 1;
+			stackInside[stackSize++] = inside;
+			stack[stackSize] = node.mChild;
+			stackInside[stackSize++] = inside;
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// Transform the bounds of the cull nodes start .. end - 1 to screen
+// space and find the bucket of raster bands they overlap and the tile
+// of their center. Bounds crossing the near plane wait for all bands
+//------------------------------------------------------------------------
+void AABBoxRasterizerSSE::BinCullNodes(UINT start, UINT end, const BoxTestSetupSSE &setup, UINT idx)
+{
+	for(UINT k = start; k < end; k++)
+	{
+		CullNode &cullNode = mpCullNodes[idx][k];
+		const BVHNode &node = mpBVHNodes[cullNode.mNode];
+		__m128 *xformedPos = &mpXformedNodes[idx][k * AABB_VERTICES];
+
+		cullNode.mZIn = TransformedAABBoxSSE::TransformBoxWS(node.mCenter, node.mHalf, xformedPos, setup);
+		if(!cullNode.mZIn)
+		{
+			cullNode.mBucket = NUM_OCCLUDEE_BUCKETS - 1;
+			cullNode.mTile = 0;
+			continue;
+		}
+
+		float minX = xformedPos[0].m128_f32[0];
+		float maxX = minX;
+		float minY = xformedPos[0].m128_f32[1];
+		float maxY = minY;
+		for(UINT v = 1; v < AABB_VERTICES; v++)
+		{
+			minX = min(minX, xformedPos[v].m128_f32[0]);
+			maxX = max(maxX, xformedPos[v].m128_f32[0]);
+			minY = min(minY, xformedPos[v].m128_f32[1]);
+			maxY = max(maxY, xformedPos[v].m128_f32[1]);
+		}
+		cullNode.mBucket = (UCHAR)GetOccludeeBucket(minY, maxY);
+		cullNode.mTile = (UCHAR)GetOccludeeTile(0.5f * (minX + maxX), 0.5f * (minY + maxY));
+	}
+}
+
+//------------------------------------------------------------------------
+// Depth test the bounds of cull node k once its bucket's bands are in
+// the depth buffer. Hidden bounds cull the whole subtree, the occludees
+// keep their initial state and are only counted. Otherwise the children
+// are tested the same way down to the leaves
+//------------------------------------------------------------------------
+void AABBoxRasterizerSSE::DepthTestCullNode(UINT k, UINT bucket, const BoxTestSetupSSE &setup, const float3 &cameraPos, UINT idx, OccludeeCounters &counters)
+{
+	const CullNode &cullNode = mpCullNodes[idx][k];
+
+	UINT stack[64];
+	UINT stackSize = 0;
+	stack[stackSize++] = cullNode.mNode;
+	while(stackSize > 0)
+	{
+		UINT nodeId = stack[--stackSize];
+		const BVHNode &node = mpBVHNodes[nodeId];
+
+		// The cull node's bounds were transformed during binning
+		__m128 xformedPos[AABB_VERTICES];
+		const __m128 *pXformedPos = &mpXformedNodes[idx][k * AABB_VERTICES];
+		bool zIn = cullNode.mZIn;
+		if(nodeId != cullNode.mNode)
+		{
+			zIn = TransformedAABBoxSSE::TransformBoxWS(node.mCenter, node.mHalf, xformedPos, setup);
+			pXformedPos = xformedPos;
+		}
+
+		if(zIn && !TransformedAABBoxSSE::RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], pXformedPos, idx, &counters))
+		{
+			counters.AddCulled(node.mCount, node.mNumTriangles);
+		}
+		else if(node.mChild != 0)
+		{
+			stack[stackSize++] = node.mChild + 1;
+			stack[stackSize++] = node.mChild;
+		}
+		else
+		{
+			DepthTestLeaf(node, cullNode.mInsideFrustum, bucket, setup, cameraPos, idx, counters);
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// For each packet of 4 occludees of a leaf whose bounds are not hidden
+// * Frustum test the occludees, unless the whole leaf is inside
+// * Size test and transform the world space AABBoxes to screen space
+// * Use the visibility history if the temporal cache skips the test
+// * Otherwise rasterize and depth test the AABBox
+//------------------------------------------------------------------------
+void AABBoxRasterizerSSE::DepthTestLeaf(const BVHNode &node, bool insideFrustum, UINT bucket, const BoxTestSetupSSE &setup, const float3 &cameraPos, UINT idx, OccludeeCounters &counters)
+{
+	UINT end = node.mFirst + node.mCount;
+	if(!insideFrustum)
+	{
+		CalcInsideFrustum(&mpCamera[idx]->mFrustum, node.mFirst, end, idx);
+	}
+
+	UINT numPackets = (mNumModels + 3) / 4;
+	for(UINT packet = node.mFirst / 4; packet * 4 < end; packet++)
+	{
+		if(packet + OCCLUDEE_PREFETCH_PACKETS < numPackets)
+		{
+			_mm_prefetch((const char*)&mpWorldBoxes[packet + OCCLUDEE_PREFETCH_PACKETS], _MM_HINT_T0);
+		}
+
+		UINT first = packet * 4;
+		UINT last = min(first + 4, end);
+		__m128 *pXformedPos = &mpXformedBoxes[idx][first * AABB_VERTICES];
+		bool *pInside = &mpInsideFrustum[idx][first];
+		if(!insideFrustum && !pInside[0] && !pInside[1] && !pInside[2] && !pInside[3])
+		{
+			for(UINT i = first; i < last; i++)
+			{
+				counters.AddCulled(mpNumTriangles[i]);
+			}
+			continue;
+		}
+
+		int tooSmallMask, zInMask;
+		TransformBoxPacket(setup, packet, pXformedPos, tooSmallMask, zInMask);
+
+		for(UINT i = first; i < last; i++)
+		{
+			UINT lane = i - first;
+			if((!insideFrustum && !pInside[lane]) || ((tooSmallMask >> lane) & 1))
+			{
+				counters.AddCulled(mpNumTriangles[i]);
+				continue;
+			}
+
+			if(!((zInMask >> lane) & 1))
+			{
+				mpVisible[idx][i] = true;
+				continue;
+			}
+
+			if(mUseHistory[idx] && UseCachedVisibility(i, cameraPos, idx))
+			{
+				mpVisible[idx][i] = mpSlotHistory[idx][i].mVisible;
+				mpBucket[idx][i] = CACHED_OCCLUDEE_BUCKET;
+			}
+			else
+			{
+				mpBucket[idx][i] = (UCHAR)bucket;
+				mpVisible[idx][i] = TransformedAABBoxSSE::RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], &pXformedPos[lane * AABB_VERTICES], idx, &counters);
+			}
+			if(!mpVisible[idx][i])
+			{
+				counters.AddCulled(mpNumTriangles[i]);
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// Size test and transform the world space boxes of a packet to screen 
+// space 4 at a time. The corners are transposed back to one __m128 per 
+// corner as the depth test expects, box b of the packet at 
+// pXformedPos[b * AABB_VERTICES]
+//------------------------------------------------------------------------
+void AABBoxRasterizerSSE::TransformBoxPacket(const BoxTestSetupSSE &setup, UINT packet, __m128 *pXformedPos, int &tooSmallMask, int &zInMask)
+{
+	const WorldBBoxPacket &box = mpWorldBoxes[packet];
+
+	// Broadcast the matrix, m[r][c] multiplies the r-th input component into the c-th output component
+	__m128 m[4][4];
+	for(UINT r = 0; r < 4; r++)
+	{
+		for(UINT c = 0; c < 4; c++)
+		{
+			m[r][c] = _mm_set1_ps(setup.mViewProjViewport[r].m128_f32[c]);
+		}
+	}
+
+	// Size test on the w of the box centers
+	__m128 w = m[3][3];
+	w = _mm_add_ps(w, _mm_mul_ps(box.mCenter[0], m[0][3]));
+	w = _mm_add_ps(w, _mm_mul_ps(box.mCenter[1], m[1][3]));
+	w = _mm_add_ps(w, _mm_mul_ps(box.mCenter[2], m[2][3]));
+
+	__m128 radiusSq = _mm_mul_ps(box.mHalf[0], box.mHalf[0]);
+	radiusSq = _mm_add_ps(radiusSq, _mm_mul_ps(box.mHalf[1], box.mHalf[1]));
+	radiusSq = _mm_add_ps(radiusSq, _mm_mul_ps(box.mHalf[2], box.mHalf[2]));
+
+	__m128 tooSmall = _mm_and_ps(_mm_cmpgt_ps(w, _mm_set1_ps(1.0f)),
+								 _mm_cmplt_ps(radiusSq, _mm_mul_ps(w, _mm_set1_ps(setup.radiusThreshold))));
+	tooSmallMask = _mm_movemask_ps(tooSmall);
+
+	// Min and max corner rows, each axis times the matrix row for all 4 output components
+	__m128 xRow[2][4], yRow[2][4], zRow[2][4];
+	__m128 minX = _mm_sub_ps(box.mCenter[0], box.mHalf[0]);
+	__m128 maxX = _mm_add_ps(box.mCenter[0], box.mHalf[0]);
+	__m128 minY = _mm_sub_ps(box.mCenter[1], box.mHalf[1]);
+	__m128 maxY = _mm_add_ps(box.mCenter[1], box.mHalf[1]);
+	__m128 minZ = _mm_sub_ps(box.mCenter[2], box.mHalf[2]);
+	__m128 maxZ = _mm_add_ps(box.mCenter[2], box.mHalf[2]);
+	for(UINT c = 0; c < 4; c++)
+	{
+		xRow[0][c] = _mm_mul_ps(minX, m[0][c]);
+		xRow[1][c] = _mm_mul_ps(maxX, m[0][c]);
+		yRow[0][c] = _mm_mul_ps(minY, m[1][c]);
+		yRow[1][c] = _mm_mul_ps(maxY, m[1][c]);
+		zRow[0][c] = _mm_mul_ps(minZ, m[2][c]);
+		zRow[1][c] = _mm_mul_ps(maxZ, m[2][c]);
+	}
+
+	__m128 zAllIn = _mm_castsi128_ps(_mm_set1_epi32(~0));
+	for(UINT i = 0; i < AABB_VERTICES; i++)
+	{
+		__m128 vert[4];
+		for(UINT c = 0; c < 4; c++)
+		{
+			vert[c] = _mm_add_ps(m[3][c], xRow[sBBxInd[i]][c]);
+			vert[c] = _mm_add_ps(vert[c], yRow[sBByInd[i]][c]);
+			vert[c] = _mm_add_ps(vert[c], zRow[sBBzInd[i]][c]);
+		}
+
+		// We have inverted z; z is in front of near plane iff z <= w.
+		zAllIn = _mm_and_ps(zAllIn, _mm_cmple_ps(vert[2], vert[3]));
+
+		// project
+		__m128 x = _mm_div_ps(vert[0], vert[3]);
+		__m128 y = _mm_div_ps(vert[1], vert[3]);
+		__m128 z = _mm_div_ps(vert[2], vert[3]);
+		__m128 one = _mm_div_ps(vert[3], vert[3]);
+		_MM_TRANSPOSE4_PS(x, y, z, one);
+		pXformedPos[0 * AABB_VERTICES + i] = x;
+		pXformedPos[1 * AABB_VERTICES + i] = y;
+		pXformedPos[2 * AABB_VERTICES + i] = z;
+		pXformedPos[3 * AABB_VERTICES + i] = one;
+	}
+	zInMask = _mm_movemask_ps(zAllIn);
+}
@@ -27,6 +27,7 @@ class AABBoxRasterizerSSE : public AABBoxRasterizer
 		AABBoxRasterizerSSE();
 		virtual ~AABBoxRasterizerSSE();
 		void CreateTransformedAABBoxes(CPUTAssetSet **pAssetSet, UINT numAssetSets);
+		void CreateTransformedAABBoxes(const CullingScene &scene);
 		
 		void RenderVisible(CPUTAssetSet **pAssetSet,
 						   CPUTRenderParametersDX &renderParams,
@@ -38,12 +39,20 @@ class AABBoxRasterizerSSE : public AABBoxRasterizer
 					UINT numAssetSets,
 					UINT idx);
 
+		void AddShadowReceivers(ShadowReceiverMask *pReceiverMask, UINT idx);
+
+		void RenderShadowCasters(CPUTRenderParametersDX &renderParams,
+								 ShadowReceiverMask *pReceiverMask,
+								 UINT idx);
+
 		inline void ResetInsideFrustum()
 		{
 			for(UINT i = 0; i < mNumModels; i++)
 			{
-				mpInsideFrustum[0][i] = true;
-				mpInsideFrustum[1][i] = true;
+				for(UINT idx = 0; idx < MAX_SLOTS; idx++)
+				{
+					mpInsideFrustum[idx][i] = true;
+				}
 			}
 		}
 
@@ -53,12 +62,23 @@ class AABBoxRasterizerSSE : public AABBoxRasterizer
 			mpRenderTargetPixels[idx] = pRenderTargetPixels;
 		}
 		inline void SetDepthTestTasks(UINT numTasks) {mNumDepthTestTasks = numTasks;}
+		inline void SetTileBinnedDepthTest(bool tileBinned) {mTileBinnedDepthTest = tileBinned;}
 		inline void SetOccludeeSizeThreshold(float occludeeSizeThreshold){mOccludeeSizeThreshold = occludeeSizeThreshold;}
+		inline void SetOccludeeProxies(bool occludeeProxies) {mOccludeeProxies = occludeeProxies;}
+		void UpdateOccludeeProxies(UINT idx);
+		inline void SetTemporalCache(bool temporalCache) {mTemporalCache = temporalCache;}
+		void UpdateVisibilityHistory(UINT idx);
 		inline void SetCamera(CPUTCamera *pCamera, UINT idx) {mpCamera[idx] = pCamera;}
 		inline void SetEnableFCulling(bool enableFCulling) {mEnableFCulling = enableFCulling;}
 
 		inline UINT GetNumOccludees() {return mNumModels;}
 		inline UINT GetNumCulled(UINT idx) {return mNumCulled[idx];}
+		inline bool IsVisible(UINT modelId, UINT idx) {return mpVisible[idx][modelId];}
+		inline UINT GetLoadOrderId(UINT modelId) {return mpLoadOrder[modelId];}
+		// The occludees are stored in the order of the occludee BVH, not in the order given
+		inline const float3 &GetOccludeeCenter(UINT modelId) {return mpTransformedAABBox[modelId].GetCenterWS();}
+		inline const float3 &GetOccludeeHalf(UINT modelId) {return mpTransformedAABBox[modelId].GetHalfWS();}
+		inline UINT GetOccludeeTriangles(UINT modelId) {return mpNumTriangles[modelId];}
 		inline double GetDepthTestTime()
 		{
 			double averageTime = 0.0;
@@ -68,6 +88,10 @@ class AABBoxRasterizerSSE : public AABBoxRasterizer
 			}
 			return averageTime / AVG_COUNTER;
 		}
+		inline double GetLastDepthTestTime()
+		{
+			return mDepthTestTime[(mTimeCounter + AVG_COUNTER - 1) % AVG_COUNTER];
+		}
 
 		inline UINT GetNumTriangles()
 		{
@@ -79,15 +103,8 @@ class AABBoxRasterizerSSE : public AABBoxRasterizer
 			return numTris;
 		}
 
-		inline UINT GetNumCulledTriangles(UINT idx)
-		{
-			UINT numCulledTris = 0;
-			for(UINT i = 0; i < mNumModels; i++)
-			{
-				numCulledTris += mpVisible[idx][i] ? 0 : mpNumTriangles[i];
-			}
-			return numCulledTris;
-		}
+		// Sums up the counter blocks the BVH walk and the depth test tasks of the slot filled in
+		void GetFrameStats(UINT idx, CullingStats *pStats);
 
 		inline UINT GetNumTrisRendered()
 		{
@@ -103,22 +120,102 @@ class AABBoxRasterizerSSE : public AABBoxRasterizer
 
 	protected:
 		struct WorldBBoxPacket;
+		struct BVHNode;
+		struct CullNode;
+		struct OccludeeHistory;
+
+		// Occludee data, bounding volume hierarchy and boxes for mNumModels occludees,
+		// of the CPUT models in mpModels or of pScene
+		void CreateOccludees(const float3 *pCenter, const float3 *pHalf, const UINT *pNumTriangles, const CullingScene *pScene);
+
+		// Split the occludees pOrder[first .. first + count - 1] into the subtree at node
+		void BuildBVH(UINT node, UINT *pOrder, const float3 *pCenter, const float3 *pHalf, const UINT *pNumTriangles, UINT first, UINT count);
+
+		// Screen space corners are only allocated once a frame actually uses the slot
+		void AllocateSlot(UINT idx);
+
+		// Size test and screen space corners of the 4 world space boxes of a packet
+		void TransformBoxPacket(const BoxTestSetupSSE &setup, UINT packet, __m128 *pXformedPos, int &tooSmallMask, int &zInMask);
+
+		// Walk the occludee BVH against the frustum of slot idx once and collect the
+		// subtrees the depth tests start from. Only the occludees of the slot's last
+		// cull nodes are reset, the ones outside them keep their initial state
+		void CollectCullNodes(UINT idx);
+		// Screen space corners, bucket and tile of the cull nodes first .. end - 1
+		void BinCullNodes(UINT start, UINT end, const BoxTestSetupSSE &setup, UINT idx);
+		// Depth test the bounds of cull node k and its subtrees top down, then the
+		// occludees of the leaves that are not hidden. Tested occludees get the bucket
+		void DepthTestCullNode(UINT k, UINT bucket, const BoxTestSetupSSE &setup, const float3 &cameraPos, UINT idx, OccludeeCounters &counters);
+		void DepthTestLeaf(const BVHNode &node, bool insideFrustum, UINT bucket, const BoxTestSetupSSE &setup, const float3 &cameraPos, UINT idx, OccludeeCounters &counters);
+
+		// Snapshot the visibility history for the frame culled in slot idx
+		void BeginVisibilityHistory(UINT idx);
+		// Whether the depth test of occludee i can be skipped in slot idx
+		bool UseCachedVisibility(UINT i, const float3 &cameraPos, UINT idx);
+
+		// Clear the counter blocks of the frame culled in slot idx
+		void BeginOccludeeCounters(UINT idx);
+		// Counter block of a depth test task of a bucket
+		inline OccludeeCounters &GetOccludeeCounters(UINT bucket, UINT taskId, UINT idx)
+		{
+			assert(bucket < NUM_OCCLUDEE_BUCKETS && taskId < NUM_DT_TASKS);
+			return mpOccludeeCounters[idx][bucket * NUM_DT_TASKS + taskId];
+		}
+		// Counter block of the BVH walk, for the subtrees outside the frustum
+		inline OccludeeCounters &GetTraversalCounters(UINT idx)
+		{
+			return mpOccludeeCounters[idx][NUM_OCCLUDEE_BUCKETS * NUM_DT_TASKS];
+		}
+
+		// Hand the picked occludee proxies to the frame culled in slot idx
+		void BeginOccludeeProxies(UINT idx);
+		// Screen space corners of the proxies start .. end - 1 of slot idx
+		void TransformProxies(UINT start, UINT end, UINT idx);
+		// Rasterize the proxies of slot idx that overlap a tile into its depth buffer
+		void RasterizeProxies(UINT tileId, UINT idx);
 
 		UINT mNumModels;
 		TransformedAABBoxSSE *mpTransformedAABBox;
 		WorldBBoxPacket *mpWorldBoxes;
+		BVHNode *mpBVHNodes;			// occludee BVH, node 0 is the root
+		UINT mNumBVHNodes;
+		UINT *mpLoadOrder;			// load order position of the occludee at each BVH position
 		CPUTModelDX11 **mpModels;
-		bool *mpInsideFrustum[2];
+		bool *mpInsideFrustum[MAX_SLOTS];
 		UINT *mpNumTriangles;
-		__m128 *mViewMatrix[2];
-		__m128 *mProjMatrix[2];
-		UINT *mpRenderTargetPixels[2];
-		CPUTCamera *mpCamera[2];
-		bool *mpVisible[2];
-		UINT mNumCulled[2];
+		__m128 *mViewMatrix[MAX_SLOTS];
+		__m128 *mProjMatrix[MAX_SLOTS];
+		UINT *mpRenderTargetPixels[MAX_SLOTS];
+		CPUTCamera *mpCamera[MAX_SLOTS];
+		bool *mpVisible[MAX_SLOTS];
+		__m128 *mpXformedBoxes[MAX_SLOTS];	// AABB_VERTICES screen space corners per occludee
+		UCHAR *mpBucket[MAX_SLOTS];		// depth test bucket, NO_OCCLUDEE_BUCKET if decided without one
+		CullNode *mpCullNodes[MAX_SLOTS];	// BVH subtrees in the frustum, the only occludees the slot touched
+		UINT mNumCullNodes[MAX_SLOTS];
+		__m128 *mpXformedNodes[MAX_SLOTS];	// AABB_VERTICES screen space corners per cull node
+		UINT *mpSortedCullNodes[MAX_SLOTS];	// cull nodes sorted by bucket and tile
+		UINT mTileStart[MAX_SLOTS][NUM_OCCLUDEE_BUCKETS * NUM_TILES + 1];
+		UINT *mpProxyCandidates;			// occludees picked as proxies, for the next frame culled
+		UINT mNumProxyCandidates;
+		UINT *mpProxyModels[MAX_SLOTS];		// occludee proxies rasterized in the slot
+		UINT mNumProxies[MAX_SLOTS];
+		__m128 *mpXformedProxies[MAX_SLOTS];	// AABB_VERTICES screen space corners per proxy
+		OccludeeHistory *mpHistory;				// visibility history, only touched between frames
+		UINT mHistoryFrame;
+		bool mHistoryValid;
+		float3 mHistoryCameraPos[OCCLUDEE_HISTORY_FRAMES];
+		OccludeeHistory *mpSlotHistory[MAX_SLOTS];	// history as it was when the slot's frame started
+		float3 mSlotHistoryCameraPos[MAX_SLOTS][OCCLUDEE_HISTORY_FRAMES];
+		UINT mSlotHistoryFrame[MAX_SLOTS];
+		bool mUseHistory[MAX_SLOTS];
+		UINT mNumCulled[MAX_SLOTS];
+		OccludeeCounters *mpOccludeeCounters[MAX_SLOTS];	// NUM_OCCLUDEE_BUCKETS * NUM_DT_TASKS + 1 per slot
 		UINT mNumTrisRendered;
 		UINT mNumFCullCount;
 		UINT mNumDepthTestTasks;
+		bool mTileBinnedDepthTest;
+		bool mOccludeeProxies;
+		bool mTemporalCache;
 		float mOccludeeSizeThreshold;
 		UINT mTimeCounter;
 
@@ -29,16 +29,80 @@ AABBoxRasterizerSSEMT::~AABBoxRasterizerSSEMT()
 }
 
 //-------------------------------------------------------------------------------
-// Create mNumDepthTestTasks to tarnsform occludee AABBox, rasterize and depth test 
-// to determine if occludee is visible or occluded
+// Walk the occludee BVH against the frustum to find the cull nodes, the subtrees
+// in view. Create mNumDepthTestTasks to transform the cull node bounds and bin
+// them by the raster bands they overlap. For every bucket create mNumDepthTestTasks
+// to depth test its cull nodes top down and then their occludees; they only wait
+// for the bucket's raster bands so the tail of the occluder rasterization overlaps
+// with the depth tests. Occludees outside the frustum are never visited.
+// With tile binned depth tests the cull nodes are sorted by screen tile first and
+// every bucket gets one task per tile of its bands, so a task keeps re-reading
+// the same part of the depth buffer instead of the whole of it.
+// With occludee proxies every raster band is followed by a task set that adds the
+// band's proxies to the depth buffer and the depth tests wait for those instead
 //-------------------------------------------------------------------------------
 void AABBoxRasterizerSSEMT::TransformAABBoxAndDepthTest(CPUTCamera *pCamera, UINT idx)
 {
 	mTaskData[idx].idx = idx;
+	mTaskData[idx].bucket = NO_OCCLUDEE_BUCKET;
+	mTaskData[idx].band = 0;
 	mTaskData[idx].pAABB = this;
 
 	mpCamera[idx] = pCamera;
-	gTaskMgr.CreateTaskSet(&AABBoxRasterizerSSEMT::TransformAABBoxAndDepthTest, &mTaskData[idx], mNumDepthTestTasks, &gRasterize[idx], 1, "Xform Vertices", &gAABBoxDepthTest[idx]);
+	if(mpXformedBoxes[idx] == NULL)
+	{
+		AllocateSlot(idx);
+	}
+	BeginOccludeeCounters(idx);
+	CollectCullNodes(idx);
+	BeginOccludeeProxies(idx);
+	BeginVisibilityHistory(idx);
+
+	TASKSETHANDLE *pRasterize = gRasterize[idx];
+	if(mNumProxies[idx] > 0)
+	{
+		UINT numXformTasks = min(mNumDepthTestTasks, mNumProxies[idx]);
+		gTaskMgr.CreateTaskSet(&AABBoxRasterizerSSEMT::TransformProxies, &mTaskData[idx], numXformTasks, NULL, 0, "Xform Occludee Proxies", &gXformProxies[idx]);
+		for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+		{
+			mProxyBandData[idx][band] = mTaskData[idx];
+			mProxyBandData[idx][band].band = band;
+
+			TASKSETHANDLE depends[] = {gXformProxies[idx], gRasterize[idx][band]};
+			gTaskMgr.CreateTaskSet(&AABBoxRasterizerSSEMT::RasterizeProxies, &mProxyBandData[idx][band], TILES_PER_BAND, depends, 2, "Raster Occludee Proxies", &gRasterizeProxies[idx][band]);
+		}
+		pRasterize = gRasterizeProxies[idx];
+	}
+
+	// Binning only needs the camera so it runs alongside the occluder tasks
+	gTaskMgr.CreateTaskSet(&AABBoxRasterizerSSEMT::BinAABBox, &mTaskData[idx], mNumDepthTestTasks, NULL, 0, "Bin AABBox", &gAABBoxBin[idx]);
+	if(mTileBinnedDepthTest)
+	{
+		gTaskMgr.CreateTaskSet(&AABBoxRasterizerSSEMT::SortAABBox, &mTaskData[idx], 1, &gAABBoxBin[idx], 1, "Sort AABBox", &gAABBoxSort[idx]);
+	}
+
+	for(UINT bucket = 0; bucket < NUM_OCCLUDEE_BUCKETS; bucket++)
+	{
+		mBucketData[idx][bucket] = mTaskData[idx];
+		mBucketData[idx][bucket].bucket = bucket;
+
+		UINT firstBand, lastBand;
+		GetBucketBands(bucket, firstBand, lastBand);
+
+		TASKSETHANDLE depends[NUM_RASTER_BANDS + 1];
+		UINT numDepends = 0;
+		depends[numDepends++] = mTileBinnedDepthTest ? gAABBoxSort[idx] : gAABBoxBin[idx];
+		for(UINT band = firstBand; band <= lastBand; band++)
+		{
+			depends[numDepends++] = pRasterize[band];
+		}
+
+		// The center of a bucket's cull nodes always lies in one of the bucket's bands
+		UINT numTasks = mTileBinnedDepthTest ? (lastBand - firstBand + 1) * TILES_PER_BAND : mNumDepthTestTasks;
+		gTaskMgr.CreateTaskSet(&AABBoxRasterizerSSEMT::DepthTestBucket, &mBucketData[idx][bucket], numTasks, depends, numDepends, "Depth Test AABBox", &gAABBoxBucketTest[idx][bucket]);
+	}
+
+	gTaskMgr.CreateTaskSet(&AABBoxRasterizerSSEMT::DepthTestDone, &mTaskData[idx], 1, gAABBoxBucketTest[idx], NUM_OCCLUDEE_BUCKETS, "Depth Test Done", &gAABBoxDepthTest[idx]);
 }
 
 void AABBoxRasterizerSSEMT::WaitForTaskToFinish(UINT idx)
@@ -50,24 +114,63 @@ void AABBoxRasterizerSSEMT::WaitForTaskToFinish(UINT idx)
 void AABBoxRasterizerSSEMT::ReleaseTaskHandles(UINT idx)
 {
 	// Release the task set
-	if(mEnableFCulling)
-	{
-		gTaskMgr.ReleaseHandle(gInsideViewFrustum[idx]);
-	}
-	else
+	// When several views are culled together only the first view's slot
+	// holds the shared visibility and activation task sets
+	if(gActiveModels[idx] != TASKSETHANDLE_INVALID)
 	{
-		gTaskMgr.ReleaseHandle(gTooSmall[idx]);
+		if(mEnableFCulling)
+		{
+			gTaskMgr.ReleaseHandle(gInsideViewFrustum[idx]);
+		}
+		else
+		{
+			gTaskMgr.ReleaseHandle(gTooSmall[idx]);
+		}
+		gTaskMgr.ReleaseHandle(gActiveModels[idx]);
+		if(gSplitNearFar[idx] != TASKSETHANDLE_INVALID)
+		{
+			gTaskMgr.ReleaseHandle(gSplitNearFar[idx]);
+		}
 	}
-	gTaskMgr.ReleaseHandle(gActiveModels[idx]);
 	gTaskMgr.ReleaseHandle(gXformMesh[idx]);
 	gTaskMgr.ReleaseHandle(gBinMesh[idx]);
 	gTaskMgr.ReleaseHandle(gSortBins[idx]);
-	gTaskMgr.ReleaseHandle(gRasterize[idx]);
+	gTaskMgr.ReleaseHandles(gRasterize[idx], NUM_RASTER_BANDS);
+	if(gActiveFarModels[idx] != TASKSETHANDLE_INVALID)
+	{
+		gTaskMgr.ReleaseHandle(gXformMeshNear[idx]);
+		gTaskMgr.ReleaseHandle(gBinMeshNear[idx]);
+		gTaskMgr.ReleaseHandle(gSortBinsNear[idx]);
+		gTaskMgr.ReleaseHandles(gRasterizeNear[idx], NUM_RASTER_BANDS);
+		gTaskMgr.ReleaseHandle(gCullFarOccluders[idx]);
+		gTaskMgr.ReleaseHandle(gActiveFarModels[idx]);
+	}
+	if(gXformProxies[idx] != TASKSETHANDLE_INVALID)
+	{
+		gTaskMgr.ReleaseHandle(gXformProxies[idx]);
+		gTaskMgr.ReleaseHandles(gRasterizeProxies[idx], NUM_RASTER_BANDS);
+	}
+	gTaskMgr.ReleaseHandle(gAABBoxBin[idx]);
+	if(gAABBoxSort[idx] != TASKSETHANDLE_INVALID)
+	{
+		gTaskMgr.ReleaseHandle(gAABBoxSort[idx]);
+	}
+	gTaskMgr.ReleaseHandles(gAABBoxBucketTest[idx], NUM_OCCLUDEE_BUCKETS);
 	gTaskMgr.ReleaseHandle(gAABBoxDepthTest[idx]);
 
-	gInsideViewFrustum[idx] = gTooSmall[idx] = gActiveModels[idx] = gXformMesh[idx] = gBinMesh[idx] = gSortBins[idx] = gRasterize[idx] = TASKSETHANDLE_INVALID;
-	gAABBoxDepthTest[idx] = TASKSETHANDLE_INVALID;
+	gInsideViewFrustum[idx] = gTooSmall[idx] = gActiveModels[idx] = gSplitNearFar[idx] = gXformMesh[idx] = gBinMesh[idx] = gSortBins[idx] = TASKSETHANDLE_INVALID;
+	gXformMeshNear[idx] = gBinMeshNear[idx] = gSortBinsNear[idx] = gCullFarOccluders[idx] = gActiveFarModels[idx] = TASKSETHANDLE_INVALID;
+	gXformProxies[idx] = gAABBoxBin[idx] = gAABBoxSort[idx] = gAABBoxDepthTest[idx] = TASKSETHANDLE_INVALID;
+	for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+	{
+		gRasterize[idx][band] = gRasterizeNear[idx][band] = gRasterizeProxies[idx][band] = TASKSETHANDLE_INVALID;
+	}
+	for(UINT bucket = 0; bucket < NUM_OCCLUDEE_BUCKETS; bucket++)
+	{
+		gAABBoxBucketTest[idx][bucket] = TASKSETHANDLE_INVALID;
+	}
 	
+	// Time spent binning plus the time from the first bucket depth test to the last one
 	LARGE_INTEGER startTime = mStartTime[idx][0];
 	LARGE_INTEGER stopTime = mStopTime[idx][0];
 	for(UINT i = 0; i < mNumDepthTestTasks; i++)
@@ -75,57 +178,145 @@ void AABBoxRasterizerSSEMT::ReleaseTaskHandles(UINT idx)
 		startTime = startTime.QuadPart > mStartTime[idx][i].QuadPart ? mStartTime[idx][i] : startTime;
 		stopTime = stopTime.QuadPart < mStopTime[idx][i].QuadPart? mStopTime[idx][i] : stopTime;
 	}
-	mDepthTestTime[mTimeCounter++] = ((double)(stopTime.QuadPart - startTime.QuadPart)) / ((double)glFrequency.QuadPart);
+	LARGE_INTEGER testStartTime = mBucketStartTime[idx][0];
+	for(UINT bucket = 0; bucket < NUM_OCCLUDEE_BUCKETS; bucket++)
+	{
+		testStartTime = testStartTime.QuadPart > mBucketStartTime[idx][bucket].QuadPart ? mBucketStartTime[idx][bucket] : testStartTime;
+	}
+	LONGLONG ticks = (stopTime.QuadPart - startTime.QuadPart) + (mTestStopTime[idx].QuadPart - testStartTime.QuadPart);
+	mDepthTestTime[mTimeCounter++] = ((double)ticks) / ((double)glFrequency.QuadPart);
 	mTimeCounter = mTimeCounter >= AVG_COUNTER ? 0 : mTimeCounter; 
 }
 
 //--------------------------------------------------------------------------------
-// Determine the batch of occludee models each task should work on
-// For each occludee model in the batch
-// * Transform the AABBox to screen space
-// * Rasterize the triangles that make up the AABBox
-// * Depth test the raterized triangles against the CPU rasterized depth buffer
+// Determine the batch of cull nodes each task should work on, transform their
+// bounds to screen space and find the bucket of raster bands they overlap and the
+// tile of their center. The occludees are left to the depth test tasks
 //--------------------------------------------------------------------------------
-void AABBoxRasterizerSSEMT::TransformAABBoxAndDepthTest(UINT taskId, UINT taskCount, UINT idx)
+void AABBoxRasterizerSSEMT::BinAABBox(UINT taskId, UINT idx)
 {
 	QueryPerformanceCounter(&mStartTime[idx][taskId]);
 
 	BoxTestSetupSSE setup;
 	setup.Init(mViewMatrix[idx], mProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccludeeSizeThreshold);
 
-	__m128 xformedPos[AABB_VERTICES];
-	__m128 cumulativeMatrix[4];
+	UINT numCullNodes = mNumCullNodes[idx];
+	BinCullNodes(numCullNodes * taskId / mNumDepthTestTasks, numCullNodes * (taskId + 1) / mNumDepthTestTasks, setup, idx);
+
+	QueryPerformanceCounter(&mStopTime[idx][taskId]);
+}
+
+void AABBoxRasterizerSSEMT::BinAABBox(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	pPerTaskData->pAABB->BinAABBox(taskId, pPerTaskData->idx);
+}
 
-	static const UINT kChunkSize = 64;
-	for(UINT base = taskId*kChunkSize; base < mNumModels; base += mNumDepthTestTasks * kChunkSize)
+//--------------------------------------------------------------------------------
+// Counting sort of the binned cull nodes by bucket and then by screen tile. One
+// pass over the cull nodes is cheap next to the depth tests it localizes
+//--------------------------------------------------------------------------------
+void AABBoxRasterizerSSEMT::SortAABBox(UINT idx)
+{
+	UINT *pStart = mTileStart[idx];
+	memset(pStart, 0, sizeof(mTileStart[idx]));
+
+	const CullNode *pCullNodes = mpCullNodes[idx];
+	UINT numCullNodes = mNumCullNodes[idx];
+	for(UINT k = 0; k < numCullNodes; k++)
 	{
-		UINT end = min(base + kChunkSize, mNumModels);
-		if(mEnableFCulling)
+		pStart[pCullNodes[k].mBucket * NUM_TILES + pCullNodes[k].mTile + 1]++;
+	}
+	for(UINT key = 0; key < NUM_OCCLUDEE_BUCKETS * NUM_TILES; key++)
+	{
+		pStart[key + 1] += pStart[key];
+	}
+
+	UINT offset[NUM_OCCLUDEE_BUCKETS * NUM_TILES];
+	memcpy(offset, pStart, sizeof(offset));
+	for(UINT k = 0; k < numCullNodes; k++)
+	{
+		mpSortedCullNodes[idx][offset[pCullNodes[k].mBucket * NUM_TILES + pCullNodes[k].mTile]++] = k;
+	}
+}
+
+void AABBoxRasterizerSSEMT::SortAABBox(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	pPerTaskData->pAABB->SortAABBox(pPerTaskData->idx);
+}
+
+//--------------------------------------------------------------------------------
+// Split the occludee proxies evenly between the transform tasks
+//--------------------------------------------------------------------------------
+void AABBoxRasterizerSSEMT::TransformProxies(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	UINT numProxies = pPerTaskData->pAABB->mNumProxies[pPerTaskData->idx];
+	UINT start = numProxies * taskId / taskCount;
+	UINT end = numProxies * (taskId + 1) / taskCount;
+	pPerTaskData->pAABB->AABBoxRasterizerSSE::TransformProxies(start, end, pPerTaskData->idx);
+}
+
+void AABBoxRasterizerSSEMT::RasterizeProxies(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	pPerTaskData->pAABB->AABBoxRasterizerSSE::RasterizeProxies(pPerTaskData->band * TILES_PER_BAND + taskId, pPerTaskData->idx);
+}
+
+//--------------------------------------------------------------------------------
+// For each cull node of the bucket in the task's batch (in the task's tile with
+// tile binned depth tests)
+// * Depth test the bounds transformed during binning, a hidden node culls its
+//   whole subtree
+// * Otherwise depth test the bounds of its children down to the leaves and then
+//   size test, transform and depth test the occludees of the leaves in view
+// The task counts the tests and culled occludees in its own counter block
+//--------------------------------------------------------------------------------
+void AABBoxRasterizerSSEMT::DepthTestBucket(UINT taskId, UINT bucket, UINT idx)
+{
+	if(taskId == 0)
+	{
+		QueryPerformanceCounter(&mBucketStartTime[idx][bucket]);
+	}
+
+	BoxTestSetupSSE setup;
+	setup.Init(mViewMatrix[idx], mProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccludeeSizeThreshold);
+	float3 cameraPos = mpCamera[idx]->GetPosition();
+
+	OccludeeCounters counters = {0};
+	if(mTileBinnedDepthTest)
+	{
+		UINT firstBand, lastBand;
+		GetBucketBands(bucket, firstBand, lastBand);
+
+		UINT key = bucket * NUM_TILES + firstBand * TILES_PER_BAND + taskId;
+		for(UINT k = mTileStart[idx][key]; k < mTileStart[idx][key + 1]; k++)
 		{
-			CalcInsideFrustum(&mpCamera[idx]->mFrustum , base, end, idx);
+			DepthTestCullNode(mpSortedCullNodes[idx][k], bucket, setup, cameraPos, idx, counters);
 		}
-		for(UINT i = base; i < end; i++)
+		GetOccludeeCounters(bucket, taskId, idx) = counters;
+		return;
+	}
+
+	for(UINT k = taskId; k < mNumCullNodes[idx]; k += mNumDepthTestTasks)
+	{
+		if(mpCullNodes[idx][k].mBucket == bucket)
 		{
-			mpVisible[idx][i] = false;
-
-			if(mpInsideFrustum[idx][i] && !mpTransformedAABBox[i].IsTooSmall(setup, cumulativeMatrix))
-			{
-				if(mpTransformedAABBox[i].TransformAABBox(xformedPos, cumulativeMatrix))
-				{
-					mpVisible[idx][i] = mpTransformedAABBox[i].RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], xformedPos, idx);
-				}
-				else
-				{
-					mpVisible[idx][i] = true;
-				}
-			}
+			DepthTestCullNode(k, bucket, setup, cameraPos, idx, counters);
 		}
 	}
-	QueryPerformanceCounter(&mStopTime[idx][taskId]);
+	GetOccludeeCounters(bucket, taskId, idx) = counters;
 }
 
-void AABBoxRasterizerSSEMT::TransformAABBoxAndDepthTest(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+void AABBoxRasterizerSSEMT::DepthTestBucket(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
-	pPerTaskData->pAABB->TransformAABBoxAndDepthTest(taskId, taskCount, pPerTaskData->idx);
-}
\ No newline at end of file
+	pPerTaskData->pAABB->DepthTestBucket(taskId, pPerTaskData->bucket, pPerTaskData->idx);
+}
+
+void AABBoxRasterizerSSEMT::DepthTestDone(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	QueryPerformanceCounter(&pPerTaskData->pAABB->mTestStopTime[pPerTaskData->idx]);
+}
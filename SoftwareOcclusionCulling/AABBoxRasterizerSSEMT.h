@@ -29,17 +29,35 @@ class AABBoxRasterizerSSEMT : public AABBoxRasterizerSSE
 		struct PerTaskData
 		{
 			UINT idx;
+			UINT bucket;
+			UINT band;
 			AABBoxRasterizerSSEMT *pAABB; 
 		};
 
-		PerTaskData mTaskData[2];
+		PerTaskData mTaskData[MAX_SLOTS];
+		PerTaskData mBucketData[MAX_SLOTS][NUM_OCCLUDEE_BUCKETS];
+		PerTaskData mProxyBandData[MAX_SLOTS][NUM_RASTER_BANDS];
 		void TransformAABBoxAndDepthTest(CPUTCamera *pCamera, UINT idx);
 		void WaitForTaskToFinish(UINT idx);
 		void ReleaseTaskHandles(UINT idx);
 
 	private:
-		static void TransformAABBoxAndDepthTest(VOID* pTaskData, INT context, UINT taskId, UINT taskCount);
-		void TransformAABBoxAndDepthTest(UINT taskId, UINT taskCount, UINT idx);
+		static void BinAABBox(VOID* pTaskData, INT context, UINT taskId, UINT taskCount);
+		void BinAABBox(UINT taskId, UINT idx);
+
+		static void SortAABBox(VOID* pTaskData, INT context, UINT taskId, UINT taskCount);
+		void SortAABBox(UINT idx);
+
+		static void TransformProxies(VOID* pTaskData, INT context, UINT taskId, UINT taskCount);
+		static void RasterizeProxies(VOID* pTaskData, INT context, UINT taskId, UINT taskCount);
+
+		static void DepthTestBucket(VOID* pTaskData, INT context, UINT taskId, UINT taskCount);
+		void DepthTestBucket(UINT taskId, UINT bucket, UINT idx);
+
+		static void DepthTestDone(VOID* pTaskData, INT context, UINT taskId, UINT taskCount);
+
+		LARGE_INTEGER mBucketStartTime[MAX_SLOTS][NUM_OCCLUDEE_BUCKETS];
+		LARGE_INTEGER mTestStopTime[MAX_SLOTS];
 };
 
 #endif //AABBOXRASTERIZERSSEMT_H
\ No newline at end of file
@@ -29,9 +29,11 @@ AABBoxRasterizerSSEST::~AABBoxRasterizerSSEST()
 }
 
 //------------------------------------------------------------------------------
-// For each occludee model
-// * Determine if the occludee model AABox is within the viewing frustum 
-// * Transform the AABBox to screen space
+// * Rasterize the occludee proxies into the depth buffer
+// * Walk the occludee BVH against the viewing frustum to find the cull nodes
+// * Depth test the cull node bounds top down, hidden nodes cull their subtrees
+// * Size test and transform the world space AABBoxes of the leaves in view to
+//   screen space, 4 at a time
 // * Rasterize the triangles that make up the AABBox
 // * Depth test the raterized triangles against the CPU rasterized depth buffer
 //-----------------------------------------------------------------------------
@@ -39,34 +41,36 @@ void AABBoxRasterizerSSEST::TransformAABBoxAndDepthTest(CPUTCamera *pCamera, UIN
 {
 	QueryPerformanceCounter(&mStartTime[idx][0]);
 	mpCamera[idx] = pCamera;
+	if(mpXformedBoxes[idx] == NULL)
+	{
+		AllocateSlot(idx);
+	}
 
-	if(mEnableFCulling)
+	BeginOccludeeCounters(idx);
+	CollectCullNodes(idx);
+	BeginOccludeeProxies(idx);
+	BeginVisibilityHistory(idx);
+	if(mNumProxies[idx] > 0)
 	{
-		CalcInsideFrustum(&mpCamera[idx]->mFrustum , 0, mNumModels, idx);
+		TransformProxies(0, mNumProxies[idx], idx);
+		for(UINT tileId = 0; tileId < NUM_TILES; tileId++)
+		{
+			RasterizeProxies(tileId, idx);
+		}
 	}
 
 	BoxTestSetupSSE setup;
 	setup.Init(mViewMatrix[idx], mProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccludeeSizeThreshold);
+	BinCullNodes(0, mNumCullNodes[idx], setup, idx);
 
-	__m128 xformedPos[AABB_VERTICES];
-	__m128 cumulativeMatrix[4];
-
-	for(UINT i = 0; i < mNumModels; i++)
+	// The depth tests all share bucket 0, which marks the occludees as tested
+	float3 cameraPos = mpCamera[idx]->GetPosition();
+	OccludeeCounters counters = {0};
+	for(UINT k = 0; k < mNumCullNodes[idx]; k++)
 	{
-		mpVisible[idx][i] = false;
-		
-		if(mpInsideFrustum[idx][i] && !mpTransformedAABBox[i].IsTooSmall(setup, cumulativeMatrix))
-		{
-			if(mpTransformedAABBox[i].TransformAABBox(xformedPos, cumulativeMatrix))
-			{
-				mpVisible[idx][i] = mpTransformedAABBox[i].RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], xformedPos, idx);
-			}
-			else
-			{
-				mpVisible[idx][i] = true;
-			}
-		}		
+		DepthTestCullNode(k, 0, setup, cameraPos, idx, counters);
 	}
+	GetOccludeeCounters(0, 0, idx) = counters;
 
 	QueryPerformanceCounter(&mStopTime[idx][0]);
 	mDepthTestTime[mTimeCounter++] = ((double)(mStopTime[idx][0].QuadPart - mStartTime[idx][0].QuadPart)) / ((double)glFrequency.QuadPart);
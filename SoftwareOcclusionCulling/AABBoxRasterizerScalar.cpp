@@ -16,6 +16,10 @@
 //--------------------------------------------------------------------------------------
 
 #include "AABBoxRasterizerScalar.h"
+#include "CullingScene.h"
+
+// A counter block per depth test task of every bucket and per binning task
+static const UINT NUM_OCCLUDEE_COUNTERS = (NUM_OCCLUDEE_BUCKETS + 1) * NUM_DT_TASKS;
 
 AABBoxRasterizerScalar::AABBoxRasterizerScalar()
 	: mNumModels(0),
@@ -24,17 +28,23 @@ AABBoxRasterizerScalar::AABBoxRasterizerScalar()
 	  mpNumTriangles(NULL),
 	  mOccludeeSizeThreshold(0.0f),
 	  mNumDepthTestTasks(0),
+	  mTileBinnedDepthTest(false),
 	  mTimeCounter(0),
 	  mEnableFCulling(true)
 {
-	mpCamera[0] = mpCamera[1] = NULL;
-	mpVisible[0] = mpVisible[1] = NULL;
-	mpInsideFrustum[0] = mpInsideFrustum[1] = NULL;
-
-	mpRenderTargetPixels[0] = NULL;
-	mpRenderTargetPixels[1] = NULL;
-	
-	mNumCulled[0] = mNumCulled[1] =NULL;
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpCamera[i] = NULL;
+		mpVisible[i] = NULL;
+		mpBucket[i] = NULL;
+		mpTile[i] = NULL;
+		mpSortedModels[i] = NULL;
+		mpInsideFrustum[i] = NULL;
+		mpRenderTargetPixels[i] = NULL;
+		mNumCulled[i] = 0;
+		mpOccludeeCounters[i] = NULL;
+	}
+
 	for(UINT i = 0; i < AVG_COUNTER; i++)
 	{
 		mDepthTestTime[i] = 0.0;
@@ -43,15 +53,20 @@ AABBoxRasterizerScalar::AABBoxRasterizerScalar()
 
 AABBoxRasterizerScalar::~AABBoxRasterizerScalar()
 {
-	for(UINT i = 0; i < mNumModels; i++)
+	for(UINT i = 0; mpModels && i < mNumModels; i++)
 	{
 		mpModels[i]->Release();
 	}
-	SAFE_DELETE_ARRAY(mpVisible[0]);
-	SAFE_DELETE_ARRAY(mpVisible[1]);
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		SAFE_DELETE_ARRAY(mpVisible[i]);
+		SAFE_DELETE_ARRAY(mpBucket[i]);
+		SAFE_DELETE_ARRAY(mpTile[i]);
+		SAFE_DELETE_ARRAY(mpSortedModels[i]);
+		SAFE_DELETE_ARRAY(mpInsideFrustum[i]);
+		_aligned_free(mpOccludeeCounters[i]);
+	}
 	SAFE_DELETE_ARRAY(mpTransformedAABBox);
-	SAFE_DELETE_ARRAY(mpInsideFrustum[0]);
-	SAFE_DELETE_ARRAY(mpInsideFrustum[1]);
 	SAFE_DELETE_ARRAY(mpNumTriangles);
 	SAFE_DELETE_ARRAY(mpModels);
 }
@@ -79,15 +94,9 @@ void AABBoxRasterizerScalar::CreateTransformedAABBoxes(CPUTAssetSet **pAssetSet,
 		}
 	}
 
-	mpVisible[0] = new bool[mNumModels];
-	mpVisible[1] = new bool[mNumModels];
-	mpTransformedAABBox = new TransformedAABBoxScalar[mNumModels];
+	AllocateOccludees();
 	mpModels = new CPUTModelDX11 *[mNumModels];
-	mpInsideFrustum[0] = new bool[mNumModels];
-	mpInsideFrustum[1] = new bool[mNumModels];
 
-	mpNumTriangles = new UINT[mNumModels];
-	
 	for(UINT assetId = 0, modelId = 0; assetId < numAssetSets; assetId++)
 	{
 		for(UINT nodeId = 0; nodeId < pAssetSet[assetId]->GetAssetCount(); nodeId++)
@@ -116,6 +125,67 @@ void AABBoxRasterizerScalar::CreateTransformedAABBoxes(CPUTAssetSet **pAssetSet,
 	}
 }
 
+//--------------------------------------------------------------------
+// Same for the occludees of a scene without CPUT models, the scene
+// can be culled but not rendered
+//--------------------------------------------------------------------
+void AABBoxRasterizerScalar::CreateTransformedAABBoxes(const CullingScene &scene)
+{
+	mNumModels = scene.GetNumOccludees();
+	AllocateOccludees();
+
+	for(UINT modelId = 0; modelId < mNumModels; modelId++)
+	{
+		mpTransformedAABBox[modelId].CreateOccludeeBox(scene, modelId);
+		mpNumTriangles[modelId] = scene.GetOccludeeTriangles()[modelId];
+	}
+}
+
+void AABBoxRasterizerScalar::AllocateOccludees()
+{
+	mpTransformedAABBox = new TransformedAABBoxScalar[mNumModels];
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpVisible[i] = new bool[mNumModels];
+		mpBucket[i] = new UCHAR[mNumModels];
+		mpTile[i] = new UCHAR[mNumModels];
+		mpSortedModels[i] = new UINT[mNumModels];
+		mpInsideFrustum[i] = new bool[mNumModels];
+		mpOccludeeCounters[i] = (OccludeeCounters*)_aligned_malloc(NUM_OCCLUDEE_COUNTERS * sizeof(OccludeeCounters), 64);
+		memset(mpOccludeeCounters[i], 0, NUM_OCCLUDEE_COUNTERS * sizeof(OccludeeCounters));
+	}
+
+	mpNumTriangles = new UINT[mNumModels];
+}
+
+//--------------------------------------------------------------------
+// Every task fills in its own block, the blocks of tasks a frame does
+// not run must read as zero too
+//--------------------------------------------------------------------
+void AABBoxRasterizerScalar::BeginOccludeeCounters(UINT idx)
+{
+	memset(mpOccludeeCounters[idx], 0, NUM_OCCLUDEE_COUNTERS * sizeof(OccludeeCounters));
+}
+
+//--------------------------------------------------------------------
+// The scalar box test does not track the quad rows it visits, only the
+// tests and their early outs are counted
+//--------------------------------------------------------------------
+void AABBoxRasterizerScalar::GetFrameStats(UINT idx, CullingStats *pStats)
+{
+	pStats->mNumCulled = pStats->mNumCulledTris = 0;
+	pStats->mNumBoxTests = pStats->mNumEarlyOuts = 0;
+	pStats->mNumRowsTested = pStats->mNumRowsSkipped = 0;
+	for(UINT i = 0; i < NUM_OCCLUDEE_COUNTERS; i++)
+	{
+		const OccludeeCounters &counters = mpOccludeeCounters[idx][i];
+		pStats->mNumCulled += counters.mNumCulled;
+		pStats->mNumCulledTris += counters.mNumCulledTris;
+		pStats->mNumBoxTests += counters.mNumBoxTests;
+		pStats->mNumEarlyOuts += counters.mNumEarlyOuts;
+	}
+}
+
 void AABBoxRasterizerScalar::SetViewProjMatrix(float4x4 *viewMatrix, float4x4 *projMatrix, UINT idx)
 {
 	mViewMatrix[idx] = *viewMatrix;
@@ -144,6 +214,45 @@ void AABBoxRasterizerScalar::RenderVisible(CPUTAssetSet **pAssetSet,
 	mNumCulled[idx] =  mNumModels - count;
 }
 
+//------------------------------------------------------------------------
+// Add the bounds of the models that are visible in view slot idx to the
+// light space receiver mask
+//------------------------------------------------------------------------
+void AABBoxRasterizerScalar::AddShadowReceivers(ShadowReceiverMask *pReceiverMask, UINT idx)
+{
+	float3 center, half;
+	for(UINT modelId = 0; modelId < mNumModels; modelId++)
+	{
+		if(mpVisible[idx][modelId])
+		{
+			mpModels[modelId]->GetBoundsWorldSpace(&center, &half);
+			pReceiverMask->AddReceiver(center, half);
+		}
+	}
+}
+
+//------------------------------------------------------------------------
+// Render the shadows of the models that are visible from the light in 
+// view slot idx and whose shadow volume reaches a visible receiver
+//------------------------------------------------------------------------
+void AABBoxRasterizerScalar::RenderShadowCasters(CPUTRenderParametersDX &renderParams,
+												 ShadowReceiverMask *pReceiverMask,
+												 UINT idx)
+{
+	float3 center, half;
+	for(UINT modelId = 0; modelId < mNumModels; modelId++)
+	{
+		if(mpVisible[idx][modelId])
+		{
+			mpModels[modelId]->GetBoundsWorldSpace(&center, &half);
+			if(pReceiverMask->ReachesReceiver(center, half))
+			{
+				mpModels[modelId]->RenderShadow(renderParams);
+			}
+		}
+	}
+}
+
 
 //------------------------------------------------------------------------
 // Go through the list of models in the asset set and render only those 
@@ -27,6 +27,7 @@ class AABBoxRasterizerScalar : public AABBoxRasterizer
 		AABBoxRasterizerScalar();
 		virtual ~AABBoxRasterizerScalar();
 		void CreateTransformedAABBoxes(CPUTAssetSet **pAssetSet, UINT numAssetSets);
+		void CreateTransformedAABBoxes(const CullingScene &scene);
 		
 		void RenderVisible(CPUTAssetSet **pAssetSet,
 						   CPUTRenderParametersDX &renderParams,
@@ -38,12 +39,20 @@ class AABBoxRasterizerScalar : public AABBoxRasterizer
 					UINT numAssetSets,
 					UINT idx);
 
+		void AddShadowReceivers(ShadowReceiverMask *pReceiverMask, UINT idx);
+
+		void RenderShadowCasters(CPUTRenderParametersDX &renderParams,
+								 ShadowReceiverMask *pReceiverMask,
+								 UINT idx);
+
 		inline void ResetInsideFrustum()
 		{
 			for(UINT i = 0; i < mNumModels; i++)
 			{
-				mpInsideFrustum[0][i] = true;
-				mpInsideFrustum[1][i] = true;
+				for(UINT idx = 0; idx < MAX_SLOTS; idx++)
+				{
+					mpInsideFrustum[idx][i] = true;
+				}
 			}
 		}
 
@@ -53,12 +62,22 @@ class AABBoxRasterizerScalar : public AABBoxRasterizer
 			mpRenderTargetPixels[idx] = pRenderTargetPixels;
 		}
 		inline void SetDepthTestTasks(UINT numTasks){mNumDepthTestTasks = numTasks;}
+		inline void SetTileBinnedDepthTest(bool tileBinned){mTileBinnedDepthTest = tileBinned;}
 		inline void SetOccludeeSizeThreshold(float occludeeSizeThreshold){mOccludeeSizeThreshold = occludeeSizeThreshold;}
+
+		// Occludee proxies and the temporal cache are only implemented by the SSE rasterizer
+		inline void SetOccludeeProxies(bool occludeeProxies) {}
+		inline void UpdateOccludeeProxies(UINT idx) {}
+		inline void SetTemporalCache(bool temporalCache) {}
+		inline void UpdateVisibilityHistory(UINT idx) {}
+
 		inline void SetCamera(CPUTCamera *pCamera, UINT idx) {mpCamera[idx] = pCamera;}	
 		inline void SetEnableFCulling(bool enableFCulling) {mEnableFCulling = enableFCulling;}
 
 		inline UINT GetNumOccludees() {return mNumModels;}
 		inline UINT GetNumCulled(UINT idx) {return mNumCulled[idx];}
+		inline bool IsVisible(UINT modelId, UINT idx) {return mpVisible[idx][modelId];}
+		inline UINT GetLoadOrderId(UINT modelId) {return modelId;}
 		inline double GetDepthTestTime()
 		{
 			double averageTime = 0.0;
@@ -68,6 +87,10 @@ class AABBoxRasterizerScalar : public AABBoxRasterizer
 			}
 			return averageTime / AVG_COUNTER;
 		}
+		inline double GetLastDepthTestTime()
+		{
+			return mDepthTestTime[(mTimeCounter + AVG_COUNTER - 1) % AVG_COUNTER];
+		}
 
 		inline UINT GetNumTriangles()
 		{
@@ -79,15 +102,8 @@ class AABBoxRasterizerScalar : public AABBoxRasterizer
 			return numTris;
 		}
 
-		inline UINT GetNumCulledTriangles(UINT idx)
-		{
-			UINT numCulledTris = 0;
-			for(UINT i = 0; i < mNumModels; i++)
-			{
-				numCulledTris += mpVisible[idx][i] ? 0 : mpNumTriangles[i];
-			}
-			return numCulledTris;
-		}
+		// Sums up the counter blocks the binning and depth test tasks of the slot filled in
+		void GetFrameStats(UINT idx, CullingStats *pStats);
 		
 		inline UINT GetNumTrisRendered()
 		{
@@ -100,20 +116,51 @@ class AABBoxRasterizerScalar : public AABBoxRasterizer
 		}
 
 	protected:
+		// Occludee data for mNumModels occludees
+		void AllocateOccludees();
+		// Clear the counter blocks of the frame culled in slot idx
+		void BeginOccludeeCounters(UINT idx);
+		// Counter block of a depth test task of a bucket, the binning tasks use the
+		// blocks of bucket NUM_OCCLUDEE_BUCKETS
+		inline OccludeeCounters &GetOccludeeCounters(UINT bucket, UINT taskId, UINT idx)
+		{
+			assert(bucket <= NUM_OCCLUDEE_BUCKETS && taskId < NUM_DT_TASKS);
+			return mpOccludeeCounters[idx][bucket * NUM_DT_TASKS + taskId];
+		}
+		// A box test of occludee i just decided mpVisible[idx][i], a visible pixel ends it early
+		inline void CountDepthTest(OccludeeCounters &counters, UINT i, UINT idx)
+		{
+			counters.mNumBoxTests++;
+			if(mpVisible[idx][i])
+			{
+				counters.mNumEarlyOuts++;
+			}
+			else
+			{
+				counters.AddCulled(mpNumTriangles[i]);
+			}
+		}
+
 		UINT mNumModels;
 		TransformedAABBoxScalar *mpTransformedAABBox;
 		CPUTModelDX11 **mpModels;
-		bool *mpInsideFrustum[2];
+		bool *mpInsideFrustum[MAX_SLOTS];
 		UINT *mpNumTriangles;
-		float4x4 mViewMatrix[2];
-		float4x4 mProjMatrix[2];
-		UINT *mpRenderTargetPixels[2];
-		CPUTCamera *mpCamera[2];
-		bool *mpVisible[2];
-		UINT mNumCulled[2];
+		float4x4 mViewMatrix[MAX_SLOTS];
+		float4x4 mProjMatrix[MAX_SLOTS];
+		UINT *mpRenderTargetPixels[MAX_SLOTS];
+		CPUTCamera *mpCamera[MAX_SLOTS];
+		bool *mpVisible[MAX_SLOTS];
+		UCHAR *mpBucket[MAX_SLOTS];		// depth test bucket, NO_OCCLUDEE_BUCKET if decided without one
+		UCHAR *mpTile[MAX_SLOTS];		// screen tile of the occludee's center
+		UINT *mpSortedModels[MAX_SLOTS];	// occludees sorted by bucket and tile
+		UINT mTileStart[MAX_SLOTS][NUM_OCCLUDEE_BUCKETS * NUM_TILES + 1];
+		UINT mNumCulled[MAX_SLOTS];
+		OccludeeCounters *mpOccludeeCounters[MAX_SLOTS];	// (NUM_OCCLUDEE_BUCKETS + 1) * NUM_DT_TASKS per slot
 		UINT mNumTrisRendered;
 		UINT mNumFCullCount;
 		UINT mNumDepthTestTasks;
+		bool mTileBinnedDepthTest;
 		float mOccludeeSizeThreshold;
 		UINT mTimeCounter;
 
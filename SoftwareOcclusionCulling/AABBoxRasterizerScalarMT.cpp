@@ -20,6 +20,7 @@
 AABBoxRasterizerScalarMT::AABBoxRasterizerScalarMT()
 	: AABBoxRasterizerScalar()
 {
+	
 }
 
 AABBoxRasterizerScalarMT::~AABBoxRasterizerScalarMT()
@@ -28,17 +29,52 @@ AABBoxRasterizerScalarMT::~AABBoxRasterizerScalarMT()
 }
 
 //-------------------------------------------------------------------------------
-// Create mNumDepthTestTasks to tarnsform occludee AABBox, rasterize and depth test 
-// to determine if occludee is visible or occluded
+// Create mNumDepthTestTasks to transform the occludee AABBox and bin it by the 
+// raster bands it overlaps. For every bucket create mNumDepthTestTasks to rasterize
+// and depth test its occludees; they only wait for the bucket's raster bands so 
+// the tail of the occluder rasterization overlaps with the depth tests.
+// With tile binned depth tests the occludees are sorted by screen tile first and
+// every bucket gets one task per tile of its bands, so a task keeps re-reading
+// the same part of the depth buffer instead of the whole of it
 //-------------------------------------------------------------------------------
 void AABBoxRasterizerScalarMT::TransformAABBoxAndDepthTest(CPUTCamera *pCamera, UINT idx)
 {
 	mTaskData[idx].idx = idx;
+	mTaskData[idx].bucket = NO_OCCLUDEE_BUCKET;
 	mTaskData[idx].pAABB = this;
 
 	mpCamera[idx] = pCamera;
-	
-	gTaskMgr.CreateTaskSet(&AABBoxRasterizerScalarMT::TransformAABBoxAndDepthTest, &mTaskData[idx], mNumDepthTestTasks, &gRasterize[idx], 1, "Xform Vertices", &gAABBoxDepthTest[idx]);
+	BeginOccludeeCounters(idx);
+
+	// Binning only needs the camera so it runs alongside the occluder tasks
+	gTaskMgr.CreateTaskSet(&AABBoxRasterizerScalarMT::BinAABBox, &mTaskData[idx], mNumDepthTestTasks, NULL, 0, "Bin AABBox", &gAABBoxBin[idx]);
+	if(mTileBinnedDepthTest)
+	{
+		gTaskMgr.CreateTaskSet(&AABBoxRasterizerScalarMT::SortAABBox, &mTaskData[idx], 1, &gAABBoxBin[idx], 1, "Sort AABBox", &gAABBoxSort[idx]);
+	}
+
+	for(UINT bucket = 0; bucket < NUM_OCCLUDEE_BUCKETS; bucket++)
+	{
+		mBucketData[idx][bucket] = mTaskData[idx];
+		mBucketData[idx][bucket].bucket = bucket;
+
+		UINT firstBand, lastBand;
+		GetBucketBands(bucket, firstBand, lastBand);
+
+		TASKSETHANDLE depends[NUM_RASTER_BANDS + 1];
+		UINT numDepends = 0;
+		depends[numDepends++] = mTileBinnedDepthTest ? gAABBoxSort[idx] : gAABBoxBin[idx];
+		for(UINT band = firstBand; band <= lastBand; band++)
+		{
+			depends[numDepends++] = gRasterize[idx][band];
+		}
+
+		// The center of a bucket's occludees always lies in one of the bucket's bands
+		UINT numTasks = mTileBinnedDepthTest ? (lastBand - firstBand + 1) * TILES_PER_BAND : mNumDepthTestTasks;
+		gTaskMgr.CreateTaskSet(&AABBoxRasterizerScalarMT::DepthTestBucket, &mBucketData[idx][bucket], numTasks, depends, numDepends, "Depth Test AABBox", &gAABBoxBucketTest[idx][bucket]);
+	}
+
+	gTaskMgr.CreateTaskSet(&AABBoxRasterizerScalarMT::DepthTestDone, &mTaskData[idx], 1, gAABBoxBucketTest[idx], NUM_OCCLUDEE_BUCKETS, "Depth Test Done", &gAABBoxDepthTest[idx]);
 }
 
 void AABBoxRasterizerScalarMT::WaitForTaskToFinish(UINT idx)
@@ -50,24 +86,58 @@ void AABBoxRasterizerScalarMT::WaitForTaskToFinish(UINT idx)
 void AABBoxRasterizerScalarMT::ReleaseTaskHandles(UINT idx)
 {
 	// Release the task set
-	if(mEnableFCulling)
-	{
-		gTaskMgr.ReleaseHandle(gInsideViewFrustum[idx]);
-	}
-	else
+	// When several views are culled together only the first view's slot
+	// holds the shared visibility and activation task sets
+	if(gActiveModels[idx] != TASKSETHANDLE_INVALID)
 	{
-		gTaskMgr.ReleaseHandle(gTooSmall[idx]);
+		if(mEnableFCulling)
+		{
+			gTaskMgr.ReleaseHandle(gInsideViewFrustum[idx]);
+		}
+		else
+		{
+			gTaskMgr.ReleaseHandle(gTooSmall[idx]);
+		}
+		gTaskMgr.ReleaseHandle(gActiveModels[idx]);
+		if(gSplitNearFar[idx] != TASKSETHANDLE_INVALID)
+		{
+			gTaskMgr.ReleaseHandle(gSplitNearFar[idx]);
+		}
 	}
-	gTaskMgr.ReleaseHandle(gActiveModels[idx]);
 	gTaskMgr.ReleaseHandle(gXformMesh[idx]);
 	gTaskMgr.ReleaseHandle(gBinMesh[idx]);
 	gTaskMgr.ReleaseHandle(gSortBins[idx]);
-	gTaskMgr.ReleaseHandle(gRasterize[idx]);
+	gTaskMgr.ReleaseHandles(gRasterize[idx], NUM_RASTER_BANDS);
+	if(gActiveFarModels[idx] != TASKSETHANDLE_INVALID)
+	{
+		gTaskMgr.ReleaseHandle(gXformMeshNear[idx]);
+		gTaskMgr.ReleaseHandle(gBinMeshNear[idx]);
+		gTaskMgr.ReleaseHandle(gSortBinsNear[idx]);
+		gTaskMgr.ReleaseHandles(gRasterizeNear[idx], NUM_RASTER_BANDS);
+		gTaskMgr.ReleaseHandle(gCullFarOccluders[idx]);
+		gTaskMgr.ReleaseHandle(gActiveFarModels[idx]);
+	}
+	gTaskMgr.ReleaseHandle(gAABBoxBin[idx]);
+	if(gAABBoxSort[idx] != TASKSETHANDLE_INVALID)
+	{
+		gTaskMgr.ReleaseHandle(gAABBoxSort[idx]);
+	}
+	gTaskMgr.ReleaseHandles(gAABBoxBucketTest[idx], NUM_OCCLUDEE_BUCKETS);
 	gTaskMgr.ReleaseHandle(gAABBoxDepthTest[idx]);
 
-	gInsideViewFrustum[idx] = gTooSmall[idx] = gActiveModels[idx] = gXformMesh[idx] = gBinMesh[idx] = gSortBins[idx] = gRasterize[idx] = TASKSETHANDLE_INVALID;
-	gAABBoxDepthTest[idx] = TASKSETHANDLE_INVALID;
-
+	gInsideViewFrustum[idx] = gTooSmall[idx] = gActiveModels[idx] = gSplitNearFar[idx] = gXformMesh[idx] = gBinMesh[idx] = gSortBins[idx] = TASKSETHANDLE_INVALID;
+	gXformMeshNear[idx] = gBinMeshNear[idx] = gSortBinsNear[idx] = gCullFarOccluders[idx] = gActiveFarModels[idx] = TASKSETHANDLE_INVALID;
+	gAABBoxBin[idx] = gAABBoxSort[idx] = gAABBoxDepthTest[idx] = TASKSETHANDLE_INVALID;
+	for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+	{
+		gRasterize[idx][band] = gRasterizeNear[idx][band] = TASKSETHANDLE_INVALID;
+	}
+	for(UINT bucket = 0; bucket < NUM_OCCLUDEE_BUCKETS; bucket++)
+	{
+		gAABBoxBucketTest[idx][bucket] = TASKSETHANDLE_INVALID;
+	}
+	
+	// Time spent binning plus the time from the first bucket depth test to the last one
 	LARGE_INTEGER startTime = mStartTime[idx][0];
 	LARGE_INTEGER stopTime = mStopTime[idx][0];
 	for(UINT i = 0; i < mNumDepthTestTasks; i++)
@@ -75,26 +145,33 @@ void AABBoxRasterizerScalarMT::ReleaseTaskHandles(UINT idx)
 		startTime = startTime.QuadPart > mStartTime[idx][i].QuadPart ? mStartTime[idx][i] : startTime;
 		stopTime = stopTime.QuadPart < mStopTime[idx][i].QuadPart? mStopTime[idx][i] : stopTime;
 	}
-	mDepthTestTime[mTimeCounter++] = ((double)(stopTime.QuadPart - startTime.QuadPart)) / ((double)glFrequency.QuadPart);
-	mTimeCounter = mTimeCounter >= AVG_COUNTER ? 0 : mTimeCounter;
+	LARGE_INTEGER testStartTime = mBucketStartTime[idx][0];
+	for(UINT bucket = 0; bucket < NUM_OCCLUDEE_BUCKETS; bucket++)
+	{
+		testStartTime = testStartTime.QuadPart > mBucketStartTime[idx][bucket].QuadPart ? mBucketStartTime[idx][bucket] : testStartTime;
+	}
+	LONGLONG ticks = (stopTime.QuadPart - startTime.QuadPart) + (mTestStopTime[idx].QuadPart - testStartTime.QuadPart);
+	mDepthTestTime[mTimeCounter++] = ((double)ticks) / ((double)glFrequency.QuadPart);
+	mTimeCounter = mTimeCounter >= AVG_COUNTER ? 0 : mTimeCounter; 
 }
 
 //--------------------------------------------------------------------------------
 // Determine the batch of occludee models each task should work on
 // For each occludee model in the batch
 // * Transform the AABBox to screen space
-// * Rasterize the triangles that make up the AABBox
-// * Depth test the raterized triangles against the CPU rasterized depth buffer
+// * Find the bucket of raster bands the AABBox overlaps and the tile of its center
+// The task counts the occludees outside the frustum or too small in its own block
 //--------------------------------------------------------------------------------
-void AABBoxRasterizerScalarMT::TransformAABBoxAndDepthTest(UINT taskId, UINT idx)
+void AABBoxRasterizerScalarMT::BinAABBox(UINT taskId, UINT idx)
 {
 	QueryPerformanceCounter(&mStartTime[idx][taskId]);
-	
+
 	BoxTestSetupScalar setup;
 	setup.Init(mViewMatrix[idx], mProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccludeeSizeThreshold);
 
 	float4 xformedPos[AABB_VERTICES];
 	float4x4 cumulativeMatrix;
+	OccludeeCounters counters = {0};
 
 	static const UINT kChunkSize = 64;
 	for(UINT base = taskId*kChunkSize; base < mNumModels; base += mNumDepthTestTasks * kChunkSize)
@@ -108,28 +185,153 @@ void AABBoxRasterizerScalarMT::TransformAABBoxAndDepthTest(UINT taskId, UINT idx
 				mpInsideFrustum[idx][i] = mpTransformedAABBox[i].IsInsideViewFrustum(mpCamera[idx]);
 			}
 			mpVisible[idx][i] = false;
-			
+			mpBucket[idx][i] = NO_OCCLUDEE_BUCKET;
+
 			if(mpInsideFrustum[idx][i] && !mpTransformedAABBox[i].IsTooSmall(setup, cumulativeMatrix))
 			{
 				if(mpTransformedAABBox[i].TransformAABBox(xformedPos, cumulativeMatrix))
 				{
-					mpVisible[idx][i] = mpTransformedAABBox[i].RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], xformedPos, idx);
+					float minX = xformedPos[0].x;
+					float maxX = minX;
+					float minY = xformedPos[0].y;
+					float maxY = minY;
+					for(UINT v = 1; v < AABB_VERTICES; v++)
+					{
+						minX = min(minX, xformedPos[v].x);
+						maxX = max(maxX, xformedPos[v].x);
+						minY = min(minY, xformedPos[v].y);
+						maxY = max(maxY, xformedPos[v].y);
+					}
+					mpBucket[idx][i] = (UCHAR)GetOccludeeBucket(minY, maxY);
+					mpTile[idx][i] = (UCHAR)GetOccludeeTile(0.5f * (minX + maxX), 0.5f * (minY + maxY));
 				}
 				else
 				{
 					mpVisible[idx][i] = true;
 				}
 			}
+			else
+			{
+				counters.AddCulled(mpNumTriangles[i]);
+			}
 		}
 	}
+	GetOccludeeCounters(NUM_OCCLUDEE_BUCKETS, taskId, idx) = counters;
 	QueryPerformanceCounter(&mStopTime[idx][taskId]);
 }
 
-void AABBoxRasterizerScalarMT::TransformAABBoxAndDepthTest(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+void AABBoxRasterizerScalarMT::BinAABBox(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	pPerTaskData->pAABB->BinAABBox(taskId, pPerTaskData->idx);
+}
+
+//--------------------------------------------------------------------------------
+// Counting sort of the binned occludees by bucket and then by screen tile. One
+// pass over the occludees is cheap next to the depth tests it localizes
+//--------------------------------------------------------------------------------
+void AABBoxRasterizerScalarMT::SortAABBox(UINT idx)
+{
+	UINT *pStart = mTileStart[idx];
+	memset(pStart, 0, sizeof(mTileStart[idx]));
+
+	for(UINT i = 0; i < mNumModels; i++)
+	{
+		if(mpBucket[idx][i] != NO_OCCLUDEE_BUCKET)
+		{
+			pStart[mpBucket[idx][i] * NUM_TILES + mpTile[idx][i] + 1]++;
+		}
+	}
+	for(UINT key = 0; key < NUM_OCCLUDEE_BUCKETS * NUM_TILES; key++)
+	{
+		pStart[key + 1] += pStart[key];
+	}
+
+	UINT offset[NUM_OCCLUDEE_BUCKETS * NUM_TILES];
+	memcpy(offset, pStart, sizeof(offset));
+	for(UINT i = 0; i < mNumModels; i++)
+	{
+		if(mpBucket[idx][i] != NO_OCCLUDEE_BUCKET)
+		{
+			mpSortedModels[idx][offset[mpBucket[idx][i] * NUM_TILES + mpTile[idx][i]]++] = i;
+		}
+	}
+}
+
+void AABBoxRasterizerScalarMT::SortAABBox(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
-	pPerTaskData->pAABB->TransformAABBoxAndDepthTest(taskId, pPerTaskData->idx);
+	pPerTaskData->pAABB->SortAABBox(pPerTaskData->idx);
 }
 
+//--------------------------------------------------------------------------------
+// For each occludee model of the bucket in the task's batch (in the task's tile
+// with tile binned depth tests)
+// * Transform the AABBox to screen space
+// * Rasterize the triangles that make up the AABBox
+// * Depth test the raterized triangles against the CPU rasterized depth buffer
+// The task counts the tests and culled occludees in its own counter block
+//--------------------------------------------------------------------------------
+void AABBoxRasterizerScalarMT::DepthTestBucket(UINT taskId, UINT bucket, UINT idx)
+{
+	if(taskId == 0)
+	{
+		QueryPerformanceCounter(&mBucketStartTime[idx][bucket]);
+	}
+
+	BoxTestSetupScalar setup;
+	setup.Init(mViewMatrix[idx], mProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccludeeSizeThreshold);
+
+	float4 xformedPos[AABB_VERTICES];
+	float4x4 cumulativeMatrix;
+	OccludeeCounters counters = {0};
+
+	// Binning already passed the size and near clip tests, the tests below only
+	// recompute the cumulative matrix and the transformed box
+	if(mTileBinnedDepthTest)
+	{
+		UINT firstBand, lastBand;
+		GetBucketBands(bucket, firstBand, lastBand);
 
+		UINT key = bucket * NUM_TILES + firstBand * TILES_PER_BAND + taskId;
+		for(UINT k = mTileStart[idx][key]; k < mTileStart[idx][key + 1]; k++)
+		{
+			UINT i = mpSortedModels[idx][k];
+			mpTransformedAABBox[i].IsTooSmall(setup, cumulativeMatrix);
+			mpTransformedAABBox[i].TransformAABBox(xformedPos, cumulativeMatrix);
+			mpVisible[idx][i] = mpTransformedAABBox[i].RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], xformedPos, idx);
+			CountDepthTest(counters, i, idx);
+		}
+		GetOccludeeCounters(bucket, taskId, idx) = counters;
+		return;
+	}
 
+	static const UINT kChunkSize = 64;
+	for(UINT base = taskId*kChunkSize; base < mNumModels; base += mNumDepthTestTasks * kChunkSize)
+	{
+		UINT end = min(base + kChunkSize, mNumModels);
+		for(UINT i = base; i < end; i++)
+		{
+			if(mpBucket[idx][i] == bucket)
+			{
+				mpTransformedAABBox[i].IsTooSmall(setup, cumulativeMatrix);
+				mpTransformedAABBox[i].TransformAABBox(xformedPos, cumulativeMatrix);
+				mpVisible[idx][i] = mpTransformedAABBox[i].RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], xformedPos, idx);
+				CountDepthTest(counters, i, idx);
+			}
+		}
+	}
+	GetOccludeeCounters(bucket, taskId, idx) = counters;
+}
+
+void AABBoxRasterizerScalarMT::DepthTestBucket(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	pPerTaskData->pAABB->DepthTestBucket(taskId, pPerTaskData->bucket, pPerTaskData->idx);
+}
+
+void AABBoxRasterizerScalarMT::DepthTestDone(VOID* pTaskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pPerTaskData = (PerTaskData*)pTaskData;
+	QueryPerformanceCounter(&pPerTaskData->pAABB->mTestStopTime[pPerTaskData->idx]);
+}
@@ -40,6 +40,7 @@ void AABBoxRasterizerScalarST::TransformAABBoxAndDepthTest(CPUTCamera *pCamera,
 	QueryPerformanceCounter(&mStartTime[idx][0]);
 
 	mpCamera[idx] = pCamera;
+	BeginOccludeeCounters(idx);
 	if(mEnableFCulling)
 	{
 		for(UINT i = 0; i < mNumModels; i++)
@@ -53,6 +54,7 @@ void AABBoxRasterizerScalarST::TransformAABBoxAndDepthTest(CPUTCamera *pCamera,
 
 	float4 xformedPos[AABB_VERTICES];
 	float4x4 cumulativeMatrix;
+	OccludeeCounters counters = {0};
 
 	for(UINT i = 0; i < mNumModels; i++)
 	{
@@ -63,13 +65,19 @@ void AABBoxRasterizerScalarST::TransformAABBoxAndDepthTest(CPUTCamera *pCamera,
 			if(mpTransformedAABBox[i].TransformAABBox(xformedPos, cumulativeMatrix))
 			{
 				mpVisible[idx][i] = mpTransformedAABBox[i].RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], xformedPos, idx);
+				CountDepthTest(counters, i, idx);
 			}
 			else
 			{
 				mpVisible[idx][i] = true;
 			}
-		}		
+		}
+		else
+		{
+			counters.AddCulled(mpNumTriangles[i]);
+		}
 	}
+	GetOccludeeCounters(0, 0, idx) = counters;
 
 	QueryPerformanceCounter(&mStopTime[idx][0]);
 	mDepthTestTime[mTimeCounter++] = ((double)(mStopTime[idx][0].QuadPart - mStartTime[idx][0].QuadPart)) / ((double)glFrequency.QuadPart);
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef AABBOXSILHOUETTE_H
+#define AABBOXSILHOUETTE_H
+
+#include "CPUT_DX11.h"
+#include "Constants.h"
+
+//-----------------------------------------------------------------------------------------
+// Find the silhouette of the projected box, the convex hull of its 8 corners, as a counter
+// clockwise polygon (at most 6 vertices). hullX/Y get the polygon closed by repeating the
+// first vertex; returns the number of edges
+//-----------------------------------------------------------------------------------------
+static inline INT64 Cross(int ox, int oy, int ax, int ay, int bx, int by)
+{
+	return (INT64)(ax - ox) * (by - oy) - (INT64)(ay - oy) * (bx - ox);
+}
+
+static UINT ComputeSilhouette(const int fxPtX[AABB_VERTICES], const int fxPtY[AABB_VERTICES], int hullX[], int hullY[])
+{
+	// Sort the corners by x and then y
+	UINT order[AABB_VERTICES];
+	for(UINT i = 0; i < AABB_VERTICES; i++)
+	{
+		UINT j = i;
+		for(; j > 0; j--)
+		{
+			UINT prev = order[j - 1];
+			if(fxPtX[prev] < fxPtX[i] || (fxPtX[prev] == fxPtX[i] && fxPtY[prev] <= fxPtY[i]))
+			{
+				break;
+			}
+			order[j] = prev;
+		}
+		order[j] = i;
+	}
+
+	// Monotone chain, lower hull left to right and then upper hull right to left
+	UINT n = 0;
+	for(int i = 0; i < AABB_VERTICES; i++)
+	{
+		int x = fxPtX[order[i]], y = fxPtY[order[i]];
+		while(n >= 2 && Cross(hullX[n - 2], hullY[n - 2], hullX[n - 1], hullY[n - 1], x, y) <= 0)
+		{
+			n--;
+		}
+		hullX[n] = x; hullY[n] = y; n++;
+	}
+	for(int i = AABB_VERTICES - 2, lower = n + 1; i >= 0; i--)
+	{
+		int x = fxPtX[order[i]], y = fxPtY[order[i]];
+		while((int)n >= lower && Cross(hullX[n - 2], hullY[n - 2], hullX[n - 1], hullY[n - 1], x, y) <= 0)
+		{
+			n--;
+		}
+		hullX[n] = x; hullY[n] = y; n++;
+	}
+	return n - 1;
+}
+
+#endif // AABBOXSILHOUETTE_H
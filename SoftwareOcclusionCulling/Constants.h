@@ -19,6 +19,7 @@
 
 #include "CPUTMath.h"
 #include "TaskMgrTBB.h"
+#include "Platform.h"
 
 enum SOC_TYPE
 {
@@ -30,16 +31,29 @@ extern SOC_TYPE gSOCType;
 extern float gOccluderSizeThreshold;
 extern float gOccludeeSizeThreshold;
 extern UINT  gDepthTestTasks;
-
-extern TASKSETHANDLE gInsideViewFrustum[2];
-extern TASKSETHANDLE gTooSmall[2];
-extern TASKSETHANDLE gActiveModels[2];
-extern TASKSETHANDLE gXformMesh[2];
-extern TASKSETHANDLE gBinMesh[2];
-extern TASKSETHANDLE gSortBins[2];
-extern TASKSETHANDLE gRasterize[2];
-extern TASKSETHANDLE gAABBoxDepthTest[2];
-
+extern UINT  gFrameSlots;
+extern bool  gCullShadowView;
+extern bool  gCullShadowCasters;
+// Render the shadow map every frame, caster culling renders it in any case
+extern bool  gShadowPass;
+extern bool  gTileBinnedDepthTest;
+extern bool  gOccluderWaves;
+extern bool  gOccludeeProxies;
+extern bool  gTemporalCache;
+
+// Culling trace the sample captures, see CullingTrace. It is replayed without the
+// sample, see RunTraceBenchmark
+extern WCHAR gCaptureFile[];
+
+// Culling state (transformed vertices, bins, depth buffer, visibility) is kept
+// per slot. Frames cycle through gFrameSlots of them so that culling of later
+// frames can overlap the rendering of earlier ones. Every frame slot holds one
+// slot per view (main camera, shadow cascades, ...) culled in that frame.
+const int MAX_FRAME_SLOTS = 4;
+const int MAX_VIEWS = 5;
+const int MAX_SLOTS = MAX_FRAME_SLOTS * MAX_VIEWS;
+
+// Ticks per second of QueryPerformanceCounter
 extern LARGE_INTEGER glFrequency;
 
 #define PI 3.1415926535f
@@ -54,9 +68,85 @@ const int SCREENW_IN_TILES = SCREENW/TILE_WIDTH_IN_PIXELS;
 const int SCREENH_IN_TILES = SCREENH/TILE_HEIGHT_IN_PIXELS;
 
 const int NUM_XFORMVERTS_TASKS = 16;
+// Tasks of the occluder frustum and size tests, each tests a range of grid cells
+const int NUM_OCCLUDER_VIS_TASKS = 32;
 
 const int NUM_TILES = (SCREENW/TILE_WIDTH_IN_PIXELS) * (SCREENH/TILE_HEIGHT_IN_PIXELS);
 
+// The tiles are rasterized in bands of whole tile rows, one task set per band, so
+// that an occludee depth test can start as soon as the bands it overlaps are final
+const int NUM_RASTER_BANDS = 4;
+const int TILE_ROWS_PER_BAND = SCREENH_IN_TILES / NUM_RASTER_BANDS;
+const int TILES_PER_BAND = NUM_TILES / NUM_RASTER_BANDS;
+
+// Occludees are bucketed by the bands their screen bounds span: one bucket per band,
+// one per pair of neighbouring bands and one for all the taller ones. This keeps the
+// number of buckets depending on a band small (see MAX_SUCCESSORS)
+const int NUM_OCCLUDEE_BUCKETS = NUM_RASTER_BANDS + (NUM_RASTER_BANDS - 1) + 1;
+const UCHAR NO_OCCLUDEE_BUCKET = 0xFF;
+// Occludees whose depth test is skipped in favour of their visibility history
+const UCHAR CACHED_OCCLUDEE_BUCKET = 0xFE;
+
+// Most occludees in a leaf of the occludee bounding volume hierarchy
+const int OCCLUDEE_BVH_LEAF_SIZE = 16;
+// The frustum walk of the occludee BVH stops at subtrees of at most this many occludees
+// inside the frustum. They are binned by their bounds and depth tested top down: a
+// hidden node culls its subtree without touching its occludees
+const int OCCLUDEE_CULL_NODE_SIZE = 256;
+
+// How many 4 box packets ahead the occludee box transform prefetches
+const int OCCLUDEE_PREFETCH_PACKETS = 4;
+
+extern TASKSETHANDLE gInsideViewFrustum[MAX_SLOTS];
+extern TASKSETHANDLE gTooSmall[MAX_SLOTS];
+extern TASKSETHANDLE gActiveModels[MAX_SLOTS];
+extern TASKSETHANDLE gSplitNearFar[MAX_SLOTS];
+extern TASKSETHANDLE gXformMesh[MAX_SLOTS];
+extern TASKSETHANDLE gBinMesh[MAX_SLOTS];
+extern TASKSETHANDLE gSortBins[MAX_SLOTS];
+extern TASKSETHANDLE gRasterize[MAX_SLOTS][NUM_RASTER_BANDS];
+// Near wave of the front to back occluder waves, the tasks above rasterize the far wave
+extern TASKSETHANDLE gXformMeshNear[MAX_SLOTS];
+extern TASKSETHANDLE gBinMeshNear[MAX_SLOTS];
+extern TASKSETHANDLE gSortBinsNear[MAX_SLOTS];
+extern TASKSETHANDLE gRasterizeNear[MAX_SLOTS][NUM_RASTER_BANDS];
+extern TASKSETHANDLE gCullFarOccluders[MAX_SLOTS];
+extern TASKSETHANDLE gActiveFarModels[MAX_SLOTS];
+// Rasterization of last frame's large visible occludees on top of the occluders
+extern TASKSETHANDLE gXformProxies[MAX_SLOTS];
+extern TASKSETHANDLE gRasterizeProxies[MAX_SLOTS][NUM_RASTER_BANDS];
+extern TASKSETHANDLE gAABBoxBin[MAX_SLOTS];
+extern TASKSETHANDLE gAABBoxSort[MAX_SLOTS];
+extern TASKSETHANDLE gAABBoxBucketTest[MAX_SLOTS][NUM_OCCLUDEE_BUCKETS];
+extern TASKSETHANDLE gAABBoxDepthTest[MAX_SLOTS];
+
+// Task sets a view slot holds while its frame is in flight: the sets above, once per
+// band or bucket for the arrays. Every slot can be in flight at once, so all of them
+// must fit into the task manager or AllocateTaskSet spins waiting for a free one
+const int NUM_SLOT_TASKSETS = 16 + 3 * NUM_RASTER_BANDS + NUM_OCCLUDEE_BUCKETS;
+static_assert(MAX_SLOTS * NUM_SLOT_TASKSETS <= MAX_TASKSETS, "MAX_TASKSETS is too small for the task sets of all the slots");
+
+// Temporal visibility cache. An occludee whose last OCCLUDEE_STABLE_FRAMES depth tests
+// agreed is only re-tested every OCCLUDEE_OCCLUDED_RETEST_FRAMES frames while occluded,
+// every OCCLUDEE_VISIBLE_RETEST_FRAMES while visible, staggered over the occludees. It is
+// re-tested early once the camera moved more than OCCLUDEE_CACHE_PARALLAX times its
+// distance since its last test; moving more than OCCLUDEE_CACHE_CUT_DISTANCE between two
+// frames is a camera cut and clears the history. The camera positions of the last
+// OCCLUDEE_HISTORY_FRAMES frames are kept, far more than the re-test intervals
+const int OCCLUDEE_STABLE_FRAMES = 4;
+const int OCCLUDEE_OCCLUDED_RETEST_FRAMES = 4;
+const int OCCLUDEE_VISIBLE_RETEST_FRAMES = 8;
+const float OCCLUDEE_CACHE_PARALLAX = 0.02f;
+const float OCCLUDEE_CACHE_CUT_DISTANCE = 100.0f;
+const int OCCLUDEE_HISTORY_FRAMES = 256;
+
+// The occluders are sorted into a uniform grid of OCCLUDER_GRID_SIZE x OCCLUDER_GRID_SIZE
+// cells over the ground plane so the frustum and size tests can reject whole cells
+const int OCCLUDER_GRID_SIZE = 16;
+const int OCCLUDER_GRID_CELLS = OCCLUDER_GRID_SIZE * OCCLUDER_GRID_SIZE;
+// Padding of a grid cell's occluder list up to whole 4 occluder packets
+const UINT NO_OCCLUDER = 0xFFFFFFFF;
+
 // depending upon the scene the max #of tris in the bin should be changed.
 const int MAX_TRIS_IN_BIN_MT = 1024 * 16;
 const int MAX_TRIS_IN_BIN_ST = 1024 * 16;
@@ -80,6 +170,16 @@ const int AABB_VERTICES = 8;
 const int AABB_INDICES  = 36;
 const int AABB_TRIANGLES = 12;
 
+// Occludees whose screen rectangle covers fewer pixels are depth tested with the
+// whole rectangle instead of their rasterized silhouette
+const int OCCLUDEE_RECT_TEST_AREA = 100;
+
+// Occludees visible in the last culled frame whose proxy covered at least this many
+// pixels are rasterized as occluders. Their proxy is the largest copy of the world
+// space AABB, shrunk around its center, that lies inside the occludee (see
+// TransformedAABBoxSSE::GetProxyScale), drawn at its farthest depth
+const int OCCLUDEE_PROXY_MIN_AREA = 64 * 64;
+
 const float4x4 viewportMatrix(
     0.5f*(float)SCREENW,                 0.0f,  0.0f, 0.0f,
                    0.0f, -0.5f*(float)SCREENH,  0.0f, 0.0f,
@@ -93,4 +193,7 @@ const int OCCLUDEE_SETS = 4;
 const int AVG_COUNTER = 10;
 
 const int NUM_DT_TASKS = 50;
+
+// Light space grid used to find the shadow casters that can reach a visible receiver
+const int RECEIVER_MASK_SIZE = 32;
 #endif
\ No newline at end of file
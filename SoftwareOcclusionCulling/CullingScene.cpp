@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#include "CullingScene.h"
+
+CullingScene::CullingScene()
+	: mNumOccluders(0),
+	  mpOccluders(NULL),
+	  mpVertices(NULL),
+	  mNumVertices(0),
+	  mpIndices(NULL),
+	  mNumIndices(0),
+	  mNumOccludees(0),
+	  mpOccludeeCenter(NULL),
+	  mpOccludeeHalf(NULL),
+	  mpOccludeeTris(NULL),
+	  mpOccludees(NULL)
+{
+}
+
+CullingScene::~CullingScene()
+{
+	Release();
+}
+
+void CullingScene::Release()
+{
+	SAFE_DELETE_ARRAY(mpOccluders);
+	_aligned_free(mpVertices);
+	mpVertices = NULL;
+	SAFE_DELETE_ARRAY(mpIndices);
+	SAFE_DELETE_ARRAY(mpOccludeeCenter);
+	SAFE_DELETE_ARRAY(mpOccludeeHalf);
+	SAFE_DELETE_ARRAY(mpOccludeeTris);
+	SAFE_DELETE_ARRAY(mpOccludees);
+	mNumOccluders = mNumVertices = mNumIndices = mNumOccludees = 0;
+}
+
+// The vertices are aligned for the SSE vertex transform
+void CullingScene::AllocateOccluders(UINT numOccluders, UINT numVertices, UINT numIndices)
+{
+	mNumOccluders = numOccluders;
+	mNumVertices = numVertices;
+	mNumIndices = numIndices;
+	mpOccluders = new Occluder[numOccluders];
+	mpVertices = (Vertex*)_aligned_malloc(max(numVertices, 1u) * sizeof(Vertex), 16);
+	mpIndices = new UINT[max(numIndices, 1u)];
+}
+
+void CullingScene::AllocateOccludees(UINT numOccludees)
+{
+	mNumOccludees = numOccludees;
+	mpOccludeeCenter = new float3[numOccludees];
+	mpOccludeeHalf = new float3[numOccludees];
+	mpOccludeeTris = new UINT[numOccludees];
+	mpOccludees = new Occludee[numOccludees];
+}
+
+void CullingScene::GetBounds(float3 *pCenter, float3 *pHalf) const
+{
+	float3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	float3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for(UINT i = 0; i < mNumOccluders + mNumOccludees; i++)
+	{
+		const float3 &center = i < mNumOccluders ? mpOccluders[i].mCenter : mpOccludeeCenter[i - mNumOccluders];
+		const float3 &half = i < mNumOccluders ? mpOccluders[i].mHalf : mpOccludeeHalf[i - mNumOccluders];
+		boundsMin = float3(min(boundsMin.x, center.x - half.x), min(boundsMin.y, center.y - half.y), min(boundsMin.z, center.z - half.z));
+		boundsMax = float3(max(boundsMax.x, center.x + half.x), max(boundsMax.y, center.y + half.y), max(boundsMax.z, center.z + half.z));
+	}
+	if(mNumOccluders + mNumOccludees == 0)
+	{
+		boundsMin = boundsMax = float3(0.0f, 0.0f, 0.0f);
+	}
+	*pCenter = (boundsMin + boundsMax) * 0.5f;
+	*pHalf = (boundsMax - boundsMin) * 0.5f;
+}
+
+size_t CullingScene::GetMemorySize() const
+{
+	return mNumOccluders * sizeof(Occluder) + mNumVertices * sizeof(Vertex) + mNumIndices * sizeof(UINT) +
+		   mNumOccludees * (2 * sizeof(float3) + sizeof(UINT) + sizeof(Occludee));
+}
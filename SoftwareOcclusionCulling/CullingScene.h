@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef CULLINGSCENE_H
+#define CULLINGSCENE_H
+
+#include "CPUT_DX11.h"
+#include "Constants.h"
+
+//--------------------------------------------------------------------------------------
+// Occluders and occludees without CPUT models, the input of the device free modes. An
+// occluder is a single mesh with its world matrix and its object and world space bounds;
+// its vertices and indices are ranges of the scene's arrays, which occluders can share.
+// An occludee is a world space box with the triangle count of the model it stands for,
+// its world matrix and object space box for the size test and the scale of its proxy.
+// DepthBufferRasterizer::CreateTransformedModels and AABBoxRasterizer::CreateTransformedAABBoxes
+// ingest the scene in place of the asset sets, so every backend can cull it but nothing
+// can render it. SyntheticScene generates one, CullingTraceScene reads one from a trace.
+//--------------------------------------------------------------------------------------
+class CullingScene
+{
+	public:
+		CullingScene();
+		virtual ~CullingScene();
+
+		inline UINT GetNumOccluders() const {return mNumOccluders;}
+		inline Vertex *GetOccluderVertices(UINT occluderId) const {return &mpVertices[mpOccluders[occluderId].mStartV];}
+		inline UINT GetOccluderNumVertices(UINT occluderId) const {return mpOccluders[occluderId].mNumVertices;}
+		inline UINT *GetOccluderIndices(UINT occluderId) const {return &mpIndices[mpOccluders[occluderId].mStartI];}
+		inline UINT GetOccluderNumIndices(UINT occluderId) const {return mpOccluders[occluderId].mNumIndices;}
+		inline const float4x4 &GetOccluderWorldMatrix(UINT occluderId) const {return mpOccluders[occluderId].mWorld;}
+		inline const float3 &GetOccluderCenterOS(UINT occluderId) const {return mpOccluders[occluderId].mCenterOS;}
+		inline const float3 &GetOccluderHalfOS(UINT occluderId) const {return mpOccluders[occluderId].mHalfOS;}
+		inline const float3 &GetOccluderCenter(UINT occluderId) const {return mpOccluders[occluderId].mCenter;}
+		inline const float3 &GetOccluderHalf(UINT occluderId) const {return mpOccluders[occluderId].mHalf;}
+
+		inline UINT GetNumOccludees() const {return mNumOccludees;}
+		inline const float3 *GetOccludeeCenters() const {return mpOccludeeCenter;}
+		inline const float3 *GetOccludeeHalves() const {return mpOccludeeHalf;}
+		inline const UINT *GetOccludeeTriangles() const {return mpOccludeeTris;}
+		inline const float4x4 &GetOccludeeWorldMatrix(UINT occludeeId) const {return mpOccludees[occludeeId].mWorld;}
+		inline const float3 &GetOccludeeCenterOS(UINT occludeeId) const {return mpOccludees[occludeeId].mCenterOS;}
+		inline const float3 &GetOccludeeHalfOS(UINT occludeeId) const {return mpOccludees[occludeeId].mHalfOS;}
+		inline float GetOccludeeProxyScale(UINT occludeeId) const {return mpOccludees[occludeeId].mProxyScale;}
+
+		// Bounds of the occluders and occludees
+		void GetBounds(float3 *pCenter, float3 *pHalf) const;
+		// Bytes held by the scene
+		size_t GetMemorySize() const;
+
+	protected:
+		struct Occluder
+		{
+			float4x4 mWorld;
+			float3 mCenterOS;
+			float3 mHalfOS;
+			float3 mCenter;
+			float3 mHalf;
+			UINT mStartV;
+			UINT mNumVertices;
+			UINT mStartI;
+			UINT mNumIndices;
+		};
+
+		// The world space boxes and triangle counts are kept in arrays of their own,
+		// the occludee BVH is built from them
+		struct Occludee
+		{
+			float4x4 mWorld;
+			float3 mCenterOS;
+			float3 mHalfOS;
+			float mProxyScale;
+		};
+
+		void AllocateOccluders(UINT numOccluders, UINT numVertices, UINT numIndices);
+		void AllocateOccludees(UINT numOccludees);
+		void Release();
+
+		UINT mNumOccluders;
+		Occluder *mpOccluders;
+		Vertex *mpVertices;
+		UINT mNumVertices;
+		UINT *mpIndices;
+		UINT mNumIndices;
+
+		UINT mNumOccludees;
+		float3 *mpOccludeeCenter;
+		float3 *mpOccludeeHalf;
+		UINT *mpOccludeeTris;
+		Occludee *mpOccludees;
+};
+
+#endif // CULLINGSCENE_H
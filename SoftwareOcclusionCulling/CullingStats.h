@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef CULLINGSTATS_H
+#define CULLINGSTATS_H
+
+#include "Constants.h"
+
+//--------------------------------------------------------------------------------------
+// Counters of the culling of one frame slot. Every task adds up its own counters in a
+// block of one cache line, so the tasks never share a line, and the snapshot below sums
+// up the blocks of the slot instead of walking all the occluders and occludees.
+//--------------------------------------------------------------------------------------
+
+// Occluders a frustum / size test task found rasterized to the view
+__declspec(align(64)) struct OccluderVisCounters
+{
+	UINT mNumOccludersR2DB;
+};
+
+// Triangles rasterized to a tile and the 4 wide batches they were rasterized in
+__declspec(align(64)) struct OccluderTileCounters
+{
+	UINT mNumTris;
+	UINT mNumSimdBatches;
+	UINT mNumSimdLanes;		// triangles in the batches, at most SSE per batch
+};
+
+// Occludees culled by the BVH walk or a depth test task and how far its box tests got
+__declspec(align(64)) struct OccludeeCounters
+{
+	UINT mNumCulled;
+	UINT mNumCulledTris;
+	UINT mNumBoxTests;
+	UINT mNumEarlyOuts;		// box tests that found a visible pixel
+	UINT mNumRowsTested;	// rows of 2x2 pixel quads visited by the box tests
+	UINT mNumRowsSkipped;	// rows the early outs did not have to visit
+
+	inline void AddCulled(UINT numTris)
+	{
+		mNumCulled++;
+		mNumCulledTris += numTris;
+	}
+
+	// A group of occludees culled at once, such as a BVH subtree
+	inline void AddCulled(UINT numOccludees, UINT numTris)
+	{
+		mNumCulled += numOccludees;
+		mNumCulledTris += numTris;
+	}
+
+	// A box test over the quad rows startYy .. endYy - 1 that stopped at row exitYy,
+	// exitYy is endYy if no row had a visible pixel
+	inline void AddBoxTest(int startYy, int endYy, int exitYy)
+	{
+		int numRows = max(endYy - startYy + 1, 0) / 2;
+		int numTested = exitYy < endYy ? (exitYy - startYy) / 2 + 1 : numRows;
+		mNumBoxTests++;
+		mNumEarlyOuts += exitYy < endYy ? 1 : 0;
+		mNumRowsTested += numTested;
+		mNumRowsSkipped += numRows - numTested;
+	}
+};
+
+//--------------------------------------------------------------------------------------
+// Snapshot of a frame slot's counters once its culling is done. The depth buffer
+// rasterizer fills in the occluder half, the AABBox rasterizer the occludee half
+//--------------------------------------------------------------------------------------
+struct CullingStats
+{
+	UINT mNumOccludersR2DB;
+	UINT mNumRasterizedTris;
+	UINT mNumTrisInTile[NUM_TILES];
+	UINT mNumSimdBatches;
+	UINT mNumSimdLanes;
+
+	UINT mNumCulled;
+	UINT mNumCulledTris;
+	UINT mNumBoxTests;
+	UINT mNumEarlyOuts;
+	UINT mNumRowsTested;
+	UINT mNumRowsSkipped;
+
+	inline void Reset() {memset(this, 0, sizeof(*this));}
+
+	// Share of the rasterizer's SIMD lanes that held a triangle
+	inline double GetLaneOccupancy() const
+	{
+		return mNumSimdBatches > 0 ? (double)mNumSimdLanes / (SSE * mNumSimdBatches) : 0.0;
+	}
+
+	inline UINT GetMaxTrisInTile() const
+	{
+		UINT maxTris = 0;
+		for(UINT i = 0; i < NUM_TILES; i++)
+		{
+			maxTris = max(maxTris, mNumTrisInTile[i]);
+		}
+		return maxTris;
+	}
+
+	// Share of the box tests' quad rows the early outs skipped
+	inline double GetRowsSkipped() const
+	{
+		UINT numRows = mNumRowsTested + mNumRowsSkipped;
+		return numRows > 0 ? (double)mNumRowsSkipped / numRows : 0.0;
+	}
+};
+
+#endif // CULLINGSTATS_H
@@ -0,0 +1,388 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#include "CullingTrace.h"
+#include "TransformedAABBoxSSE.h"
+
+static const UINT CULLING_TRACE_MAGIC = 'SOCT';
+static const UINT CULLING_TRACE_VERSION = 3;
+
+// The models of the asset sets, in the order the rasterizers take them in
+static void GetModels(CPUTAssetSet **pAssetSet, UINT numAssetSets, std::vector<CPUTModelDX11*> *pModels)
+{
+	for(UINT assetId = 0; assetId < numAssetSets; assetId++)
+	{
+		for(UINT nodeId = 0; nodeId < pAssetSet[assetId]->GetAssetCount(); nodeId++)
+		{
+			CPUTRenderNode* pRenderNode = NULL;
+			CPUTResult result = pAssetSet[assetId]->GetAssetByIndex(nodeId, &pRenderNode);
+			ASSERT((CPUT_SUCCESS == result), _L ("Failed getting asset by index")); 
+			if(pRenderNode->IsModel())
+			{
+				pModels->push_back((CPUTModelDX11*)pRenderNode);
+			}
+			pRenderNode->Release();
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Copies what the rasterizers take from the models: the occluders' world matrices, bounds
+// and mesh vertices and indices, the occludees' bounds, triangle counts and proxy scales
+//--------------------------------------------------------------------------------------
+void CullingTraceScene::Create(CPUTAssetSet **pOccluderSets, UINT numOccluderSets, CPUTAssetSet **pOccludeeSets, UINT numOccludeeSets)
+{
+	Release();
+
+	std::vector<CPUTModelDX11*> models;
+	GetModels(pOccluderSets, numOccluderSets, &models);
+	UINT numVertices = 0, numIndices = 0;
+	for(UINT modelId = 0; modelId < models.size(); modelId++)
+	{
+		for(int meshId = 0; meshId < models[modelId]->GetMeshCount(); meshId++)
+		{
+			numVertices += models[modelId]->GetMesh(meshId)->GetVertexCount();
+			numIndices += models[modelId]->GetMesh(meshId)->GetIndexCount();
+		}
+	}
+	AllocateOccluders((UINT)models.size(), numVertices, numIndices);
+
+	// The indices of a mesh are moved past the vertices of the meshes before it
+	UINT startV = 0, startI = 0;
+	for(UINT modelId = 0; modelId < mNumOccluders; modelId++)
+	{
+		CPUTModelDX11 *pModel = models[modelId];
+		Occluder &occluder = mpOccluders[modelId];
+		occluder.mWorld = *pModel->GetWorldMatrix();
+		pModel->GetBoundsObjectSpace(&occluder.mCenterOS, &occluder.mHalfOS);
+		pModel->GetBoundsWorldSpace(&occluder.mCenter, &occluder.mHalf);
+		occluder.mStartV = startV;
+		occluder.mStartI = startI;
+		for(int meshId = 0; meshId < pModel->GetMeshCount(); meshId++)
+		{
+			CPUTMeshDX11 *pMesh = pModel->GetMesh(meshId);
+			memcpy(&mpVertices[startV], pMesh->GetVertices(), pMesh->GetVertexCount() * sizeof(Vertex));
+			for(UINT i = 0; i < pMesh->GetIndexCount(); i++)
+			{
+				mpIndices[startI + i] = pMesh->GetIndices()[i] + startV - occluder.mStartV;
+			}
+			startV += pMesh->GetVertexCount();
+			startI += pMesh->GetIndexCount();
+		}
+		occluder.mNumVertices = startV - occluder.mStartV;
+		occluder.mNumIndices = startI - occluder.mStartI;
+	}
+
+	models.clear();
+	GetModels(pOccludeeSets, numOccludeeSets, &models);
+	AllocateOccludees((UINT)models.size());
+	for(UINT modelId = 0; modelId < mNumOccludees; modelId++)
+	{
+		CPUTModelDX11 *pModel = models[modelId];
+		Occludee &occludee = mpOccludees[modelId];
+		occludee.mWorld = *pModel->GetWorldMatrix();
+		pModel->GetBoundsObjectSpace(&occludee.mCenterOS, &occludee.mHalfOS);
+		pModel->GetBoundsWorldSpace(&mpOccludeeCenter[modelId], &mpOccludeeHalf[modelId]);
+		mpOccludeeTris[modelId] = 0;
+		for(int meshId = 0; meshId < pModel->GetMeshCount(); meshId++)
+		{
+			mpOccludeeTris[modelId] += pModel->GetMesh(meshId)->GetTriangleCount();
+		}
+
+		// The proxy is searched for in the model's meshes, which the trace leaves out
+		TransformedAABBoxSSE box;
+		box.CreateAABBVertexIndexList(pModel);
+		occludee.mProxyScale = box.GetProxyScale();
+	}
+}
+
+void CullingTraceScene::GetHeader(CullingTraceHeader *pHeader) const
+{
+	pHeader->mNumOccluders = mNumOccluders;
+	pHeader->mNumVertices = mNumVertices;
+	pHeader->mNumIndices = mNumIndices;
+	pHeader->mNumOccludees = mNumOccludees;
+}
+
+bool CullingTraceScene::Write(FILE *pFile) const
+{
+	return fwrite(mpOccluders, sizeof(Occluder), mNumOccluders, pFile) == mNumOccluders &&
+		   fwrite(mpVertices, sizeof(Vertex), mNumVertices, pFile) == mNumVertices &&
+		   fwrite(mpIndices, sizeof(UINT), mNumIndices, pFile) == mNumIndices &&
+		   fwrite(mpOccludeeCenter, sizeof(float3), mNumOccludees, pFile) == mNumOccludees &&
+		   fwrite(mpOccludeeHalf, sizeof(float3), mNumOccludees, pFile) == mNumOccludees &&
+		   fwrite(mpOccludeeTris, sizeof(UINT), mNumOccludees, pFile) == mNumOccludees &&
+		   fwrite(mpOccludees, sizeof(Occludee), mNumOccludees, pFile) == mNumOccludees;
+}
+
+//--------------------------------------------------------------------------------------
+// The scene is copied out of the mapped trace, the vertices have to be aligned for the
+// SSE transform. Occluders whose vertex or index ranges or indices point outside the
+// scene's arrays are rejected
+//--------------------------------------------------------------------------------------
+size_t CullingTraceScene::Read(const CullingTraceHeader &header, const UCHAR *pData, size_t size)
+{
+	Release();
+
+	UINT64 sceneBytes = (UINT64)header.mNumOccluders * sizeof(Occluder) + (UINT64)header.mNumVertices * sizeof(Vertex) +
+						(UINT64)header.mNumIndices * sizeof(UINT) +
+						(UINT64)header.mNumOccludees * (2 * sizeof(float3) + sizeof(UINT) + sizeof(Occludee));
+	if(sceneBytes > size)
+	{
+		return 0;
+	}
+
+	AllocateOccluders(header.mNumOccluders, header.mNumVertices, header.mNumIndices);
+	AllocateOccludees(header.mNumOccludees);
+	const UCHAR *pRead = pData;
+	memcpy(mpOccluders, pRead, mNumOccluders * sizeof(Occluder));
+	pRead += mNumOccluders * sizeof(Occluder);
+	memcpy(mpVertices, pRead, mNumVertices * sizeof(Vertex));
+	pRead += mNumVertices * sizeof(Vertex);
+	memcpy(mpIndices, pRead, mNumIndices * sizeof(UINT));
+	pRead += mNumIndices * sizeof(UINT);
+	memcpy(mpOccludeeCenter, pRead, mNumOccludees * sizeof(float3));
+	pRead += mNumOccludees * sizeof(float3);
+	memcpy(mpOccludeeHalf, pRead, mNumOccludees * sizeof(float3));
+	pRead += mNumOccludees * sizeof(float3);
+	memcpy(mpOccludeeTris, pRead, mNumOccludees * sizeof(UINT));
+	pRead += mNumOccludees * sizeof(UINT);
+	memcpy(mpOccludees, pRead, mNumOccludees * sizeof(Occludee));
+	pRead += mNumOccludees * sizeof(Occludee);
+
+	for(UINT occluderId = 0; occluderId < mNumOccluders; occluderId++)
+	{
+		const Occluder &occluder = mpOccluders[occluderId];
+		bool valid = (UINT64)occluder.mStartV + occluder.mNumVertices <= mNumVertices &&
+					 (UINT64)occluder.mStartI + occluder.mNumIndices <= mNumIndices &&
+					 occluder.mNumIndices % 3 == 0;
+		for(UINT i = 0; valid && i < occluder.mNumIndices; i++)
+		{
+			valid = mpIndices[occluder.mStartI + i] < occluder.mNumVertices;
+		}
+		if(!valid)
+		{
+			Release();
+			return 0;
+		}
+	}
+	return pRead - pData;
+}
+
+CullingTrace::CullingTrace()
+	: mCapturing(false),
+	  mNumCapturedFrames(0),
+	  mNumResolvedFrames(0),
+	  mpReplayView(NULL),
+	  mReplaySize(0),
+	  mpReplayFrames(NULL),
+	  mNumComparedFrames(0),
+	  mNumMismatchedFrames(0),
+	  mNumFalseVisible(0),
+	  mNumFalseCulled(0),
+	  mFirstMismatchedFrame(0)
+{
+	memset(&mHeader, 0, sizeof(mHeader));
+}
+
+CullingTrace::~CullingTrace()
+{
+	EndReplay();
+}
+
+void CullingTrace::BeginCapture(CPUTAssetSet **pOccluderSets, UINT numOccluderSets, CPUTAssetSet **pOccludeeSets, UINT numOccludeeSets)
+{
+	mScene.Create(pOccluderSets, numOccluderSets, pOccludeeSets, numOccludeeSets);
+	memset(&mHeader, 0, sizeof(mHeader));
+	mHeader.mMagic = CULLING_TRACE_MAGIC;
+	mHeader.mVersion = CULLING_TRACE_VERSION;
+	mScene.GetHeader(&mHeader);
+	mHeader.mVisibilityWords = (mHeader.mNumOccludees + 31) / 32;
+	mCapturing = true;
+	mNumCapturedFrames = 0;
+	mNumResolvedFrames = 0;
+	mFrames.clear();
+}
+void CullingTrace::AddFrame(CPUTCamera *pCamera)
+{
+	if(!mCapturing)
+	{
+		return;
+	}
+
+	CullingTraceCamera camera;
+	camera.mParentMatrix = *pCamera->GetParentMatrix();
+	camera.mFov = pCamera->GetFov();
+	camera.mAspectRatio = pCamera->GetAspectRatio();
+	camera.mNearPlaneDistance = pCamera->GetNearPlaneDistance();
+	camera.mFarPlaneDistance = pCamera->GetFarPlaneDistance();
+
+	// The visibility stays all visible until the frame's results are in
+	size_t start = mFrames.size();
+	mFrames.resize(start + GetFrameWords(), 0xFFFFFFFF);
+	memcpy(&mFrames[start], &camera, sizeof(camera));
+	mNumCapturedFrames++;
+}
+
+void CullingTrace::SetVisibility(UINT frame, AABBoxRasterizer *pAABB, UINT idx)
+{
+	UINT *pVisibility = NULL;
+	if(mCapturing && frame < mNumCapturedFrames)
+	{
+		// The bits are kept in load order, the rasterizers may store the occludees in
+		// a different one
+		pVisibility = &mFrames[frame * GetFrameWords() + sizeof(CullingTraceCamera) / sizeof(UINT)];
+		memset(pVisibility, 0, mHeader.mVisibilityWords * sizeof(UINT));
+		for(UINT i = 0; i < mHeader.mNumOccludees; i++)
+		{
+			UINT loadId = pAABB->GetLoadOrderId(i);
+			pVisibility[loadId / 32] |= pAABB->IsVisible(i, idx) ? (1 << (loadId % 32)) : 0;
+		}
+		// Frames finish in the order they were culled in
+		mNumResolvedFrames = max(mNumResolvedFrames, frame + 1);
+	}
+	else if(mpReplayFrames && frame < mHeader.mNumFrames)
+	{
+		const UINT *pCaptured = mpReplayFrames + frame * GetFrameWords() + sizeof(CullingTraceCamera) / sizeof(UINT);
+		UINT numMismatches = 0;
+		for(UINT i = 0; i < mHeader.mNumOccludees; i++)
+		{
+			UINT loadId = pAABB->GetLoadOrderId(i);
+			bool captured = (pCaptured[loadId / 32] & (1 << (loadId % 32))) != 0;
+			bool replayed = pAABB->IsVisible(i, idx);
+			if(captured != replayed)
+			{
+				numMismatches++;
+				mNumFalseVisible += replayed ? 1 : 0;
+				mNumFalseCulled += replayed ? 0 : 1;
+			}
+		}
+		if(numMismatches > 0 && mNumMismatchedFrames++ == 0)
+		{
+			mFirstMismatchedFrame = frame;
+		}
+		mNumComparedFrames++;
+	}
+}
+
+bool CullingTrace::WriteCapture(const WCHAR *pFileName)
+{
+	FILE *pFile = NULL;
+	if(!mCapturing || _wfopen_s(&pFile, pFileName, L"wb") != 0)
+	{
+		return false;
+	}
+
+	// The frames still in flight have no visibility to compare against and are left out
+	mHeader.mNumFrames = mNumResolvedFrames;
+	size_t numWords = (size_t)mNumResolvedFrames * GetFrameWords();
+	bool written = fwrite(&mHeader, sizeof(mHeader), 1, pFile) == 1 && mScene.Write(pFile);
+	if(written && numWords > 0)
+	{
+		written = fwrite(&mFrames[0], sizeof(UINT), numWords, pFile) == numWords;
+	}
+	fclose(pFile);
+	return written;
+}
+
+//--------------------------------------------------------------------------------------
+// The trace is mapped rather than read so that long captures replay without loading
+// their frames up front, only the scene is copied out
+//--------------------------------------------------------------------------------------
+bool CullingTrace::BeginReplay(const WCHAR *pFileName)
+{
+	EndReplay();
+
+	mpReplayView = MapFile(pFileName, &mReplaySize);
+	if(!mpReplayView || mReplaySize < sizeof(CullingTraceHeader))
+	{
+		EndReplay();
+		return false;
+	}
+
+	memcpy(&mHeader, mpReplayView, sizeof(mHeader));
+	if(mHeader.mMagic != CULLING_TRACE_MAGIC || mHeader.mVersion != CULLING_TRACE_VERSION ||
+	   mHeader.mVisibilityWords != (mHeader.mNumOccludees + 31) / 32)
+	{
+		EndReplay();
+		return false;
+	}
+
+	const UCHAR *pScene = (const UCHAR*)mpReplayView + sizeof(CullingTraceHeader);
+	size_t sceneBytes = mScene.Read(mHeader, pScene, mReplaySize - sizeof(CullingTraceHeader));
+	UINT64 frameBytes = (UINT64)GetFrameWords() * sizeof(UINT);
+	if(sceneBytes == 0 ||
+	   (UINT64)mReplaySize < sizeof(CullingTraceHeader) + sceneBytes + frameBytes * mHeader.mNumFrames)
+	{
+		EndReplay();
+		return false;
+	}
+	mpReplayFrames = (const UINT*)(pScene + sceneBytes);
+	mNumComparedFrames = mNumMismatchedFrames = mNumFalseVisible = mNumFalseCulled = 0;
+	return true;
+}
+
+void CullingTrace::EndReplay()
+{
+	if(mpReplayView)
+	{
+		UnmapFile(mpReplayView, mReplaySize);
+		mpReplayView = NULL;
+		mReplaySize = 0;
+		mpReplayFrames = NULL;
+	}
+}
+
+void CullingTrace::GetCamera(UINT frame, CPUTCamera *pCamera)
+{
+	if(!mpReplayFrames || frame >= mHeader.mNumFrames)
+	{
+		return;
+	}
+
+	CullingTraceCamera camera;
+	memcpy(&camera, mpReplayFrames + frame * GetFrameWords(), sizeof(camera));
+	pCamera->SetParentMatrix(camera.mParentMatrix);
+	pCamera->SetFov(camera.mFov);
+	pCamera->SetAspectRatio(camera.mAspectRatio);
+	pCamera->SetNearPlaneDistance(camera.mNearPlaneDistance);
+	pCamera->SetFarPlaneDistance(camera.mFarPlaneDistance);
+	pCamera->Update();
+}
+
+bool CullingTrace::WriteReport(const WCHAR *pFileName)
+{
+	FILE *pFile = NULL;
+	if(!mpReplayFrames || _wfopen_s(&pFile, pFileName, L"w") != 0)
+	{
+		return false;
+	}
+
+	fprintf(pFile, "occluders: %d\n", mHeader.mNumOccluders);
+	fprintf(pFile, "occludees: %d\n", mHeader.mNumOccludees);
+	fprintf(pFile, "frames captured: %d\n", mHeader.mNumFrames);
+	fprintf(pFile, "frames compared: %d\n", mNumComparedFrames);
+	fprintf(pFile, "frames with a different visibility: %d\n", mNumMismatchedFrames);
+	if(mNumMismatchedFrames > 0)
+	{
+		fprintf(pFile, "first different frame: %d\n", mFirstMismatchedFrame);
+	}
+	fprintf(pFile, "occludees visible only in the replay: %d\n", mNumFalseVisible);
+	fprintf(pFile, "occludees culled only in the replay: %d\n", mNumFalseCulled);
+	fclose(pFile);
+	return true;
+}
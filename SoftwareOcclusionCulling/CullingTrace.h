@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef CULLINGTRACE_H
+#define CULLINGTRACE_H
+
+#include "CPUT_DX11.h"
+#include "AABBoxRasterizer.h"
+#include "CullingScene.h"
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Culling inputs and results of a run, saved to a .soctrace file. The scene is static, so
+// the file starts with it once: the occluder meshes with their world matrices and bounds
+// and the occludee boxes, as CullingScene holds them, so that a replay needs neither the
+// CPUT assets nor a D3D device. It is followed by one fixed size record per culled frame:
+// the main camera and the occludee visibility it produced, one bit per occludee in load
+// order. A replay (see RunTraceBenchmark) culls the scene from the cameras with any
+// rasterizer and compares its visibility bit for bit with the captured one. With
+// pipelining the last frames in flight never get results, they are dropped.
+//--------------------------------------------------------------------------------------
+struct CullingTraceHeader
+{
+	UINT mMagic;
+	UINT mVersion;
+	UINT mNumOccluders;
+	UINT mNumVertices;
+	UINT mNumIndices;
+	UINT mNumOccludees;
+	UINT mNumFrames;
+	UINT mVisibilityWords;
+};
+
+struct CullingTraceCamera
+{
+	float4x4 mParentMatrix;
+	float mFov;
+	float mAspectRatio;
+	float mNearPlaneDistance;
+	float mFarPlaneDistance;
+};
+
+//--------------------------------------------------------------------------------------
+// Scene of a trace, taken from the CPUT models the rasterizers were created from when
+// capturing and read back from the file when replaying. The meshes of an occluder model
+// become the one mesh of its occluder, the rasterized depth is the same
+//--------------------------------------------------------------------------------------
+class CullingTraceScene : public CullingScene
+{
+	public:
+		void Create(CPUTAssetSet **pOccluderSets, UINT numOccluderSets, CPUTAssetSet **pOccludeeSets, UINT numOccludeeSets);
+		// Scene counts of the header
+		void GetHeader(CullingTraceHeader *pHeader) const;
+		bool Write(FILE *pFile) const;
+		// Read the scene of the header from the size bytes following it, returns the bytes
+		// read or 0 if they are too few or the meshes are broken
+		size_t Read(const CullingTraceHeader &header, const UCHAR *pData, size_t size);
+};
+
+class CullingTrace
+{
+	public:
+		CullingTrace();
+		~CullingTrace();
+
+		// Take the scene from the asset sets the rasterizers were created from
+		void BeginCapture(CPUTAssetSet **pOccluderSets, UINT numOccluderSets, CPUTAssetSet **pOccludeeSets, UINT numOccludeeSets);
+		// Write the scene and the frames captured so far that have their visibility
+		bool WriteCapture(const WCHAR *pFileName);
+		// Map a trace for replay and read its scene
+		bool BeginReplay(const WCHAR *pFileName);
+		// Write the replay's visibility differences
+		bool WriteReport(const WCHAR *pFileName);
+
+		inline bool IsCapturing() {return mCapturing;}
+		inline bool IsReplaying() {return mpReplayFrames != NULL;}
+		inline UINT GetNumFrames() {return mpReplayFrames ? mHeader.mNumFrames : mNumCapturedFrames;}
+		inline const CullingScene &GetScene() {return mScene;}
+
+		// Capture: add the camera of the next culled frame
+		void AddFrame(CPUTCamera *pCamera);
+		// Capture: record, replay: compare the visibility of a frame once it is final
+		void SetVisibility(UINT frame, AABBoxRasterizer *pAABB, UINT idx);
+		// Replay: set the camera to the one a frame was captured with
+		void GetCamera(UINT frame, CPUTCamera *pCamera);
+
+	private:
+		CullingTraceHeader mHeader;
+		CullingTraceScene mScene;
+		bool mCapturing;
+		UINT mNumCapturedFrames;
+		UINT mNumResolvedFrames;	// frames 0 .. mNumResolvedFrames - 1 have their visibility
+		std::vector<UINT> mFrames;
+
+		const void *mpReplayView;
+		size_t mReplaySize;
+		const UINT *mpReplayFrames;
+
+		UINT mNumComparedFrames;
+		UINT mNumMismatchedFrames;
+		UINT mNumFalseVisible;
+		UINT mNumFalseCulled;
+		UINT mFirstMismatchedFrame;
+
+		inline UINT GetFrameWords() {return sizeof(CullingTraceCamera) / sizeof(UINT) + mHeader.mVisibilityWords;}
+		void EndReplay();
+};
+
+#endif // CULLINGTRACE_H
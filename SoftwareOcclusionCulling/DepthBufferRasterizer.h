@@ -19,6 +19,9 @@
 #include "CPUT_DX11.h"
 #include "TaskMgrTBB.h"
 #include "Constants.h"
+#include "CullingStats.h"
+
+class CullingScene;
 
 class DepthBufferRasterizer
 {
@@ -26,7 +29,11 @@ class DepthBufferRasterizer
 		DepthBufferRasterizer();
 		virtual ~DepthBufferRasterizer();
 		virtual void CreateTransformedModels(CPUTAssetSet **pAssetSet, UINT numAssetSets) = 0;
+		// Occluders of a scene without CPUT models, for the device free modes
+		virtual void CreateTransformedModels(const CullingScene &scene) = 0;
 		virtual void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx) = 0;
+		// Cull several views at once, the views use slots idx .. idx + numViews - 1
+		virtual void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx) = 0;
 
 		virtual void ResetInsideFrustum() = 0;
 		virtual void ComputeR2DBTime(UINT idx) = 0;
@@ -34,17 +41,22 @@ class DepthBufferRasterizer
 		virtual void SetViewProj(float4x4 *viewMatrix, float4x4 *projMatrix, UINT idx) = 0;
 		virtual void SetCPURenderTargetPixels(UINT *pRenderTargetPixels, UINT idx) = 0;
 		virtual void SetOccluderSizeThreshold(float occluderSizeThreshold) = 0;
+		// Rasterize the occluders front to back in a near and a far wave, culling the
+		// far wave's occluders against the near wave's depth buffer
+		virtual void SetOccluderWaves(bool occluderWaves) = 0;
 		virtual inline void SetCamera(CPUTCamera *pCamera, UINT idx) = 0;
 
 		virtual UINT GetNumOccluders() = 0;
-		virtual UINT GetNumOccludersR2DB(UINT idx) = 0;
 		virtual double GetRasterizeTime() = 0;
+		// Rasterize time of the last frame instead of the average of the last AVG_COUNTER ones
+		virtual double GetLastRasterizeTime() = 0;
 		virtual UINT GetNumTriangles() = 0;
-		virtual UINT GetNumRasterizedTriangles(UINT idx) = 0;
+		// Fill in the occluder half of the stats of view slot idx, once its culling is done
+		virtual void GetFrameStats(UINT idx, CullingStats *pStats) = 0;
 
 	protected:
-		LARGE_INTEGER mStartTime[2];
-		LARGE_INTEGER mStopTime[2][NUM_TILES];
+		LARGE_INTEGER mStartTime[MAX_SLOTS];
+		LARGE_INTEGER mStopTime[MAX_SLOTS][NUM_TILES];
 };
 
 #endif //DEPTHBUFFERRASTERIZER
\ No newline at end of file
@@ -14,6 +14,26 @@
 // responsibility to update it.
 //-------------------------------------------------------------------------------------
 #include "DepthBufferRasterizerSSE.h"
+#include "CullingScene.h"
+
+// World space bounds and bounding radii of 4 occluders, structure of arrays
+struct DepthBufferRasterizerSSE::OccluderPacket
+{
+	__m128 mCenter[3];
+	__m128 mHalf[3];
+	__m128 mRadiusSq;
+
+	inline void SetLane(UINT lane, const float3& center, const float3& half, float radiusSq)
+	{
+		mCenter[0].m128_f32[lane] = center.x;
+		mCenter[1].m128_f32[lane] = center.y;
+		mCenter[2].m128_f32[lane] = center.z;
+		mHalf[0].m128_f32[lane] = half.x;
+		mHalf[1].m128_f32[lane] = half.y;
+		mHalf[2].m128_f32[lane] = half.z;
+		mRadiusSq.m128_f32[lane] = radiusSq;
+	}
+};
 
 DepthBufferRasterizerSSE::DepthBufferRasterizerSSE()
 	: DepthBufferRasterizer(),
@@ -24,27 +44,41 @@ DepthBufferRasterizerSSE::DepthBufferRasterizerSSE()
 	  mpStartT1(NULL),
 	  mNumVertices1(0),
 	  mNumTriangles1(0),
+	  mpOccluderBoxes(NULL),
+	  mpOccluderPackets(NULL),
+	  mpBoxTestSetup(NULL),
+	  mpCellModels(NULL),
 	  mOccluderSizeThreshold(0.0f),
 	  mTimeCounter(0),
-	  mEnableFCulling(true)
+	  mEnableFCulling(true),
+	  mOccluderWaves(false)
 {
-	mpXformedPos[0] = mpXformedPos[1] = NULL;
-	mpCamera[0] = mpCamera[1] = NULL;
-	mpViewMatrix[0] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mpViewMatrix[1] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mpProjMatrix[0] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mpProjMatrix[1] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mpRenderTargetPixels[0] = NULL;
-	mpRenderTargetPixels[1] = NULL;
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpXformedPos[i] = NULL;
+		mpCamera[i] = NULL;
+		mpViewMatrix[i] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
+		mpProjMatrix[i] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
+		mpRenderTargetPixels[i] = NULL;
 
-	mNumRasterized[0] = mNumRasterized[1] = NULL;
+		mpTileCounters[i] = NULL;
+		mpVisCounters[i] = NULL;
 
-	mpBin[0] = mpBin[1] = NULL;
-	mpBinModel[0] = mpBinModel[1] = NULL;
-	mpBinMesh[0] = mpBinMesh[1] = NULL;
-	mpNumTrisInBin[0] = mpNumTrisInBin[1] = NULL;
+		mpBin[i] = NULL;
+		mpBinModel[i] = NULL;
+		mpBinMesh[i] = NULL;
+		mpNumTrisInBin[i] = NULL;
 
-	mpModelIndexA[0] = mpModelIndexA[1] = NULL;
+		mpModelIndexA[i] = NULL;
+		mpStartVA[i] = NULL;
+		mpStartTA[i] = NULL;
+		mNumModelsFar[i] = 0;
+		mpViewDepth[i] = NULL;
+		mpFarVisible[i] = NULL;
+		mpInsideFrustum1[i] = NULL;
+		mpTooSmall1[i] = NULL;
+	}
+	mpBoxTestSetup = (BoxTestSetupSSE*)_aligned_malloc(sizeof(BoxTestSetupSSE) * MAX_SLOTS, 16);
 
 	for(UINT i = 0; i < AVG_COUNTER; i++)
 	{
@@ -58,20 +92,37 @@ DepthBufferRasterizerSSE::~DepthBufferRasterizerSSE()
 	SAFE_DELETE_ARRAY(mpXformedPosOffset1);
 	SAFE_DELETE_ARRAY(mpStartV1);
 	SAFE_DELETE_ARRAY(mpStartT1);
-	SAFE_DELETE_ARRAY(mpModelIndexA[0]);
-	SAFE_DELETE_ARRAY(mpModelIndexA[1]);
-	_aligned_free(mpXformedPos[0]);
-	_aligned_free(mpXformedPos[1]);
-	_aligned_free(mpViewMatrix[0]);
-	_aligned_free(mpViewMatrix[1]);
-	_aligned_free(mpProjMatrix[0]);
-	_aligned_free(mpProjMatrix[1]);
+	SAFE_DELETE_ARRAY(mpOccluderBoxes);
+	SAFE_DELETE_ARRAY(mpCellModels);
+	_aligned_free(mpOccluderPackets);
+	_aligned_free(mpBoxTestSetup);
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		SAFE_DELETE_ARRAY(mpInsideFrustum1[i]);
+		SAFE_DELETE_ARRAY(mpTooSmall1[i]);
+		SAFE_DELETE_ARRAY(mpModelIndexA[i]);
+		SAFE_DELETE_ARRAY(mpStartVA[i]);
+		SAFE_DELETE_ARRAY(mpStartTA[i]);
+		SAFE_DELETE_ARRAY(mpViewDepth[i]);
+		SAFE_DELETE_ARRAY(mpFarVisible[i]);
+		_aligned_free(mpXformedPos[i]);
+		_aligned_free(mpViewMatrix[i]);
+		_aligned_free(mpProjMatrix[i]);
+
+		SAFE_DELETE_ARRAY(mpBin[i]);
+		SAFE_DELETE_ARRAY(mpBinModel[i]);
+		SAFE_DELETE_ARRAY(mpBinMesh[i]);
+		_aligned_free(mpNumTrisInBin[i]);
+		_aligned_free(mpTileCounters[i]);
+		_aligned_free(mpVisCounters[i]);
+	}
 }
 
 //--------------------------------------------------------------------
 // * Go through the asset set and determine the model count in it
 // * Create data structures for all the models in the asset set
 // * For each model create the place holders for the transformed vertices
+// * Sort the models into the occluder grid
 //--------------------------------------------------------------------
 void DepthBufferRasterizerSSE::CreateTransformedModels(CPUTAssetSet **mpAssetSet, UINT numAssetSets)
 {
@@ -90,14 +141,9 @@ void DepthBufferRasterizerSSE::CreateTransformedModels(CPUTAssetSet **mpAssetSet
 		}
 	}
 
-	mpTransformedModels1 = new TransformedModelSSE[mNumModels1];
-	mpXformedPosOffset1 = new UINT[mNumModels1];
-	mpStartV1 = new UINT[mNumModels1 + 1];
-	mpStartT1 = new UINT[mNumModels1 + 1];
+	AllocateModels();
 
 	//mpStartV1[0] = mpStartT1[0] = 0;
-	mpModelIndexA[0] = new UINT[mNumModels1];
-	mpModelIndexA[1] = new UINT[mNumModels1];
 	UINT modelId = 0;
 
 	for(UINT assetId = 0; assetId < numAssetSets; assetId++)
@@ -114,14 +160,8 @@ void DepthBufferRasterizerSSE::CreateTransformedModels(CPUTAssetSet **mpAssetSet
 
 				model = (CPUTModelDX11*)pRenderNode;
 				mpTransformedModels1[modelId].CreateTransformedMeshes(model);
-			
-				mpXformedPosOffset1[modelId] = mpTransformedModels1[modelId].GetNumVertices();
-								
-				mpStartV1[modelId] = mNumVertices1;				
-				mNumVertices1 += mpTransformedModels1[modelId].GetNumVertices();
-
-				mpStartT1[modelId] = mNumTriangles1;
-				mNumTriangles1 += mpTransformedModels1[modelId].GetNumTriangles();
+				mpOccluderBoxes[modelId].CreateAABBVertexIndexList(model);
+				AddModel(modelId);
 				modelId++;
 			}
 			pRenderNode->Release();
@@ -130,17 +170,507 @@ void DepthBufferRasterizerSSE::CreateTransformedModels(CPUTAssetSet **mpAssetSet
 
 	mpStartV1[modelId] = mNumVertices1;
 	mpStartT1[modelId] = mNumTriangles1;
-		
-	//for x, y, z, w
-	mpXformedPos[0] = (__m128*)_aligned_malloc(sizeof(float)* 4 * mNumVertices1, 16);
-	mpXformedPos[1] = (__m128*)_aligned_malloc(sizeof(float)* 4 * mNumVertices1, 16);
 
+	CreateOccluderGrid();
+}
+
+//--------------------------------------------------------------------
+// Same for the occluders of a scene without CPUT models, every one
+// of them is a model with a single mesh
+//--------------------------------------------------------------------
+void DepthBufferRasterizerSSE::CreateTransformedModels(const CullingScene &scene)
+{
+	mNumModels1 = scene.GetNumOccluders();
+	AllocateModels();
+
+	for(UINT modelId = 0; modelId < mNumModels1; modelId++)
+	{
+		mpTransformedModels1[modelId].CreateTransformedMeshes(scene, modelId);
+		mpOccluderBoxes[modelId].CreateAABBVertexIndexList(scene, modelId);
+		AddModel(modelId);
+	}
+
+	mpStartV1[mNumModels1] = mNumVertices1;
+	mpStartT1[mNumModels1] = mNumTriangles1;
+
+	CreateOccluderGrid();
+}
+
+void DepthBufferRasterizerSSE::AllocateModels()
+{
+	mpTransformedModels1 = new TransformedModelSSE[mNumModels1];
+	mpOccluderBoxes = new TransformedAABBoxSSE[mNumModels1];
+	mpXformedPosOffset1 = new UINT[mNumModels1];
+	mpStartV1 = new UINT[mNumModels1 + 1];
+	mpStartT1 = new UINT[mNumModels1 + 1];
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpInsideFrustum1[i] = new bool[mNumModels1];
+		mpTooSmall1[i] = new bool[mNumModels1];
+		memset(mpInsideFrustum1[i], 0, sizeof(bool) * mNumModels1);
+		memset(mpTooSmall1[i], 0, sizeof(bool) * mNumModels1);
+	}
+}
+
+void DepthBufferRasterizerSSE::AddModel(UINT modelId)
+{
+	mpXformedPosOffset1[modelId] = mpTransformedModels1[modelId].GetNumVertices();
+
+	mpStartV1[modelId] = mNumVertices1;
+	mNumVertices1 += mpTransformedModels1[modelId].GetNumVertices();
+
+	mpStartT1[modelId] = mNumTriangles1;
+	mNumTriangles1 += mpTransformedModels1[modelId].GetNumTriangles();
+}
+
+//--------------------------------------------------------------------
+// Spread the grid over the occluder centers on the ground plane (x, z)
+// and counting sort the occluders by the cell of their center. Every 
+// cell is padded to whole packets of 4 occluders, the packets hold the
+// world bounds of the occluders for the SIMD frustum and size tests.
+// Every cell keeps the bounds of its occluders' boxes, which can reach
+// out of the cell, and the largest of their bounding radii
+//--------------------------------------------------------------------
+void DepthBufferRasterizerSSE::CreateOccluderGrid()
+{
+	memset(mCellStart, 0, sizeof(mCellStart));
+	if(mNumModels1 == 0)
+	{
+		return;
+	}
+
+	float3 gridMin = mpOccluderBoxes[0].GetCenterWS();
+	float3 gridMax = gridMin;
+	for(UINT i = 1; i < mNumModels1; i++)
+	{
+		const float3 &center = mpOccluderBoxes[i].GetCenterWS();
+		gridMin.x = min(gridMin.x, center.x);
+		gridMin.z = min(gridMin.z, center.z);
+		gridMax.x = max(gridMax.x, center.x);
+		gridMax.z = max(gridMax.z, center.z);
+	}
+	float scaleX = (float)OCCLUDER_GRID_SIZE / max(gridMax.x - gridMin.x, 1e-3f);
+	float scaleZ = (float)OCCLUDER_GRID_SIZE / max(gridMax.z - gridMin.z, 1e-3f);
+
+	UINT *pCell = new UINT[mNumModels1];
+	for(UINT i = 0; i < mNumModels1; i++)
+	{
+		const float3 &center = mpOccluderBoxes[i].GetCenterWS();
+		int cellX = min((int)((center.x - gridMin.x) * scaleX), OCCLUDER_GRID_SIZE - 1);
+		int cellZ = min((int)((center.z - gridMin.z) * scaleZ), OCCLUDER_GRID_SIZE - 1);
+		pCell[i] = cellZ * OCCLUDER_GRID_SIZE + cellX;
+		mCellStart[pCell[i] + 1]++;
+	}
+	for(UINT cell = 0; cell < OCCLUDER_GRID_CELLS; cell++)
+	{
+		mCellStart[cell + 1] = mCellStart[cell] + ((mCellStart[cell + 1] + SSE - 1) & ~(SSE - 1));
+	}
+
+	UINT numSlots = mCellStart[OCCLUDER_GRID_CELLS];
+	mpCellModels = new UINT[numSlots];
+	for(UINT k = 0; k < numSlots; k++)
+	{
+		mpCellModels[k] = NO_OCCLUDER;
+	}
+
+	UINT offset[OCCLUDER_GRID_CELLS];
+	memcpy(offset, mCellStart, sizeof(offset));
+	for(UINT i = 0; i < mNumModels1; i++)
+	{
+		mpCellModels[offset[pCell[i]]++] = i;
+	}
+	SAFE_DELETE_ARRAY(pCell);
+
+	// The padding lanes get empty bounds, their results are never written
+	mpOccluderPackets = (OccluderPacket*)_aligned_malloc(sizeof(OccluderPacket) * numSlots / SSE, 16);
+	float3 zero(0.0f, 0.0f, 0.0f);
+	for(UINT k = 0; k < numSlots; k++)
+	{
+		UINT i = mpCellModels[k];
+		if(i == NO_OCCLUDER)
+		{
+			mpOccluderPackets[k / SSE].SetLane(k % SSE, zero, zero, 0.0f);
+		}
+		else
+		{
+			mpOccluderPackets[k / SSE].SetLane(k % SSE, mpOccluderBoxes[i].GetCenterWS(), mpOccluderBoxes[i].GetHalfWS(), mpTransformedModels1[i].GetRadiusSq());
+		}
+	}
+
+	for(UINT cell = 0; cell < OCCLUDER_GRID_CELLS; cell++)
+	{
+		float3 bbMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		float3 bbMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		mCellRadiusSq[cell] = 0.0f;
+		for(UINT k = mCellStart[cell]; k < mCellStart[cell + 1]; k++)
+		{
+			UINT i = mpCellModels[k];
+			if(i == NO_OCCLUDER)
+			{
+				continue;
+			}
+			const float3 &center = mpOccluderBoxes[i].GetCenterWS();
+			const float3 &half = mpOccluderBoxes[i].GetHalfWS();
+			for(UINT j = 0; j < 3; j++)
+			{
+				bbMin.f[j] = min(bbMin.f[j], center.f[j] - half.f[j]);
+				bbMax.f[j] = max(bbMax.f[j], center.f[j] + half.f[j]);
+			}
+			mCellRadiusSq[cell] = max(mCellRadiusSq[cell], mpTransformedModels1[i].GetRadiusSq());
+		}
+		mCellCenter[cell] = (bbMax + bbMin) * 0.5f;
+		mCellHalf[cell] = (bbMax - bbMin) * 0.5f;
+	}
+}
+
+//--------------------------------------------------------------------
+// A cell is too small for a view when even its largest occluder would
+// be too small at the nearest w of the cell's bounds; w is linear so 
+// its minimum over the box is found from the center and half vector
+//--------------------------------------------------------------------
+static inline bool CellTooSmall(const BoxTestSetupSSE &setup, const float3 &center, const float3 &half, float radiusSq)
+{
+	const __m128 *pMatrix = setup.mViewProjViewport;
+	float w = center.x * pMatrix[0].m128_f32[3] +
+			  center.y * pMatrix[1].m128_f32[3] +
+			  center.z * pMatrix[2].m128_f32[3] +
+			  pMatrix[3].m128_f32[3];
+	float minW = w - (half.x * fabsf(pMatrix[0].m128_f32[3]) +
+					  half.y * fabsf(pMatrix[1].m128_f32[3]) +
+					  half.z * fabsf(pMatrix[2].m128_f32[3]));
+	return minW > 1.0f && radiusSq < minW * setup.radiusThreshold;
+}
+
+void DepthBufferRasterizerSSE::InitBoxTestSetup(CPUTCamera *pCamera, UINT idx)
+{
+	mpBoxTestSetup[idx].Init(mpViewMatrix[idx], mpProjMatrix[idx], viewportMatrix, pCamera, mOccluderSizeThreshold);
+	memset(mpVisCounters[idx], 0, NUM_OCCLUDER_VIS_TASKS * sizeof(OccluderVisCounters));
+}
+
+//--------------------------------------------------------------------
+// The counters are only read once the slot's tasks are done, summing
+// up a block per task is all the main thread has to do
+//--------------------------------------------------------------------
+void DepthBufferRasterizerSSE::GetFrameStats(UINT idx, CullingStats *pStats)
+{
+	pStats->mNumOccludersR2DB = 0;
+	for(UINT i = 0; i < NUM_OCCLUDER_VIS_TASKS; i++)
+	{
+		pStats->mNumOccludersR2DB += mpVisCounters[idx][i].mNumOccludersR2DB;
+	}
+
+	pStats->mNumRasterizedTris = pStats->mNumSimdBatches = pStats->mNumSimdLanes = 0;
+	for(UINT i = 0; i < NUM_TILES; i++)
+	{
+		const OccluderTileCounters &tile = mpTileCounters[idx][i];
+		pStats->mNumTrisInTile[i] = tile.mNumTris;
+		pStats->mNumRasterizedTris += tile.mNumTris;
+		pStats->mNumSimdBatches += tile.mNumSimdBatches;
+		pStats->mNumSimdLanes += tile.mNumSimdLanes;
+	}
+}
+
+void DepthBufferRasterizerSSE::CullOccluderCells(UINT numViews, UINT start, UINT end, UINT taskId, UINT idx)
+{
+	UINT numRasterized[MAX_VIEWS] = {0};
+	const BoxTestSetupSSE *pSetup = &mpBoxTestSetup[idx];
+
+	// Prepare the plane equations and the w column of every view
+	__m128 planeNormal[MAX_VIEWS][6][3];
+	__m128 planeNormalSign[MAX_VIEWS][6][3];
+	__m128 planeDist[MAX_VIEWS][6];
+	__m128 matrixW[MAX_VIEWS][4];
+	__m128 radiusThreshold[MAX_VIEWS];
+	__m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	for(UINT view = 0; view < numViews; view++)
+	{
+		const CPUTFrustum &frustum = pSetup[view].mpCamera->mFrustum;
+		for(UINT i = 0; i < 6; i++)
+		{
+			for(UINT j = 0; j < 3; j++)
+			{
+				planeNormal[view][i][j] = _mm_set1_ps(frustum.mpNormal[i].f[j]);
+				planeNormalSign[view][i][j] = _mm_and_ps(planeNormal[view][i][j], signMask);
+			}
+			planeDist[view][i] = _mm_set1_ps(frustum.mPlanes[3*8 + i]);
+		}
+
+		for(UINT j = 0; j < 4; j++)
+		{
+			matrixW[view][j] = _mm_set1_ps(pSetup[view].mViewProjViewport[j].m128_f32[3]);
+		}
+		radiusThreshold[view] = _mm_set1_ps(pSetup[view].radiusThreshold);
+	}
+
+	__m128 one = _mm_set1_ps(1.0f);
+	for(UINT cell = start; cell < end; cell++)
+	{
+		mCellNumModelsA[idx][cell] = mCellNumVerticesA[idx][cell] = mCellNumTrianglesA[idx][cell] = 0;
+		if(mCellStart[cell] == mCellStart[cell + 1])
+		{
+			continue;
+		}
+
+		for(UINT view = 0; view < numViews; view++)
+		{
+			bool * __restrict pInside = mpInsideFrustum1[idx + view];
+			bool * __restrict pTooSmall = mpTooSmall1[idx + view];
+
+			bool cellIn = (!mEnableFCulling || pSetup[view].mpCamera->mFrustum.IsVisible(mCellCenter[cell], mCellHalf[cell])) &&
+						  !CellTooSmall(pSetup[view], mCellCenter[cell], mCellHalf[cell], mCellRadiusSq[cell]);
+			if(!cellIn)
+			{
+				// Without frustum culling the inside flags stay set, mark the rejected occluders too small
+				for(UINT k = mCellStart[cell]; k < mCellStart[cell + 1]; k++)
+				{
+					UINT i = mpCellModels[k];
+					if(i != NO_OCCLUDER)
+					{
+						if(mEnableFCulling)
+						{
+							pInside[i] = false;
+						}
+						else
+						{
+							pTooSmall[i] = true;
+						}
+					}
+				}
+				continue;
+			}
+
+			for(UINT packet = mCellStart[cell] / SSE; packet < mCellStart[cell + 1] / SSE; packet++)
+			{
+				const OccluderPacket &boxes = mpOccluderPackets[packet];
+
+				// Start assuming all 4 boxes are inside
+				__m128 inMask = _mm_castsi128_ps(_mm_set1_epi32(~0));
+				if(mEnableFCulling)
+				{
+					for(UINT j = 0; j < 6; j++)
+					{
+						// Sign for half[XYZ] so that dot product with plane normal would be maximal
+						__m128 cornerX = _mm_sub_ps(boxes.mCenter[0], _mm_xor_ps(boxes.mHalf[0], planeNormalSign[view][j][0]));
+						__m128 cornerY = _mm_sub_ps(boxes.mCenter[1], _mm_xor_ps(boxes.mHalf[1], planeNormalSign[view][j][1]));
+						__m128 cornerZ = _mm_sub_ps(boxes.mCenter[2], _mm_xor_ps(boxes.mHalf[2], planeNormalSign[view][j][2]));
+
+						// The box is inside the plane as long as the dot product is negative -> sign bit set
+						__m128 dot = planeDist[view][j];
+						dot = _mm_add_ps(dot, _mm_mul_ps(cornerX, planeNormal[view][j][0]));
+						dot = _mm_add_ps(dot, _mm_mul_ps(cornerY, planeNormal[view][j][1]));
+						dot = _mm_add_ps(dot, _mm_mul_ps(cornerZ, planeNormal[view][j][2]));
+						inMask = _mm_and_ps(inMask, dot);
+					}
+				}
+
+				// Screen space size test at the w of the box center. A center behind the near
+				// clip plane makes the screen space radius meaningless, such a box is kept
+				__m128 w = matrixW[view][3];
+				w = _mm_add_ps(w, _mm_mul_ps(boxes.mCenter[0], matrixW[view][0]));
+				w = _mm_add_ps(w, _mm_mul_ps(boxes.mCenter[1], matrixW[view][1]));
+				w = _mm_add_ps(w, _mm_mul_ps(boxes.mCenter[2], matrixW[view][2]));
+				__m128 smallMask = _mm_and_ps(_mm_cmpgt_ps(w, one), _mm_cmplt_ps(boxes.mRadiusSq, _mm_mul_ps(w, radiusThreshold[view])));
+
+				int insideBits = _mm_movemask_ps(inMask);
+				int smallBits = _mm_movemask_ps(smallMask);
+				for(UINT lane = 0; lane < SSE; lane++)
+				{
+					UINT i = mpCellModels[packet * SSE + lane];
+					if(i == NO_OCCLUDER)
+					{
+						continue;
+					}
+
+					bool inside = (insideBits >> lane) & 1;
+					if(mEnableFCulling)
+					{
+						pInside[i] = inside;
+					}
+					else
+					{
+						inside = pInside[i];
+					}
+
+					if(inside)
+					{
+						pTooSmall[i] = (smallBits >> lane) & 1;
+						if(!pTooSmall[i])
+						{
+							numRasterized[view]++;
+							mpTransformedModels1[i].ComputeCumulativeMatrix(pSetup[view], idx + view);
+						}
+					}
+				}
+			}
+		}
+
+		// Count the cell's active occluders for the compaction of the active model list
+		for(UINT k = mCellStart[cell]; k < mCellStart[cell + 1]; k++)
+		{
+			UINT i = mpCellModels[k];
+			if(i != NO_OCCLUDER && IsActive(i, numViews, idx))
+			{
+				mCellNumModelsA[idx][cell]++;
+				mCellNumVerticesA[idx][cell] += mpStartV1[i + 1] - mpStartV1[i];
+				mCellNumTrianglesA[idx][cell] += mpStartT1[i + 1] - mpStartT1[i];
+			}
+		}
+	}
+
+	for(UINT view = 0; view < numViews; view++)
+	{
+		mpVisCounters[idx + view][taskId].mNumOccludersR2DB = numRasterized[view];
+	}
+}
+
+void DepthBufferRasterizerSSE::CompactActiveCells(UINT numViews, UINT start, UINT end, UINT idx)
+{
+	UINT numModels = 0, numVertices = 0, numTriangles = 0;
+	for(UINT cell = 0; cell < start; cell++)
+	{
+		numModels += mCellNumModelsA[idx][cell];
+		numVertices += mCellNumVerticesA[idx][cell];
+		numTriangles += mCellNumTrianglesA[idx][cell];
+	}
+
+	for(UINT cell = start; cell < end; cell++)
+	{
+		if(mCellNumModelsA[idx][cell] == 0)
+		{
+			continue;
+		}
+
+		for(UINT k = mCellStart[cell]; k < mCellStart[cell + 1]; k++)
+		{
+			UINT i = mpCellModels[k];
+			if(i == NO_OCCLUDER || !IsActive(i, numViews, idx))
+			{
+				continue;
+			}
+
+			for(UINT view = idx; view < idx + numViews; view++)
+			{
+				mpModelIndexA[view][numModels] = i;
+				mpStartVA[view][numModels] = numVertices;
+				mpStartTA[view][numModels] = numTriangles;
+			}
+			numModels++;
+			numVertices += mpStartV1[i + 1] - mpStartV1[i];
+			numTriangles += mpStartT1[i + 1] - mpStartT1[i];
+		}
+	}
+
+	if(end == OCCLUDER_GRID_CELLS)
+	{
+		for(UINT view = idx; view < idx + numViews; view++)
+		{
+			mNumModelsA[view] = numModels;
+			mNumVerticesA[view] = numVertices;
+			mNumTrianglesA[view] = numTriangles;
+			mNumModelsFar[view] = 0;
+			mpStartVA[view][numModels] = numVertices;
+			mpStartTA[view][numModels] = numTriangles;
+		}
+	}
+}
+
+//--------------------------------------------------------------------
+// Create the transformed vertex buffer, active model list and bins
+// for a frame slot the first time the slot is used
+//--------------------------------------------------------------------
+void DepthBufferRasterizerSSE::AllocateSlot(UINT idx, UINT numBins, UINT maxTrisInBin)
+{
+	mpModelIndexA[idx] = new UINT[mNumModels1];
+	mpStartVA[idx] = new UINT[mNumModels1 + 1];
+	mpStartTA[idx] = new UINT[mNumModels1 + 1];
+	mpViewDepth[idx] = new float[mNumModels1];
+	mpFarVisible[idx] = new bool[mNumModels1];
+
+	//for x, y, z, w
+	mpXformedPos[idx] = (__m128*)_aligned_malloc(sizeof(float)* 4 * mNumVertices1, 16);
 	for(UINT i = 0; i < mNumModels1; i++)
 	{
-		mpTransformedModels1[i].SetXformedPos(&mpXformedPos[0][mpStartV1[i]],
-											  &mpXformedPos[1][mpStartV1[i]],
-											  mpStartV1[i]);
+		mpTransformedModels1[i].SetXformedPos(&mpXformedPos[idx][mpStartV1[i]], idx);
 	}
+
+	mpBin[idx] = new UINT[numBins * maxTrisInBin];
+	mpBinModel[idx] = new USHORT[numBins * maxTrisInBin];
+	mpBinMesh[idx] = new USHORT[numBins * maxTrisInBin];
+	mpNumTrisInBin[idx] = (USHORT*)_aligned_malloc(numBins * sizeof(USHORT), 64);
+
+	// One cache line per task, the tile counters are filled in by the first raster pass
+	mpTileCounters[idx] = (OccluderTileCounters*)_aligned_malloc(NUM_TILES * sizeof(OccluderTileCounters), 64);
+	mpVisCounters[idx] = (OccluderVisCounters*)_aligned_malloc(NUM_OCCLUDER_VIS_TASKS * sizeof(OccluderVisCounters), 64);
+	memset(mpTileCounters[idx], 0, NUM_TILES * sizeof(OccluderTileCounters));
+}
+
+//--------------------------------------------------------------------
+// Coarse front to back order: the occluders are sorted by the view 
+// depth of their bounding box center and the nearest ones holding half
+// of the active triangles make up the near wave
+//--------------------------------------------------------------------
+void DepthBufferRasterizerSSE::SplitActiveNearFar(UINT idx)
+{
+	UINT numActive = mNumModelsA[idx];
+	UINT numTriangles = mNumTrianglesA[idx];
+	UINT *pActive = mpModelIndexA[idx];
+	float *pViewDepth = mpViewDepth[idx];
+	const __m128 *pView = mpViewMatrix[idx];
+
+	for(UINT i = 0; i < numActive; i++)
+	{
+		const float3 &center = mpOccluderBoxes[pActive[i]].GetCenterWS();
+		pViewDepth[pActive[i]] = center.x * pView[0].m128_f32[2] + 
+								 center.y * pView[1].m128_f32[2] + 
+								 center.z * pView[2].m128_f32[2] + 
+								 pView[3].m128_f32[2];
+	}
+	std::sort(pActive, pActive + numActive,
+		[&](const UINT a, const UINT b){ return pViewDepth[a] < pViewDepth[b]; });
+
+	// Activate re-writes the sorted list in place
+	ResetActive(idx);
+	UINT i = 0;
+	for(; i < numActive && 2 * mNumTrianglesA[idx] < numTriangles; i++)
+	{
+		Activate(pActive[i], idx);
+	}
+	mNumModelsFar[idx] = numActive - i;
+}
+
+//--------------------------------------------------------------------
+// A far wave occluder is dropped if its bounding box is hidden by the
+// near wave, the near clipped ones are always kept
+//--------------------------------------------------------------------
+void DepthBufferRasterizerSSE::CullFarOccluders(UINT start, UINT end, UINT idx)
+{
+	const BoxTestSetupSSE &setup = mpBoxTestSetup[idx];
+
+	__m128 xformedPos[AABB_VERTICES];
+	const UINT *pFar = mpModelIndexA[idx] + mNumModelsA[idx];
+	for(UINT i = start; i < end; i++)
+	{
+		TransformedAABBoxSSE &box = mpOccluderBoxes[pFar[i]];
+		mpFarVisible[idx][i] = !box.TransformAABBoxWS(xformedPos, setup, 1.0f) ||
+							   box.RasterizeAndDepthTestAABBox(mpRenderTargetPixels[idx], xformedPos, idx);
+	}
+}
+
+void DepthBufferRasterizerSSE::ActivateFar(UINT idx)
+{
+	UINT numFar = mNumModelsFar[idx];
+	const UINT *pFar = mpModelIndexA[idx] + mNumModelsA[idx];
+
+	// The survivors are compacted to the front of the list, never past the entry being read
+	ResetActive(idx);
+	for(UINT i = 0; i < numFar; i++)
+	{
+		if(mpFarVisible[idx][i])
+		{
+			Activate(pFar[i], idx);
+		}
+	}
+	mNumModelsFar[idx] = 0;
 }
 
 //--------------------------------------------------------------------
@@ -162,6 +692,158 @@ void DepthBufferRasterizerSSE::ClearDepthTile(int startX, int startY, int endX,
 	}
 }
 
+//--------------------------------------------------------------------------------------
+// Rasterize up to 4 gathered screen space triangles into the part of the depth buffer in
+// the tile (tileStartX, tileStartY) .. (tileEndX, tileEndY). Shared by the binned
+// rasterizers and the kernel benchmark
+//--------------------------------------------------------------------------------------
+void DepthBufferRasterizerSSE::RasterizeTriangles(float *pDepthBuffer, const __m128 gatherBuf[4][3], int numSimdTris, int tileStartX, int tileEndX, int tileStartY, int tileEndY)
+{
+	__m128i colOffset = _mm_setr_epi32(0, 1, 0, 1);
+	__m128i rowOffset = _mm_setr_epi32(0, 0, 1, 1);
+
+	// use fixed-point only for X and Y.  Avoid work for Z and W.
+	__m128i fxPtX[3], fxPtY[3];
+	__m128 Z[3];
+	for(int i = 0; i < 3; i++)
+	{
+		// read 4 verts
+		__m128 v0 = gatherBuf[0][i];
+		__m128 v1 = gatherBuf[1][i];
+		__m128 v2 = gatherBuf[2][i];
+		__m128 v3 = gatherBuf[3][i];
+
+		// transpose into SoA layout
+		_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+		fxPtX[i] = _mm_cvtps_epi32(v0);
+		fxPtY[i] = _mm_cvtps_epi32(v1);
+		Z[i] = v2;
+	}
+
+	// Fab(x, y) =     Ax       +       By     +      C              = 0
+	// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
+	// Compute A = (ya - yb) for the 3 line segments that make up each triangle
+	__m128i A0 = _mm_sub_epi32(fxPtY[1], fxPtY[2]);
+	__m128i A1 = _mm_sub_epi32(fxPtY[2], fxPtY[0]);
+	__m128i A2 = _mm_sub_epi32(fxPtY[0], fxPtY[1]);
+
+	// Compute B = (xb - xa) for the 3 line segments that make up each triangle
+	__m128i B0 = _mm_sub_epi32(fxPtX[2], fxPtX[1]);
+	__m128i B1 = _mm_sub_epi32(fxPtX[0], fxPtX[2]);
+	__m128i B2 = _mm_sub_epi32(fxPtX[1], fxPtX[0]);
+
+	// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
+	__m128i C0 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[1], fxPtY[2]), _mm_mullo_epi32(fxPtX[2], fxPtY[1]));
+	__m128i C1 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[2], fxPtY[0]), _mm_mullo_epi32(fxPtX[0], fxPtY[2]));
+	__m128i C2 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[0], fxPtY[1]), _mm_mullo_epi32(fxPtX[1], fxPtY[0]));
+
+	// Compute triangle area
+	__m128i triArea = _mm_mullo_epi32(B2, A1);
+	triArea = _mm_sub_epi32(triArea, _mm_mullo_epi32(B1, A2));
+	__m128 oneOverTriArea = _mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(triArea));
+
+	Z[1] = _mm_mul_ps(_mm_sub_ps(Z[1], Z[0]), oneOverTriArea);
+	Z[2] = _mm_mul_ps(_mm_sub_ps(Z[2], Z[0]), oneOverTriArea);
+
+	// Use bounding box traversal strategy to determine which pixels to rasterize 
+	__m128i startX = _mm_and_si128(_mm_max_epi32(_mm_min_epi32(_mm_min_epi32(fxPtX[0], fxPtX[1]), fxPtX[2]), _mm_set1_epi32(tileStartX)), _mm_set1_epi32(0xFFFFFFFE));
+	__m128i endX   = _mm_min_epi32(_mm_add_epi32(_mm_max_epi32(_mm_max_epi32(fxPtX[0], fxPtX[1]), fxPtX[2]), _mm_set1_epi32(1)), _mm_set1_epi32(tileEndX));
+
+	__m128i startY = _mm_and_si128(_mm_max_epi32(_mm_min_epi32(_mm_min_epi32(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(tileStartY)), _mm_set1_epi32(0xFFFFFFFE));
+	__m128i endY   = _mm_min_epi32(_mm_add_epi32(_mm_max_epi32(_mm_max_epi32(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(1)), _mm_set1_epi32(tileEndY));
+
+	// Now we have 4 triangles set up.  Rasterize them each individually.
+	for(int lane=0; lane < numSimdTris; lane++)
+	{
+		// Extract this triangle's properties from the SIMD versions
+		__m128 zz[3];
+		for(int vv = 0; vv < 3; vv++)
+		{
+			zz[vv] = _mm_set1_ps(Z[vv].m128_f32[lane]);
+		}
+
+		int startXx = startX.m128i_i32[lane];
+		int endXx	= endX.m128i_i32[lane];
+		int startYy = startY.m128i_i32[lane];
+		int endYy	= endY.m128i_i32[lane];
+	
+		// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY) 
+		__m128i aa0 = _mm_set1_epi32(A0.m128i_i32[lane]);
+		__m128i aa1 = _mm_set1_epi32(A1.m128i_i32[lane]);
+		__m128i aa2 = _mm_set1_epi32(A2.m128i_i32[lane]);
+
+		__m128i bb0 = _mm_set1_epi32(B0.m128i_i32[lane]);
+		__m128i bb1 = _mm_set1_epi32(B1.m128i_i32[lane]);
+		__m128i bb2 = _mm_set1_epi32(B2.m128i_i32[lane]);
+
+		__m128i aa0Inc = _mm_slli_epi32(aa0, 1);
+		__m128i aa1Inc = _mm_slli_epi32(aa1, 1);
+		__m128i aa2Inc = _mm_slli_epi32(aa2, 1);
+
+		__m128i row, col;
+
+		// Tranverse pixels in 2x2 blocks and store 2x2 pixel quad depthscontiguously in memory ==> 2*X
+		// This method provides better perfromance
+		int rowIdx = (startYy * SCREENW + 2 * startXx);
+		
+		col = _mm_add_epi32(colOffset, _mm_set1_epi32(startXx));
+		__m128i aa0Col = _mm_mullo_epi32(aa0, col);
+		__m128i aa1Col = _mm_mullo_epi32(aa1, col);
+		__m128i aa2Col = _mm_mullo_epi32(aa2, col);
+
+		row = _mm_add_epi32(rowOffset, _mm_set1_epi32(startYy));
+		__m128i bb0Row = _mm_add_epi32(_mm_mullo_epi32(bb0, row), _mm_set1_epi32(C0.m128i_i32[lane]));
+		__m128i bb1Row = _mm_add_epi32(_mm_mullo_epi32(bb1, row), _mm_set1_epi32(C1.m128i_i32[lane]));
+		__m128i bb2Row = _mm_add_epi32(_mm_mullo_epi32(bb2, row), _mm_set1_epi32(C2.m128i_i32[lane]));
+
+		__m128i sum0Row = _mm_add_epi32(aa0Col, bb0Row);
+		__m128i sum1Row = _mm_add_epi32(aa1Col, bb1Row);
+		__m128i sum2Row = _mm_add_epi32(aa2Col, bb2Row);
+
+		__m128i bb0Inc = _mm_slli_epi32(bb0, 1);
+		__m128i bb1Inc = _mm_slli_epi32(bb1, 1);
+		__m128i bb2Inc = _mm_slli_epi32(bb2, 1);
+
+		__m128 zx = _mm_mul_ps(_mm_cvtepi32_ps(aa1Inc), zz[1]);
+		zx = _mm_add_ps(zx, _mm_mul_ps(_mm_cvtepi32_ps(aa2Inc), zz[2]));
+
+		for(int r = startYy; r < endYy; r += 2,
+										rowIdx += 2 * SCREENW,
+										sum0Row = _mm_add_epi32(sum0Row, bb0Inc),
+										sum1Row = _mm_add_epi32(sum1Row, bb1Inc),
+										sum2Row = _mm_add_epi32(sum2Row, bb2Inc))
+		{
+			// Compute barycentric coordinates 
+			int index = rowIdx;
+			__m128i alpha = sum0Row;
+			__m128i beta = sum1Row;
+			__m128i gama = sum2Row;
+
+			//Compute barycentric-interpolated depth
+			__m128 depth = zz[0];
+			depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(beta), zz[1]));
+			depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(gama), zz[2]));
+
+			for(int c = startXx; c < endXx; c += 2,
+											index += 4,
+											alpha = _mm_add_epi32(alpha, aa0Inc),
+											beta  = _mm_add_epi32(beta, aa1Inc),
+											gama  = _mm_add_epi32(gama, aa2Inc), 
+											depth = _mm_add_ps(depth, zx))
+			{
+				//Test Pixel inside triangle
+				__m128i mask = _mm_or_si128(_mm_or_si128(alpha, beta), gama);
+				
+				//Update depth
+				__m128 previousDepthValue = _mm_load_ps(&pDepthBuffer[index]);
+				__m128 mergedDepth = _mm_max_ps(depth, previousDepthValue);
+				__m128 finaldepth = _mm_blendv_ps(mergedDepth, previousDepthValue, _mm_castsi128_ps(mask));
+				_mm_store_ps(&pDepthBuffer[index], finaldepth);
+			}//for each column											
+		}// for each row
+	}// for each triangle
+}
+
 void DepthBufferRasterizerSSE::SetViewProj(float4x4 *viewMatrix, float4x4 *projMatrix, UINT idx)
 {
 	mpViewMatrix[idx][0] = _mm_loadu_ps((float*)&viewMatrix->r0);
@@ -18,7 +18,9 @@
 
 #include "DepthBufferRasterizer.h"
 #include "TransformedModelSSE.h"
+#include "TransformedAABBoxSSE.h"
 #include "HelperSSE.h"
+#include <algorithm>
 
 class DepthBufferRasterizerSSE : public DepthBufferRasterizer, public HelperSSE
 {
@@ -27,17 +29,22 @@ class DepthBufferRasterizerSSE : public DepthBufferRasterizer, public HelperSSE
 		virtual ~DepthBufferRasterizerSSE();
 		
 		void CreateTransformedModels(CPUTAssetSet **pAssetSet, UINT numAssetSets);
+		void CreateTransformedModels(const CullingScene &scene);
 
 		// start inclusive, end exclusive
 		void ClearDepthTile(int startX, int startY, int endX, int endY, UINT idx);
+		// Rasterize numSimdTris gathered triangles into a tile, start and end inclusive
+		static void RasterizeTriangles(float *pDepthBuffer, const __m128 gatherBuf[4][3], int numSimdTris, int tileStartX, int tileEndX, int tileStartY, int tileEndY);
 		
 		// Reset all models to be visible when frustum culling is disabled 
 		inline void ResetInsideFrustum()
 		{
 			for(UINT i = 0; i < mNumModels1; i++)
 			{
-				mpTransformedModels1[i].SetInsideFrustum(true, 0);
-				mpTransformedModels1[i].SetInsideFrustum(true, 1);
+				for(UINT idx = 0; idx < MAX_SLOTS; idx++)
+				{
+					mpInsideFrustum1[idx][i] = true;
+				}
 			}
 		}
 
@@ -55,16 +62,9 @@ class DepthBufferRasterizerSSE : public DepthBufferRasterizer, public HelperSSE
 
 		inline void SetEnableFCulling(bool enableFCulling) {mEnableFCulling = enableFCulling;}
 
+		inline void SetOccluderWaves(bool occluderWaves) {mOccluderWaves = occluderWaves;}
+
 		inline UINT GetNumOccluders() {return mNumModels1;}
-		inline UINT GetNumOccludersR2DB(UINT idx)
-		{
-			mNumRasterized[idx] = 0;
-			for(UINT i = 0; i < mNumModels1; i++)
-			{
-				mNumRasterized[idx] += mpTransformedModels1[i].IsRasterized2DB(idx) ? 1 : 0;
-			}
-			return mNumRasterized[idx];
-		}
 		inline double GetRasterizeTime()
 		{
 			double averageTime = 0.0;
@@ -74,20 +74,37 @@ class DepthBufferRasterizerSSE : public DepthBufferRasterizer, public HelperSSE
 			}
 			return averageTime / AVG_COUNTER;
 		}
+		inline double GetLastRasterizeTime()
+		{
+			return mRasterizeTime[(mTimeCounter + AVG_COUNTER - 1) % AVG_COUNTER];
+		}
 		inline UINT GetNumTriangles(){return mNumTriangles1;}
-		inline UINT GetNumRasterizedTriangles(UINT idx) 
+		// Sums up the counter blocks the visibility and raster tasks of the slot filled in
+		void GetFrameStats(UINT idx, CullingStats *pStats);
+
+		inline bool IsRasterized2DB(UINT modelId, UINT idx)
 		{
-			UINT numRasterizedTris = 0;
-			for(UINT i = 0; i < NUM_TILES; i++)
+			return mpInsideFrustum1[idx][modelId] && !mpTooSmall1[idx][modelId];
+		}
+
+		// The views culled together share one active model list, a model is active 
+		// if it is rasterized to at least one of them
+		inline bool IsActive(UINT modelId, UINT numViews, UINT idx)
+		{
+			for(UINT view = idx; view < idx + numViews; view++)
 			{
-				numRasterizedTris += mNumRasterizedTris[idx][i];
+				if(IsRasterized2DB(modelId, view))
+				{
+					return true;
+				}
 			}
-			return numRasterizedTris;
+			return false;
 		}
 
 		inline void ResetActive(UINT idx)
 		{
 			mNumModelsA[idx] = mNumVerticesA[idx] = mNumTrianglesA[idx] = 0;
+			mpStartVA[idx][0] = mpStartTA[idx][0] = 0;
 		}
 
 		inline void Activate(UINT modelId, UINT idx)
@@ -98,9 +115,69 @@ class DepthBufferRasterizerSSE : public DepthBufferRasterizer, public HelperSSE
 			mpModelIndexA[idx][activeId] = modelId;
 			mNumVerticesA[idx] += mpStartV1[modelId + 1] - mpStartV1[modelId];
 			mNumTrianglesA[idx] += mpStartT1[modelId + 1] - mpStartT1[modelId];
+			mpStartVA[idx][activeId + 1] = mNumVerticesA[idx];
+			mpStartTA[idx][activeId + 1] = mNumTrianglesA[idx];
+		}
+
+		// Views culled together share one active model list
+		inline void ShareActive(UINT srcIdx, UINT dstIdx)
+		{
+			mNumModelsA[dstIdx] = mNumModelsA[srcIdx];
+			mNumVerticesA[dstIdx] = mNumVerticesA[srcIdx];
+			mNumTrianglesA[dstIdx] = mNumTrianglesA[srcIdx];
+			mNumModelsFar[dstIdx] = mNumModelsFar[srcIdx];
+			memcpy(mpModelIndexA[dstIdx], mpModelIndexA[srcIdx], (mNumModelsA[srcIdx] + mNumModelsFar[srcIdx]) * sizeof(UINT));
+			memcpy(mpStartVA[dstIdx], mpStartVA[srcIdx], (mNumModelsA[srcIdx] + 1) * sizeof(UINT));
+			memcpy(mpStartTA[dstIdx], mpStartTA[srcIdx], (mNumModelsA[srcIdx] + 1) * sizeof(UINT));
+		}
+
+		// First active model whose vertices (pStartA = mpStartVA) or triangles 
+		// (pStartA = mpStartTA) reach up to the given index
+		inline UINT FindActive(const UINT *pStartA, UINT index, UINT idx)
+		{
+			return (UINT)(std::lower_bound(pStartA + 1, pStartA + mNumModelsA[idx] + 1, index) - (pStartA + 1));
 		}
 		
 	protected:
+		// Allocate the per model data for mNumModels1 models
+		void AllocateModels();
+		// Add the vertices and triangles of a model created by CreateTransformedModels
+		void AddModel(UINT modelId);
+
+		// Slot buffers are only allocated once a frame actually uses the slot
+		void AllocateSlot(UINT idx, UINT numBins, UINT maxTrisInBin);
+
+		// Sort the active models front to back and keep the nearest as the active
+		// near wave, the rest follow it in the active list as the far wave
+		void SplitActiveNearFar(UINT idx);
+
+		// Sort the occluders into the cells of the occluder grid
+		void CreateOccluderGrid();
+
+		// Frustum (with frustum culling enabled) and size test the occluders of the cells
+		// start .. end - 1 for the views in slots idx .. idx + numViews - 1. The cells are
+		// tested first and the occluders of a cell rejected by a view are not tested again.
+		// The occluders are tested 4 at a time and only the survivors get their cumulative
+		// matrix. The views' box test setups must be initialized with InitBoxTestSetup.
+		// The occluders rasterized to a view are counted in the task's counter block
+		void CullOccluderCells(UINT numViews, UINT start, UINT end, UINT taskId, UINT idx);
+
+		// Write the active occluders of the cells start .. end - 1 to the active model lists
+		// of the views, the offsets of the cells in the lists are summed up from the active 
+		// counts CullOccluderCells left for the cells before them. The cells can be compacted
+		// in parallel, the one holding the last cell sets the list sizes
+		void CompactActiveCells(UINT numViews, UINT start, UINT end, UINT idx);
+
+		// Set up the view of slot idx for the occluder tests and clear its visibility
+		// counters, once per frame
+		void InitBoxTestSetup(CPUTCamera *pCamera, UINT idx);
+
+		// Depth test the far wave's bounding boxes against the near wave's depth buffer
+		void CullFarOccluders(UINT start, UINT end, UINT idx);
+
+		// Make the far wave's occluders that passed the depth test the active models
+		void ActivateFar(UINT idx);
+
 		TransformedModelSSE *mpTransformedModels1;
 		UINT mNumModels1;
 		UINT *mpXformedPosOffset1;
@@ -108,27 +185,47 @@ class DepthBufferRasterizerSSE : public DepthBufferRasterizer, public HelperSSE
 		UINT *mpStartT1;
 		UINT mNumVertices1;
 		UINT mNumTriangles1;
-		UINT mNumRasterizedTris[2][NUM_TILES];
-		__m128 *mpXformedPos[2];
-		CPUTCamera *mpCamera[2];
-		__m128 *mpViewMatrix[2];
-		__m128 *mpProjMatrix[2];
-		UINT *mpRenderTargetPixels[2];
-		UINT mNumRasterized[2];
-		UINT *mpBin[2];				 // triangle index
-		USHORT *mpBinModel[2];			 // model index
-		USHORT *mpBinMesh[2];			 // mesh index
-		USHORT *mpNumTrisInBin[2];      // number of triangles in the bin
+		OccluderTileCounters *mpTileCounters[MAX_SLOTS];	// NUM_TILES per slot, one per raster task
+		OccluderVisCounters *mpVisCounters[MAX_SLOTS];		// NUM_OCCLUDER_VIS_TASKS per slot
+		__m128 *mpXformedPos[MAX_SLOTS];
+		CPUTCamera *mpCamera[MAX_SLOTS];
+		__m128 *mpViewMatrix[MAX_SLOTS];
+		__m128 *mpProjMatrix[MAX_SLOTS];
+		UINT *mpRenderTargetPixels[MAX_SLOTS];
+		UINT *mpBin[MAX_SLOTS];				 // triangle index
+		USHORT *mpBinModel[MAX_SLOTS];			 // model index
+		USHORT *mpBinMesh[MAX_SLOTS];			 // mesh index
+		USHORT *mpNumTrisInBin[MAX_SLOTS];      // number of triangles in the bin
 		UINT mTimeCounter;
 
-		UINT *mpModelIndexA[2]; // 'active' models = visible and not too small
-		UINT mNumModelsA[2];
-		UINT mNumVerticesA[2];
-		UINT mNumTrianglesA[2];
+		UINT *mpModelIndexA[MAX_SLOTS]; // 'active' models = visible and not too small
+		UINT *mpStartVA[MAX_SLOTS];		// first vertex of every active model in the active models' vertices
+		UINT *mpStartTA[MAX_SLOTS];		// first triangle, both hold the total after the last active model
+		UINT mNumModelsFar[MAX_SLOTS];	// far wave models, following the active ones
+		float *mpViewDepth[MAX_SLOTS];	// sort key of the front to back waves
+		bool *mpFarVisible[MAX_SLOTS];
+		TransformedAABBoxSSE *mpOccluderBoxes;
+		struct OccluderPacket;
+		OccluderPacket *mpOccluderPackets;	// world bounds of the occluders in grid cell order, 4 per packet
+		bool *mpInsideFrustum1[MAX_SLOTS];
+		bool *mpTooSmall1[MAX_SLOTS];
+		BoxTestSetupSSE *mpBoxTestSetup;
+		UINT *mpCellModels;					// occluders sorted by grid cell, NO_OCCLUDER pads a cell to whole packets
+		UINT mCellStart[OCCLUDER_GRID_CELLS + 1];	// multiples of 4
+		float3 mCellCenter[OCCLUDER_GRID_CELLS];	// world space bounds of the cell's occluders
+		float3 mCellHalf[OCCLUDER_GRID_CELLS];
+		float mCellRadiusSq[OCCLUDER_GRID_CELLS];	// largest bounding radius of the cell's occluders
+		UINT mCellNumModelsA[MAX_SLOTS][OCCLUDER_GRID_CELLS];	// active occluders of the cell and their vertices and triangles
+		UINT mCellNumVerticesA[MAX_SLOTS][OCCLUDER_GRID_CELLS];
+		UINT mCellNumTrianglesA[MAX_SLOTS][OCCLUDER_GRID_CELLS];
+		UINT mNumModelsA[MAX_SLOTS];
+		UINT mNumVerticesA[MAX_SLOTS];
+		UINT mNumTrianglesA[MAX_SLOTS];
 
 		float mOccluderSizeThreshold;
 
 		bool   mEnableFCulling;
+		bool   mOccluderWaves;
 		double mRasterizeTime[AVG_COUNTER];
 };
 
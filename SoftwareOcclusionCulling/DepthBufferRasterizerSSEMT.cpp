@@ -21,92 +21,61 @@
 DepthBufferRasterizerSSEMT::DepthBufferRasterizerSSEMT()
 	: DepthBufferRasterizerSSE()
 {
-	int size = SCREENH_IN_TILES * SCREENW_IN_TILES *  NUM_XFORMVERTS_TASKS;
-	mpBin[0] = new UINT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinModel[0] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinMesh[0] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpNumTrisInBin[0] = (USHORT*)_aligned_malloc(size * sizeof(USHORT), 64);
-
-	mpBin[1] = new UINT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinModel[1] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinMesh[1] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpNumTrisInBin[1] = (USHORT*)_aligned_malloc(size * sizeof(USHORT), 64);
 }
 
 DepthBufferRasterizerSSEMT::~DepthBufferRasterizerSSEMT()
 {
-	SAFE_DELETE_ARRAY(mpBin[0]);
-	SAFE_DELETE_ARRAY(mpBinModel[0]);
-	SAFE_DELETE_ARRAY(mpBinMesh[0]);
-	_aligned_free(mpNumTrisInBin[0]);
-
-	SAFE_DELETE_ARRAY(mpBin[1]);
-	SAFE_DELETE_ARRAY(mpBinModel[1]);
-	SAFE_DELETE_ARRAY(mpBinMesh[1]);
-	_aligned_free(mpNumTrisInBin[1]);
 }
 
-void DepthBufferRasterizerSSEMT::InsideViewFrustum(VOID *taskData, INT context, UINT taskId, UINT taskCount)
+void DepthBufferRasterizerSSEMT::CullOccluders(VOID *taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->InsideViewFrustum(taskId, taskCount, pTaskData->idx);
+	pTaskData->pDBR->CullOccluders(taskId, taskCount, pTaskData->idx, pTaskData->numViews);
 }
 
 //------------------------------------------------------------
-// * Determine if the occluder model is inside view frustum
+// * Determine if the occluder model is inside view frustum,
+//   when frustum culling is enabled, and not too small in 
+//   screen space of each of the views, a task tests a range
+//   of grid cells
 //------------------------------------------------------------
-void DepthBufferRasterizerSSEMT::InsideViewFrustum(UINT taskId, UINT taskCount, UINT idx)
+void DepthBufferRasterizerSSEMT::CullOccluders(UINT taskId, UINT taskCount, UINT idx, UINT numViews)
 {
 	UINT start, end;
-	GetWorkExtent(&start, &end, taskId, taskCount, mNumModels1);
-
- 	BoxTestSetupSSE setup;
-    setup.Init(mpViewMatrix[idx], mpProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccluderSizeThreshold); 
-
-	for(UINT i = start; i < end; i++)
-	{
-		mpTransformedModels1[i].InsideViewFrustum(setup,  idx);
-	}
+	GetWorkExtent(&start, &end, taskId, taskCount, OCCLUDER_GRID_CELLS);
+	CullOccluderCells(numViews, start, end, taskId, idx);
 }
 
-void DepthBufferRasterizerSSEMT::TooSmall(VOID *taskData, INT context, UINT taskId, UINT taskCount)
+void DepthBufferRasterizerSSEMT::ActiveModels(VOID* taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->TooSmall(taskId, taskCount, pTaskData->idx);
+	pTaskData->pDBR->ActiveModels(taskId, taskCount, pTaskData->idx, pTaskData->numViews);
 }
 
 //------------------------------------------------------------
-// * Determine if the occluder model is too small in screen space
+// * The active model list is shared by all the views, a model
+//   is active if it is rasterized to at least one of them.
+//   The visibility tasks counted the active models of every
+//   grid cell, a task compacts a range of grid cells into 
+//   the list at the offset summed up from the cells before
 //------------------------------------------------------------
-void DepthBufferRasterizerSSEMT::TooSmall(UINT taskId, UINT taskCount, UINT idx)
+void DepthBufferRasterizerSSEMT::ActiveModels(UINT taskId, UINT taskCount, UINT idx, UINT numViews)
 {
 	UINT start, end;
-	GetWorkExtent(&start, &end, taskId, taskCount, mNumModels1);
-
- 	BoxTestSetupSSE setup;
-    setup.Init(mpViewMatrix[idx], mpProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccluderSizeThreshold); 
-
-	for(UINT i = start; i < end; i++)
-	{
-		mpTransformedModels1[i].TooSmall(setup,  idx);
-	}
+	GetWorkExtent(&start, &end, taskId, taskCount, OCCLUDER_GRID_CELLS);
+	CompactActiveCells(numViews, start, end, idx);
 }
 
-void DepthBufferRasterizerSSEMT::ActiveModels(VOID* taskData, INT context, UINT taskId, UINT taskCount)
+void DepthBufferRasterizerSSEMT::SplitNearFar(VOID* taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->ActiveModels(taskId, pTaskData->idx);
-}
+	DepthBufferRasterizerSSEMT *pDBR = pTaskData->pDBR;
+	UINT idx = pTaskData->idx;
 
-void DepthBufferRasterizerSSEMT::ActiveModels(UINT taskId, UINT idx)
-{
-	ResetActive(idx);
-	for (UINT i = 0; i < mNumModels1; i++)
+	pDBR->SplitActiveNearFar(idx);
+	for(UINT view = 1; view < pTaskData->numViews; view++)
 	{
-		if(mpTransformedModels1[i].IsRasterized2DB(idx))
-		{
-			Activate(i, idx);
-		}
+		pDBR->ShareActive(idx, idx + view);
 	}
 }
 
@@ -116,39 +85,108 @@ void DepthBufferRasterizerSSEMT::ActiveModels(UINT taskId, UINT idx)
 // * Transform the occluder models on the CPU
 // * Bin the occluder triangles into tiles that the frame buffer is divided into
 // * Rasterize the occluder triangles to the CPU depth buffer
+// With occluder waves the near half of the occluders goes through these steps
+// first, then the far occluders hidden by it are dropped and the rest go through
+// them again on top of the near wave's depth buffer
 //-------------------------------------------------------------------------------
 void DepthBufferRasterizerSSEMT::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx)
 {
-	static const unsigned int kNumOccluderVisTasks = 32;
+	TransformModelsAndRasterizeToDepthBuffer(&pCamera, 1, idx);
+}
 
-	mTaskData[idx].idx = idx;
-	mTaskData[idx].pDBR = this;
+//-------------------------------------------------------------------------------
+// Multi view version, the views use slots idx .. idx + numViews - 1
+// The visibility and activation tasks run once for all the views. Every view 
+// gets its own transform, bin, sort and rasterize tasks which only depend on the
+// shared activation, so the views are rasterized concurrently
+//-------------------------------------------------------------------------------
+void DepthBufferRasterizerSSEMT::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx)
+{
+	static const unsigned int kNumActiveModelsTasks = 16;
+	assert(numViews <= MAX_VIEWS && idx + numViews <= MAX_SLOTS);
 
 	QueryPerformanceCounter(&mStartTime[idx]);
-	mpCamera[idx] = pCamera;
+	for(UINT view = idx; view < idx + numViews; view++)
+	{
+		if(mpBin[view] == NULL)
+		{
+			AllocateSlot(view, SCREENH_IN_TILES * SCREENW_IN_TILES * NUM_XFORMVERTS_TASKS, MAX_TRIS_IN_BIN_MT);
+		}
+
+		mTaskData[view].idx = view;
+		mTaskData[view].numViews = (view == idx) ? numViews : 1;
+		mTaskData[view].clearDepth = true;
+		mTaskData[view].pDBR = this;
+
+		for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+		{
+			mNearBandData[view][band] = mTaskData[view];
+			mNearBandData[view][band].band = band;
+
+			// The far wave rasterizes on top of the near wave
+			mBandData[view][band] = mNearBandData[view][band];
+			mBandData[view][band].clearDepth = !mOccluderWaves;
+		}
+
+		mStartTime[view] = mStartTime[idx];
+		mpCamera[view] = ppCamera[view - idx];
+		InitBoxTestSetup(mpCamera[view], view);
+	}
 	
 	if(mEnableFCulling)
 	{
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::InsideViewFrustum, &mTaskData[idx], kNumOccluderVisTasks, NULL, 0, "Is Visible", &gInsideViewFrustum[idx]);
-		
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::ActiveModels, &mTaskData[idx], 1, &gInsideViewFrustum[idx], 1, "IsActive", &gActiveModels[idx]);
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::CullOccluders, &mTaskData[idx], NUM_OCCLUDER_VIS_TASKS, NULL, 0, "Is Visible", &gInsideViewFrustum[idx]);
 		
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::TransformMeshes, &mTaskData[idx], NUM_XFORMVERTS_TASKS, &gActiveModels[idx], 1, "Xform Vertices", &gXformMesh[idx]);
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::ActiveModels, &mTaskData[idx], kNumActiveModelsTasks, &gInsideViewFrustum[idx], 1, "IsActive", &gActiveModels[idx]);
 	}
 	else
 	{
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::TooSmall, &mTaskData[idx], kNumOccluderVisTasks, NULL, 0, "TooSmall", &gTooSmall[idx]);
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::CullOccluders, &mTaskData[idx], NUM_OCCLUDER_VIS_TASKS, NULL, 0, "TooSmall", &gTooSmall[idx]);
 	
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::ActiveModels, &mTaskData[idx], 1, &gTooSmall[idx], 1, "IsActive", &gActiveModels[idx]);
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::ActiveModels, &mTaskData[idx], kNumActiveModelsTasks, &gTooSmall[idx], 1, "IsActive", &gActiveModels[idx]);
+	}
 
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::TransformMeshes, &mTaskData[idx], NUM_XFORMVERTS_TASKS, &gActiveModels[idx], 1, "Xform Vertices", &gXformMesh[idx]);
+	// The front to back sort of the occluder waves needs the whole active list
+	if(mOccluderWaves)
+	{
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::SplitNearFar, &mTaskData[idx], 1, &gActiveModels[idx], 1, "Split Near Far", &gSplitNearFar[idx]);
 	}
 
-	gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::BinTransformedMeshes, &mTaskData[idx], NUM_XFORMVERTS_TASKS, &gXformMesh[idx], 1, "Bin Meshes", &gBinMesh[idx]);
+	for(UINT view = idx; view < idx + numViews; view++)
+	{
+		TASKSETHANDLE activeModels = gActiveModels[idx];
+		if(mOccluderWaves)
+		{
+			gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::TransformMeshes, &mTaskData[view], NUM_XFORMVERTS_TASKS, &gSplitNearFar[idx], 1, "Xform Near Vertices", &gXformMeshNear[view]);
+
+			gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::BinTransformedMeshes, &mTaskData[view], NUM_XFORMVERTS_TASKS, &gXformMeshNear[view], 1, "Bin Near Meshes", &gBinMeshNear[view]);
+
+			gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::SortBins, &mTaskData[view], 1, &gBinMeshNear[view], 1, "Near BinSort", &gSortBinsNear[view]);
+
+			for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+			{
+				gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer, &mNearBandData[view][band], TILES_PER_BAND, &gSortBinsNear[view], 1, "Raster Near Tris to DB", &gRasterizeNear[view][band]);
+			}
+
+			gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::CullFarOccluders, &mTaskData[view], NUM_XFORMVERTS_TASKS, gRasterizeNear[view], NUM_RASTER_BANDS, "Cull Far Occluders", &gCullFarOccluders[view]);
+
+			gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::ActivateFar, &mTaskData[view], 1, &gCullFarOccluders[view], 1, "IsActive Far", &gActiveFarModels[view]);
+			activeModels = gActiveFarModels[view];
+		}
+
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::TransformMeshes, &mTaskData[view], NUM_XFORMVERTS_TASKS, &activeModels, 1, "Xform Vertices", &gXformMesh[view]);
 
-	gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::SortBins, &mTaskData[idx], 1, &gBinMesh[idx], 1, "BinSort", &gSortBins[idx]);
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::BinTransformedMeshes, &mTaskData[view], NUM_XFORMVERTS_TASKS, &gXformMesh[view], 1, "Bin Meshes", &gBinMesh[view]);
+
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::SortBins, &mTaskData[view], 1, &gBinMesh[view], 1, "BinSort", &gSortBins[view]);
 	
-	gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer, &mTaskData[idx], NUM_TILES, &gSortBins[idx], 1, "Raster Tris to DB", &gRasterize[idx]);
+		// One raster task set per band of tile rows, the occludee depth tests only wait
+		// for the bands they overlap
+		for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+		{
+			gTaskMgr.CreateTaskSet(&DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer, &mBandData[view][band], TILES_PER_BAND, &gSortBins[view], 1, "Raster Tris to DB", &gRasterize[view][band]);
+		}
+	}
 }
 
 void DepthBufferRasterizerSSEMT::TransformMeshes(VOID* taskData, INT context, UINT taskId, UINT taskCount)
@@ -170,8 +208,10 @@ void DepthBufferRasterizerSSEMT::TransformMeshes(UINT taskId, UINT taskCount, UI
 	UINT remainingVerticesPerTask = verticesPerTask;
 
 	// Now, process all of the surfaces that contain this task's triangle range.
-	UINT runningVertexCount = 0;
-	for(UINT active = 0; active < mNumModelsA[idx]; active++)
+	// The first one is found in the active models' vertex offsets
+	UINT first = FindActive(mpStartVA[idx], startIndex, idx);
+	UINT runningVertexCount = mpStartVA[idx][first];
+	for(UINT active = first; active < mNumModelsA[idx]; active++)
     {
 		UINT ss = mpModelIndexA[idx][active];
 		UINT thisSurfaceVertexCount = mpTransformedModels1[ss].GetNumVertices();
@@ -188,7 +228,11 @@ void DepthBufferRasterizerSSEMT::TransformMeshes(UINT taskId, UINT taskCount, UI
         UINT thisSurfaceStartIndex = max( 0, (int)startIndex - (int)runningVertexCount );
         UINT thisSurfaceEndIndex   = min( thisSurfaceStartIndex + remainingVerticesPerTask, thisSurfaceVertexCount) - 1;
 
-		mpTransformedModels1[ss].TransformMeshes(thisSurfaceStartIndex, thisSurfaceEndIndex, mpCamera[idx], idx);
+		// The active list is shared by the views, skip the models not rasterized to this one
+		if(IsRasterized2DB(ss, idx))
+		{
+			mpTransformedModels1[ss].TransformMeshes(thisSurfaceStartIndex, thisSurfaceEndIndex, mpCamera[idx], idx);
+		}
 
 		remainingVerticesPerTask -= (thisSurfaceEndIndex + 1 - thisSurfaceStartIndex);
         if( remainingVerticesPerTask <= 0 ) break;
@@ -232,8 +276,10 @@ void DepthBufferRasterizerSSEMT::BinTransformedMeshes(UINT taskId, UINT taskCoun
 	UINT remainingTrianglesPerTask = trianglesPerTask;
 
 	// Now, process all of the surfaces that contain this task's triangle range.
-	UINT runningTriangleCount = 0;
-	for(UINT active = 0; active < mNumModelsA[idx]; active++)
+	// The first one is found in the active models' triangle offsets
+	UINT first = FindActive(mpStartTA[idx], startIndex, idx);
+	UINT runningTriangleCount = mpStartTA[idx][first];
+	for(UINT active = first; active < mNumModelsA[idx]; active++)
     {
 		UINT ss = mpModelIndexA[idx][active];
 		UINT thisSurfaceTriangleCount = mpTransformedModels1[ss].GetNumTriangles();
@@ -250,7 +296,10 @@ void DepthBufferRasterizerSSEMT::BinTransformedMeshes(UINT taskId, UINT taskCoun
         UINT thisSurfaceStartIndex = max( 0, (int)startIndex - (int)runningTriangleCount );
         UINT thisSurfaceEndIndex   = min( thisSurfaceStartIndex + remainingTrianglesPerTask, thisSurfaceTriangleCount) - 1;
 
-       	mpTransformedModels1[ss].BinTransformedTrianglesMT(taskId, ss, thisSurfaceStartIndex, thisSurfaceEndIndex, mpBin[idx], mpBinModel[idx], mpBinMesh[idx], mpNumTrisInBin[idx], idx);
+		if(IsRasterized2DB(ss, idx))
+		{
+			mpTransformedModels1[ss].BinTransformedTrianglesMT(taskId, ss, thisSurfaceStartIndex, thisSurfaceEndIndex, mpBin[idx], mpBinModel[idx], mpBinMesh[idx], mpNumTrisInBin[idx], idx);
+		}
 
 		remainingTrianglesPerTask -= ( thisSurfaceEndIndex + 1 - thisSurfaceStartIndex);
         if( remainingTrianglesPerTask <= 0 ) break;
@@ -262,7 +311,21 @@ void DepthBufferRasterizerSSEMT::BinTransformedMeshes(UINT taskId, UINT taskCoun
 void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(VOID* taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->RasterizeBinnedTrianglesToDepthBuffer(taskId, pTaskData->idx);
+	pTaskData->pDBR->RasterizeBinnedTrianglesToDepthBuffer(pTaskData->band * TILES_PER_BAND + taskId, pTaskData->idx, pTaskData->clearDepth);
+}
+
+void DepthBufferRasterizerSSEMT::CullFarOccluders(VOID* taskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pTaskData = (PerTaskData*)taskData;
+	UINT start, end;
+	GetWorkExtent(&start, &end, taskId, taskCount, pTaskData->pDBR->mNumModelsFar[pTaskData->idx]);
+	pTaskData->pDBR->DepthBufferRasterizerSSE::CullFarOccluders(start, end, pTaskData->idx);
+}
+
+void DepthBufferRasterizerSSEMT::ActivateFar(VOID* taskData, INT context, UINT taskId, UINT taskCount)
+{
+	PerTaskData *pTaskData = (PerTaskData*)taskData;
+	pTaskData->pDBR->DepthBufferRasterizerSSE::ActivateFar(pTaskData->idx);
 }
 
 //--------------------------------------------------------------------------------------
@@ -270,7 +333,8 @@ void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(VOID* tas
 // scheduler starts tasks roughly in order, the idea is to put the "fat tiles" first
 // and leave the small jobs for last. This is to avoid the pathological case where a
 // relatively big tile gets picked up late (as the other worker threads are about to
-// finish) and rendering effectively completes single-threaded.
+// finish) and rendering effectively completes single-threaded. Every band of tile
+// rows is its own task set, so the tiles are sorted within their band.
 //--------------------------------------------------------------------------------------
 void DepthBufferRasterizerSSEMT::SortBins(VOID* taskData, INT context, UINT taskId, UINT taskCount)
 {
@@ -291,17 +355,22 @@ void DepthBufferRasterizerSSEMT::SortBins(VOID* taskData, INT context, UINT task
 		tileTotalTris[tile] = numTris;
 	}
 
-	// Sort tiles by number of triangles, decreasing.
-	std::sort(pTaskData->pDBR->mTileSequence[pTaskData->idx], pTaskData->pDBR->mTileSequence[pTaskData->idx] + NUM_TILES,
-		[&](const UINT a, const UINT b){ return tileTotalTris[a] > tileTotalTris[b]; });
+	// Sort the tiles of every band by number of triangles, decreasing.
+	for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+	{
+		UINT *pBandSequence = pTaskData->pDBR->mTileSequence[pTaskData->idx] + band * TILES_PER_BAND;
+		std::sort(pBandSequence, pBandSequence + TILES_PER_BAND,
+			[&](const UINT a, const UINT b){ return tileTotalTris[a] > tileTotalTris[b]; });
+	}
 }
 
 
 //-------------------------------------------------------------------------------
 // For each tile go through all the bins and process all the triangles in it.
-// Rasterize each triangle to the CPU depth buffer. 
+// Rasterize each triangle to the CPU depth buffer. The far occluder wave keeps
+// the near wave's depth instead of clearing the tile.
 //-------------------------------------------------------------------------------
-void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(UINT rawTaskId, UINT idx)
+void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(UINT rawTaskId, UINT idx, bool clearDepth)
 {
 	UINT taskId = mTileSequence[idx][rawTaskId];
 	// Set DAZ and FZ MXCSR bits to flush denormals to zero (i.e., make it faster)
@@ -309,10 +378,6 @@ void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(UINT rawT
 	// so to enable the two to have to set bits 6 and 15 which 1000 0000 0100 0000 = 0x8040
 	_mm_setcsr( _mm_getcsr() | 0x8040 );
 
-	__m128i colOffset = _mm_setr_epi32(0, 1, 0, 1);
-	__m128i rowOffset = _mm_setr_epi32(0, 0, 1, 1);
-
-	__m128i fxptZero = _mm_setzero_si128();
 	float* pDepthBuffer = (float*)mpRenderTargetPixels[idx]; 
 
 	// Based on TaskId determine which tile to process
@@ -326,7 +391,16 @@ void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(UINT rawT
 	int tileStartY = tileY * TILE_HEIGHT_IN_PIXELS;
 	int tileEndY   = tileStartY + TILE_HEIGHT_IN_PIXELS - 1;
 
-	ClearDepthTile(tileStartX, tileStartY, tileEndX + 1, tileEndY + 1, idx);
+	// The far wave adds to the counters of the near wave
+	OccluderTileCounters counters = {0};
+	if(clearDepth)
+	{
+		ClearDepthTile(tileStartX, tileStartY, tileEndX + 1, tileEndY + 1, idx);
+	}
+	else
+	{
+		counters = mpTileCounters[idx][taskId];
+	}
 
 	UINT bin = 0;
 	UINT binIndex = 0;
@@ -337,7 +411,7 @@ void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(UINT rawT
 	__m128 gatherBuf[4][3];
 	bool done = false;
 	bool allBinsEmpty = true;
-	mNumRasterizedTris[idx][taskId] = numTrisInBin;
+	counters.mNumTris += numTrisInBin;
 	while(!done)
 	{
 		// Loop through all the bins and process the 4 binned traingles at a time
@@ -353,7 +427,7 @@ void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(UINT rawT
 					break;
 				}
 				numTrisInBin = mpNumTrisInBin[idx][offset1 + TOFFSET1_MT * bin];
-				mNumRasterizedTris[idx][taskId] += numTrisInBin;
+				counters.mNumTris += numTrisInBin;
 				binIndex = 0;
 			}
 			if(!numTrisInBin)
@@ -374,151 +448,15 @@ void DepthBufferRasterizerSSEMT::RasterizeBinnedTrianglesToDepthBuffer(UINT rawT
 		
 		if(allBinsEmpty)
 		{
-			QueryPerformanceCounter(&mStopTime[idx][taskId]);
-			return;
+			break;
 		}
 
-		// use fixed-point only for X and Y.  Avoid work for Z and W.
-        __m128i fxPtX[3], fxPtY[3];
-		__m128 Z[3];
-		for(int i = 0; i < 3; i++)
-		{
-			// read 4 verts
-			__m128 v0 = gatherBuf[0][i];
-			__m128 v1 = gatherBuf[1][i];
-			__m128 v2 = gatherBuf[2][i];
-			__m128 v3 = gatherBuf[3][i];
-
-  			// transpose into SoA layout
-			_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
-			fxPtX[i] = _mm_cvtps_epi32(v0);
-			fxPtY[i] = _mm_cvtps_epi32(v1);
-			Z[i] = v2;
-		}
-
-		// Fab(x, y) =     Ax       +       By     +      C              = 0
-		// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
-		// Compute A = (ya - yb) for the 3 line segments that make up each triangle
-		__m128i A0 = _mm_sub_epi32(fxPtY[1], fxPtY[2]);
-		__m128i A1 = _mm_sub_epi32(fxPtY[2], fxPtY[0]);
-		__m128i A2 = _mm_sub_epi32(fxPtY[0], fxPtY[1]);
-
-		// Compute B = (xb - xa) for the 3 line segments that make up each triangle
-		__m128i B0 = _mm_sub_epi32(fxPtX[2], fxPtX[1]);
-		__m128i B1 = _mm_sub_epi32(fxPtX[0], fxPtX[2]);
-		__m128i B2 = _mm_sub_epi32(fxPtX[1], fxPtX[0]);
-
-		// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
-		__m128i C0 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[1], fxPtY[2]), _mm_mullo_epi32(fxPtX[2], fxPtY[1]));
-		__m128i C1 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[2], fxPtY[0]), _mm_mullo_epi32(fxPtX[0], fxPtY[2]));
-		__m128i C2 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[0], fxPtY[1]), _mm_mullo_epi32(fxPtX[1], fxPtY[0]));
-
-		// Compute triangle area
-		__m128i triArea = _mm_mullo_epi32(B2, A1);
-		triArea = _mm_sub_epi32(triArea, _mm_mullo_epi32(B1, A2));
-		__m128 oneOverTriArea = _mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(triArea));
-
-		Z[1] = _mm_mul_ps(_mm_sub_ps(Z[1], Z[0]), oneOverTriArea);
-		Z[2] = _mm_mul_ps(_mm_sub_ps(Z[2], Z[0]), oneOverTriArea);
-
-		// Use bounding box traversal strategy to determine whichhttps://maps.google.com/maps?hl=en&tab=ml pixels to rasterize 
-		__m128i startX = _mm_and_si128(Max(Min(Min(fxPtX[0], fxPtX[1]), fxPtX[2]), _mm_set1_epi32(tileStartX)), _mm_set1_epi32(0xFFFFFFFE));
-		__m128i endX   = Min(_mm_add_epi32(Max(Max(fxPtX[0], fxPtX[1]), fxPtX[2]), _mm_set1_epi32(1)), _mm_set1_epi32(tileEndX));
-
-		__m128i startY = _mm_and_si128(Max(Min(Min(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(tileStartY)), _mm_set1_epi32(0xFFFFFFFE));
-		__m128i endY   = Min(_mm_add_epi32(Max(Max(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(1)), _mm_set1_epi32(tileEndY));
-
-        // Now we have 4 triangles set up.  Rasterize them each individually.
-        for(int lane=0; lane < numSimdTris; lane++)
-        {
-			// Extract this triangle's properties from the SIMD versions
-            __m128 zz[3];
-			for(int vv = 0; vv < 3; vv++)
-			{
-				zz[vv] = _mm_set1_ps(Z[vv].m128_f32[lane]);
-			}
-
-			int startXx = startX.m128i_i32[lane];
-			int endXx	= endX.m128i_i32[lane];
-			int startYy = startY.m128i_i32[lane];
-			int endYy	= endY.m128i_i32[lane];
-		
-			 // Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY) 
-			__m128i aa0 = _mm_set1_epi32(A0.m128i_i32[lane]);
-			__m128i aa1 = _mm_set1_epi32(A1.m128i_i32[lane]);
-			__m128i aa2 = _mm_set1_epi32(A2.m128i_i32[lane]);
-
-			__m128i bb0 = _mm_set1_epi32(B0.m128i_i32[lane]);
-			__m128i bb1 = _mm_set1_epi32(B1.m128i_i32[lane]);
-			__m128i bb2 = _mm_set1_epi32(B2.m128i_i32[lane]);
-
-			__m128i aa0Inc = _mm_slli_epi32(aa0, 1);
-			__m128i aa1Inc = _mm_slli_epi32(aa1, 1);
-			__m128i aa2Inc = _mm_slli_epi32(aa2, 1);
-
-			__m128i row, col;
-
-			// Tranverse pixels in 2x2 blocks and store 2x2 pixel quad depthscontiguously in memory ==> 2*X
-			// This method provides better perfromance
-			int rowIdx = (startYy * SCREENW + 2 * startXx);
-			
-			col = _mm_add_epi32(colOffset, _mm_set1_epi32(startXx));
-			__m128i aa0Col = _mm_mullo_epi32(aa0, col);
-			__m128i aa1Col = _mm_mullo_epi32(aa1, col);
-			__m128i aa2Col = _mm_mullo_epi32(aa2, col);
-
-			row = _mm_add_epi32(rowOffset, _mm_set1_epi32(startYy));
-			__m128i bb0Row = _mm_add_epi32(_mm_mullo_epi32(bb0, row), _mm_set1_epi32(C0.m128i_i32[lane]));
-			__m128i bb1Row = _mm_add_epi32(_mm_mullo_epi32(bb1, row), _mm_set1_epi32(C1.m128i_i32[lane]));
-			__m128i bb2Row = _mm_add_epi32(_mm_mullo_epi32(bb2, row), _mm_set1_epi32(C2.m128i_i32[lane]));
-
-			__m128i sum0Row = _mm_add_epi32(aa0Col, bb0Row);
-			__m128i sum1Row = _mm_add_epi32(aa1Col, bb1Row);
-			__m128i sum2Row = _mm_add_epi32(aa2Col, bb2Row);
-
-			__m128i bb0Inc = _mm_slli_epi32(bb0, 1);
-			__m128i bb1Inc = _mm_slli_epi32(bb1, 1);
-			__m128i bb2Inc = _mm_slli_epi32(bb2, 1);
-
-			__m128 zx = _mm_mul_ps(_mm_cvtepi32_ps(aa1Inc), zz[1]);
-			zx = _mm_add_ps(zx, _mm_mul_ps(_mm_cvtepi32_ps(aa2Inc), zz[2]));
-
-			for(int r = startYy; r < endYy; r += 2,
-											rowIdx += 2 * SCREENW,
-											sum0Row = _mm_add_epi32(sum0Row, bb0Inc),
-											sum1Row = _mm_add_epi32(sum1Row, bb1Inc),
-											sum2Row = _mm_add_epi32(sum2Row, bb2Inc))
-			{
-				// Compute barycentric coordinates 
-				int index = rowIdx;
-				__m128i alpha = sum0Row;
-				__m128i beta = sum1Row;
-				__m128i gama = sum2Row;
-
-				//Compute barycentric-interpolated depth
-				__m128 depth = zz[0];
-				depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(beta), zz[1]));
-				depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(gama), zz[2]));
-
-				for(int c = startXx; c < endXx; c += 2,
-												index += 4,
-												alpha = _mm_add_epi32(alpha, aa0Inc),
-												beta  = _mm_add_epi32(beta, aa1Inc),
-												gama  = _mm_add_epi32(gama, aa2Inc), 
-												depth = _mm_add_ps(depth, zx))
-				{
-					//Test Pixel inside triangle
-					__m128i mask = _mm_or_si128(_mm_or_si128(alpha, beta), gama);
-					
-					//Update depth
-					__m128 previousDepthValue = _mm_load_ps(&pDepthBuffer[index]);
-					__m128 mergedDepth = _mm_max_ps(depth, previousDepthValue);
-					__m128 finaldepth = _mm_blendv_ps(mergedDepth, previousDepthValue, _mm_castsi128_ps(mask));
-					_mm_store_ps(&pDepthBuffer[index], finaldepth);
-				}//for each column											
-			}// for each row
-		}// for each triangle
+		RasterizeTriangles(pDepthBuffer, gatherBuf, numSimdTris, tileStartX, tileEndX, tileStartY, tileEndY);
+		// The last pass over the bins can come up empty
+		counters.mNumSimdBatches += numSimdTris > 0 ? 1 : 0;
+		counters.mNumSimdLanes += numSimdTris;
 	}// for each set of SIMD# triangles	
+	mpTileCounters[idx][taskId] = counters;
 	QueryPerformanceCounter(&mStopTime[idx][taskId]);
 }
 
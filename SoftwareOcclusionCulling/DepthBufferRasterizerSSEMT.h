@@ -27,22 +27,29 @@ class DepthBufferRasterizerSSEMT : public DepthBufferRasterizerSSE
 		struct PerTaskData
 		{
 			UINT idx;
+			UINT numViews;
+			UINT band;
+			bool clearDepth;
 			DepthBufferRasterizerSSEMT *pDBR; 
 		};
 
-		PerTaskData mTaskData[2];
+		PerTaskData mTaskData[MAX_SLOTS];
+		PerTaskData mBandData[MAX_SLOTS][NUM_RASTER_BANDS];
+		PerTaskData mNearBandData[MAX_SLOTS][NUM_RASTER_BANDS];
 		void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx);
+		void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx);
 		void ComputeR2DBTime(UINT idx);
 
 	private:
-		static void InsideViewFrustum(VOID* taskData, INT context, UINT taskId, UINT taskCount);
-		void InsideViewFrustum(UINT taskId, UINT taskCount, UINT idx);
-
-		static void TooSmall(VOID* taskData, INT context, UINT taskId, UINT taskCount);
-		void TooSmall(UINT taskId, UINT taskCount, UINT idx);
+		// The frustum and size tests both run in CullOccluderCells, only the task set
+		// names and handles tell them apart
+		static void CullOccluders(VOID* taskData, INT context, UINT taskId, UINT taskCount);
+		void CullOccluders(UINT taskId, UINT taskCount, UINT idx, UINT numViews);
 
 		static void ActiveModels(VOID* taskData, INT context, UINT taskId, UINT taskCount);
-		void ActiveModels(UINT taskId, UINT idx);
+		void ActiveModels(UINT taskId, UINT taskCount, UINT idx, UINT numViews);
+
+		static void SplitNearFar(VOID* taskData, INT context, UINT taskId, UINT taskCount);
 
 		static void TransformMeshes(VOID* taskData, INT context, UINT taskId, UINT taskCount);
 		void TransformMeshes(UINT taskId, UINT taskCount, UINT idx);
@@ -53,9 +60,12 @@ class DepthBufferRasterizerSSEMT : public DepthBufferRasterizerSSE
 		static void SortBins(VOID* taskData, INT context, UINT taskId, UINT taskCount);
 
 		static void RasterizeBinnedTrianglesToDepthBuffer(VOID* taskData, INT context, UINT taskId, UINT taskCount);
-		void RasterizeBinnedTrianglesToDepthBuffer(UINT taskId, UINT idx);
+		void RasterizeBinnedTrianglesToDepthBuffer(UINT taskId, UINT idx, bool clearDepth);
+
+		static void CullFarOccluders(VOID* taskData, INT context, UINT taskId, UINT taskCount);
+		static void ActivateFar(VOID* taskData, INT context, UINT taskId, UINT taskCount);
 
-		UINT mTileSequence[2][NUM_TILES];
+		UINT mTileSequence[MAX_SLOTS][NUM_TILES];
 };
 
 #endif  //DEPTHBUFFERRASTERIZERSSEMT_H
\ No newline at end of file
@@ -20,29 +20,10 @@
 DepthBufferRasterizerSSEST::DepthBufferRasterizerSSEST()
 	: DepthBufferRasterizerSSE()
 {
-	int size = SCREENH_IN_TILES * SCREENW_IN_TILES; 
-	mpBin[0] = new UINT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinModel[0] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinMesh[0] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpNumTrisInBin[0] = new USHORT[size];
-
-	mpBin[1] = new UINT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinModel[1] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinMesh[1] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpNumTrisInBin[1] = new USHORT[size];
 }
 
 DepthBufferRasterizerSSEST::~DepthBufferRasterizerSSEST()
 {
-	SAFE_DELETE_ARRAY(mpBin[0]);
-	SAFE_DELETE_ARRAY(mpBinModel[0]);
-	SAFE_DELETE_ARRAY(mpBinMesh[0]);
-	SAFE_DELETE_ARRAY(mpNumTrisInBin[0]);
-
-	SAFE_DELETE_ARRAY(mpBin[1]);
-	SAFE_DELETE_ARRAY(mpBinModel[1]);
-	SAFE_DELETE_ARRAY(mpBinMesh[1]);
-	SAFE_DELETE_ARRAY(mpNumTrisInBin[1]);
 }
 
 //------------------------------------------------------------------------------
@@ -53,50 +34,54 @@ DepthBufferRasterizerSSEST::~DepthBufferRasterizerSSEST()
 //-------------------------------------------------------------------------------
 void DepthBufferRasterizerSSEST::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx)
 {
+	TransformModelsAndRasterizeToDepthBuffer(&pCamera, 1, idx);
+}
+
+//------------------------------------------------------------------------------
+// Multi view version, the views use slots idx .. idx + numViews - 1
+// The visibility tests and model activation are done once for all the views
+//-------------------------------------------------------------------------------
+void DepthBufferRasterizerSSEST::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx)
+{
+	assert(numViews <= MAX_VIEWS && idx + numViews <= MAX_SLOTS);
+
 	QueryPerformanceCounter(&mStartTime[idx]);
-	mpCamera[idx] = pCamera;
-	
-	BoxTestSetupSSE setup;
-	setup.Init(mpViewMatrix[idx], mpProjMatrix[idx], viewportMatrix, pCamera, mOccluderSizeThreshold);
 
-	if(mEnableFCulling)
+	for(UINT view = 0; view < numViews; view++)
 	{
-		for(UINT i = 0; i < mNumModels1; i++)
+		if(mpBin[idx + view] == NULL)
 		{
-			mpTransformedModels1[i].InsideViewFrustum(setup, idx);
+			AllocateSlot(idx + view, SCREENH_IN_TILES * SCREENW_IN_TILES, MAX_TRIS_IN_BIN_ST);
 		}
+		mpCamera[idx + view] = ppCamera[view];
+		InitBoxTestSetup(ppCamera[view], idx + view);
 	}
-	else
+
+	CullOccluderCells(numViews, 0, OCCLUDER_GRID_CELLS, 0, idx);
+
+	ActiveModels(idx, numViews);
+	for(UINT view = idx; view < idx + numViews; view++)
 	{
-		for(UINT i = 0; i < mNumModels1; i++)
+		TransformMeshes(view);
+		BinTransformedMeshes(view);
+		for(UINT i = 0; i < NUM_TILES; i++)
 		{
-			mpTransformedModels1[i].TooSmall(setup, idx);
+			RasterizeBinnedTrianglesToDepthBuffer(i, view);
 		}
 	}
 
-	ActiveModels(idx);
-	TransformMeshes(idx);
-	BinTransformedMeshes(idx);
-	for(UINT i = 0; i < NUM_TILES; i++)
-	{
-		RasterizeBinnedTrianglesToDepthBuffer(i, idx);
-	}
-
 	QueryPerformanceCounter(&mStopTime[idx][0]);
 	mRasterizeTime[mTimeCounter++] = ((double)(mStopTime[idx][0].QuadPart - mStartTime[idx].QuadPart)) / ((double)glFrequency.QuadPart);
 	mTimeCounter = mTimeCounter >= AVG_COUNTER ? 0 : mTimeCounter;
 }
 
-void DepthBufferRasterizerSSEST::ActiveModels(UINT idx)
+//------------------------------------------------------------
+// * The active model list is shared by all the views, a model
+//   is active if it is rasterized to at least one of them
+//------------------------------------------------------------
+void DepthBufferRasterizerSSEST::ActiveModels(UINT idx, UINT numViews)
 {
-	ResetActive(idx);
-	for (UINT i = 0; i < mNumModels1; i++)
-	{
-		if(mpTransformedModels1[i].IsRasterized2DB(idx))
-		{
-			Activate(i, idx);
-		}
-	}
+	CompactActiveCells(numViews, 0, OCCLUDER_GRID_CELLS, idx);
 }
 
 //-------------------------------------------------------------------
@@ -109,7 +94,11 @@ void DepthBufferRasterizerSSEST::TransformMeshes(UINT idx)
 		UINT ss = mpModelIndexA[idx][active];
 		UINT thisSurfaceVertexCount = mpTransformedModels1[ss].GetNumVertices();
         
-        mpTransformedModels1[ss].TransformMeshes(0, thisSurfaceVertexCount - 1, mpCamera[idx], idx);
+		// The active list is shared by the views, skip the models not rasterized to this one
+		if(IsRasterized2DB(ss, idx))
+		{
+			mpTransformedModels1[ss].TransformMeshes(0, thisSurfaceVertexCount - 1, mpCamera[idx], idx);
+		}
     }
 }
 
@@ -137,7 +126,10 @@ void DepthBufferRasterizerSSEST::BinTransformedMeshes(UINT idx)
 		UINT ss = mpModelIndexA[idx][active];
 		UINT thisSurfaceTriangleCount = mpTransformedModels1[ss].GetNumTriangles();
         
-		mpTransformedModels1[ss].BinTransformedTrianglesST(0, ss, 0, thisSurfaceTriangleCount - 1, mpBin[idx], mpBinModel[idx], mpBinMesh[idx], mpNumTrisInBin[idx], idx);
+		if(IsRasterized2DB(ss, idx))
+		{
+			mpTransformedModels1[ss].BinTransformedTrianglesST(0, ss, 0, thisSurfaceTriangleCount - 1, mpBin[idx], mpBinModel[idx], mpBinMesh[idx], mpNumTrisInBin[idx], idx);
+		}
 	}
 }
 
@@ -150,10 +142,6 @@ void DepthBufferRasterizerSSEST::RasterizeBinnedTrianglesToDepthBuffer(UINT tile
 	// Set DAZ and FZ MXCSR bits to flush denormals to zero (i.e., make it faster)
 	_mm_setcsr( _mm_getcsr() | 0x8040 );
 
-	__m128i colOffset = _mm_setr_epi32(0, 1, 0, 1);
-	__m128i rowOffset = _mm_setr_epi32(0, 0, 1, 1);
-
-	__m128i fxptZero = _mm_setzero_si128();
 	float* pDepthBuffer = (float*)mpRenderTargetPixels[idx]; 
 
 	// Based on TaskId determine which tile to process
@@ -178,7 +166,8 @@ void DepthBufferRasterizerSSEST::RasterizeBinnedTrianglesToDepthBuffer(UINT tile
 	__m128 gatherBuf[4][3];
 	bool done = false;
 	bool allBinsEmpty = true;
-	mNumRasterizedTris[idx][tileId] = numTrisInBin;
+	OccluderTileCounters counters = {0};
+	counters.mNumTris = numTrisInBin;
 	while(!done)
 	{
 		// Loop through all the bins and process 4 binned traingles at a time
@@ -194,7 +183,7 @@ void DepthBufferRasterizerSSEST::RasterizeBinnedTrianglesToDepthBuffer(UINT tile
 					break;
 				}
 				numTrisInBin = mpNumTrisInBin[idx][offset1 + bin];
-				mNumRasterizedTris[idx][tileId] += numTrisInBin;
+				counters.mNumTris += numTrisInBin;
 				binIndex = 0;
 			}
 			if(!numTrisInBin)
@@ -215,148 +204,15 @@ void DepthBufferRasterizerSSEST::RasterizeBinnedTrianglesToDepthBuffer(UINT tile
 		
 		if(allBinsEmpty)
 		{
-			return;
-		}
-
-		// use fixed-point only for X and Y.  Avoid work for Z and W.
-        __m128i fxPtX[3], fxPtY[3];
-		__m128 Z[3];
-		for(int i = 0; i < 3; i++)
-		{
-			__m128 v0 = gatherBuf[0][i];
-			__m128 v1 = gatherBuf[1][i];
-			__m128 v2 = gatherBuf[2][i];
-			__m128 v3 = gatherBuf[3][i];
-
-  			// transpose into SoA layout
-			_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
-			fxPtX[i] = _mm_cvtps_epi32(v0);
-			fxPtY[i] = _mm_cvtps_epi32(v1);
-			Z[i] = v2;
+			break;
 		}
 
-		// Fab(x, y) =     Ax       +       By     +      C              = 0
-		// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
-		// Compute A = (ya - yb) for the 3 line segments that make up each triangle
-		__m128i A0 = _mm_sub_epi32(fxPtY[1], fxPtY[2]);
-		__m128i A1 = _mm_sub_epi32(fxPtY[2], fxPtY[0]);
-		__m128i A2 = _mm_sub_epi32(fxPtY[0], fxPtY[1]);
-
-		// Compute B = (xb - xa) for the 3 line segments that make up each triangle
-		__m128i B0 = _mm_sub_epi32(fxPtX[2], fxPtX[1]);
-		__m128i B1 = _mm_sub_epi32(fxPtX[0], fxPtX[2]);
-		__m128i B2 = _mm_sub_epi32(fxPtX[1], fxPtX[0]);
-
-		// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
-		__m128i C0 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[1], fxPtY[2]), _mm_mullo_epi32(fxPtX[2], fxPtY[1]));
-		__m128i C1 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[2], fxPtY[0]), _mm_mullo_epi32(fxPtX[0], fxPtY[2]));
-		__m128i C2 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[0], fxPtY[1]), _mm_mullo_epi32(fxPtX[1], fxPtY[0]));
-
-		// Compute triangle area
-		__m128i triArea = _mm_mullo_epi32(B2, A1);
-		triArea = _mm_sub_epi32(triArea, _mm_mullo_epi32(B1, A2));
-		__m128 oneOverTriArea = _mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(triArea));
-
-		Z[1] = _mm_mul_ps(_mm_sub_ps(Z[1], Z[0]), oneOverTriArea);
-		Z[2] = _mm_mul_ps(_mm_sub_ps(Z[2], Z[0]), oneOverTriArea);
-
-		// Use bounding box traversal strategy to determine which pixels to rasterize 
-		__m128i startX = _mm_and_si128(Max(Min(Min(fxPtX[0], fxPtX[1]), fxPtX[2]), _mm_set1_epi32(tileStartX)), _mm_set1_epi32(0xFFFFFFFE));
-		__m128i endX   = Min(_mm_add_epi32(Max(Max(fxPtX[0], fxPtX[1]), fxPtX[2]), _mm_set1_epi32(1)), _mm_set1_epi32(tileEndX));
-
-		__m128i startY = _mm_and_si128(Max(Min(Min(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(tileStartY)), _mm_set1_epi32(0xFFFFFFFE));
-		__m128i endY   = Min(_mm_add_epi32(Max(Max(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(1)), _mm_set1_epi32(tileEndY));
-
-		// Now we have 4 triangles set up.  Rasterize them each individually.
-        for(int lane=0; lane < numSimdTris; lane++)
-        {
-			// Extract this triangle's properties from the SIMD versions
-            __m128 zz[3];
-			for(int vv = 0; vv < 3; vv++)
-			{
-				zz[vv] = _mm_set1_ps(Z[vv].m128_f32[lane]);
-			}
-									
-			int startXx = startX.m128i_i32[lane];
-			int endXx	= endX.m128i_i32[lane];
-			int startYy = startY.m128i_i32[lane];
-			int endYy	= endY.m128i_i32[lane];
-		
-			__m128i aa0 = _mm_set1_epi32(A0.m128i_i32[lane]);
-			__m128i aa1 = _mm_set1_epi32(A1.m128i_i32[lane]);
-			__m128i aa2 = _mm_set1_epi32(A2.m128i_i32[lane]);
-
-			__m128i bb0 = _mm_set1_epi32(B0.m128i_i32[lane]);
-			__m128i bb1 = _mm_set1_epi32(B1.m128i_i32[lane]);
-			__m128i bb2 = _mm_set1_epi32(B2.m128i_i32[lane]);
-
-			__m128i aa0Inc = _mm_slli_epi32(aa0, 1);
-			__m128i aa1Inc = _mm_slli_epi32(aa1, 1);
-			__m128i aa2Inc = _mm_slli_epi32(aa2, 1);
-
-			__m128i row, col;
-
-			// Tranverse pixels in 2x2 blocks and store 2x2 pixel quad depths contiguously in memory ==> 2*X
-			// This method provides better perfromance
-			int rowIdx = (startYy * SCREENW + 2 * startXx);
-
-			col = _mm_add_epi32(colOffset, _mm_set1_epi32(startXx));
-			__m128i aa0Col = _mm_mullo_epi32(aa0, col);
-			__m128i aa1Col = _mm_mullo_epi32(aa1, col);
-			__m128i aa2Col = _mm_mullo_epi32(aa2, col);
-
-			row = _mm_add_epi32(rowOffset, _mm_set1_epi32(startYy));
-			__m128i bb0Row = _mm_add_epi32(_mm_mullo_epi32(bb0, row), _mm_set1_epi32(C0.m128i_i32[lane]));
-			__m128i bb1Row = _mm_add_epi32(_mm_mullo_epi32(bb1, row), _mm_set1_epi32(C1.m128i_i32[lane]));
-			__m128i bb2Row = _mm_add_epi32(_mm_mullo_epi32(bb2, row), _mm_set1_epi32(C2.m128i_i32[lane]));
-
-			__m128i sum0Row = _mm_add_epi32(aa0Col, bb0Row);
-			__m128i sum1Row = _mm_add_epi32(aa1Col, bb1Row);
-			__m128i sum2Row = _mm_add_epi32(aa2Col, bb2Row);
-
-			__m128i bb0Inc = _mm_slli_epi32(bb0, 1);
-			__m128i bb1Inc = _mm_slli_epi32(bb1, 1);
-			__m128i bb2Inc = _mm_slli_epi32(bb2, 1);
-
-			__m128 zx = _mm_mul_ps(_mm_cvtepi32_ps(aa1Inc), zz[1]);
-			zx = _mm_add_ps(zx, _mm_mul_ps(_mm_cvtepi32_ps(aa2Inc), zz[2]));
-
-			// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY)
-			for(int r = startYy; r < endYy; r += 2,
-											rowIdx += 2 * SCREENW,
-											sum0Row = _mm_add_epi32(sum0Row, bb0Inc),
-											sum1Row = _mm_add_epi32(sum1Row, bb1Inc),
-											sum2Row = _mm_add_epi32(sum2Row, bb2Inc))
-			{
-				// Compute barycentric coordinates 
-				int index = rowIdx;
-				__m128i alpha = sum0Row;
-				__m128i beta = sum1Row;
-				__m128i gama = sum2Row;
-
-				//Compute barycentric-interpolated depth
-				__m128 depth = zz[0];
-				depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(beta), zz[1]));
-				depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(gama), zz[2]));
-
-				for(int c = startXx; c < endXx; c += 2,
-												index += 4,
-												alpha = _mm_add_epi32(alpha, aa0Inc),
-												beta  = _mm_add_epi32(beta, aa1Inc),
-												gama  = _mm_add_epi32(gama, aa2Inc),
-												depth = _mm_add_ps(depth, zx))
-				{
-					//Test Pixel inside triangle
-					__m128i mask = _mm_or_si128(_mm_or_si128(alpha, beta), gama);
-					
-					__m128 previousDepthValue = _mm_load_ps(&pDepthBuffer[index]);
-					__m128 mergedDepth = _mm_max_ps(depth, previousDepthValue);
-					__m128 finalDepth = _mm_blendv_ps(mergedDepth, previousDepthValue, _mm_castsi128_ps(mask));
-					_mm_store_ps(&pDepthBuffer[index], finalDepth);
-				}//for each column											
-			}// for each row
-		}// for each triangle
+		RasterizeTriangles(pDepthBuffer, gatherBuf, numSimdTris, tileStartX, tileEndX, tileStartY, tileEndY);
+		// The last pass over the bins can come up empty
+		counters.mNumSimdBatches += numSimdTris > 0 ? 1 : 0;
+		counters.mNumSimdLanes += numSimdTris;
 	}// for each set of SIMD# triangles
+	mpTileCounters[idx][tileId] = counters;
 }
 
 
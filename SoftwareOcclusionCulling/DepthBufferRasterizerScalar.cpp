@@ -14,6 +14,7 @@
 // responsibility to update it.
 //-------------------------------------------------------------------------------------
 #include "DepthBufferRasterizerScalar.h"
+#include "CullingScene.h"
 
 DepthBufferRasterizerScalar::DepthBufferRasterizerScalar()
 	: DepthBufferRasterizer(),
@@ -28,18 +29,21 @@ DepthBufferRasterizerScalar::DepthBufferRasterizerScalar()
 	  mTimeCounter(0),
 	  mEnableFCulling(true)  
 {
-	mpXformedPos[0] = mpXformedPos[1] = NULL;
-	mpCamera[0] = mpCamera[1] = NULL;
-	mpRenderTargetPixels[0] = NULL;
-	mpRenderTargetPixels[1] = NULL;
-	mNumRasterized[0] = mNumRasterized[1] = NULL;
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpXformedPos[i] = NULL;
+		mpCamera[i] = NULL;
+		mpRenderTargetPixels[i] = NULL;
+		mpTileCounters[i] = NULL;
+		mpVisCounters[i] = NULL;
 
-	mpBin[0] = mpBin[1] = NULL;
-	mpBinModel[0] = mpBinModel[1] = NULL;
-	mpBinMesh[0] = mpBinMesh[1] = NULL;
-	mpNumTrisInBin[0] = mpNumTrisInBin[1] = NULL;
+		mpBin[i] = NULL;
+		mpBinModel[i] = NULL;
+		mpBinMesh[i] = NULL;
+		mpNumTrisInBin[i] = NULL;
 
-	mpModelIndexA[0] = mpModelIndexA[1] = NULL;
+		mpModelIndexA[i] = NULL;
+	}
 
 	for(UINT i = 0; i < AVG_COUNTER; i++)
 	{
@@ -53,10 +57,18 @@ DepthBufferRasterizerScalar::~DepthBufferRasterizerScalar()
 	SAFE_DELETE_ARRAY(mpXformedPosOffset1);
 	SAFE_DELETE_ARRAY(mpStartV1);
 	SAFE_DELETE_ARRAY(mpStartT1);
-	SAFE_DELETE_ARRAY(mpModelIndexA[0]);
-	SAFE_DELETE_ARRAY(mpModelIndexA[1]);
-	SAFE_DELETE_ARRAY(mpXformedPos[0]);
-	SAFE_DELETE_ARRAY(mpXformedPos[1]);
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		SAFE_DELETE_ARRAY(mpModelIndexA[i]);
+		SAFE_DELETE_ARRAY(mpXformedPos[i]);
+
+		SAFE_DELETE_ARRAY(mpBin[i]);
+		SAFE_DELETE_ARRAY(mpBinModel[i]);
+		SAFE_DELETE_ARRAY(mpBinMesh[i]);
+		_aligned_free(mpNumTrisInBin[i]);
+		_aligned_free(mpTileCounters[i]);
+		_aligned_free(mpVisCounters[i]);
+	}
 }
 
 //--------------------------------------------------------------------
@@ -81,13 +93,8 @@ void DepthBufferRasterizerScalar::CreateTransformedModels(CPUTAssetSet **mpAsset
 		}	
 	}
 
-	mpTransformedModels1 = new TransformedModelScalar[mNumModels1];
-	mpXformedPosOffset1 = new UINT[mNumModels1];
-	mpStartV1 = new UINT[mNumModels1 + 1];
-	mpStartT1 = new UINT[mNumModels1 + 1];
+	AllocateModels();
 
-	mpModelIndexA[0] = new UINT[mNumModels1];
-	mpModelIndexA[1] = new UINT[mNumModels1];
 	UINT modelId = 0;
 
 	for(UINT assetId = 0; assetId < numAssetSets; assetId++)
@@ -104,14 +111,7 @@ void DepthBufferRasterizerScalar::CreateTransformedModels(CPUTAssetSet **mpAsset
 
 				model = (CPUTModelDX11*)pRenderNode;
 				mpTransformedModels1[modelId].CreateTransformedMeshes(model);
-			
-				mpXformedPosOffset1[modelId] = mpTransformedModels1[modelId].GetNumVertices();
-	
-				mpStartV1[modelId] = mNumVertices1;				
-				mNumVertices1 += mpTransformedModels1[modelId].GetNumVertices();
-
-				mpStartT1[modelId] = mNumTriangles1;
-				mNumTriangles1 += mpTransformedModels1[modelId].GetNumTriangles();
+				AddModel(modelId);
 				modelId++;
 			}
 			pRenderNode->Release();
@@ -120,15 +120,91 @@ void DepthBufferRasterizerScalar::CreateTransformedModels(CPUTAssetSet **mpAsset
 
 	mpStartV1[modelId] = mNumVertices1;
 	mpStartT1[modelId] = mNumTriangles1;
-	
+}
+
+//--------------------------------------------------------------------
+// Same for the occluders of a scene without CPUT models, every one
+// of them is a model with a single mesh
+//--------------------------------------------------------------------
+void DepthBufferRasterizerScalar::CreateTransformedModels(const CullingScene &scene)
+{
+	mNumModels1 = scene.GetNumOccluders();
+	AllocateModels();
+
+	for(UINT modelId = 0; modelId < mNumModels1; modelId++)
+	{
+		mpTransformedModels1[modelId].CreateTransformedMeshes(scene, modelId);
+		AddModel(modelId);
+	}
+
+	mpStartV1[mNumModels1] = mNumVertices1;
+	mpStartT1[mNumModels1] = mNumTriangles1;
+}
+
+void DepthBufferRasterizerScalar::AllocateModels()
+{
+	mpTransformedModels1 = new TransformedModelScalar[mNumModels1];
+	mpXformedPosOffset1 = new UINT[mNumModels1];
+	mpStartV1 = new UINT[mNumModels1 + 1];
+	mpStartT1 = new UINT[mNumModels1 + 1];
+}
+
+void DepthBufferRasterizerScalar::AddModel(UINT modelId)
+{
+	mpXformedPosOffset1[modelId] = mpTransformedModels1[modelId].GetNumVertices();
+
+	mpStartV1[modelId] = mNumVertices1;
+	mNumVertices1 += mpTransformedModels1[modelId].GetNumVertices();
+
+	mpStartT1[modelId] = mNumTriangles1;
+	mNumTriangles1 += mpTransformedModels1[modelId].GetNumTriangles();
+}
+
+//--------------------------------------------------------------------
+// Create the transformed vertex buffer, active model list and bins
+// for a frame slot the first time the slot is used
+//--------------------------------------------------------------------
+void DepthBufferRasterizerScalar::AllocateSlot(UINT idx, UINT numBins, UINT maxTrisInBin)
+{
+	mpModelIndexA[idx] = new UINT[mNumModels1];
+
 	//multiply by 4 for x, y, z, w
-	mpXformedPos[0] =  new float[mNumVertices1 * 4];
-	mpXformedPos[1] =  new float[mNumVertices1 * 4];
+	mpXformedPos[idx] = new float[mNumVertices1 * 4];
 	for(UINT i = 0; i < mNumModels1; i++)
 	{
-		mpTransformedModels1[i].SetXformedPos((float4*)&mpXformedPos[0][mpStartV1[i] * 4],
-											  (float4*)&mpXformedPos[1][mpStartV1[i] * 4],
-											   mpStartV1[i]);
+		mpTransformedModels1[i].SetXformedPos((float4*)&mpXformedPos[idx][mpStartV1[i] * 4], idx);
+	}
+
+	mpBin[idx] = new UINT[numBins * maxTrisInBin];
+	mpBinModel[idx] = new USHORT[numBins * maxTrisInBin];
+	mpBinMesh[idx] = new USHORT[numBins * maxTrisInBin];
+	mpNumTrisInBin[idx] = (USHORT*)_aligned_malloc(numBins * sizeof(USHORT), 64);
+
+	// Blocks of tasks a frame does not run read as zero
+	mpTileCounters[idx] = (OccluderTileCounters*)_aligned_malloc(NUM_TILES * sizeof(OccluderTileCounters), 64);
+	mpVisCounters[idx] = (OccluderVisCounters*)_aligned_malloc(NUM_OCCLUDER_VIS_TASKS * sizeof(OccluderVisCounters), 64);
+	memset(mpTileCounters[idx], 0, NUM_TILES * sizeof(OccluderTileCounters));
+	memset(mpVisCounters[idx], 0, NUM_OCCLUDER_VIS_TASKS * sizeof(OccluderVisCounters));
+}
+
+//--------------------------------------------------------------------
+// The counters are only read once the slot's tasks are done, summing
+// up a block per task is all the main thread has to do. The scalar
+// rasterizer draws one triangle at a time, there are no SIMD batches
+//--------------------------------------------------------------------
+void DepthBufferRasterizerScalar::GetFrameStats(UINT idx, CullingStats *pStats)
+{
+	pStats->mNumOccludersR2DB = 0;
+	for(UINT i = 0; i < NUM_OCCLUDER_VIS_TASKS; i++)
+	{
+		pStats->mNumOccludersR2DB += mpVisCounters[idx][i].mNumOccludersR2DB;
+	}
+
+	pStats->mNumRasterizedTris = pStats->mNumSimdBatches = pStats->mNumSimdLanes = 0;
+	for(UINT i = 0; i < NUM_TILES; i++)
+	{
+		pStats->mNumTrisInTile[i] = mpTileCounters[idx][i].mNumTris;
+		pStats->mNumRasterizedTris += mpTileCounters[idx][i].mNumTris;
 	}
 }
 
@@ -151,6 +227,99 @@ void DepthBufferRasterizerScalar::ClearDepthTile(int startX, int startY, int end
 	}
 }
 
+//--------------------------------------------------------------------------------------
+// Rasterize a screen space triangle into the part of the depth buffer in the tile 
+// (tileStartX, tileStartY) .. (tileEndX, tileEndY). Shared by the binned rasterizers and
+// the kernel benchmark
+//--------------------------------------------------------------------------------------
+void DepthBufferRasterizerScalar::RasterizeTriangle(float *pDepthBuffer, const float4 xformedPos[3], int tileStartX, int tileEndX, int tileStartY, int tileEndY)
+{
+	// use fixed-point only for X and Y.  Avoid work for Z and W.
+	int fxPtX[3], fxPtY[3];
+	float Z[3];
+	for(UINT i = 0; i < 3; i++)
+	{
+		fxPtX[i] = (int)(xformedPos[i].x + 0.5);
+		fxPtY[i] = (int)(xformedPos[i].y + 0.5);
+		Z[i] = xformedPos[i].z;
+	}
+
+	// Fab(x, y) =     Ax       +       By     +      C              = 0
+	// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
+	// Compute A = (ya - yb) for the 3 line segments that make up each triangle
+	int A0 = fxPtY[1] - fxPtY[2];
+	int A1 = fxPtY[2] - fxPtY[0];
+	int A2 = fxPtY[0] - fxPtY[1];
+
+	// Compute B = (xb - xa) for the 3 line segments that make up each triangle
+	int B0 = fxPtX[2] - fxPtX[1];
+	int B1 = fxPtX[0] - fxPtX[2];
+	int B2 = fxPtX[1] - fxPtX[0];
+
+	// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
+	int C0 = fxPtX[1] * fxPtY[2] - fxPtX[2] * fxPtY[1];
+	int C1 = fxPtX[2] * fxPtY[0] - fxPtX[0] * fxPtY[2];
+	int C2 = fxPtX[0] * fxPtY[1] - fxPtX[1] * fxPtY[0];
+
+	// Compute triangle area
+	int triArea = (fxPtX[1] - fxPtX[0]) * (fxPtY[2] - fxPtY[0]) - (fxPtX[0] - fxPtX[2]) * (fxPtY[0] - fxPtY[1]);
+	float oneOverTriArea = (1.0f/float(triArea));
+
+	Z[1] = (Z[1] - Z[0]) * oneOverTriArea;
+	Z[2] = (Z[2] - Z[0]) * oneOverTriArea;
+
+	// Use bounding box traversal strategy to determine which pixels to rasterize 
+	int startX = max(min(min(fxPtX[0], fxPtX[1]), fxPtX[2]), tileStartX) & int(0xFFFFFFFE);
+	int endX   = min(max(max(fxPtX[0], fxPtX[1]), fxPtX[2]), tileEndX+1);
+
+	int startY = max(min(min(fxPtY[0], fxPtY[1]), fxPtY[2]), tileStartY) & int(0xFFFFFFFE);
+	int endY   = min(max(max(fxPtY[0], fxPtY[1]), fxPtY[2]), tileEndY+1);
+
+	int rowIdx = (startY * SCREENW + startX);
+	int col = startX;
+	int row = startY;
+	
+	// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY) 
+	int alpha0 = (A0 * col) + (B0 * row) + C0;
+	int beta0 = (A1 * col) + (B1 * row) + C1;
+	int gama0 = (A2 * col) + (B2 * row) + C2;
+
+	float zx = A1 * Z[1] + A2 * Z[2];
+			
+	for(int r = startY; r < endY; r++,
+								  row++,
+								  rowIdx = rowIdx + SCREENW,
+								  alpha0 += B0,
+								  beta0 += B1,
+								  gama0 += B2)									 
+	{
+		// Compute barycentric coordinates 
+		int index = rowIdx;
+		int alpha = alpha0;
+		int beta = beta0;
+		int gama = gama0;
+
+		float depth = Z[0] + Z[1] * beta + Z[2] * gama;
+		
+		for(int c = startX; c < endX; c++,
+									  index++,
+									  alpha += A0,
+									  beta  += A1,
+									  gama  += A2,
+									  depth += zx)
+		{
+			//Test Pixel inside triangle
+			int mask = alpha | beta | gama;
+				
+			float previousDepthValue = pDepthBuffer[index];
+			float mergedDepth = max(depth, previousDepthValue);				
+			float finaldepth = mask < 0 ? previousDepthValue : mergedDepth;
+			
+			pDepthBuffer[index] = finaldepth;
+		}//for each column											
+	}// for each row
+}
+
 void DepthBufferRasterizerScalar::SetViewProj(float4x4 *viewMatrix, float4x4 *projMatrix, UINT idx)
 {
 	mpViewMatrix[idx] = *viewMatrix;
@@ -27,17 +27,22 @@ class DepthBufferRasterizerScalar : public DepthBufferRasterizer, public HelperS
 		virtual ~DepthBufferRasterizerScalar();
 
 		void CreateTransformedModels(CPUTAssetSet **pAssetSet, UINT numAssetSets);
+		void CreateTransformedModels(const CullingScene &scene);
 
 		// start inclusive, end exclusive
 		void ClearDepthTile(int startX, int startY, int endX, int endY, UINT idx);
+		// Rasterize a triangle into a tile, start and end inclusive
+		static void RasterizeTriangle(float *pDepthBuffer, const float4 xformedPos[3], int tileStartX, int tileEndX, int tileStartY, int tileEndY);
 
 		// Reset all models to be visible when frustum culling is disabled 
 		inline void ResetInsideFrustum()
 		{
 			for(UINT i = 0; i < mNumModels1; i++)
 			{
-				mpTransformedModels1[i].SetInsideFrustum(true, 0);
-				mpTransformedModels1[i].SetInsideFrustum(true, 1);
+				for(UINT idx = 0; idx < MAX_SLOTS; idx++)
+				{
+					mpTransformedModels1[i].SetInsideFrustum(true, idx);
+				}
 			}
 		}
 
@@ -55,16 +60,10 @@ class DepthBufferRasterizerScalar : public DepthBufferRasterizer, public HelperS
 
 		inline void SetEnableFCulling(bool enableFCulling) {mEnableFCulling = enableFCulling;}
 
+		// Occluder waves are only implemented by the SSE rasterizer
+		inline void SetOccluderWaves(bool occluderWaves) {}
+
 		inline UINT GetNumOccluders() {return mNumModels1;}
-		inline UINT GetNumOccludersR2DB(UINT idx)
-		{
-			mNumRasterized[idx] = 0;
-			for(UINT i = 0; i < mNumModels1; i++)
-			{
-				mNumRasterized[idx] += mpTransformedModels1[i].IsRasterized2DB(idx) ? 1 : 0;
-			}
-			return mNumRasterized[idx];
-		}
 		inline double GetRasterizeTime()
 		{
 			double averageTime = 0.0;
@@ -74,16 +73,13 @@ class DepthBufferRasterizerScalar : public DepthBufferRasterizer, public HelperS
 			}
 			return averageTime / AVG_COUNTER;
 		}
-		inline UINT GetNumTriangles(){return mNumTriangles1;}
-		inline UINT GetNumRasterizedTriangles(UINT idx) 
+		inline double GetLastRasterizeTime()
 		{
-			UINT numRasterizedTris = 0;
-			for(UINT i = 0; i < NUM_TILES; i++)
-			{
-				numRasterizedTris += mNumRasterizedTris[idx][i];
-			}
-			return numRasterizedTris;
+			return mRasterizeTime[(mTimeCounter + AVG_COUNTER - 1) % AVG_COUNTER];
 		}
+		inline UINT GetNumTriangles(){return mNumTriangles1;}
+		// Sums up the counter blocks the visibility and raster tasks of the slot filled in
+		void GetFrameStats(UINT idx, CullingStats *pStats);
 
 		inline void ResetActive(UINT idx)
 		{
@@ -100,7 +96,23 @@ class DepthBufferRasterizerScalar : public DepthBufferRasterizer, public HelperS
 			mNumTrianglesA[idx] += mpStartT1[modelId + 1] - mpStartT1[modelId];
 		}
 
+		// Views culled together share one active model list
+		inline void ShareActive(UINT srcIdx, UINT dstIdx)
+		{
+			mNumModelsA[dstIdx] = mNumModelsA[srcIdx];
+			mNumVerticesA[dstIdx] = mNumVerticesA[srcIdx];
+			mNumTrianglesA[dstIdx] = mNumTrianglesA[srcIdx];
+			memcpy(mpModelIndexA[dstIdx], mpModelIndexA[srcIdx], mNumModelsA[srcIdx] * sizeof(UINT));
+		}
+
 	protected:
+		// Model data for mNumModels1 models
+		void AllocateModels();
+		// Add the vertices and triangles of a model created by CreateTransformedModels
+		void AddModel(UINT modelId);
+		// Slot buffers are only allocated once a frame actually uses the slot
+		void AllocateSlot(UINT idx, UINT numBins, UINT maxTrisInBin);
+
 		TransformedModelScalar* mpTransformedModels1;
 		UINT mNumModels1;
 		UINT *mpXformedPosOffset1;
@@ -108,23 +120,23 @@ class DepthBufferRasterizerScalar : public DepthBufferRasterizer, public HelperS
 		UINT *mpStartT1;
 		UINT mNumVertices1;
 		UINT mNumTriangles1;
-		UINT mNumRasterizedTris[2][NUM_TILES];
-		float* mpXformedPos[2];
-		CPUTCamera *mpCamera[2];
-		float4x4 mpViewMatrix[2];
-		float4x4 mpProjMatrix[2];
-		UINT *mpRenderTargetPixels[2];
-		UINT mNumRasterized[2];
-		UINT	*mpBin[2];				 // triangle index
-		USHORT  *mpBinModel[2];		 // model Index	
-		USHORT  *mpBinMesh[2];			 // mesh index
-		USHORT  *mpNumTrisInBin[2];     // number of triangles in the bin 
+		OccluderTileCounters *mpTileCounters[MAX_SLOTS];	// NUM_TILES per slot, one per raster task
+		OccluderVisCounters *mpVisCounters[MAX_SLOTS];		// NUM_OCCLUDER_VIS_TASKS per slot
+		float* mpXformedPos[MAX_SLOTS];
+		CPUTCamera *mpCamera[MAX_SLOTS];
+		float4x4 mpViewMatrix[MAX_SLOTS];
+		float4x4 mpProjMatrix[MAX_SLOTS];
+		UINT *mpRenderTargetPixels[MAX_SLOTS];
+		UINT	*mpBin[MAX_SLOTS];				 // triangle index
+		USHORT  *mpBinModel[MAX_SLOTS];		 // model Index	
+		USHORT  *mpBinMesh[MAX_SLOTS];			 // mesh index
+		USHORT  *mpNumTrisInBin[MAX_SLOTS];     // number of triangles in the bin 
 		UINT mTimeCounter;
 
-		UINT *mpModelIndexA[2]; // 'active' models = visible and not too small
-		UINT mNumModelsA[2];
-		UINT mNumVerticesA[2];
-		UINT mNumTrianglesA[2];
+		UINT *mpModelIndexA[MAX_SLOTS]; // 'active' models = visible and not too small
+		UINT mNumModelsA[MAX_SLOTS];
+		UINT mNumVerticesA[MAX_SLOTS];
+		UINT mNumTrianglesA[MAX_SLOTS];
 
 		float mOccluderSizeThreshold;
 
@@ -21,94 +21,116 @@
 DepthBufferRasterizerScalarMT::DepthBufferRasterizerScalarMT()
 	: DepthBufferRasterizerScalar()
 {
-	int size = SCREENH_IN_TILES * SCREENW_IN_TILES *  NUM_XFORMVERTS_TASKS;
-	mpBin[0] = new UINT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinModel[0] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinMesh[0] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpNumTrisInBin[0] = new USHORT[size];
-
-	mpBin[1] = new UINT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinModel[1] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpBinMesh[1] = new USHORT[size * MAX_TRIS_IN_BIN_MT];
-	mpNumTrisInBin[1] = new USHORT[size];
 }
 
 DepthBufferRasterizerScalarMT::~DepthBufferRasterizerScalarMT()
 {
-	SAFE_DELETE_ARRAY(mpBin[0]);
-	SAFE_DELETE_ARRAY(mpBinModel[0]);
-	SAFE_DELETE_ARRAY(mpBinMesh[0]);
-	SAFE_DELETE_ARRAY(mpNumTrisInBin[0]);
-
-	SAFE_DELETE_ARRAY(mpBin[1]);
-	SAFE_DELETE_ARRAY(mpBinModel[1]);
-	SAFE_DELETE_ARRAY(mpBinMesh[1]);
-	SAFE_DELETE_ARRAY(mpNumTrisInBin[1]);
 }
 
 
 void DepthBufferRasterizerScalarMT::InsideViewFrustum(VOID *taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->InsideViewFrustum(taskId, taskCount, pTaskData->idx);
+	pTaskData->pDBR->InsideViewFrustum(taskId, taskCount, pTaskData->idx, pTaskData->numViews);
 }
 
 //------------------------------------------------------------
 // * Determine if the occluder model is inside view frustum
+//   of each of the views
+// * Count the occluders rasterized to each view
 //------------------------------------------------------------
-void DepthBufferRasterizerScalarMT::InsideViewFrustum(UINT taskId, UINT taskCount, UINT idx)
+void DepthBufferRasterizerScalarMT::InsideViewFrustum(UINT taskId, UINT taskCount, UINT idx, UINT numViews)
 {
 	UINT start, end;
 	GetWorkExtent(&start, &end, taskId, taskCount, mNumModels1);
 
-	BoxTestSetupScalar setup;
-	setup.Init(mpViewMatrix[idx], mpProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccluderSizeThreshold); 
+	BoxTestSetupScalar setup[MAX_VIEWS];
+	for(UINT view = 0; view < numViews; view++)
+	{
+		setup[view].Init(mpViewMatrix[idx + view], mpProjMatrix[idx + view], viewportMatrix, mpCamera[idx + view], mOccluderSizeThreshold);
+	}
 
+	UINT numRasterized[MAX_VIEWS] = {0};
 	for(UINT i = start; i < end; i++)
 	{
-		mpTransformedModels1[i].InsideViewFrustum(setup, idx);
+		mpTransformedModels1[i].InsideViewFrustum(setup, numViews, idx);
+		for(UINT view = 0; view < numViews; view++)
+		{
+			numRasterized[view] += mpTransformedModels1[i].IsRasterized2DB(idx + view) ? 1 : 0;
+		}
+	}
+	for(UINT view = 0; view < numViews; view++)
+	{
+		mpVisCounters[idx + view][taskId].mNumOccludersR2DB = numRasterized[view];
 	}
 }
 
 void DepthBufferRasterizerScalarMT::TooSmall(VOID *taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->TooSmall(taskId, taskCount, pTaskData->idx);
+	pTaskData->pDBR->TooSmall(taskId, taskCount, pTaskData->idx, pTaskData->numViews);
 }
 
 //------------------------------------------------------------
-// * Determine if the occluder model is inside view frustum
+// * Determine if the occluder model is too small in screen space
+//   of each of the views
+// * Count the occluders rasterized to each view
 //------------------------------------------------------------
-void DepthBufferRasterizerScalarMT::TooSmall(UINT taskId, UINT taskCount, UINT idx)
+void DepthBufferRasterizerScalarMT::TooSmall(UINT taskId, UINT taskCount, UINT idx, UINT numViews)
 {
 	UINT start, end;
 	GetWorkExtent(&start, &end, taskId, taskCount, mNumModels1);
 
-	BoxTestSetupScalar setup;
-	setup.Init(mpViewMatrix[idx], mpProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccluderSizeThreshold); 
+	BoxTestSetupScalar setup[MAX_VIEWS];
+	for(UINT view = 0; view < numViews; view++)
+	{
+		setup[view].Init(mpViewMatrix[idx + view], mpProjMatrix[idx + view], viewportMatrix, mpCamera[idx + view], mOccluderSizeThreshold);
+	}
 
+	UINT numRasterized[MAX_VIEWS] = {0};
 	for(UINT i = start; i < end; i++)
 	{
-		mpTransformedModels1[i].TooSmall(setup, idx);
+		for(UINT view = 0; view < numViews; view++)
+		{
+			mpTransformedModels1[i].TooSmall(setup[view], idx + view);
+			numRasterized[view] += mpTransformedModels1[i].IsRasterized2DB(idx + view) ? 1 : 0;
+		}
+	}
+	for(UINT view = 0; view < numViews; view++)
+	{
+		mpVisCounters[idx + view][taskId].mNumOccludersR2DB = numRasterized[view];
 	}
 }
 
 void DepthBufferRasterizerScalarMT::ActiveModels(VOID* taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->ActiveModels(taskId, pTaskData->idx);
+	pTaskData->pDBR->ActiveModels(taskId, pTaskData->idx, pTaskData->numViews);
 }
 
-void DepthBufferRasterizerScalarMT::ActiveModels(UINT taskId, UINT idx)
+//------------------------------------------------------------
+// * The active model list is shared by all the views, a model
+//   is active if it is rasterized to at least one of them
+//------------------------------------------------------------
+void DepthBufferRasterizerScalarMT::ActiveModels(UINT taskId, UINT idx, UINT numViews)
 {
 	ResetActive(idx);
 	for (UINT i = 0; i < mNumModels1; i++)
 	{
-		if(mpTransformedModels1[i].IsRasterized2DB(idx))
+		for(UINT view = 0; view < numViews; view++)
 		{
-			Activate(i, idx);
+			if(mpTransformedModels1[i].IsRasterized2DB(idx + view))
+			{
+				Activate(i, idx);
+				break;
+			}
 		}
 	}
+
+	for(UINT view = 1; view < numViews; view++)
+	{
+		ShareActive(idx, idx + view);
+	}
 }
 
 //------------------------------------------------------------------------------
@@ -120,36 +142,69 @@ void DepthBufferRasterizerScalarMT::ActiveModels(UINT taskId, UINT idx)
 //-------------------------------------------------------------------------------
 void DepthBufferRasterizerScalarMT::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx)
 {
-	static const unsigned int kNumOccluderVisTasks = 32;
+	TransformModelsAndRasterizeToDepthBuffer(&pCamera, 1, idx);
+}
 
-	mTaskData[idx].idx = idx;
-	mTaskData[idx].pDBR = this;
+//-------------------------------------------------------------------------------
+// Multi view version, the views use slots idx .. idx + numViews - 1
+// The visibility and activation tasks run once for all the views. Every view 
+// gets its own transform, bin, sort and rasterize tasks which only depend on the
+// shared activation, so the views are rasterized concurrently
+//-------------------------------------------------------------------------------
+void DepthBufferRasterizerScalarMT::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx)
+{
+	assert(numViews <= MAX_VIEWS && idx + numViews <= MAX_SLOTS);
 
 	QueryPerformanceCounter(&mStartTime[idx]);
+	for(UINT view = idx; view < idx + numViews; view++)
+	{
+		if(mpBin[view] == NULL)
+		{
+			AllocateSlot(view, SCREENH_IN_TILES * SCREENW_IN_TILES * NUM_XFORMVERTS_TASKS, MAX_TRIS_IN_BIN_MT);
+		}
+
+		mTaskData[view].idx = view;
+		mTaskData[view].numViews = (view == idx) ? numViews : 1;
+		mTaskData[view].pDBR = this;
+
+		for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+		{
+			mBandData[view][band] = mTaskData[view];
+			mBandData[view][band].band = band;
+		}
 
-	mpCamera[idx] = pCamera;
+		mStartTime[view] = mStartTime[idx];
+		mpCamera[view] = ppCamera[view - idx];
+	}
+	
 	if(mEnableFCulling)
 	{
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::InsideViewFrustum, &mTaskData[idx], kNumOccluderVisTasks, NULL, 0, "Is Visible", &gInsideViewFrustum[idx]);
-
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::InsideViewFrustum, &mTaskData[idx], NUM_OCCLUDER_VIS_TASKS, NULL, 0, "Is Visible", &gInsideViewFrustum[idx]);
+		
 		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::ActiveModels, &mTaskData[idx], 1, &gInsideViewFrustum[idx], 1, "IsActive", &gActiveModels[idx]);
-
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::TransformMeshes, &mTaskData[idx], NUM_XFORMVERTS_TASKS, &gActiveModels[idx], 1, "Xform Vertices", &gXformMesh[idx]);
 	}
 	else
 	{
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::TooSmall, &mTaskData[idx], kNumOccluderVisTasks, NULL, 0, "TooSmall", &gTooSmall[idx]);
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::TooSmall, &mTaskData[idx], NUM_OCCLUDER_VIS_TASKS, NULL, 0, "TooSmall", &gTooSmall[idx]);
 	
 		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::ActiveModels, &mTaskData[idx], 1, &gTooSmall[idx], 1, "IsActive", &gActiveModels[idx]);
-
-		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::TransformMeshes, &mTaskData[idx], NUM_XFORMVERTS_TASKS, &gActiveModels[idx], 1, "Xform Vertices", &gXformMesh[idx]);
 	}
 
-	gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::BinTransformedMeshes, &mTaskData[idx], NUM_XFORMVERTS_TASKS, &gXformMesh[idx], 1, "Bin Meshes", &gBinMesh[idx]);
-	
-	gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::SortBins, &mTaskData[idx], 1, &gBinMesh[idx], 1, "BinSort", &gSortBins[idx]);
+	for(UINT view = idx; view < idx + numViews; view++)
+	{
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::TransformMeshes, &mTaskData[view], NUM_XFORMVERTS_TASKS, &gActiveModels[idx], 1, "Xform Vertices", &gXformMesh[view]);
 
-	gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::RasterizeBinnedTrianglesToDepthBuffer, &mTaskData[idx], NUM_TILES, &gSortBins[idx], 1, "Raster Tris to DB", &gRasterize[idx]);	
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::BinTransformedMeshes, &mTaskData[view], NUM_XFORMVERTS_TASKS, &gXformMesh[view], 1, "Bin Meshes", &gBinMesh[view]);
+
+		gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::SortBins, &mTaskData[view], 1, &gBinMesh[view], 1, "BinSort", &gSortBins[view]);
+	
+		// One raster task set per band of tile rows, the occludee depth tests only wait
+		// for the bands they overlap
+		for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+		{
+			gTaskMgr.CreateTaskSet(&DepthBufferRasterizerScalarMT::RasterizeBinnedTrianglesToDepthBuffer, &mBandData[view][band], TILES_PER_BAND, &gSortBins[view], 1, "Raster Tris to DB", &gRasterize[view][band]);
+		}
+	}
 }
 
 void DepthBufferRasterizerScalarMT::TransformMeshes(VOID* taskData, INT context, UINT taskId, UINT taskCount)
@@ -265,7 +320,8 @@ void DepthBufferRasterizerScalarMT::BinTransformedMeshes(UINT taskId, UINT taskC
 // scheduler starts tasks roughly in order, the idea is to put the "fat tiles" first
 // and leave the small jobs for last. This is to avoid the pathological case where a
 // relatively big tile gets picked up late (as the other worker threads are about to
-// finish) and rendering effectively completes single-threaded.
+// finish) and rendering effectively completes single-threaded. Every band of tile
+// rows is its own task set, so the tiles are sorted within their band.
 //--------------------------------------------------------------------------------------
 void DepthBufferRasterizerScalarMT::SortBins(VOID* taskData, INT context, UINT taskId, UINT taskCount)
 {
@@ -286,16 +342,20 @@ void DepthBufferRasterizerScalarMT::SortBins(VOID* taskData, INT context, UINT t
 		tileTotalTris[tile] = numTris;
 	}
 
-	// Sort tiles by number of triangles, decreasing.
-	std::sort(pTaskData->pDBR->mTileSequence[pTaskData->idx], pTaskData->pDBR->mTileSequence[pTaskData->idx] + NUM_TILES,
-		[&](const UINT a, const UINT b){ return tileTotalTris[a] > tileTotalTris[b]; });
+	// Sort the tiles of every band by number of triangles, decreasing.
+	for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+	{
+		UINT *pBandSequence = pTaskData->pDBR->mTileSequence[pTaskData->idx] + band * TILES_PER_BAND;
+		std::sort(pBandSequence, pBandSequence + TILES_PER_BAND,
+			[&](const UINT a, const UINT b){ return tileTotalTris[a] > tileTotalTris[b]; });
+	}
 }
 
 
 void DepthBufferRasterizerScalarMT::RasterizeBinnedTrianglesToDepthBuffer(VOID* taskData, INT context, UINT taskId, UINT taskCount)
 {
 	PerTaskData *pTaskData = (PerTaskData*)taskData;
-	pTaskData->pDBR->RasterizeBinnedTrianglesToDepthBuffer(taskId, pTaskData->idx);
+	pTaskData->pDBR->RasterizeBinnedTrianglesToDepthBuffer(pTaskData->band * TILES_PER_BAND + taskId, pTaskData->idx);
 }
 
 //-------------------------------------------------------------------------------
@@ -329,7 +389,7 @@ void DepthBufferRasterizerScalarMT::RasterizeBinnedTrianglesToDepthBuffer(UINT r
 	float4 xformedPos[3];
 	bool done = false;
 	bool allBinsEmpty = true;
-	mNumRasterizedTris[idx][taskId] = numTrisInBin;
+	mpTileCounters[idx][taskId].mNumTris = numTrisInBin;
 
 	while(!done)
 	{
@@ -342,7 +402,7 @@ void DepthBufferRasterizerScalarMT::RasterizeBinnedTrianglesToDepthBuffer(UINT r
 				break;
 			}
 			numTrisInBin = mpNumTrisInBin[idx][offset1 + TOFFSET1_MT * bin];
-			mNumRasterizedTris[idx][taskId] += numTrisInBin;
+			mpTileCounters[idx][taskId].mNumTris += numTrisInBin;
 			binIndex = 0; 
 		}
 		if(!numTrisInBin)
@@ -366,90 +426,7 @@ void DepthBufferRasterizerScalarMT::RasterizeBinnedTrianglesToDepthBuffer(UINT r
 			return;
 		}
 
-		// use fixed-point only for X and Y.  Avoid work for Z and W.
-		int fxPtX[3], fxPtY[3];
-		float Z[3];
-		for(UINT i = 0; i < 3; i++)
-		{
-			fxPtX[i] = (int)(xformedPos[i].x + 0.5);
-			fxPtY[i] = (int)(xformedPos[i].y + 0.5);
-			Z[i] = xformedPos[i].z;
-		}
-
-		// Fab(x, y) =     Ax       +       By     +      C              = 0
-		// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
-		// Compute A = (ya - yb) for the 3 line segments that make up each triangle
-		int A0 = fxPtY[1] - fxPtY[2];
-		int A1 = fxPtY[2] - fxPtY[0];
-		int A2 = fxPtY[0] - fxPtY[1];
-
-		// Compute B = (xb - xa) for the 3 line segments that make up each triangle
-		int B0 = fxPtX[2] - fxPtX[1];
-		int B1 = fxPtX[0] - fxPtX[2];
-		int B2 = fxPtX[1] - fxPtX[0];
-
-		// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
-		int C0 = fxPtX[1] * fxPtY[2] - fxPtX[2] * fxPtY[1];
-		int C1 = fxPtX[2] * fxPtY[0] - fxPtX[0] * fxPtY[2];
-		int C2 = fxPtX[0] * fxPtY[1] - fxPtX[1] * fxPtY[0];
-
-		// Compute triangle area
-		int triArea = (fxPtX[1] - fxPtX[0]) * (fxPtY[2] - fxPtY[0]) - (fxPtX[0] - fxPtX[2]) * (fxPtY[0] - fxPtY[1]);
-		float oneOverTriArea = (1.0f/float(triArea));
-
-		Z[1] = (Z[1] - Z[0]) * oneOverTriArea;
-		Z[2] = (Z[2] - Z[0]) * oneOverTriArea;
-
-		// Use bounding box traversal strategy to determine which pixels to rasterize 
-		int startX = max(min(min(fxPtX[0], fxPtX[1]), fxPtX[2]), tileStartX) & int(0xFFFFFFFE);
-		int endX   = min(max(max(fxPtX[0], fxPtX[1]), fxPtX[2]), tileEndX+1);
-
-		int startY = max(min(min(fxPtY[0], fxPtY[1]), fxPtY[2]), tileStartY) & int(0xFFFFFFFE);
-		int endY   = min(max(max(fxPtY[0], fxPtY[1]), fxPtY[2]), tileEndY+1);
-
-		int rowIdx = (startY * SCREENW + startX);
-		int col = startX;
-		int row = startY;
-		
-		// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY) 
-		int alpha0 = (A0 * col) + (B0 * row) + C0;
-		int beta0 = (A1 * col) + (B1 * row) + C1;
-		int gama0 = (A2 * col) + (B2 * row) + C2;
-
-		float zx = A1 * Z[1] + A2 * Z[2];
-				
-		for(int r = startY; r < endY; r++,
-									  row++,
-									  rowIdx = rowIdx + SCREENW,
-									  alpha0 += B0,
-									  beta0 += B1,
-									  gama0 += B2)									 
-		{
-			// Compute barycentric coordinates 
-			int index = rowIdx;
-			int alpha = alpha0;
-			int beta = beta0;
-			int gama = gama0;
-
-			float depth = Z[0] + Z[1] * beta + Z[2] * gama;
-			
-			for(int c = startX; c < endX; c++,
-   										  index++,
-										  alpha += A0,
-										  beta  += A1,
-										  gama  += A2,
-										  depth += zx)
-			{
-				//Test Pixel inside triangle
-				int mask = alpha | beta | gama;
-					
-				float previousDepthValue = pDepthBuffer[index];
-				float mergedDepth = max(depth, previousDepthValue);				
-				float finaldepth = mask < 0 ? previousDepthValue : mergedDepth;
-				
-				pDepthBuffer[index] = finaldepth;
-			}//for each column											
-		}// for each row
+		RasterizeTriangle(pDepthBuffer, xformedPos, tileStartX, tileEndX, tileStartY, tileEndY);
 	}// for each triangle
 	QueryPerformanceCounter(&mStopTime[idx][taskId]);
 }
@@ -27,21 +27,25 @@ class DepthBufferRasterizerScalarMT : public DepthBufferRasterizerScalar
 		struct PerTaskData
 		{
 			UINT idx;
+			UINT numViews;
+			UINT band;
 			DepthBufferRasterizerScalarMT *pDBR; 
 		};
-		PerTaskData mTaskData[2];
+		PerTaskData mTaskData[MAX_SLOTS];
+		PerTaskData mBandData[MAX_SLOTS][NUM_RASTER_BANDS];
 		void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx);
+		void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx);
 		void ComputeR2DBTime(UINT idx);
 
 	private:
 		static void InsideViewFrustum(VOID* taskData, INT context, UINT taskId, UINT taskCount);
-		void InsideViewFrustum(UINT taskId, UINT taskCount, UINT idx);
+		void InsideViewFrustum(UINT taskId, UINT taskCount, UINT idx, UINT numViews);
 
 		static void TooSmall(VOID* taskData, INT context, UINT taskId, UINT taskCount);
-		void TooSmall(UINT taskId, UINT taskCount, UINT idx);
+		void TooSmall(UINT taskId, UINT taskCount, UINT idx, UINT numViews);
 
 		static void ActiveModels(VOID* taskData, INT context, UINT taskId, UINT taskCount);
-		void ActiveModels(UINT taskId, UINT idx);
+		void ActiveModels(UINT taskId, UINT idx, UINT numViews);
 
 		static void TransformMeshes(VOID* taskData, INT context, UINT taskId, UINT taskCount);
 		void TransformMeshes(UINT taskId, UINT taskCount, UINT idx);
@@ -54,7 +58,7 @@ class DepthBufferRasterizerScalarMT : public DepthBufferRasterizerScalar
 		static void RasterizeBinnedTrianglesToDepthBuffer(VOID* taskData, INT context, UINT taskId, UINT taskCount);
 		void RasterizeBinnedTrianglesToDepthBuffer(UINT rawTaskId, UINT idx);
 
-		UINT mTileSequence[2][NUM_TILES];
+		UINT mTileSequence[MAX_SLOTS][NUM_TILES];
 };
 
 #endif  //DEPTHBUFFERRASTERIZERSCALARMT_H
\ No newline at end of file
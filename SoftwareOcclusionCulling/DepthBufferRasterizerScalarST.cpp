@@ -20,29 +20,10 @@
 DepthBufferRasterizerScalarST::DepthBufferRasterizerScalarST()
 	: DepthBufferRasterizerScalar()
 {
-	int size = SCREENH_IN_TILES * SCREENW_IN_TILES;
-	mpBin[0] = new UINT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinModel[0] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinMesh[0] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpNumTrisInBin[0] = new USHORT[size];
-
-	mpBin[1] = new UINT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinModel[1] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpBinMesh[1] = new USHORT[size * MAX_TRIS_IN_BIN_ST];
-	mpNumTrisInBin[1] = new USHORT[size];
 }
 
 DepthBufferRasterizerScalarST::~DepthBufferRasterizerScalarST()
 {
-	SAFE_DELETE_ARRAY(mpBin[0]);
-	SAFE_DELETE_ARRAY(mpBinModel[0]);
-	SAFE_DELETE_ARRAY(mpBinMesh[0]);
-	SAFE_DELETE_ARRAY(mpNumTrisInBin[0]);
-
-	SAFE_DELETE_ARRAY(mpBin[1]);
-	SAFE_DELETE_ARRAY(mpBinModel[1]);
-	SAFE_DELETE_ARRAY(mpBinMesh[1]);
-	SAFE_DELETE_ARRAY(mpNumTrisInBin[1]);
 }
 
 //------------------------------------------------------------------------------
@@ -53,33 +34,68 @@ DepthBufferRasterizerScalarST::~DepthBufferRasterizerScalarST()
 //-------------------------------------------------------------------------------
 void DepthBufferRasterizerScalarST::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx)
 {
+	TransformModelsAndRasterizeToDepthBuffer(&pCamera, 1, idx);
+}
+
+//------------------------------------------------------------------------------
+// Multi view version, the views use slots idx .. idx + numViews - 1
+// The visibility tests and model activation are done once for all the views
+//-------------------------------------------------------------------------------
+void DepthBufferRasterizerScalarST::TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx)
+{
+	assert(numViews <= MAX_VIEWS && idx + numViews <= MAX_SLOTS);
+
 	QueryPerformanceCounter(&mStartTime[idx]);
-	mpCamera[idx] = pCamera;
 
-	BoxTestSetupScalar setup;
-	setup.Init(mpViewMatrix[idx], mpProjMatrix[idx], viewportMatrix, mpCamera[idx], mOccluderSizeThreshold); 
+	BoxTestSetupScalar setup[MAX_VIEWS];
+	for(UINT view = 0; view < numViews; view++)
+	{
+		if(mpBin[idx + view] == NULL)
+		{
+			AllocateSlot(idx + view, SCREENH_IN_TILES * SCREENW_IN_TILES, MAX_TRIS_IN_BIN_ST);
+		}
+		mpCamera[idx + view] = ppCamera[view];
+		setup[view].Init(mpViewMatrix[idx + view], mpProjMatrix[idx + view], viewportMatrix, ppCamera[view], mOccluderSizeThreshold);
+	}
 
+	// The visibility loop is the only visibility task, it fills in the first block
+	UINT numRasterized[MAX_VIEWS] = {0};
 	if(mEnableFCulling)
 	{
 		for(UINT i = 0; i < mNumModels1; i++)
 		{
-			mpTransformedModels1[i].InsideViewFrustum(setup, idx);
+			mpTransformedModels1[i].InsideViewFrustum(setup, numViews, idx);
+			for(UINT view = 0; view < numViews; view++)
+			{
+				numRasterized[view] += mpTransformedModels1[i].IsRasterized2DB(idx + view) ? 1 : 0;
+			}
 		}
 	}
 	else
 	{
 		for(UINT i = 0; i < mNumModels1; i++)
 		{
-			mpTransformedModels1[i].TooSmall(setup, idx);
+			for(UINT view = 0; view < numViews; view++)
+			{
+				mpTransformedModels1[i].TooSmall(setup[view], idx + view);
+				numRasterized[view] += mpTransformedModels1[i].IsRasterized2DB(idx + view) ? 1 : 0;
+			}
 		}
 	}
+	for(UINT view = 0; view < numViews; view++)
+	{
+		mpVisCounters[idx + view][0].mNumOccludersR2DB = numRasterized[view];
+	}
 
-	ActiveModels(idx);
-	TransformMeshes(idx);
-	BinTransformedMeshes(idx);
-	for(UINT i = 0; i < NUM_TILES; i++)
+	ActiveModels(idx, numViews);
+	for(UINT view = idx; view < idx + numViews; view++)
 	{
-		RasterizeBinnedTrianglesToDepthBuffer(i, idx);
+		TransformMeshes(view);
+		BinTransformedMeshes(view);
+		for(UINT i = 0; i < NUM_TILES; i++)
+		{
+			RasterizeBinnedTrianglesToDepthBuffer(i, view);
+		}
 	}
 
 	QueryPerformanceCounter(&mStopTime[idx][0]);
@@ -87,18 +103,30 @@ void DepthBufferRasterizerScalarST::TransformModelsAndRasterizeToDepthBuffer(CPU
 	mTimeCounter = mTimeCounter >= AVG_COUNTER ? 0 : mTimeCounter;
 }
 
-void DepthBufferRasterizerScalarST::ActiveModels(UINT idx)
+//------------------------------------------------------------
+// * The active model list is shared by all the views, a model
+//   is active if it is rasterized to at least one of them
+//------------------------------------------------------------
+void DepthBufferRasterizerScalarST::ActiveModels(UINT idx, UINT numViews)
 {
 	ResetActive(idx);
 	for (UINT i = 0; i < mNumModels1; i++)
 	{
-		if(mpTransformedModels1[i].IsRasterized2DB(idx))
+		for(UINT view = 0; view < numViews; view++)
 		{
-			Activate(i, idx);
+			if(mpTransformedModels1[i].IsRasterized2DB(idx + view))
+			{
+				Activate(i, idx);
+				break;
+			}
 		}
 	}
-}
 
+	for(UINT view = 1; view < numViews; view++)
+	{
+		ShareActive(idx, idx + view);
+	}
+}
 
 //-------------------------------------------------------------------
 // Trasforms the occluder vertices to screen space once every frame
@@ -172,7 +200,7 @@ void DepthBufferRasterizerScalarST::RasterizeBinnedTrianglesToDepthBuffer(UINT t
 	float4 xformedPos[3];
 	bool done = false;
 	bool allBinsEmpty = true;
-	mNumRasterizedTris[idx][tileId] = numTrisInBin;
+	mpTileCounters[idx][tileId].mNumTris = numTrisInBin;
 
 	while(!done)
 	{
@@ -185,7 +213,7 @@ void DepthBufferRasterizerScalarST::RasterizeBinnedTrianglesToDepthBuffer(UINT t
 				break;
 			}
 			numTrisInBin = mpNumTrisInBin[idx][offset1 + bin];
-			mNumRasterizedTris[idx][tileId] += numTrisInBin;
+			mpTileCounters[idx][tileId].mNumTris += numTrisInBin;
 			binIndex = 0; // Slightly inefficient.  We set it every time through this loop.  Could do only once.
 		}
 		if(!numTrisInBin)
@@ -208,90 +236,7 @@ void DepthBufferRasterizerScalarST::RasterizeBinnedTrianglesToDepthBuffer(UINT t
 			return;
 		}
 
-		// use fixed-point only for X and Y.  Avoid work for Z and W.
-        int fxPtX[3], fxPtY[3];
-		float Z[3];
-		for(UINT i = 0; i < 3; i++)
-		{
-			fxPtX[i] = (int)(xformedPos[i].x + 0.5);
-			fxPtY[i] = (int)(xformedPos[i].y + 0.5);
-			Z[i] = xformedPos[i].z;
-		}
-
-		// Fab(x, y) =     Ax       +       By     +      C              = 0
-		// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
-		// Compute A = (ya - yb) for the 3 line segments that make up each triangle
-		int A0 = fxPtY[1] - fxPtY[2];
-		int A1 = fxPtY[2] - fxPtY[0];
-		int A2 = fxPtY[0] - fxPtY[1];
-
-		// Compute B = (xb - xa) for the 3 line segments that make up each triangle
-		int B0 = fxPtX[2] - fxPtX[1];
-		int B1 = fxPtX[0] - fxPtX[2];
-		int B2 = fxPtX[1] - fxPtX[0];
-
-		// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
-		int C0 = fxPtX[1] * fxPtY[2] - fxPtX[2] * fxPtY[1];
-		int C1 = fxPtX[2] * fxPtY[0] - fxPtX[0] * fxPtY[2];
-		int C2 = fxPtX[0] * fxPtY[1] - fxPtX[1] * fxPtY[0];
-
-		// Compute triangle area
-		int triArea = (fxPtX[1] - fxPtX[0]) * (fxPtY[2] - fxPtY[0]) - (fxPtX[0] - fxPtX[2]) * (fxPtY[0] - fxPtY[1]);
-		float oneOverTriArea = (1.0f/float(triArea));
-
-		Z[1] = (Z[1] - Z[0]) * oneOverTriArea;
-		Z[2] = (Z[2] - Z[0]) * oneOverTriArea;
-
-		// Use bounding box traversal strategy to determine which pixels to rasterize 
-		int startX = max(min(min(fxPtX[0], fxPtX[1]), fxPtX[2]), tileStartX) & int(0xFFFFFFFE);
-		int endX   = min(max(max(fxPtX[0], fxPtX[1]), fxPtX[2]), tileEndX+1);
-
-		int startY = max(min(min(fxPtY[0], fxPtY[1]), fxPtY[2]), tileStartY) & int(0xFFFFFFFE);
-		int endY   = min(max(max(fxPtY[0], fxPtY[1]), fxPtY[2]), tileEndY+1);
-
-		int rowIdx = (startY * SCREENW + startX);
-		int col = startX;
-		int row = startY;
-		
-		// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY)
-		int alpha0 = (A0 * col) + (B0 * row) + C0;
-		int beta0 = (A1 * col) + (B1 * row) + C1;
-		int gama0 = (A2 * col) + (B2 * row) + C2;
-
-		float zx = A1 * Z[1] + A2 * Z[2];
-
-		for(int r = startY; r < endY; r++,
-									  row++,
-									  rowIdx = rowIdx + SCREENW,
-									  alpha0 += B0,
-									  beta0 += B1,
-									  gama0 += B2)									 
-		{
-			// Compute barycentric coordinates 
-			int index = rowIdx;
-			int alpha = alpha0;
-			int beta = beta0;
-			int gama = gama0;
-
-			float depth = Z[0] + Z[1] * beta + Z[2] * gama;
-			
-			for(int c = startX; c < endX; c++,
-   										  index++,
-										  alpha += A0,
-										  beta  += A1,
-										  gama  += A2,
-										  depth += zx)
-			{
-				//Test Pixel inside triangle
-				int mask = alpha | beta | gama;
-					
-				float previousDepthValue = pDepthBuffer[index];
-				float mergedDepth = max(depth, previousDepthValue);				
-				float finaldepth = mask < 0 ? previousDepthValue : mergedDepth;
-				
-				pDepthBuffer[index] = finaldepth;
-			}//for each column											
-		}// for each row
+		RasterizeTriangle(pDepthBuffer, xformedPos, tileStartX, tileEndX, tileStartY, tileEndY);
 	}// for each triangle*/
 }
 
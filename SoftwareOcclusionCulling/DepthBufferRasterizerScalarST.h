@@ -25,10 +25,11 @@ class DepthBufferRasterizerScalarST : public DepthBufferRasterizerScalar
 		~DepthBufferRasterizerScalarST();
 
 		void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera *pCamera, UINT idx);
+		void TransformModelsAndRasterizeToDepthBuffer(CPUTCamera **ppCamera, UINT numViews, UINT idx);
 		void ComputeR2DBTime(UINT idx);
 
 	private:
-		void ActiveModels(UINT idx);
+		void ActiveModels(UINT idx, UINT numViews);
 		void TransformMeshes(UINT idx);
 		void BinTransformedMeshes(UINT idx);
 		void RasterizeBinnedTrianglesToDepthBuffer(UINT tileId, UINT idx);
@@ -0,0 +1,239 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#include "KernelBenchmark.h"
+#include "DepthBufferRasterizerScalar.h"
+#include "DepthBufferRasterizerSSE.h"
+#include "TransformedAABBoxScalar.h"
+#include "TransformedAABBoxSSE.h"
+#include <stdio.h>
+
+// Every case is timed this many times, the fastest run is reported
+static const UINT KERNEL_BENCHMARK_RUNS = 5;
+static const UINT KERNEL_BENCHMARK_MAX_TRIS = 1 << 16;
+static const UINT KERNEL_BENCHMARK_BOXES = 1 << 12;
+
+static const float sTriangleSizes[] = {2.0f, 8.0f, 32.0f, 128.0f, 512.0f};
+static const float sTriangleAspects[] = {1.0f, 4.0f, 16.0f};
+static const UINT sTriangleOverdraw[] = {1, 4};
+static const float sBoxSizes[] = {4.0f, 16.0f, 64.0f, 256.0f};
+static const float sBoxHitRates[] = {0.0f, 0.5f, 1.0f};
+
+#define KERNEL_BENCHMARK_CASES(cases) (sizeof(cases) / sizeof(cases[0]))
+
+// Same random numbers for every backend so that they rasterize the same inputs
+static float Random(UINT &seed)
+{
+	seed = seed * 1664525 + 1013904223;
+	return (float)(seed >> 8) / (float)(1 << 24);
+}
+
+//--------------------------------------------------------------------------------------
+// Front facing right triangles with a w x h bounding box at random positions on screen,
+// enough of them to cover the screen overdraw times. Returns the pixels they cover
+//--------------------------------------------------------------------------------------
+static double CreateTriangles(float4 *pVertices, UINT &numTris, float size, float aspect, UINT overdraw)
+{
+	float w = min(size * sqrtf(aspect), (float)SCREENW - 1.0f);
+	float h = min(size / sqrtf(aspect), (float)SCREENH - 1.0f);
+	w = max(w, 1.0f);
+	h = max(h, 1.0f);
+
+	double screenArea = (double)SCREENW * (double)SCREENH;
+	numTris = (UINT)(overdraw * screenArea / (0.5 * w * h));
+	numTris = max(numTris, (UINT)SSE);
+	numTris = min(numTris, (UINT)KERNEL_BENCHMARK_MAX_TRIS);
+
+	UINT seed = 1;
+	for(UINT i = 0; i < numTris; i++)
+	{
+		float x = Random(seed) * ((float)SCREENW - 1.0f - w);
+		float y = Random(seed) * ((float)SCREENH - 1.0f - h);
+		float4 *pTri = &pVertices[i * 3];
+		if(i & 1)
+		{
+			pTri[0] = float4(x, y, Random(seed), 1.0f);
+			pTri[1] = float4(x + w, y, Random(seed), 1.0f);
+			pTri[2] = float4(x, y + h, Random(seed), 1.0f);
+		}
+		else
+		{
+			pTri[0] = float4(x + w, y + h, Random(seed), 1.0f);
+			pTri[1] = float4(x, y + h, Random(seed), 1.0f);
+			pTri[2] = float4(x + w, y, Random(seed), 1.0f);
+		}
+	}
+	return 0.5 * w * h * numTris;
+}
+
+static UINT64 RasterizeTrianglesScalar(float *pDepthBuffer, const float4 *pVertices, UINT numTris)
+{
+	UINT64 start = __rdtsc();
+	for(UINT i = 0; i < numTris; i++)
+	{
+		DepthBufferRasterizerScalar::RasterizeTriangle(pDepthBuffer, &pVertices[i * 3], 0, SCREENW - 1, 0, SCREENH - 1);
+	}
+	return __rdtsc() - start;
+}
+
+static UINT64 RasterizeTrianglesSSE(float *pDepthBuffer, const float4 *pVertices, UINT numTris)
+{
+	UINT64 start = __rdtsc();
+	__m128 gatherBuf[4][3];
+	for(UINT i = 0; i < numTris; i += SSE)
+	{
+		int numSimdTris = (int)min((UINT)SSE, numTris - i);
+		for(int lane = 0; lane < numSimdTris; lane++)
+		{
+			for(UINT vv = 0; vv < 3; vv++)
+			{
+				gatherBuf[lane][vv] = _mm_loadu_ps(&pVertices[(i + lane) * 3 + vv].x);
+			}
+		}
+		DepthBufferRasterizerSSE::RasterizeTriangles(pDepthBuffer, gatherBuf, numSimdTris, 0, SCREENW - 1, 0, SCREENH - 1);
+	}
+	return __rdtsc() - start;
+}
+
+//--------------------------------------------------------------------------------------
+// Screen space corners of boxes size pixels wide, their back face offset by a quarter of
+// that. The depth buffer is at 0.5, a visible box has its nearest corner in front of it
+//--------------------------------------------------------------------------------------
+static void CreateBoxes(float4 *pCorners, float size, float hitRate)
+{
+	UINT seed = 1;
+	float offset = size * 0.25f;
+	for(UINT i = 0; i < KERNEL_BENCHMARK_BOXES; i++)
+	{
+		float x = Random(seed) * ((float)SCREENW - 1.0f - size - offset);
+		float y = Random(seed) * ((float)SCREENH - 1.0f - size - offset);
+		float z = Random(seed) < hitRate ? 0.6f : 0.4f;
+		for(UINT c = 0; c < AABB_VERTICES; c++)
+		{
+			float back = (c & 4) ? offset : 0.0f;
+			pCorners[i * AABB_VERTICES + c] = float4(x + ((c & 1) ? size : 0.0f) + back,
+													  y + ((c & 2) ? size : 0.0f) + back,
+													  (c & 4) ? z - 0.05f : z,
+													  1.0f);
+		}
+	}
+}
+
+static UINT64 DepthTestBoxesScalar(float *pDepthBuffer, const float4 *pCorners, UINT &numVisible)
+{
+	TransformedAABBoxScalar box;
+	numVisible = 0;
+	UINT64 start = __rdtsc();
+	for(UINT i = 0; i < KERNEL_BENCHMARK_BOXES; i++)
+	{
+		numVisible += box.RasterizeAndDepthTestAABBox((UINT*)pDepthBuffer, &pCorners[i * AABB_VERTICES], 0) ? 1 : 0;
+	}
+	return __rdtsc() - start;
+}
+
+static UINT64 DepthTestBoxesSSE(float *pDepthBuffer, const float4 *pCorners, UINT &numVisible)
+{
+	TransformedAABBoxSSE box;
+	__m128 xformedPos[AABB_VERTICES];
+	numVisible = 0;
+	UINT64 start = __rdtsc();
+	for(UINT i = 0; i < KERNEL_BENCHMARK_BOXES; i++)
+	{
+		for(UINT c = 0; c < AABB_VERTICES; c++)
+		{
+			xformedPos[c] = _mm_loadu_ps(&pCorners[i * AABB_VERTICES + c].x);
+		}
+		numVisible += box.RasterizeAndDepthTestAABBox((UINT*)pDepthBuffer, xformedPos, 0) ? 1 : 0;
+	}
+	return __rdtsc() - start;
+}
+
+bool RunKernelBenchmark(const WCHAR *pFileName)
+{
+	FILE *pFile = NULL;
+	if(_wfopen_s(&pFile, pFileName, L"w") != 0)
+	{
+		return false;
+	}
+
+	// Flush denormals to zero like the rasterizer tasks do
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+
+	float *pDepthBuffer = (float*)_aligned_malloc(sizeof(float) * SCREENW * SCREENH, 16);
+	float4 *pVertices = new float4[KERNEL_BENCHMARK_MAX_TRIS * 3];
+	float4 *pCorners = new float4[KERNEL_BENCHMARK_BOXES * AABB_VERTICES];
+
+	fprintf(pFile, "kernel,backend,size,aspect,overdraw or hit rate,count,pixels,cycles per item,cycles per pixel\n");
+
+	for(UINT s = 0; s < KERNEL_BENCHMARK_CASES(sTriangleSizes); s++)
+	{
+		for(UINT a = 0; a < KERNEL_BENCHMARK_CASES(sTriangleAspects); a++)
+		{
+			for(UINT o = 0; o < KERNEL_BENCHMARK_CASES(sTriangleOverdraw); o++)
+			{
+				UINT numTris = 0;
+				double pixels = CreateTriangles(pVertices, numTris, sTriangleSizes[s], sTriangleAspects[a], sTriangleOverdraw[o]);
+				for(UINT backend = 0; backend < 2; backend++)
+				{
+					UINT64 best = ~0ULL;
+					for(UINT run = 0; run < KERNEL_BENCHMARK_RUNS; run++)
+					{
+						memset(pDepthBuffer, 0, sizeof(float) * SCREENW * SCREENH);
+						UINT64 cycles = backend == 0 ? RasterizeTrianglesScalar(pDepthBuffer, pVertices, numTris)
+													 : RasterizeTrianglesSSE(pDepthBuffer, pVertices, numTris);
+						best = min(best, cycles);
+					}
+					fprintf(pFile, "triangles,%s,%g,%g,%d,%d,%.0f,%.1f,%.3f\n", backend == 0 ? "Scalar" : "SSE",
+							sTriangleSizes[s], sTriangleAspects[a], sTriangleOverdraw[o], numTris, pixels,
+							(double)best / numTris, (double)best / pixels);
+				}
+			}
+		}
+	}
+
+	for(UINT i = 0; i < SCREENW * SCREENH; i++)
+	{
+		pDepthBuffer[i] = 0.5f;
+	}
+	for(UINT s = 0; s < KERNEL_BENCHMARK_CASES(sBoxSizes); s++)
+	{
+		for(UINT h = 0; h < KERNEL_BENCHMARK_CASES(sBoxHitRates); h++)
+		{
+			CreateBoxes(pCorners, sBoxSizes[s], sBoxHitRates[h]);
+			for(UINT backend = 0; backend < 2; backend++)
+			{
+				UINT64 best = ~0ULL;
+				UINT numVisible = 0;
+				for(UINT run = 0; run < KERNEL_BENCHMARK_RUNS; run++)
+				{
+					UINT64 cycles = backend == 0 ? DepthTestBoxesScalar(pDepthBuffer, pCorners, numVisible)
+												 : DepthTestBoxesSSE(pDepthBuffer, pCorners, numVisible);
+					best = min(best, cycles);
+				}
+				fprintf(pFile, "boxes,%s,%g,-,%.3f,%d,-,%.1f,-\n", backend == 0 ? "Scalar" : "SSE",
+						sBoxSizes[s], (float)numVisible / KERNEL_BENCHMARK_BOXES, KERNEL_BENCHMARK_BOXES,
+						(double)best / KERNEL_BENCHMARK_BOXES);
+			}
+		}
+	}
+
+	delete [] pCorners;
+	delete [] pVertices;
+	_aligned_free(pDepthBuffer);
+	fclose(pFile);
+	return true;
+}
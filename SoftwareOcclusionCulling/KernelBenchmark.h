@@ -0,0 +1,32 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef KERNELBENCHMARK_H
+#define KERNELBENCHMARK_H
+
+#include "Platform.h"
+
+//--------------------------------------------------------------------------------------
+// Times the occluder triangle rasterizer and the occludee box test of the scalar and
+// SSE rasterizers in isolation, on synthetic screen space inputs: triangle sizes, aspect
+// ratios and overdraw, occludee screen sizes and the share of boxes that are visible
+// (and so exit the test early). Writes one CSV row per kernel, backend and case with the
+// cycles per triangle, pixel or box. Needs neither the scene nor a D3D device.
+//--------------------------------------------------------------------------------------
+bool RunKernelBenchmark(const WCHAR *pFileName);
+
+#endif // KERNELBENCHMARK_H
@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+//--------------------------------------------------------------------------------------
+// The operating system calls of the culling and of the device free modes (benchmarks,
+// culling trace replay). Windows builds make the Win32 calls. Other builds, e.g. the
+// benchmarks on a GPU-less Linux box, get the same calls on top of POSIX so that their
+// callers stay as they are. The Windows scalar types (UINT, WCHAR, LARGE_INTEGER, ...)
+// come from wtypes.h, see TaskMgrTBB.h.
+//--------------------------------------------------------------------------------------
+#if defined(_WIN32)
+
+#include <windows.h>
+#include <psapi.h>
+
+// Bytes of memory private to the process
+inline size_t GetProcessPrivateBytes()
+{
+	PROCESS_MEMORY_COUNTERS_EX counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters)))
+	{
+		return 0;
+	}
+	return counters.PrivateUsage;
+}
+
+inline UINT GetLogicalProcessorCount()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+// Read only view of a whole file, NULL if it cannot be opened or is empty. The view keeps
+// the file open until it is unmapped
+inline const void *MapFile(const WCHAR *pFileName, size_t *pSize)
+{
+	HANDLE file = CreateFileW(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if(GetFileSizeEx(file, &size) && size.QuadPart > 0 && (UINT64)size.QuadPart <= (size_t)-1)
+	{
+		mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	const void *pView = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if(mapping)
+	{
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	*pSize = pView ? (size_t)size.QuadPart : 0;
+	return pView;
+}
+
+inline void UnmapFile(const void *pView, size_t size)
+{
+	UNREFERENCED_PARAMETER(size);
+	UnmapViewOfFile(pView);
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif
+
+// Nanoseconds of the monotonic clock
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER *pCount)
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pCount->QuadPart = (LONGLONG)now.tv_sec * 1000000000 + now.tv_nsec;
+	return TRUE;
+}
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER *pFrequency)
+{
+	pFrequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+#ifndef _TRUNCATE
+#define _TRUNCATE ((size_t)-1)
+#endif
+
+inline int _wcsicmp(const wchar_t *pString1, const wchar_t *pString2)
+{
+	return wcscasecmp(pString1, pString2);
+}
+
+inline double _wtof(const wchar_t *pString)
+{
+	return wcstod(pString, NULL);
+}
+
+// Only the truncating copy of the command line parsing, count has to be _TRUNCATE
+inline int wcsncpy_s(wchar_t *pDest, size_t destSize, const wchar_t *pSource, size_t count)
+{
+	if(count != _TRUNCATE || destSize == 0)
+	{
+		return EINVAL;
+	}
+	wcsncpy(pDest, pSource, destSize - 1);
+	pDest[destSize - 1] = 0;
+	return 0;
+}
+
+// The file name and mode are converted to the multibyte encoding of the locale
+inline int _wfopen_s(FILE **ppFile, const wchar_t *pFileName, const wchar_t *pMode)
+{
+	char fileName[4 * MAX_PATH];
+	char mode[16];
+	*ppFile = NULL;
+	if(wcstombs(fileName, pFileName, sizeof(fileName)) >= sizeof(fileName) ||
+	   wcstombs(mode, pMode, sizeof(mode)) >= sizeof(mode))
+	{
+		return EINVAL;
+	}
+	*ppFile = fopen(fileName, mode);
+	return *ppFile ? 0 : errno;
+}
+
+// Resident pages that are not shared with other processes
+inline size_t GetProcessPrivateBytes()
+{
+	FILE *pFile = fopen("/proc/self/statm", "r");
+	if(!pFile)
+	{
+		return 0;
+	}
+	unsigned long size = 0, resident = 0, shared = 0;
+	int numRead = fscanf(pFile, "%lu %lu %lu", &size, &resident, &shared);
+	fclose(pFile);
+	if(numRead != 3 || resident < shared)
+	{
+		return 0;
+	}
+	return (size_t)(resident - shared) * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+inline UINT GetLogicalProcessorCount()
+{
+	long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+	return numProcessors > 0 ? (UINT)numProcessors : 1;
+}
+
+inline const void *MapFile(const wchar_t *pFileName, size_t *pSize)
+{
+	char fileName[4 * MAX_PATH];
+	*pSize = 0;
+	if(wcstombs(fileName, pFileName, sizeof(fileName)) >= sizeof(fileName))
+	{
+		return NULL;
+	}
+	int file = open(fileName, O_RDONLY);
+	if(file < 0)
+	{
+		return NULL;
+	}
+	struct stat status;
+	void *pView = NULL;
+	if(fstat(file, &status) == 0 && status.st_size > 0)
+	{
+		pView = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		pView = pView == MAP_FAILED ? NULL : pView;
+	}
+	close(file);
+	*pSize = pView ? (size_t)status.st_size : 0;
+	return pView;
+}
+
+inline void UnmapFile(const void *pView, size_t size)
+{
+	munmap((void*)pView, size);
+}
+
+#endif
+
+#endif // PLATFORM_H
@@ -0,0 +1,215 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#include "ReferenceRasterizer.h"
+
+// A triangle clipped by two planes has at most 5 vertices
+static const UINT MAX_CLIPPED_VERTICES = 5;
+
+ReferenceRasterizer::ReferenceRasterizer()
+	: mpClipPos(NULL),
+	  mClipPosSize(0)
+{
+	mpDepth = new float[SCREENW * SCREENH];
+	Reset(float4x4Identity());
+}
+
+ReferenceRasterizer::~ReferenceRasterizer()
+{
+	SAFE_DELETE_ARRAY(mpDepth);
+	SAFE_DELETE_ARRAY(mpClipPos);
+}
+
+void ReferenceRasterizer::Reset(const float4x4 &viewProj)
+{
+	mViewProj = viewProj;
+	memset(mpDepth, 0, SCREENW * SCREENH * sizeof(float));
+}
+
+void ReferenceRasterizer::AddMesh(const Vertex *pVertices, UINT numVertices, const UINT *pIndices, UINT numTriangles)
+{
+	DrawMesh(pVertices, numVertices, pIndices, numTriangles, false);
+}
+
+bool ReferenceRasterizer::IsMeshVisible(const Vertex *pVertices, UINT numVertices, const UINT *pIndices, UINT numTriangles)
+{
+	return DrawMesh(pVertices, numVertices, pIndices, numTriangles, true);
+}
+
+bool ReferenceRasterizer::IsOutsideFrustum(const Vertex *pVertices, UINT numVertices) const
+{
+	// One bit per plane: -x, +x, -y, +y, near, far, set while all vertices are outside it
+	UINT outside = 0x3F;
+	for(UINT i = 0; i < numVertices && outside; i++)
+	{
+		float4 clip = pVertices[i].pos * mViewProj;
+		UINT code = (clip.x < -clip.w ? 0x01 : 0) | (clip.x > clip.w ? 0x02 : 0) |
+					(clip.y < -clip.w ? 0x04 : 0) | (clip.y > clip.w ? 0x08 : 0) |
+					(clip.z < 0.0f ? 0x10 : 0) | (clip.z > clip.w ? 0x20 : 0);
+		outside &= code;
+	}
+	return outside != 0;
+}
+
+bool ReferenceRasterizer::DrawMesh(const Vertex *pVertices, UINT numVertices, const UINT *pIndices, UINT numTriangles, bool test)
+{
+	if(IsOutsideFrustum(pVertices, numVertices))
+	{
+		return false;
+	}
+
+	if(numVertices > mClipPosSize)
+	{
+		SAFE_DELETE_ARRAY(mpClipPos);
+		mpClipPos = new float4[numVertices];
+		mClipPosSize = numVertices;
+	}
+	for(UINT i = 0; i < numVertices; i++)
+	{
+		mpClipPos[i] = pVertices[i].pos * mViewProj;
+	}
+
+	bool visible = false;
+	for(UINT i = 0; i < numTriangles; i++)
+	{
+		const UINT *pTri = &pIndices[i * 3];
+		visible |= DrawTriangle(mpClipPos[pTri[0]], mpClipPos[pTri[1]], mpClipPos[pTri[2]], test);
+		if(test && visible)
+		{
+			return true;
+		}
+	}
+	return visible;
+}
+
+//--------------------------------------------------------------------------------------
+// Clip the triangle to 0 <= z <= w, which keeps w positive, then project the remaining
+// polygon and rasterize it as a fan. The x and y planes are left to the pixel loops
+//--------------------------------------------------------------------------------------
+bool ReferenceRasterizer::DrawTriangle(const float4 &v0, const float4 &v1, const float4 &v2, bool test)
+{
+	float4 polygon[2][MAX_CLIPPED_VERTICES];
+	UINT count = 3;
+	polygon[0][0] = v0;
+	polygon[0][1] = v1;
+	polygon[0][2] = v2;
+
+	UINT in = 0;
+	for(UINT plane = 0; plane < 2; plane++)
+	{
+		UINT out = 0;
+		for(UINT i = 0; i < count; i++)
+		{
+			const float4 &a = polygon[in][i];
+			const float4 &b = polygon[in][(i + 1) % count];
+			// Signed distance to z = 0 and to z = w, inside if not negative
+			float da = plane == 0 ? a.z : a.w - a.z;
+			float db = plane == 0 ? b.z : b.w - b.z;
+
+			if(da >= 0.0f)
+			{
+				polygon[1 - in][out++] = a;
+			}
+			if((da >= 0.0f) != (db >= 0.0f))
+			{
+				float t = da / (da - db);
+				polygon[1 - in][out++] = a + (b - a) * t;
+			}
+		}
+		in = 1 - in;
+		count = out;
+		if(count < 3)
+		{
+			return false;
+		}
+	}
+
+	ScreenVertex screen[MAX_CLIPPED_VERTICES];
+	for(UINT i = 0; i < count; i++)
+	{
+		const float4 &v = polygon[in][i];
+		float invW = 1.0f / v.w;
+		screen[i].x = (v.x * invW * 0.5f + 0.5f) * (float)SCREENW;
+		screen[i].y = (-v.y * invW * 0.5f + 0.5f) * (float)SCREENH;
+		screen[i].invW = invW;
+	}
+
+	bool visible = false;
+	for(UINT i = 1; i + 1 < count; i++)
+	{
+		visible |= RasterizeTriangle(screen[0], screen[i], screen[i + 1], test);
+		if(test && visible)
+		{
+			return true;
+		}
+	}
+	return visible;
+}
+
+//--------------------------------------------------------------------------------------
+// Pixel centers on an edge belong to both triangles sharing it, drawing a pixel twice
+// does not change the depth buffer
+//--------------------------------------------------------------------------------------
+bool ReferenceRasterizer::RasterizeTriangle(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2, bool test)
+{
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if(area == 0.0f)
+	{
+		return false;
+	}
+	float invArea = 1.0f / area;
+
+	int startX = max((int)floorf(min(min(v0.x, v1.x), v2.x)), 0);
+	int endX = min((int)ceilf(max(max(v0.x, v1.x), v2.x)), SCREENW - 1);
+	int startY = max((int)floorf(min(min(v0.y, v1.y), v2.y)), 0);
+	int endY = min((int)ceilf(max(max(v0.y, v1.y), v2.y)), SCREENH - 1);
+
+	bool visible = false;
+	for(int y = startY; y <= endY; y++)
+	{
+		float py = (float)y + 0.5f;
+		for(int x = startX; x <= endX; x++)
+		{
+			float px = (float)x + 0.5f;
+
+			// Barycentric coordinates, all of them positive inside whatever the winding
+			float b0 = ((v1.x - px) * (v2.y - py) - (v1.y - py) * (v2.x - px)) * invArea;
+			float b1 = ((v2.x - px) * (v0.y - py) - (v2.y - py) * (v0.x - px)) * invArea;
+			float b2 = ((v0.x - px) * (v1.y - py) - (v0.y - py) * (v1.x - px)) * invArea;
+			if(b0 < 0.0f || b1 < 0.0f || b2 < 0.0f)
+			{
+				continue;
+			}
+
+			float depth = b0 * v0.invW + b1 * v1.invW + b2 * v2.invW;
+			float &bufferDepth = mpDepth[y * SCREENW + x];
+			if(test)
+			{
+				if(depth >= bufferDepth)
+				{
+					return true;
+				}
+			}
+			else if(depth > bufferDepth)
+			{
+				bufferDepth = depth;
+				visible = true;
+			}
+		}
+	}
+	return visible;
+}
@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef REFERENCERASTERIZER_H
+#define REFERENCERASTERIZER_H
+
+#include "CPUT_DX11.h"
+#include "Constants.h"
+
+//--------------------------------------------------------------------------------------
+// Exact, slow CPU rasterizer to measure the culling against. Meshes are clipped to the
+// near and far planes and rasterized at every pixel center of a SCREENW x SCREENH depth
+// buffer, both faces of every triangle, interpolating 1/w so that nearer is larger for
+// any projection. A mesh is visible if one of its pixels is at least as near as the depth
+// of the whole scene; the same code computes the depth it wrote, so a mesh that won a
+// pixel passes there.
+//--------------------------------------------------------------------------------------
+class ReferenceRasterizer
+{
+	public:
+		ReferenceRasterizer();
+		~ReferenceRasterizer();
+
+		// Start over with an empty depth buffer for the given view projection matrix
+		void Reset(const float4x4 &viewProj);
+		// Rasterize numTriangles indexed triangles into the depth buffer
+		void AddMesh(const Vertex *pVertices, UINT numVertices, const UINT *pIndices, UINT numTriangles);
+		bool IsMeshVisible(const Vertex *pVertices, UINT numVertices, const UINT *pIndices, UINT numTriangles);
+		// Whether all the vertices are outside one of the frustum planes
+		bool IsOutsideFrustum(const Vertex *pVertices, UINT numVertices) const;
+
+	private:
+		struct ScreenVertex
+		{
+			float x, y;
+			float invW;
+		};
+
+		float4x4 mViewProj;
+		float *mpDepth;			// 1/w, 0 where nothing was drawn
+		float4 *mpClipPos;		// clip space vertices of the current mesh
+		UINT mClipPosSize;
+
+		// Rasterize the mesh, with test set stop at its first visible pixel instead
+		bool DrawMesh(const Vertex *pVertices, UINT numVertices, const UINT *pIndices, UINT numTriangles, bool test);
+		bool DrawTriangle(const float4 &v0, const float4 &v1, const float4 &v2, bool test);
+		bool RasterizeTriangle(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2, bool test);
+};
+
+#endif // REFERENCERASTERIZER_H
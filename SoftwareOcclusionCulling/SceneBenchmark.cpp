@@ -0,0 +1,822 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#include "SceneBenchmark.h"
+#include "SceneGenerator.h"
+#include "CullingTrace.h"
+#include "DepthBufferRasterizerScalarST.h"
+#include "DepthBufferRasterizerScalarMT.h"
+#include "DepthBufferRasterizerSSEST.h"
+#include "DepthBufferRasterizerSSEMT.h"
+#include "AABBoxRasterizerScalarST.h"
+#include "AABBoxRasterizerScalarMT.h"
+#include "AABBoxRasterizerSSEST.h"
+#include "AABBoxRasterizerSSEMT.h"
+#include "ReferenceRasterizer.h"
+#include <stdio.h>
+
+static const UINT sSceneOccludees[] = {100000, 250000, 500000, 1000000};
+
+// Frames culled before and while the times are taken, half of them at street level
+static const UINT SCENE_BENCHMARK_WARMUP_FRAMES = 4;
+static const UINT SCENE_BENCHMARK_FRAMES = 64;
+static const float SCENE_BENCHMARK_FAR_CLIP = 2000.0f;
+
+#define SCENE_BENCHMARK_CASES(cases) (sizeof(cases) / sizeof(cases[0]))
+
+// Most taskset names reported by the thread scaling study
+static const UINT THREAD_SCALING_MAX_STAGES = 64;
+
+// The culling quality sweep scales the command line's occluder and occludee size thresholds
+static const float sQualityThresholdScales[] = {0.0f, 0.5f, 1.0f, 2.0f, 4.0f};
+
+// Ground truth of an occludee in a frame
+enum OCCLUDEE_TRUTH
+{
+	OCCLUDEE_OUTSIDE_FRUSTUM,
+	OCCLUDEE_HIDDEN,
+	OCCLUDEE_VISIBLE,
+};
+
+static double GetPrivateMegaBytes()
+{
+	return (double)GetProcessPrivateBytes() / (1024.0 * 1024.0);
+}
+
+static double GetSeconds(const LARGE_INTEGER &start)
+{
+	LARGE_INTEGER stop;
+	QueryPerformanceCounter(&stop);
+	return (double)(stop.QuadPart - start.QuadPart) / (double)glFrequency.QuadPart;
+}
+
+//--------------------------------------------------------------------------------------
+// The first half of the numFrames frames drive down the street in the middle of the city,
+// from its center to the edge, looking along it and swaying 30 degrees to the sides. The
+// second half fly the same way 20 units above the highest roofs, looking down the street.
+// The camera is turned by turn radians to the side, for the extra views of a frame
+//--------------------------------------------------------------------------------------
+static void SetBenchmarkCamera(CPUTCamera &camera, const SyntheticScene &scene, UINT frame, UINT numFrames, float turn = 0.0f)
+{
+	const SceneGeneratorParams &params = scene.GetParams();
+	float pitch = scene.GetBlockPitch();
+	float origin = -0.5f * pitch * (float)scene.GetBlocksPerSide();
+	float z = origin + pitch * (float)(scene.GetBlocksPerSide() / 2) - 0.5f * params.streetWidth;
+
+	UINT half = max(numFrames / 2, 1u);
+	bool street = frame < half;
+	float t = (float)(frame % half) / (float)half;
+	float x = -origin * t;
+	float y = street ? 2.0f : params.maxHeight + 20.0f;
+	float yaw = (PI / 6.0f) * sinf(2.0f * PI * t * 4.0f) + turn;
+
+	camera.SetPosition(x, y, z);
+	camera.LookAt(x + 10.0f * cosf(yaw), street ? y : y - 4.0f, z + 10.0f * sinf(yaw));
+	camera.Update();
+}
+
+// The settings of the command line, culling into the given depth buffer as view 0
+static void SetRasterizerOptions(DepthBufferRasterizer *pDBR, AABBoxRasterizer *pAABB, UINT *pDepthBuffer)
+{
+	pDBR->SetOccluderSizeThreshold(gOccluderSizeThreshold);
+	pDBR->SetOccluderWaves(gOccluderWaves);
+	pDBR->SetEnableFCulling(true);
+	pAABB->SetDepthTestTasks(gDepthTestTasks);
+	pAABB->SetTileBinnedDepthTest(gTileBinnedDepthTest);
+	pAABB->SetOccludeeSizeThreshold(gOccludeeSizeThreshold);
+	pAABB->SetOccludeeProxies(gOccludeeProxies);
+	pAABB->SetTemporalCache(gTemporalCache);
+	pAABB->SetEnableFCulling(true);
+	pDBR->SetCPURenderTargetPixels(pDepthBuffer, 0);
+	pAABB->SetCPURenderTargetPixels(pDepthBuffer, 0);
+}
+
+// Culling times and results of the measured frames of the scene benchmark
+struct SceneBenchmarkTotals
+{
+	double rasterizeTime, depthTestTime, worstTime;
+	double numOccludersR2DB, numRasterizedTris, numCulled;
+};
+
+//--------------------------------------------------------------------------------------
+// Waits for the numViews views of the frame slot starting at view slot idx and releases
+// their task sets, like the sample's FinishViews. The frame's times are those of its
+// slowest view, its results those of the main view
+//--------------------------------------------------------------------------------------
+static void FinishBenchmarkFrame(DepthBufferRasterizer *pDBR, AABBoxRasterizer *pAABB, UINT numViews, UINT idx, SceneBenchmarkTotals *pTotals)
+{
+	double rasterizeTime = 0.0, depthTestTime = 0.0;
+	for(UINT view = idx; view < idx + numViews; view++)
+	{
+		pAABB->WaitForTaskToFinish(view);
+		pAABB->ReleaseTaskHandles(view);
+		pDBR->ComputeR2DBTime(view);
+		rasterizeTime = max(rasterizeTime, pDBR->GetLastRasterizeTime());
+		depthTestTime = max(depthTestTime, pAABB->GetLastDepthTestTime());
+	}
+	pAABB->UpdateOccludeeProxies(idx);
+	pAABB->UpdateVisibilityHistory(idx);
+
+	if(pTotals)
+	{
+		pTotals->rasterizeTime += rasterizeTime;
+		pTotals->depthTestTime += depthTestTime;
+		pTotals->worstTime = max(pTotals->worstTime, rasterizeTime + depthTestTime);
+
+		CullingStats stats;
+		pDBR->GetFrameStats(idx, &stats);
+		pAABB->GetFrameStats(idx, &stats);
+		pTotals->numOccludersR2DB += stats.mNumOccludersR2DB;
+		pTotals->numRasterizedTris += stats.mNumRasterizedTris;
+		pTotals->numCulled += stats.mNumCulled;
+	}
+}
+
+bool RunSceneBenchmark(const WCHAR *pFileName, UINT numOccludees, UINT numViews)
+{
+	FILE *pFile = NULL;
+	if(_wfopen_s(&pFile, pFileName, L"w") != 0)
+	{
+		return false;
+	}
+
+	QueryPerformanceFrequency(&glFrequency);
+
+	// Every view of every frame in flight culls into its own slot and depth buffer
+	numViews = min(max(numViews, (UINT)1), (UINT)MAX_VIEWS);
+	UINT numFrameSlots = min(max(gFrameSlots, (UINT)1), (UINT)MAX_FRAME_SLOTS);
+	UINT numSlots = numFrameSlots * numViews;
+	UINT *pDepthBuffer = (UINT*)_aligned_malloc(sizeof(float) * SCREENW * SCREENH * numSlots, 16);
+
+	CPUTCamera *pCameras = new CPUTCamera[numSlots];
+	for(UINT i = 0; i < numSlots; i++)
+	{
+		pCameras[i].SetFov(PI / 3.0f);
+		pCameras[i].SetAspectRatio((float)SCREENW / (float)SCREENH);
+		pCameras[i].SetFarPlaneDistance(SCENE_BENCHMARK_FAR_CLIP);
+	}
+
+	fprintf(pFile, "occludees,occluders,occluder tris,blocks,views,frame slots,generate ms,create ms,scene MB,rasterizer MB,"
+				   "rasterize ms,depth test ms,total ms,worst total ms,occluders R2DB,rasterized tris,culled,visible\n");
+
+	UINT numCases = numOccludees != 0 ? 1 : SCENE_BENCHMARK_CASES(sSceneOccludees);
+	for(UINT c = 0; c < numCases; c++)
+	{
+		SceneGeneratorParams params;
+		params.numOccludees = numOccludees != 0 ? numOccludees : sSceneOccludees[c];
+
+		double startMB = GetPrivateMegaBytes();
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		SyntheticScene *pScene = new SyntheticScene;
+		pScene->Generate(params);
+		double generateTime = GetSeconds(start);
+		double sceneMB = GetPrivateMegaBytes() - startMB;
+
+		QueryPerformanceCounter(&start);
+		DepthBufferRasterizerSSEMT *pDBRSSEMT = new DepthBufferRasterizerSSEMT;
+		AABBoxRasterizerSSEMT *pAABBSSEMT = new AABBoxRasterizerSSEMT;
+		pDBRSSEMT->CreateTransformedModels(*pScene);
+		pAABBSSEMT->CreateTransformedAABBoxes(*pScene);
+		double createTime = GetSeconds(start);
+
+		// Cull through the interfaces like the sample does
+		DepthBufferRasterizer *pDBR = pDBRSSEMT;
+		AABBoxRasterizer *pAABB = pAABBSSEMT;
+
+		SetRasterizerOptions(pDBR, pAABB, pDepthBuffer);
+		for(UINT i = 1; i < numSlots; i++)
+		{
+			pDBR->SetCPURenderTargetPixels(pDepthBuffer + i * SCREENW * SCREENH, i);
+			pAABB->SetCPURenderTargetPixels(pDepthBuffer + i * SCREENW * SCREENH, i);
+		}
+
+		// The frames are pipelined like the sample's: once all the frame slots are in
+		// flight the oldest one is finished before its slot is culled into again
+		SceneBenchmarkTotals totals = {};
+		UINT numFrames = SCENE_BENCHMARK_WARMUP_FRAMES + SCENE_BENCHMARK_FRAMES;
+		UINT numFramesInFlight = 0;
+		for(UINT frame = 0; frame < numFrames; frame++)
+		{
+			UINT idx = (frame % numFrameSlots) * numViews;
+			CPUTCamera *pViewCamera[MAX_VIEWS];
+			for(UINT view = 0; view < numViews; view++)
+			{
+				CPUTCamera &camera = pCameras[idx + view];
+				SetBenchmarkCamera(camera, *pScene, frame < SCENE_BENCHMARK_WARMUP_FRAMES ? 0 : frame - SCENE_BENCHMARK_WARMUP_FRAMES,
+								   SCENE_BENCHMARK_FRAMES, 2.0f * PI * (float)view / (float)numViews);
+				pDBR->SetViewProj(camera.GetViewMatrix(), (float4x4*)camera.GetProjectionMatrix(), idx + view);
+				pAABB->SetViewProjMatrix(camera.GetViewMatrix(), (float4x4*)camera.GetProjectionMatrix(), idx + view);
+				pViewCamera[view] = &camera;
+			}
+
+			pDBR->TransformModelsAndRasterizeToDepthBuffer(pViewCamera, numViews, idx);
+			pAABB->TransformAABBoxAndDepthTest(pViewCamera, numViews, idx);
+
+			if(++numFramesInFlight == numFrameSlots)
+			{
+				UINT oldest = frame + 1 - numFrameSlots;
+				FinishBenchmarkFrame(pDBR, pAABB, numViews, (oldest % numFrameSlots) * numViews,
+									 oldest >= SCENE_BENCHMARK_WARMUP_FRAMES ? &totals : NULL);
+				numFramesInFlight--;
+			}
+		}
+		for(UINT oldest = numFrames - numFramesInFlight; oldest < numFrames; oldest++)
+		{
+			FinishBenchmarkFrame(pDBR, pAABB, numViews, (oldest % numFrameSlots) * numViews, &totals);
+		}
+		double rasterizerMB = GetPrivateMegaBytes() - startMB - sceneMB;
+
+		double frames = (double)SCENE_BENCHMARK_FRAMES;
+		fprintf(pFile, "%d,%d,%d,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.3f,%.3f,%.3f,%.3f,%.0f,%.0f,%.0f,%.0f\n",
+				pScene->GetNumOccludees(), pScene->GetNumOccluders(), pDBR->GetNumTriangles(),
+				pScene->GetBlocksPerSide() * pScene->GetBlocksPerSide(), numViews, numFrameSlots,
+				generateTime * 1000.0, createTime * 1000.0, sceneMB, rasterizerMB,
+				totals.rasterizeTime * 1000.0 / frames, totals.depthTestTime * 1000.0 / frames,
+				(totals.rasterizeTime + totals.depthTestTime) * 1000.0 / frames, totals.worstTime * 1000.0,
+				totals.numOccludersR2DB / frames, totals.numRasterizedTris / frames,
+				totals.numCulled / frames, pScene->GetNumOccludees() - totals.numCulled / frames);
+		fflush(pFile);
+
+		delete pAABB;
+		delete pDBR;
+		delete pScene;
+	}
+
+	delete [] pCameras;
+	_aligned_free(pDepthBuffer);
+	fclose(pFile);
+	return true;
+}
+
+// Rasterizers of the backend picked on the command line
+static void CreateRasterizers(bool multiThreaded, DepthBufferRasterizer **ppDBR, AABBoxRasterizer **ppAABB)
+{
+	if(gSOCType == SCALAR_TYPE && multiThreaded)
+	{
+		*ppDBR = new DepthBufferRasterizerScalarMT;
+		*ppAABB = new AABBoxRasterizerScalarMT;
+	}
+	else if(gSOCType == SCALAR_TYPE)
+	{
+		*ppDBR = new DepthBufferRasterizerScalarST;
+		*ppAABB = new AABBoxRasterizerScalarST;
+	}
+	else if(multiThreaded)
+	{
+		*ppDBR = new DepthBufferRasterizerSSEMT;
+		*ppAABB = new AABBoxRasterizerSSEMT;
+	}
+	else
+	{
+		*ppDBR = new DepthBufferRasterizerSSEST;
+		*ppAABB = new AABBoxRasterizerSSEST;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Random view over the scene bounds, 2 to 10 units above the ground and looking level in
+// a random direction. The same seed gives the same views on every run
+//--------------------------------------------------------------------------------------
+static void SetRandomCamera(CPUTCamera &camera, const float3 &center, const float3 &half, UINT &random)
+{
+	float r[4];
+	for(UINT i = 0; i < 4; i++)
+	{
+		random = random * 1664525 + 1013904223;
+		r[i] = (float)(random >> 8) / (float)(1 << 24);
+	}
+	float yaw = 2.0f * PI * r[3];
+	float3 position(center.x + half.x * (2.0f * r[0] - 1.0f),
+					center.y - half.y + 2.0f + 8.0f * r[1],
+					center.z + half.z * (2.0f * r[2] - 1.0f));
+
+	camera.SetPosition(position.x, position.y, position.z);
+	camera.LookAt(position.x + 10.0f * cosf(yaw), position.y, position.z + 10.0f * sinf(yaw));
+	camera.Update();
+}
+
+//--------------------------------------------------------------------------------------
+// Waits for the frame culled in slot idx like FinishBenchmarkFrame and writes its CSV row.
+// A replayed frame's visibility is compared with the trace's
+//--------------------------------------------------------------------------------------
+static void WriteBenchmarkFrame(FILE *pFile, DepthBufferRasterizer *pDBR, AABBoxRasterizer *pAABB, CPUTCamera &camera,
+								UINT frame, UINT idx, UINT numOccludeeTris, CullingTrace *pTrace)
+{
+	FinishBenchmarkFrame(pDBR, pAABB, 1, idx, NULL);
+	if(pTrace)
+	{
+		pTrace->SetVisibility(frame, pAABB, idx);
+	}
+
+	CullingStats stats;
+	pDBR->GetFrameStats(idx, &stats);
+	pAABB->GetFrameStats(idx, &stats);
+	double rasterizeTime = pDBR->GetLastRasterizeTime();
+	double depthTestTime = pAABB->GetLastDepthTestTime();
+	float3 position = camera.GetPosition();
+	fprintf(pFile, "%d,%f,%f,%f,%f,%f,%f,%d,%d,%d,%d,%d,%d,%d,%f,%d,%d,%f\n", frame,
+			position.x, position.y, position.z,
+			rasterizeTime * 1000.0, depthTestTime * 1000.0, (rasterizeTime + depthTestTime) * 1000.0,
+			stats.mNumOccludersR2DB, stats.mNumRasterizedTris, stats.mNumCulled, pAABB->GetNumOccludees() - stats.mNumCulled,
+			stats.mNumCulledTris, numOccludeeTris - stats.mNumCulledTris,
+			stats.GetMaxTrisInTile(), stats.GetLaneOccupancy(),
+			stats.mNumBoxTests, stats.mNumEarlyOuts, stats.GetRowsSkipped());
+}
+
+//--------------------------------------------------------------------------------------
+// Culls frame i of the scene from pCameras[i] with the backend of the command line and
+// writes a CSV row per frame. The multi threaded rasterizers pipeline the frames over the
+// frame slots like the sample does, the single threaded ones finish every frame at once
+//--------------------------------------------------------------------------------------
+static void CullBenchmarkFrames(FILE *pFile, const CullingScene &scene, CPUTCamera *pCameras, UINT numFrames, bool multiThreaded, CullingTrace *pTrace)
+{
+	DepthBufferRasterizer *pDBR = NULL;
+	AABBoxRasterizer *pAABB = NULL;
+	CreateRasterizers(multiThreaded, &pDBR, &pAABB);
+	pDBR->CreateTransformedModels(scene);
+	pAABB->CreateTransformedAABBoxes(scene);
+	UINT numOccludeeTris = pAABB->GetNumTriangles();
+
+	UINT numFrameSlots = multiThreaded ? min(max(gFrameSlots, (UINT)1), (UINT)MAX_FRAME_SLOTS) : 1;
+	UINT *pDepthBuffer = (UINT*)_aligned_malloc(sizeof(float) * SCREENW * SCREENH * numFrameSlots, 16);
+	SetRasterizerOptions(pDBR, pAABB, pDepthBuffer);
+	for(UINT i = 1; i < numFrameSlots; i++)
+	{
+		pDBR->SetCPURenderTargetPixels(pDepthBuffer + i * SCREENW * SCREENH, i);
+		pAABB->SetCPURenderTargetPixels(pDepthBuffer + i * SCREENW * SCREENH, i);
+	}
+
+	fprintf(pFile, "frame,x,y,z,rasterize ms,depth test ms,total cull ms,"
+				   "occluders rasterized,rasterized tris,culled,visible,culled tris,visible tris,"
+				   "max tile tris,simd lane occupancy,box tests,box early outs,box rows skipped\n");
+
+	UINT numFramesInFlight = 0;
+	for(UINT frame = 0; frame < numFrames; frame++)
+	{
+		UINT idx = frame % numFrameSlots;
+		CPUTCamera *pCamera = &pCameras[frame];
+		pDBR->SetViewProj(pCamera->GetViewMatrix(), (float4x4*)pCamera->GetProjectionMatrix(), idx);
+		pAABB->SetViewProjMatrix(pCamera->GetViewMatrix(), (float4x4*)pCamera->GetProjectionMatrix(), idx);
+		pDBR->TransformModelsAndRasterizeToDepthBuffer(&pCamera, 1, idx);
+		pAABB->TransformAABBoxAndDepthTest(&pCamera, 1, idx);
+
+		if(++numFramesInFlight == numFrameSlots)
+		{
+			UINT oldest = frame + 1 - numFrameSlots;
+			WriteBenchmarkFrame(pFile, pDBR, pAABB, pCameras[oldest], oldest, oldest % numFrameSlots, numOccludeeTris, pTrace);
+			numFramesInFlight--;
+		}
+	}
+	for(UINT oldest = numFrames - numFramesInFlight; oldest < numFrames; oldest++)
+	{
+		WriteBenchmarkFrame(pFile, pDBR, pAABB, pCameras[oldest], oldest, oldest % numFrameSlots, numOccludeeTris, pTrace);
+	}
+
+	delete pAABB;
+	delete pDBR;
+	_aligned_free(pDepthBuffer);
+}
+
+bool RunFrameBenchmark(const WCHAR *pFileName, UINT numOccludees, UINT numFrames, UINT seed, bool multiThreaded)
+{
+	FILE *pFile = NULL;
+	if(_wfopen_s(&pFile, pFileName, L"w") != 0)
+	{
+		return false;
+	}
+
+	QueryPerformanceFrequency(&glFrequency);
+
+	SceneGeneratorParams params;
+	if(numOccludees != 0)
+	{
+		params.numOccludees = numOccludees;
+	}
+	SyntheticScene *pScene = new SyntheticScene;
+	pScene->Generate(params);
+
+	float3 center, half;
+	pScene->GetBounds(&center, &half);
+	UINT random = seed;
+
+	CPUTCamera *pCameras = new CPUTCamera[numFrames];
+	for(UINT frame = 0; frame < numFrames; frame++)
+	{
+		CPUTCamera &camera = pCameras[frame];
+		camera.SetFov(PI / 3.0f);
+		camera.SetAspectRatio((float)SCREENW / (float)SCREENH);
+		camera.SetFarPlaneDistance(SCENE_BENCHMARK_FAR_CLIP);
+		if(seed == 0)
+		{
+			SetBenchmarkCamera(camera, *pScene, frame, numFrames);
+		}
+		else
+		{
+			SetRandomCamera(camera, center, half, random);
+		}
+	}
+
+	CullBenchmarkFrames(pFile, *pScene, pCameras, numFrames, multiThreaded, NULL);
+
+	delete [] pCameras;
+	delete pScene;
+	fclose(pFile);
+	return true;
+}
+
+bool RunTraceBenchmark(const WCHAR *pTraceFile, const WCHAR *pFileName, const WCHAR *pReportFile, bool multiThreaded)
+{
+	CullingTrace *pTrace = new CullingTrace;
+	FILE *pFile = NULL;
+	if(!pTrace->BeginReplay(pTraceFile) || _wfopen_s(&pFile, pFileName, L"w") != 0)
+	{
+		delete pTrace;
+		return false;
+	}
+
+	QueryPerformanceFrequency(&glFrequency);
+
+	UINT numFrames = pTrace->GetNumFrames();
+	CPUTCamera *pCameras = new CPUTCamera[numFrames];
+	for(UINT frame = 0; frame < numFrames; frame++)
+	{
+		pTrace->GetCamera(frame, &pCameras[frame]);
+	}
+
+	CullBenchmarkFrames(pFile, pTrace->GetScene(), pCameras, numFrames, multiThreaded, pTrace);
+	fclose(pFile);
+
+	bool written = pTrace->WriteReport(pReportFile);
+	delete [] pCameras;
+	delete pTrace;
+	return written;
+}
+
+//--------------------------------------------------------------------------------------
+// Culls the frames of the scene benchmark's camera path with a fresh pair of rasterizers,
+// the task manager must be initialized. Tracing starts after the warm up frames and every
+// frame is marked so that the task manager's trace analysis can sum up the tasksets
+//--------------------------------------------------------------------------------------
+static void CullTracedFrames(const SyntheticScene &scene, UINT *pDepthBuffer, CPUTCamera &camera)
+{
+	CPUTCamera *pCamera = &camera;
+	DepthBufferRasterizerSSEMT *pDBRSSEMT = new DepthBufferRasterizerSSEMT;
+	AABBoxRasterizerSSEMT *pAABBSSEMT = new AABBoxRasterizerSSEMT;
+	pDBRSSEMT->CreateTransformedModels(scene);
+	pAABBSSEMT->CreateTransformedAABBoxes(scene);
+
+	DepthBufferRasterizer *pDBR = pDBRSSEMT;
+	AABBoxRasterizer *pAABB = pAABBSSEMT;
+
+	SetRasterizerOptions(pDBR, pAABB, pDepthBuffer);
+
+	for(UINT frame = 0; frame < SCENE_BENCHMARK_WARMUP_FRAMES + SCENE_BENCHMARK_FRAMES; frame++)
+	{
+		if(frame == SCENE_BENCHMARK_WARMUP_FRAMES)
+		{
+			gTaskMgr.EnableTrace(TRUE);
+		}
+		gTaskMgr.TraceFrame();
+
+		SetBenchmarkCamera(camera, scene, frame < SCENE_BENCHMARK_WARMUP_FRAMES ? 0 : frame - SCENE_BENCHMARK_WARMUP_FRAMES, SCENE_BENCHMARK_FRAMES);
+		pDBR->SetViewProj(camera.GetViewMatrix(), (float4x4*)camera.GetProjectionMatrix(), 0);
+		pAABB->SetViewProjMatrix(camera.GetViewMatrix(), (float4x4*)camera.GetProjectionMatrix(), 0);
+
+		pDBR->TransformModelsAndRasterizeToDepthBuffer(&pCamera, 1, 0);
+		pAABB->TransformAABBoxAndDepthTest(&pCamera, 1, 0);
+		pAABB->WaitForTaskToFinish(0);
+		pAABB->ReleaseTaskHandles(0);
+		pAABB->UpdateOccludeeProxies(0);
+		pAABB->UpdateVisibilityHistory(0);
+		pDBR->ComputeR2DBTime(0);
+	}
+	// Closes the last frame for the analysis
+	gTaskMgr.TraceFrame();
+	gTaskMgr.EnableTrace(FALSE);
+
+	delete pAABB;
+	delete pDBR;
+}
+
+bool RunThreadScaling(const WCHAR *pFileName, UINT numOccludees, UINT maxThreads)
+{
+	FILE *pFile = NULL;
+	if(_wfopen_s(&pFile, pFileName, L"w") != 0)
+	{
+		return false;
+	}
+
+	QueryPerformanceFrequency(&glFrequency);
+
+	if(maxThreads == 0)
+	{
+		maxThreads = GetLogicalProcessorCount();
+	}
+
+	SceneGeneratorParams params;
+	if(numOccludees != 0)
+	{
+		params.numOccludees = numOccludees;
+	}
+	SyntheticScene *pScene = new SyntheticScene;
+	pScene->Generate(params);
+
+	UINT *pDepthBuffer = (UINT*)_aligned_malloc(sizeof(float) * SCREENW * SCREENH, 16);
+
+	CPUTCamera camera;
+	camera.SetFov(PI / 3.0f);
+	camera.SetAspectRatio((float)SCREENW / (float)SCREENH);
+	camera.SetFarPlaneDistance(SCENE_BENCHMARK_FAR_CLIP);
+
+	TraceStageTimes *pBase = new TraceStageTimes[THREAD_SCALING_MAX_STAGES];
+	TraceStageTimes *pStages = new TraceStageTimes[THREAD_SCALING_MAX_STAGES];
+	UINT numBaseStages = 0;
+	double baseFrameTime = 0.0;
+
+	// The speedup of a stage is its span per frame with one thread over its span with more,
+	// its scaling efficiency the speedup per thread. Utilization is the share of the threads'
+	// time during the stage's span spent running its tasks, low for stages of few tasks
+	fprintf(pFile, "threads,stage,sets/frame,tasks/frame,span ms,busy ms,critical ms,speedup,efficiency,utilization\n");
+
+	for(UINT threads = 1; threads <= maxThreads; threads++)
+	{
+		gTaskMgr.miDemoModeThreadCountOverride = (INT)threads;
+		gTaskMgr.Init();
+		CullTracedFrames(*pScene, pDepthBuffer, camera);
+
+		UINT numFrames = 0;
+		double frameTime = 0.0;
+		UINT numStages = min(gTaskMgr.GetTraceStages(pStages, THREAD_SCALING_MAX_STAGES, &numFrames, &frameTime), THREAD_SCALING_MAX_STAGES);
+		gTaskMgr.Shutdown();
+
+		if(numFrames == 0)
+		{
+			continue;
+		}
+		if(threads == 1)
+		{
+			memcpy(pBase, pStages, sizeof(TraceStageTimes) * numStages);
+			numBaseStages = numStages;
+			baseFrameTime = frameTime / numFrames;
+		}
+
+		double frames = (double)numFrames;
+		for(UINT s = 0; s < numStages; s++)
+		{
+			const TraceStageTimes &stage = pStages[s];
+			double span = stage.dSpan / frames;
+			double speedup = 0.0;
+			for(UINT b = 0; b < numBaseStages; b++)
+			{
+				if(!strcmp(pBase[b].szName, stage.szName) && span > 0.0)
+				{
+					speedup = pBase[b].dSpan / (double)pBase[b].uSets / (stage.dSpan / (double)stage.uSets);
+				}
+			}
+			double utilization = stage.dSpan > 0.0 ? stage.dBusy / (stage.dSpan * threads) : 0.0;
+
+			fprintf(pFile, "%d,%s,%.2f,%.1f,%.3f,%.3f,%.3f,%.2f,%.2f,%.2f\n",
+					threads, stage.szName, stage.uSets / frames, stage.uTasks / frames,
+					span, stage.dBusy / frames, stage.dCritical / frames,
+					speedup, speedup / threads, utilization);
+		}
+
+		double frame = frameTime / frames;
+		double speedup = frame > 0.0 ? baseFrameTime / frame : 0.0;
+		fprintf(pFile, "%d,frame,,,%.3f,,,%.2f,%.2f,\n", threads, frame, speedup, speedup / threads);
+		fflush(pFile);
+	}
+
+	delete [] pStages;
+	delete [] pBase;
+	_aligned_free(pDepthBuffer);
+	delete pScene;
+	fclose(pFile);
+	return true;
+}
+
+// The 8 corners of a box in the order of the scene's occluder vertices
+static void GetBoxVertices(const float3 &center, const float3 &half, Vertex *pVertices)
+{
+	for(UINT i = 0; i < AABB_VERTICES; i++)
+	{
+		pVertices[i].pos = float4(center.x + ((i & 1) ? half.x : -half.x),
+								  center.y + ((i & 2) ? half.y : -half.y),
+								  center.z + ((i & 4) ? half.z : -half.z),
+								  1.0f);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Exact visibility of every occludee in the measured frames of the camera path: the whole
+// scene, occluders and occludees, is rasterized by the reference rasterizer, then every
+// occludee is tested against it. An occludee hidden by other occludees is hidden, drawing
+// it would be wasted. The truth is stored per frame in the occludee order of pAABB, which
+// is the same for every rasterizer built from the scene
+//--------------------------------------------------------------------------------------
+static void ComputeGroundTruth(const SyntheticScene &scene, AABBoxRasterizerSSE *pAABB, CPUTCamera &camera, UCHAR *pTruth)
+{
+	ReferenceRasterizer *pReference = new ReferenceRasterizer;
+	// The buildings are cubes with identity world matrices, the occludee boxes use their
+	// index list
+	const UINT *pIndices = scene.GetOccluderIndices(0);
+	UINT numOccludees = pAABB->GetNumOccludees();
+	Vertex vertices[AABB_VERTICES];
+
+	for(UINT frame = 0; frame < SCENE_BENCHMARK_FRAMES; frame++)
+	{
+		SetBenchmarkCamera(camera, scene, frame, SCENE_BENCHMARK_FRAMES);
+		pReference->Reset(*camera.GetViewMatrix() * *camera.GetProjectionMatrix());
+
+		for(UINT i = 0; i < scene.GetNumOccluders(); i++)
+		{
+			pReference->AddMesh(scene.GetOccluderVertices(i), scene.GetOccluderNumVertices(i),
+								scene.GetOccluderIndices(i), scene.GetOccluderNumIndices(i) / 3);
+		}
+		for(UINT i = 0; i < numOccludees; i++)
+		{
+			GetBoxVertices(pAABB->GetOccludeeCenter(i), pAABB->GetOccludeeHalf(i), vertices);
+			pReference->AddMesh(vertices, AABB_VERTICES, pIndices, AABB_TRIANGLES);
+		}
+
+		UCHAR *pFrameTruth = &pTruth[frame * numOccludees];
+		for(UINT i = 0; i < numOccludees; i++)
+		{
+			GetBoxVertices(pAABB->GetOccludeeCenter(i), pAABB->GetOccludeeHalf(i), vertices);
+			if(pReference->IsOutsideFrustum(vertices, AABB_VERTICES))
+			{
+				pFrameTruth[i] = OCCLUDEE_OUTSIDE_FRUSTUM;
+			}
+			else
+			{
+				pFrameTruth[i] = pReference->IsMeshVisible(vertices, AABB_VERTICES, pIndices, AABB_TRIANGLES) ? OCCLUDEE_VISIBLE : OCCLUDEE_HIDDEN;
+			}
+		}
+	}
+
+	delete pReference;
+}
+
+bool RunCullingQuality(const WCHAR *pFileName, UINT numOccludees)
+{
+	FILE *pFile = NULL;
+	if(_wfopen_s(&pFile, pFileName, L"w") != 0)
+	{
+		return false;
+	}
+
+	QueryPerformanceFrequency(&glFrequency);
+
+	SceneGeneratorParams params;
+	if(numOccludees != 0)
+	{
+		params.numOccludees = numOccludees;
+	}
+	SyntheticScene *pScene = new SyntheticScene;
+	pScene->Generate(params);
+
+	UINT *pDepthBuffer = (UINT*)_aligned_malloc(sizeof(float) * SCREENW * SCREENH, 16);
+
+	CPUTCamera camera;
+	camera.SetFov(PI / 3.0f);
+	camera.SetAspectRatio((float)SCREENW / (float)SCREENH);
+	camera.SetFarPlaneDistance(SCENE_BENCHMARK_FAR_CLIP);
+	CPUTCamera *pCamera = &camera;
+
+	UCHAR *pTruth = NULL;
+	double referenceTime = 0.0;
+
+	// Per frame averages. Occludees and triangles outside the view frustum are left out: the
+	// false visible rate is the share of the drawn occludees that are hidden, the false occluded
+	// rate the share of the visible occludees that were culled. The occluder efficiency is the
+	// number of triangles culled by occlusion per occluder triangle rasterized, out of the
+	// hidden triangles a perfect culling would have culled
+	fprintf(pFile, "occluder threshold,occludee threshold,rasterize ms,depth test ms,total ms,reference ms,"
+				   "occluders R2DB,rasterized tris,in frustum,visible,drawn,false visible,false visible %%,wasted tris,"
+				   "false occluded,false occluded %%,culled tris,hidden tris,occluder efficiency\n");
+
+	UINT numScales = SCENE_BENCHMARK_CASES(sQualityThresholdScales);
+	for(UINT c = 0; c < numScales * numScales; c++)
+	{
+		float occluderThreshold = gOccluderSizeThreshold * sQualityThresholdScales[c / numScales];
+		float occludeeThreshold = gOccludeeSizeThreshold * sQualityThresholdScales[c % numScales];
+
+		DepthBufferRasterizerSSEMT *pDBRSSEMT = new DepthBufferRasterizerSSEMT;
+		AABBoxRasterizerSSEMT *pAABBSSEMT = new AABBoxRasterizerSSEMT;
+		pDBRSSEMT->CreateTransformedModels(*pScene);
+		pAABBSSEMT->CreateTransformedAABBoxes(*pScene);
+
+		UINT numModels = pAABBSSEMT->GetNumOccludees();
+		if(!pTruth)
+		{
+			pTruth = new UCHAR[SCENE_BENCHMARK_FRAMES * numModels];
+			LARGE_INTEGER start;
+			QueryPerformanceCounter(&start);
+			ComputeGroundTruth(*pScene, pAABBSSEMT, camera, pTruth);
+			referenceTime = GetSeconds(start) / SCENE_BENCHMARK_FRAMES;
+		}
+
+		DepthBufferRasterizer *pDBR = pDBRSSEMT;
+		AABBoxRasterizer *pAABB = pAABBSSEMT;
+
+		SetRasterizerOptions(pDBR, pAABB, pDepthBuffer);
+		pDBR->SetOccluderSizeThreshold(occluderThreshold);
+		pAABB->SetOccludeeSizeThreshold(occludeeThreshold);
+
+		double rasterizeTime = 0.0, depthTestTime = 0.0;
+		double numOccludersR2DB = 0.0, numRasterizedTris = 0.0;
+		double numInFrustum = 0.0, numVisible = 0.0, numDrawn = 0.0, numFalseVisible = 0.0, numFalseOccluded = 0.0;
+		double wastedTris = 0.0, culledTris = 0.0, hiddenTris = 0.0;
+		for(UINT frame = 0; frame < SCENE_BENCHMARK_WARMUP_FRAMES + SCENE_BENCHMARK_FRAMES; frame++)
+		{
+			UINT pathFrame = frame < SCENE_BENCHMARK_WARMUP_FRAMES ? 0 : frame - SCENE_BENCHMARK_WARMUP_FRAMES;
+			SetBenchmarkCamera(camera, *pScene, pathFrame, SCENE_BENCHMARK_FRAMES);
+			pDBR->SetViewProj(camera.GetViewMatrix(), (float4x4*)camera.GetProjectionMatrix(), 0);
+			pAABB->SetViewProjMatrix(camera.GetViewMatrix(), (float4x4*)camera.GetProjectionMatrix(), 0);
+
+			pDBR->TransformModelsAndRasterizeToDepthBuffer(&pCamera, 1, 0);
+			pAABB->TransformAABBoxAndDepthTest(&pCamera, 1, 0);
+			pAABB->WaitForTaskToFinish(0);
+			pAABB->ReleaseTaskHandles(0);
+			pAABB->UpdateOccludeeProxies(0);
+			pAABB->UpdateVisibilityHistory(0);
+			pDBR->ComputeR2DBTime(0);
+
+			if(frame < SCENE_BENCHMARK_WARMUP_FRAMES)
+			{
+				continue;
+			}
+			rasterizeTime += pDBR->GetLastRasterizeTime();
+			depthTestTime += pAABB->GetLastDepthTestTime();
+
+			CullingStats stats;
+			pDBR->GetFrameStats(0, &stats);
+			numOccludersR2DB += stats.mNumOccludersR2DB;
+			numRasterizedTris += stats.mNumRasterizedTris;
+
+			const UCHAR *pFrameTruth = &pTruth[pathFrame * numModels];
+			for(UINT i = 0; i < numModels; i++)
+			{
+				if(pFrameTruth[i] == OCCLUDEE_OUTSIDE_FRUSTUM)
+				{
+					continue;
+				}
+				bool visible = pFrameTruth[i] == OCCLUDEE_VISIBLE;
+				bool drawn = pAABBSSEMT->IsVisible(i, 0);
+				UINT numTris = pAABBSSEMT->GetOccludeeTriangles(i);
+
+				numInFrustum += 1.0;
+				numVisible += visible ? 1.0 : 0.0;
+				numDrawn += drawn ? 1.0 : 0.0;
+				hiddenTris += visible ? 0.0 : numTris;
+				if(drawn && !visible)
+				{
+					numFalseVisible += 1.0;
+					wastedTris += numTris;
+				}
+				if(!drawn)
+				{
+					culledTris += numTris;
+					numFalseOccluded += visible ? 1.0 : 0.0;
+				}
+			}
+		}
+
+		double frames = (double)SCENE_BENCHMARK_FRAMES;
+		fprintf(pFile, "%.4f,%.4f,%.3f,%.3f,%.3f,%.3f,%.0f,%.0f,%.0f,%.0f,%.0f,%.1f,%.2f,%.0f,%.1f,%.2f,%.0f,%.0f,%.2f\n",
+				occluderThreshold, occludeeThreshold,
+				rasterizeTime * 1000.0 / frames, depthTestTime * 1000.0 / frames,
+				(rasterizeTime + depthTestTime) * 1000.0 / frames, referenceTime * 1000.0,
+				numOccludersR2DB / frames, numRasterizedTris / frames,
+				numInFrustum / frames, numVisible / frames, numDrawn / frames,
+				numFalseVisible / frames, numDrawn > 0.0 ? 100.0 * numFalseVisible / numDrawn : 0.0, wastedTris / frames,
+				numFalseOccluded / frames, numVisible > 0.0 ? 100.0 * numFalseOccluded / numVisible : 0.0,
+				culledTris / frames, hiddenTris / frames,
+				numRasterizedTris > 0.0 ? culledTris / numRasterizedTris : 0.0);
+		fflush(pFile);
+
+		delete pAABB;
+		delete pDBR;
+	}
+
+	delete [] pTruth;
+	_aligned_free(pDepthBuffer);
+	delete pScene;
+	fclose(pFile);
+	return true;
+}
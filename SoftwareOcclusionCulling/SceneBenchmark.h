@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef SCENEBENCHMARK_H
+#define SCENEBENCHMARK_H
+
+#include "Platform.h"
+
+//--------------------------------------------------------------------------------------
+// Culls synthetic cities (see SyntheticScene) of growing size with the multi threaded SSE
+// rasterizers, or only one city of numOccludees props if that is not 0. For every city a
+// camera drives down the middle street and then flies over the roofs; the CSV row holds
+// the object counts, the time to generate and to ingest the scene, the memory held by the
+// scene and by the rasterizers, and the average and worst culling times with the average
+// culling results. The settings (thresholds, depth test tasks, occluder waves, ...) are
+// the command line's. Every frame culls numViews views, the path camera and copies turned
+// evenly around it, and up to gFrameSlots frames are in flight, which puts the task sets
+// of all the slots in flight at once. Needs the task manager but neither the CPUT scene
+// nor a D3D device.
+//--------------------------------------------------------------------------------------
+bool RunSceneBenchmark(const WCHAR *pFileName, UINT numOccludees, UINT numViews);
+
+//--------------------------------------------------------------------------------------
+// Frame benchmark: culls numFrames frames of one synthetic city (numOccludees props, the
+// default city if 0) with the backend of the command line, the scalar or SSE rasterizers
+// and the multi threaded ones if multiThreaded. Seed 0 follows the scene benchmark's camera
+// path over the frames, any other seed places every frame's camera at a random spot of the
+// city. The CSV row of a frame holds the camera position, the rasterize, depth test and
+// total culling times and the frame's culling statistics. Needs the task manager like
+// RunSceneBenchmark but neither the CPUT scene nor a D3D device.
+//--------------------------------------------------------------------------------------
+bool RunFrameBenchmark(const WCHAR *pFileName, UINT numOccludees, UINT numFrames, UINT seed, bool multiThreaded);
+
+//--------------------------------------------------------------------------------------
+// Trace replay: the frame benchmark over the scene and the cameras of a culling trace the
+// sample captured (see CullingTrace), with the backend and the settings of the command
+// line, which may differ from the capture's. Every frame's visibility is compared bit for
+// bit with the captured one and the differences are written to pReportFile. Needs the
+// task manager but neither the CPUT assets nor a D3D device.
+//--------------------------------------------------------------------------------------
+bool RunTraceBenchmark(const WCHAR *pTraceFile, const WCHAR *pFileName, const WCHAR *pReportFile, bool multiThreaded);
+
+//--------------------------------------------------------------------------------------
+// Thread scaling study: culls the camera path of the scene benchmark over one synthetic
+// city (numOccludees props, the default city if 0) with the task manager initialized for
+// 1, 2, ... maxThreads threads (the logical processors if 0). The task manager traces the
+// measured frames, the CSV holds per thread count and taskset name the span, busy and
+// critical path time per frame, the speedup over one thread and the scaling efficiency,
+// which shows the stages that stop scaling, e.g. the single task sorts. Initializes and
+// shuts down the task manager itself, it must not be initialized when called.
+//--------------------------------------------------------------------------------------
+bool RunThreadScaling(const WCHAR *pFileName, UINT numOccludees, UINT maxThreads);
+
+//--------------------------------------------------------------------------------------
+// Culling quality against ground truth: the exact visibility of every occludee along the
+// scene benchmark's camera path over one synthetic city (numOccludees props, the default
+// city if 0) is computed by the reference rasterizer from the whole scene's depth. The city
+// is then culled with the multi threaded SSE rasterizers for every pair of occluder and
+// occludee size thresholds of the sweep, scaled from the command line's. The CSV row holds
+// the culling times, the false visible rate (wasted draws), the false occluded errors and
+// the occluder efficiency, the triangles culled per occluder triangle rasterized. Needs the
+// task manager like RunSceneBenchmark.
+//--------------------------------------------------------------------------------------
+bool RunCullingQuality(const WCHAR *pFileName, UINT numOccludees);
+
+#endif // SCENEBENCHMARK_H
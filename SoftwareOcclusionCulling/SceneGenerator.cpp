@@ -0,0 +1,184 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#include "SceneGenerator.h"
+
+// The bins keep the model index of a triangle in a USHORT
+static const UINT MAX_SCENE_OCCLUDERS = 1 << 16;
+
+// Corner i of a building is at the min (bit clear) or max (bit set) of x (bit 0), y (bit 1)
+// and z (bit 2). The faces are wound clockwise seen from outside, like the scene's meshes
+static const UINT sBuildingIndices[AABB_INDICES] =
+{
+	0, 6, 2, 0, 4, 6,	// -x
+	1, 3, 7, 1, 7, 5,	// +x
+	0, 1, 5, 0, 5, 4,	// -y
+	2, 7, 3, 2, 6, 7,	// +y
+	0, 3, 1, 0, 2, 3,	// -z
+	4, 5, 7, 4, 7, 6,	// +z
+};
+
+SceneGeneratorParams::SceneGeneratorParams()
+	: numOccludees(100000),
+	  occludeesPerBlock(256),
+	  buildingsPerSide(4),
+	  blockSize(60.0f),
+	  streetWidth(12.0f),
+	  sidewalkWidth(4.0f),
+	  minHeight(8.0f),
+	  maxHeight(40.0f),
+	  seed(1)
+{
+}
+
+SyntheticScene::SyntheticScene()
+	: mRandom(1),
+	  mBlocksPerSide(0),
+	  mBlockPitch(0.0f)
+{
+}
+
+// Same sequence for a seed on every run so that runs with the same parameters cull the same scene
+float SyntheticScene::Random()
+{
+	mRandom = mRandom * 1664525 + 1013904223;
+	return (float)(mRandom >> 8) / (float)(1 << 24);
+}
+
+void SyntheticScene::AddBuilding(const float3 &center, const float3 &half)
+{
+	UINT occluderId = mNumOccluders++;
+	Occluder &occluder = mpOccluders[occluderId];
+	occluder.mWorld = float4x4Identity();
+	occluder.mCenterOS = occluder.mCenter = center;
+	occluder.mHalfOS = occluder.mHalf = half;
+	occluder.mStartV = occluderId * AABB_VERTICES;
+	occluder.mNumVertices = AABB_VERTICES;
+	occluder.mStartI = 0;
+	occluder.mNumIndices = AABB_INDICES;
+
+	Vertex *pVertices = GetOccluderVertices(occluderId);
+	for(UINT i = 0; i < AABB_VERTICES; i++)
+	{
+		pVertices[i].pos = float4(center.x + ((i & 1) ? half.x : -half.x),
+								  center.y + ((i & 2) ? half.y : -half.y),
+								  center.z + ((i & 4) ? half.z : -half.z),
+								  1.0f);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// The blocks form the smallest square grid holding numOccludees at occludeesPerBlock, the
+// city is centered on the origin. Every side of a block is lined with buildingsPerSide
+// buildings a quarter of the block deep, the x sides running the full block length and the
+// z sides between them. Cities with more buildings than the bins can address get fewer
+// buildings per side, down to one, and then leave the last blocks empty. The props are
+// dealt out to the blocks in turn, half of them on the sidewalks around the block, where a
+// street view sees them, and half in the courtyard behind the buildings. They are 0.4 to 2
+// units wide, 0.6 to 4 high, and stand for 100 to 2000 triangle models
+//--------------------------------------------------------------------------------------
+void SyntheticScene::Generate(const SceneGeneratorParams &params)
+{
+	Release();
+	mParams = params;
+	mRandom = params.seed;
+
+	UINT occludeesPerBlock = max(params.occludeesPerBlock, 1u);
+	UINT numBlocks = max((params.numOccludees + occludeesPerBlock - 1) / occludeesPerBlock, 1u);
+	mBlocksPerSide = (UINT)ceilf(sqrtf((float)numBlocks));
+	numBlocks = mBlocksPerSide * mBlocksPerSide;
+	mBlockPitch = params.blockSize + params.streetWidth;
+
+	UINT buildingsPerSide = min(max(params.buildingsPerSide, 1u), MAX_SCENE_OCCLUDERS / (4 * numBlocks));
+	buildingsPerSide = max(buildingsPerSide, 1u);
+	UINT maxOccluders = min(numBlocks * 4 * buildingsPerSide, MAX_SCENE_OCCLUDERS);
+
+	// The buildings are counted as they are added, they all share the one index list
+	AllocateOccluders(maxOccluders, maxOccluders * AABB_VERTICES, AABB_INDICES);
+	memcpy(mpIndices, sBuildingIndices, sizeof(sBuildingIndices));
+	mNumOccluders = 0;
+
+	float origin = -0.5f * mBlockPitch * (float)mBlocksPerSide;
+	float lot = params.blockSize - 2.0f * params.sidewalkWidth;
+	float depth = 0.25f * lot;
+	for(UINT blockId = 0; blockId < numBlocks && mNumOccluders + 4 * buildingsPerSide <= maxOccluders; blockId++)
+	{
+		float x0 = origin + mBlockPitch * (float)(blockId % mBlocksPerSide) + params.sidewalkWidth;
+		float z0 = origin + mBlockPitch * (float)(blockId / mBlocksPerSide) + params.sidewalkWidth;
+		for(UINT side = 0; side < 4; side++)
+		{
+			// x sides run the full lot length, the z sides fit between them
+			bool xSide = side < 2;
+			float start = xSide ? 0.0f : depth;
+			float length = (xSide ? lot : lot - 2.0f * depth) / (float)buildingsPerSide;
+			float across = (side & 1) ? lot - 0.5f * depth : 0.5f * depth;
+			for(UINT i = 0; i < buildingsPerSide; i++)
+			{
+				float along = start + length * ((float)i + 0.5f);
+				float height = params.minHeight + (params.maxHeight - params.minHeight) * Random();
+				float3 half(0.45f * length, 0.5f * height, 0.5f * depth);
+				float3 center(x0 + along, 0.5f * height, z0 + across);
+				if(!xSide)
+				{
+					half = float3(half.z, half.y, half.x);
+					center = float3(x0 + across, center.y, z0 + along);
+				}
+				AddBuilding(center, half);
+			}
+		}
+	}
+
+	mNumVertices = mNumOccluders * AABB_VERTICES;
+
+	AllocateOccludees(params.numOccludees);
+	float courtyard = lot - 2.0f * depth;
+	for(UINT i = 0; i < mNumOccludees; i++)
+	{
+		UINT blockId = i % numBlocks;
+		float x0 = origin + mBlockPitch * (float)(blockId % mBlocksPerSide);
+		float z0 = origin + mBlockPitch * (float)(blockId / mBlocksPerSide);
+
+		float3 half(0.2f + 0.8f * Random(), 0.3f + 1.7f * Random(), 0.2f + 0.8f * Random());
+		float u = Random(), v = Random();
+		float x, z;
+		if(i & 1)
+		{
+			// Courtyard
+			x = x0 + params.sidewalkWidth + depth + courtyard * u;
+			z = z0 + params.sidewalkWidth + depth + courtyard * v;
+		}
+		else
+		{
+			// Sidewalk, a random position along one of the four sides
+			float along = params.blockSize * u;
+			float across = params.sidewalkWidth * 0.5f;
+			UINT side = (UINT)(v * 4.0f) & 3;
+			x = x0 + ((side < 2) ? along : ((side & 1) ? params.blockSize - across : across));
+			z = z0 + ((side < 2) ? ((side & 1) ? params.blockSize - across : across) : along);
+		}
+		mpOccludeeCenter[i] = float3(x, half.y, z);
+		mpOccludeeHalf[i] = half;
+		mpOccludeeTris[i] = 100 + (UINT)(1900.0f * Random());
+
+		// The box is the whole of the prop, its proxy is the box itself
+		Occludee &occludee = mpOccludees[i];
+		occludee.mWorld = float4x4Identity();
+		occludee.mCenterOS = mpOccludeeCenter[i];
+		occludee.mHalfOS = half;
+		occludee.mProxyScale = 1.0f;
+	}
+}
@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include "CullingScene.h"
+
+struct SceneGeneratorParams
+{
+	UINT  numOccludees;			// props in the whole city
+	UINT  occludeesPerBlock;	// prop density, sets the number of blocks
+	UINT  buildingsPerSide;		// buildings along every side of a block
+	float blockSize;			// width of a block, without the streets
+	float streetWidth;
+	float sidewalkWidth;		// strip between the street and the buildings
+	float minHeight;			// building heights
+	float maxHeight;
+	UINT  seed;
+
+	SceneGeneratorParams();
+};
+
+//--------------------------------------------------------------------------------------
+// Synthetic city for culling scaling tests: a square grid of blocks separated by streets,
+// every block lined with box buildings (the occluders) and scattered with small props
+// (the occludees) on its sidewalks and in its courtyard. The buildings are world space
+// cubes, with an identity world matrix, sharing one index list, the props world space
+// boxes with the triangle count of the model they stand for and themselves as proxy.
+//--------------------------------------------------------------------------------------
+class SyntheticScene : public CullingScene
+{
+	public:
+		SyntheticScene();
+
+		void Generate(const SceneGeneratorParams &params);
+
+		inline UINT GetBlocksPerSide() const {return mBlocksPerSide;}
+		inline float GetBlockPitch() const {return mBlockPitch;}
+		inline const SceneGeneratorParams &GetParams() const {return mParams;}
+
+	private:
+		void AddBuilding(const float3 &center, const float3 &half);
+		float Random();
+
+		SceneGeneratorParams mParams;
+		UINT mRandom;
+		UINT mBlocksPerSide;
+		float mBlockPitch;			// block plus street
+};
+
+#endif // SCENEGENERATOR_H
@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#include "ShadowReceiverMask.h"
+#include <float.h>
+
+ShadowReceiverMask::ShadowReceiverMask()
+{
+	Reset(float4x4Identity());
+}
+
+ShadowReceiverMask::~ShadowReceiverMask()
+{
+}
+
+void ShadowReceiverMask::Reset(const float4x4 &lightViewProj)
+{
+	mLightViewProj = lightViewProj;
+	for(int i = 0; i < RECEIVER_MASK_SIZE * RECEIVER_MASK_SIZE; i++)
+	{
+		mMaxReceiverDepth[i] = -FLT_MAX;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Project the 8 corners of the world space box to light space and return the covered
+// grid cells [x0, y0, x1, y1] (inclusive) along with the range of the light space depth (w).
+// A box that reaches behind the light covers the whole grid, starting at depth 0.
+//--------------------------------------------------------------------------------------
+void ShadowReceiverMask::LightSpaceRect(const float3 &centerWS, const float3 &halfWS, int rect[4], float &minDepth, float &maxDepth) const
+{
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	minDepth = FLT_MAX;
+	maxDepth = -FLT_MAX;
+
+	bool behindLight = false;
+	for(UINT i = 0; i < AABB_VERTICES; i++)
+	{
+		float4 corner(centerWS.x + ((i & 1) ? halfWS.x : -halfWS.x),
+					  centerWS.y + ((i & 2) ? halfWS.y : -halfWS.y),
+					  centerWS.z + ((i & 4) ? halfWS.z : -halfWS.z),
+					  1.0f);
+		float4 clip = corner * mLightViewProj;
+
+		minDepth = clip.w < minDepth ? clip.w : minDepth;
+		maxDepth = clip.w > maxDepth ? clip.w : maxDepth;
+		if(clip.w <= FLT_EPSILON)
+		{
+			behindLight = true;
+			continue;
+		}
+
+		float x = clip.x / clip.w;
+		float y = clip.y / clip.w;
+		minX = x < minX ? x : minX;
+		maxX = x > maxX ? x : maxX;
+		minY = y < minY ? y : minY;
+		maxY = y > maxY ? y : maxY;
+	}
+
+	if(behindLight)
+	{
+		minX = minY = -1.0f;
+		maxX = maxY = 1.0f;
+		minDepth = 0.0f;
+	}
+
+	// [-1, 1] to grid cells, clamped to the grid
+	float scale = 0.5f * (float)RECEIVER_MASK_SIZE;
+	int x0 = (int)floorf((minX + 1.0f) * scale);
+	int x1 = (int)floorf((maxX + 1.0f) * scale);
+	int y0 = (int)floorf((minY + 1.0f) * scale);
+	int y1 = (int)floorf((maxY + 1.0f) * scale);
+
+	rect[0] = x0 < 0 ? 0 : x0;
+	rect[1] = y0 < 0 ? 0 : y0;
+	rect[2] = x1 > RECEIVER_MASK_SIZE - 1 ? RECEIVER_MASK_SIZE - 1 : x1;
+	rect[3] = y1 > RECEIVER_MASK_SIZE - 1 ? RECEIVER_MASK_SIZE - 1 : y1;
+}
+
+void ShadowReceiverMask::AddReceiver(const float3 &centerWS, const float3 &halfWS)
+{
+	int rect[4];
+	float minDepth, maxDepth;
+	LightSpaceRect(centerWS, halfWS, rect, minDepth, maxDepth);
+
+	for(int y = rect[1]; y <= rect[3]; y++)
+	{
+		for(int x = rect[0]; x <= rect[2]; x++)
+		{
+			float &depth = mMaxReceiverDepth[y * RECEIVER_MASK_SIZE + x];
+			depth = maxDepth > depth ? maxDepth : depth;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// The shadow volume of the caster covers the same cells as the caster itself and 
+// extends away from the light. It reaches a receiver if any of those cells holds a
+// receiver that is farther away from the light than the nearest point of the caster.
+//--------------------------------------------------------------------------------------
+bool ShadowReceiverMask::ReachesReceiver(const float3 &centerWS, const float3 &halfWS) const
+{
+	int rect[4];
+	float minDepth, maxDepth;
+	LightSpaceRect(centerWS, halfWS, rect, minDepth, maxDepth);
+
+	for(int y = rect[1]; y <= rect[3]; y++)
+	{
+		for(int x = rect[0]; x <= rect[2]; x++)
+		{
+			if(mMaxReceiverDepth[y * RECEIVER_MASK_SIZE + x] >= minDepth)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
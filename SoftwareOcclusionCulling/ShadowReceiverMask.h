@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Copyright 2013 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+//
+//--------------------------------------------------------------------------------------
+
+#ifndef SHADOWRECEIVERMASK_H
+#define SHADOWRECEIVERMASK_H
+
+#include "CPUTMath.h"
+#include "Constants.h"
+
+//--------------------------------------------------------------------------------------
+// Coarse light space grid of the shadow receivers visible in the main view. Every cell 
+// keeps the farthest light space depth of the receivers that cover it. A caster can only
+// throw a visible shadow if its shadow volume, which starts at the caster's nearest depth
+// and extends away from the light, reaches one of these receivers.
+//--------------------------------------------------------------------------------------
+class ShadowReceiverMask
+{
+	public:
+		ShadowReceiverMask();
+		~ShadowReceiverMask();
+
+		// Start over with no receivers for the given light view projection matrix
+		void Reset(const float4x4 &lightViewProj);
+		void AddReceiver(const float3 &centerWS, const float3 &halfWS);
+		bool ReachesReceiver(const float3 &centerWS, const float3 &halfWS) const;
+
+	private:
+		float4x4 mLightViewProj;
+		float mMaxReceiverDepth[RECEIVER_MASK_SIZE * RECEIVER_MASK_SIZE];
+
+		void LightSpaceRect(const float3 &centerWS, const float3 &halfWS, int rect[4], float &minDepth, float &maxDepth) const;
+};
+
+#endif // SHADOWRECEIVERMASK_H
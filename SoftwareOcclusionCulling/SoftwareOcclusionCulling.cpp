@@ -29,20 +29,7 @@ extern char *gpDefaultShaderSource;
 
 float gFarClipDistance = 2000.0f;
 
-SOC_TYPE gSOCType			 = SSE_TYPE;
-float gOccluderSizeThreshold = 1.5f;
-float gOccludeeSizeThreshold = 0.01f;
-UINT  gDepthTestTasks		 = 20;
-TASKSETHANDLE gInsideViewFrustum[2]	= {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-TASKSETHANDLE gTooSmall[2]			= {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-TASKSETHANDLE gActiveModels[2]      = {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-TASKSETHANDLE gXformMesh[2]			= {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-TASKSETHANDLE gBinMesh[2]			= {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-TASKSETHANDLE gSortBins[2]			= {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-TASKSETHANDLE gRasterize[2]			= {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-TASKSETHANDLE gAABBoxDepthTest[2]   = {TASKSETHANDLE_INVALID, TASKSETHANDLE_INVALID};
-
-LARGE_INTEGER glFrequency; 
+// The culling settings and task sets are defined with the command line, see main.cpp
 
 // Handle OnCreation events
 //-----------------------------------------------------------------------------
@@ -137,6 +124,7 @@ void MySample::Create()
 	mpDepthTestTaskSlider->SetValue((float)mNumDepthTestTasks);
 	mpDepthTestTaskSlider->SetTickDrawing(false);
 	mpAABB->SetDepthTestTasks(mNumDepthTestTasks);
+	mpAABB->SetTileBinnedDepthTest(mTileBinnedDepthTest);
 
     //
     // Create Static text
@@ -158,8 +146,10 @@ void MySample::Create()
     CPUTMaterial::mGlobalProperties.AddValue( _L("_Shadow"), _L("$shadow_depth") );
 
 	// Creating a render target to view the CPU rasterized depth buffer
-	mpCPUDepthBuf[0] = new char[SCREENW*SCREENH*4];
-	mpCPUDepthBuf[1] = new char[SCREENW*SCREENH*4];
+	for(UINT i = 0; i < mNumFrameSlots * mNumViews; i++)
+	{
+		mpCPUDepthBuf[i] = new char[SCREENW*SCREENH*4];
+	}
 	mpGPUDepthBuf    = new char[SCREENW*SCREENH*4];
 
 	CD3D11_TEXTURE2D_DESC cpuRenderTargetDescSSE
@@ -348,6 +338,12 @@ void MySample::Create()
 	mNumOccludees = mpAABB->GetNumOccludees();
 	// Get number of occluddee triangles in the scene
 	mNumOccludeeTris = mpAABB->GetNumTriangles();
+
+	// The culling trace holds the scene, so that it replays without the assets
+	if(gCaptureFile[0] != 0)
+	{
+		mCullingTrace.BeginCapture(mpAssetSetDBR, OCCLUDER_SETS, mpAssetSetAABB, OCCLUDEE_SETS);
+	}
 	
 	swprintf_s(&string[0], CPUT_MAX_STRING_LENGTH, _L("\tNumber of Models: \t%d"), mNumOccluders);
 	mpNumOccludersText->SetText(string);
@@ -426,8 +422,11 @@ void MySample::Create()
 
 	// Setting occluder size threshold in DepthBufferRasterizer
 	mpDBR->SetOccluderSizeThreshold(mOccluderSizeThreshold);
+	mpDBR->SetOccluderWaves(mOccluderWaves);
 	// Setting occludee size threshold in AABBoxRasterizer
 	mpAABB->SetOccludeeSizeThreshold(mOccludeeSizeThreshold);
+	mpAABB->SetOccludeeProxies(mOccludeeProxies);
+	mpAABB->SetTemporalCache(mTemporalCache);
 	
 	//
 	// If no cameras were created from the model sets then create a default simple camera
@@ -485,7 +484,7 @@ void MySample::Create()
 	gLightDir = float3(-40.48f, -142.493f, -3.348f);
 	gLightDir = gLightDir.normalize();
 
-	QueryPerformanceFrequency(&glFrequency); 
+	QueryPerformanceFrequency(&glFrequency);
 }
 
 //-----------------------------------------------------------------------------
@@ -646,6 +645,7 @@ CPUTEventHandledCode MySample::HandleKeyboardEvent(CPUTKey key)
 					mpAABB = mpAABBSSEMT;
 				}
 				mpAABB->SetDepthTestTasks(mNumDepthTestTasks);
+				mpAABB->SetTileBinnedDepthTest(mTileBinnedDepthTest);
 			}
 			else
 			{
@@ -671,8 +671,11 @@ CPUTEventHandledCode MySample::HandleKeyboardEvent(CPUTKey key)
 			}
 			mpDBR->CreateTransformedModels(mpAssetSetDBR, OCCLUDER_SETS);		
 			mpDBR->SetOccluderSizeThreshold(mOccluderSizeThreshold);
+			mpDBR->SetOccluderWaves(mOccluderWaves);
 			mpAABB->CreateTransformedAABBoxes(mpAssetSetAABB, OCCLUDEE_SETS);
 			mpAABB->SetOccludeeSizeThreshold(mOccludeeSizeThreshold);
+			mpAABB->SetOccludeeProxies(mOccludeeProxies);
+			mpAABB->SetTemporalCache(mTemporalCache);
 			mpTasksCheckBox->SetCheckboxState(state);
 			break;
 		}
@@ -732,30 +735,73 @@ void MySample::TaskCleanUp()
 	{
 		if(mEnableTasks)
 		{
-			if(gAABBoxDepthTest[mCurrId] != TASKSETHANDLE_INVALID)
-			{
-				do
-				{
-					Sleep(10);
-				}while(!gTaskMgr.IsSetComplete(gAABBoxDepthTest[mCurrId]));
-				mpAABB->ReleaseTaskHandles(mCurrId);					
-			}
-
-			if(gAABBoxDepthTest[mPrevId] != TASKSETHANDLE_INVALID)
+			for(UINT i = 0; i < mNumFrameSlots * mNumViews; i++)
 			{
-				do
+				if(gAABBoxDepthTest[i] != TASKSETHANDLE_INVALID)
 				{
-					Sleep(10);
-				}while(!gTaskMgr.IsSetComplete(gAABBoxDepthTest[mPrevId]));
-				mpAABB->ReleaseTaskHandles(mPrevId);			
+					do
+					{
+						Sleep(10);
+					}while(!gTaskMgr.IsSetComplete(gAABBoxDepthTest[i]));
+					mpAABB->ReleaseTaskHandles(i);
+				}
 			}
 		}
 		mCurrId = 0;
-		mPrevId = 1;
+		mPrevId = 0;
+		mNumFramesInFlight = 0;
 		mFirstFrame = true;
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Wait for the occludee depth tests of all the views culled in a frame slot
+// and release the slot's task sets. The main view's results become the occludee
+// proxies and the visibility history of the next frames culled
+void MySample::FinishViews(UINT idx)
+{
+	for(UINT view = idx; view < idx + mNumViews; view++)
+	{
+		if(!gTaskMgr.IsSetComplete(gAABBoxDepthTest[view]))
+		{
+			mpAABB->WaitForTaskToFinish(view);
+		}
+		mpAABB->ReleaseTaskHandles(view);
+	}
+	mpAABB->UpdateOccludeeProxies(idx);
+	mpAABB->UpdateVisibilityHistory(idx);
+}
+
+//-----------------------------------------------------------------------------
+// Render the shadow casters to the shadow map. With caster culling only the
+// casters that are visible from the light (view slot idx + 1) and whose shadow
+// can fall on a receiver visible in the main view (view slot idx) are drawn
+void MySample::RenderShadowMap(CPUTRenderParametersDX &renderParams, bool prevReady)
+{
+	CPUTCamera *pCamera = renderParams.mpCamera;
+	renderParams.mpCamera = mpShadowCamera;
+	mpShadowRenderTarget->SetRenderTarget(renderParams, 0, 0.0f, true);
+
+	if(mEnableCulling && mCullShadowCasters && (prevReady || !(mEnableTasks && mPipeline)))
+	{
+		UINT idx = (mEnableTasks && mPipeline) ? mPrevId : mCurrId;
+		
+		mShadowReceiverMask.Reset(*mCameraCopy[idx + 1].GetViewMatrix() * *mCameraCopy[idx + 1].GetProjectionMatrix());
+		mpAABB->AddShadowReceivers(&mShadowReceiverMask, idx);
+		mpAABB->RenderShadowCasters(renderParams, &mShadowReceiverMask, idx + 1);
+	}
+	else
+	{
+		for(UINT i = 0; i < OCCLUDEE_SETS; i++)
+		{
+			mpAssetSetAABB[i]->RenderShadowRecursive(renderParams);
+		}
+	}
+
+	mpShadowRenderTarget->RestoreRenderTarget(renderParams);
+	renderParams.mpCamera = pCamera;
+}
+
 // Handle mouse events
 //-----------------------------------------------------------------------------
 CPUTEventHandledCode MySample::HandleMouseEvent(int x, int y, int wheel, CPUTMouseState state)
@@ -847,13 +893,17 @@ void MySample::HandleCallbackEvent( CPUTEventID Event, CPUTControlID ControlID,
 		}
 		mpDBR->CreateTransformedModels(mpAssetSetDBR, OCCLUDER_SETS);		
 		mpDBR->SetOccluderSizeThreshold(mOccluderSizeThreshold);
+		mpDBR->SetOccluderWaves(mOccluderWaves);
 		mpDBR->SetEnableFCulling(mEnableFCulling);
 		mpDBR->SetCamera(mpCamera, mCurrId);
 		mpDBR->ResetInsideFrustum();
 
 		mpAABB->CreateTransformedAABBoxes(mpAssetSetAABB, OCCLUDEE_SETS);
 		mpAABB->SetDepthTestTasks(mNumDepthTestTasks);
+		mpAABB->SetTileBinnedDepthTest(mTileBinnedDepthTest);
 		mpAABB->SetOccludeeSizeThreshold(mOccludeeSizeThreshold);
+		mpAABB->SetOccludeeProxies(mOccludeeProxies);
+		mpAABB->SetTemporalCache(mTemporalCache);
 		mpAABB->SetEnableFCulling(mEnableFCulling);
 		mpAABB->SetCamera(mpCamera, mCurrId);
 		mpAABB->ResetInsideFrustum();
@@ -920,6 +970,7 @@ void MySample::HandleCallbackEvent( CPUTEventID Event, CPUTControlID ControlID,
 				mpAABB = mpAABBSSEMT;
 			}
 			mpAABB->SetDepthTestTasks(mNumDepthTestTasks);
+			mpAABB->SetTileBinnedDepthTest(mTileBinnedDepthTest);
 		}
 		else
 		{
@@ -945,12 +996,15 @@ void MySample::HandleCallbackEvent( CPUTEventID Event, CPUTControlID ControlID,
 		}
 		mpDBR->CreateTransformedModels(mpAssetSetDBR, OCCLUDER_SETS);		
 		mpDBR->SetOccluderSizeThreshold(mOccluderSizeThreshold);
+		mpDBR->SetOccluderWaves(mOccluderWaves);
 		mpDBR->SetEnableFCulling(mEnableFCulling);
 		mpDBR->SetCamera(mpCamera, mCurrId);
 		mpDBR->ResetInsideFrustum();
 
 		mpAABB->CreateTransformedAABBoxes(mpAssetSetAABB, OCCLUDEE_SETS);
 		mpAABB->SetOccludeeSizeThreshold(mOccludeeSizeThreshold);
+		mpAABB->SetOccludeeProxies(mOccludeeProxies);
+		mpAABB->SetTemporalCache(mTemporalCache);
 		mpAABB->SetEnableFCulling(mEnableFCulling);
 		mpAABB->SetCamera(mpCamera, mCurrId);
 		mpAABB->ResetInsideFrustum();
@@ -982,6 +1036,8 @@ void MySample::HandleCallbackEvent( CPUTEventID Event, CPUTControlID ControlID,
 		swprintf_s(&string[0], CPUT_MAX_STRING_LENGTH, _L("Occludee Size Threshold: %0.4f"), mOccludeeSizeThreshold);
 		mpOccludeeSizeSlider->SetText(string);
 		mpAABB->SetOccludeeSizeThreshold(mOccludeeSizeThreshold);
+		mpAABB->SetOccludeeProxies(mOccludeeProxies);
+		mpAABB->SetTemporalCache(mTemporalCache);
 		break;
 	}
 	case ID_DEPTH_TEST_TASKS:
@@ -995,6 +1051,7 @@ void MySample::HandleCallbackEvent( CPUTEventID Event, CPUTControlID ControlID,
 		swprintf_s(&string[0], CPUT_MAX_STRING_LENGTH, _L("Depth Test Task: \t\t%d"), mNumDepthTestTasks);
 		mpDepthTestTaskSlider->SetText(string);
 		mpAABB->SetDepthTestTasks(mNumDepthTestTasks);
+		mpAABB->SetTileBinnedDepthTest(mTileBinnedDepthTest);
 		break;
 	}
 
@@ -1137,6 +1194,9 @@ void MySample::Render(double deltaSeconds)
 {
     CPUTRenderParametersDX renderParams(mpContext);
 
+	// The task sets created from here on belong to this frame in the task trace
+	gTaskMgr.TraceFrame();
+
 	// If mViewBoundingBox is enabled then draw the axis aligned bounding box 
 	// for all the model in the scene. FYI This will affect frame rate.
 	if(mViewBoundingBox)
@@ -1152,24 +1212,45 @@ void MySample::Render(double deltaSeconds)
 	{
 		if(!mFirstFrame)
 		{
-			UINT tmpId = mCurrId;
-			mCurrId = mPrevId;
-			mPrevId = tmpId;
+			mCurrId = (mCurrId + mNumViews) % (mNumFrameSlots * mNumViews);
 		}	
 	}
 
+	// Every frame slot holds mNumViews consecutive slots, the main view comes first
+	// followed by the shadow camera view
 	mCameraCopy[mCurrId] = *mpCamera;
+	if(mNumViews > 1)
+	{
+		mCameraCopy[mCurrId + 1] = *mpShadowCamera;
+	}
+
+	// The culling trace frame of the slot, its visibility is captured once final
+	if(mEnableCulling)
+	{
+		mSlotFrame[mCurrId] = mCullFrame++;
+		mCullingTrace.AddFrame(&mCameraCopy[mCurrId]);
+	}
+
+	// With pipelining the visibility of the oldest slot in flight is used; until the
+	// ring has filled up there is no such slot and everything is rendered
+	bool prevReady = false;
 
 	// Clear back buffer
 	const float clearColor[] = { 0.0993f, 0.0993f, 0.0993f, 1.0f };
     mpContext->ClearRenderTargetView( mpBackBufferRTV,  clearColor );
     mpContext->ClearDepthStencilView( mpDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 0.0f, 0);
 
-	// Set the camera transforms so that the occluders can be transformed 
-	mpDBR->SetViewProj(mCameraCopy[mCurrId].GetViewMatrix(), (float4x4*)mCameraCopy[mCurrId].GetProjectionMatrix(), mCurrId);
+	CPUTCamera *pViewCamera[MAX_VIEWS];
+	for(UINT view = mCurrId; view < mCurrId + mNumViews; view++)
+	{
+		pViewCamera[view - mCurrId] = &mCameraCopy[view];
+
+		// Set the camera transforms so that the occluders can be transformed 
+		mpDBR->SetViewProj(mCameraCopy[view].GetViewMatrix(), (float4x4*)mCameraCopy[view].GetProjectionMatrix(), view);
 
-	// Set the camera transforms so that the occludee abix aligned bounding boxes (AABB) can be transformed
-	mpAABB->SetViewProjMatrix(mCameraCopy[mCurrId].GetViewMatrix(), (float4x4*)mCameraCopy[mCurrId].GetProjectionMatrix(), mCurrId);
+		// Set the camera transforms so that the occludee abix aligned bounding boxes (AABB) can be transformed
+		mpAABB->SetViewProjMatrix(mCameraCopy[view].GetViewMatrix(), (float4x4*)mCameraCopy[view].GetProjectionMatrix(), view);
+	}
 
 	// If view frustum culling is enabled then determine which occluders and occludees are 
 	// inside the view frustum and run the software occlusion culling on only the those models
@@ -1185,41 +1266,43 @@ void MySample::Render(double deltaSeconds)
 	// if software occlusion culling is enabled
 	if(mEnableCulling)
 	{
-		// Set the Depth Buffer
+		// Set the Depth Buffer of every view
+		for(UINT view = mCurrId; view < mCurrId + mNumViews; view++)
+		{
+			mpDBR->SetCPURenderTargetPixels((UINT*)mpCPUDepthBuf[view], view);
+			mpAABB->SetCPURenderTargetPixels((UINT*)mpCPUDepthBuf[view], view);
+		}
 		mpCPURenderTargetPixels = (UINT*)mpCPUDepthBuf[mCurrId];
 		
-		mpDBR->SetCPURenderTargetPixels(mpCPURenderTargetPixels, mCurrId);
 		// Transform the occluder models and rasterize them to the depth buffer
-		mpDBR->TransformModelsAndRasterizeToDepthBuffer(&mCameraCopy[mCurrId], mCurrId);
+		mpDBR->TransformModelsAndRasterizeToDepthBuffer(pViewCamera, mNumViews, mCurrId);
 	
-		
-		mpAABB->SetCPURenderTargetPixels(mpCPURenderTargetPixels, mCurrId);
 		// Transform the occludee AABB, rasterize and depth test to determine is occludee is visible or occluded 
-		mpAABB->TransformAABBoxAndDepthTest(&mCameraCopy[mCurrId], mCurrId);		
+		mpAABB->TransformAABBoxAndDepthTest(pViewCamera, mNumViews, mCurrId);		
 
 		if(mEnableTasks)
 		{
 			if(mPipeline)
 			{
-				if(mFirstFrame)
+				mFirstFrame = false;
+				if(++mNumFramesInFlight == mNumFrameSlots)
 				{
-					mFirstFrame = false;
-				}
-				else
-				{
-					if(!gTaskMgr.IsSetComplete(gAABBoxDepthTest[mPrevId]))
-					{
-						mpAABB->WaitForTaskToFinish(mPrevId);
-					}
-					mpAABB->ReleaseTaskHandles(mPrevId);
+					mPrevId = (mCurrId + mNumViews) % (mNumFrameSlots * mNumViews);
+					FinishViews(mPrevId);
+					mNumFramesInFlight--;
+					prevReady = true;
 				}
 			}
 			else
 			{
-				mpAABB->WaitForTaskToFinish(mCurrId);
-				mpAABB->ReleaseTaskHandles(mCurrId);
+				FinishViews(mCurrId);
 			}
 		}
+		else
+		{
+			mpAABB->UpdateOccludeeProxies(mCurrId);
+			mpAABB->UpdateVisibilityHistory(mCurrId);
+		}
 	}
 	
 	// If mViewDepthBuffer is enabled then blit the CPU rasterized depth buffer to the frame buffer
@@ -1229,14 +1312,17 @@ void MySample::Render(double deltaSeconds)
 		if(mEnableCulling && mEnableTasks && mPipeline)
 		{
 			// Update the GPU-side depth buffer
-			UpdateGPUDepthBuf(mPrevId);
-		    mpContext->UpdateSubresource(mpCPURenderTarget[mPrevId], 0, NULL, mpGPUDepthBuf, rowPitch, 0);			
+			if(prevReady)
+			{
+				UpdateGPUDepthBuf(mPrevId);
+				mpContext->UpdateSubresource(mpCPURenderTarget[0], 0, NULL, mpGPUDepthBuf, rowPitch, 0);
+			}
 		}
 		else 
 		{
 			// Update the GPU-side depth buffer
 			UpdateGPUDepthBuf(mCurrId);
-			mpContext->UpdateSubresource(mpCPURenderTarget[mCurrId], 0, NULL, mpGPUDepthBuf, rowPitch, 0);			
+			mpContext->UpdateSubresource(mpCPURenderTarget[0], 0, NULL, mpGPUDepthBuf, rowPitch, 0);			
 		}
 		mpContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
 		mpContext->Draw(3, 0);
@@ -1244,6 +1330,12 @@ void MySample::Render(double deltaSeconds)
 	// else render the (frustum culled) occluders and only the visible occludees
 	else
 	{
+		// The shadow pass is opt in so the default frame costs what it always did
+		if(mShadowPass)
+		{
+			RenderShadowMap(renderParams, prevReady);
+		}
+
 		CPUTMeshDX11::ResetDrawCallCount();
 
 		if(mpAssetSetAABB) 
@@ -1253,8 +1345,16 @@ void MySample::Render(double deltaSeconds)
 			{
 				if(mEnableTasks && mPipeline)
 				{
-					renderParams.mpCamera = &mCameraCopy[mPrevId];
-					mpAABB->RenderVisible(mpAssetSetAABB, renderParams, OCCLUDEE_SETS, mPrevId); 
+					if(prevReady)
+					{
+						renderParams.mpCamera = &mCameraCopy[mPrevId];
+						mpAABB->RenderVisible(mpAssetSetAABB, renderParams, OCCLUDEE_SETS, mPrevId);
+					}
+					else
+					{
+						renderParams.mpCamera = &mCameraCopy[mCurrId];
+						mpAABB->Render(mpAssetSetAABB, renderParams, OCCLUDEE_SETS, mCurrId);
+					}
 				}
 				else
 				{
@@ -1274,25 +1374,29 @@ void MySample::Render(double deltaSeconds)
 	}
 
 	wchar_t string[CPUT_MAX_STRING_LENGTH];
-	if(mEnableCulling)
+	if(mEnableCulling && (prevReady || !(mEnableTasks && mPipeline)))
 	{
-		if(mEnableTasks && mPipeline)
-		{
-			mpDBR->ComputeR2DBTime(mPrevId);
-			mNumOccludersR2DB = mpDBR->GetNumOccludersR2DB(mPrevId);
-			mNumOccluderRasterizedTris = mpDBR->GetNumRasterizedTriangles(mPrevId);
-			mNumCulled = mpAABB->GetNumCulled(mPrevId);
-			mNumOccludeeCulledTris = mpAABB->GetNumCulledTriangles(mPrevId);
-		}
-		else
-		{
-			mpDBR->ComputeR2DBTime(mCurrId);
-			mNumOccludersR2DB = mpDBR->GetNumOccludersR2DB(mCurrId);
-			mNumOccluderRasterizedTris = mpDBR->GetNumRasterizedTriangles(mCurrId);
-			mNumCulled = mpAABB->GetNumCulled(mCurrId);
-			mNumOccludeeCulledTris = mpAABB->GetNumCulledTriangles(mCurrId);
-		}
+		// The culling tasks counted their work as they went, the snapshot only sums up
+		// their counter blocks
+		UINT statsId = (mEnableTasks && mPipeline) ? mPrevId : mCurrId;
+		mpDBR->ComputeR2DBTime(statsId);
+		mpDBR->GetFrameStats(statsId, &mFrameStats);
+		mpAABB->GetFrameStats(statsId, &mFrameStats);
+		mCullingTrace.SetVisibility(mSlotFrame[statsId], mpAABB, statsId);
+
+		mNumOccludersR2DB = mFrameStats.mNumOccludersR2DB;
+		mNumOccluderRasterizedTris = mFrameStats.mNumRasterizedTris;
+		mNumCulled = mFrameStats.mNumCulled;
+		mNumOccludeeCulledTris = mFrameStats.mNumCulledTris;
 		mRasterizeTime = mpDBR->GetRasterizeTime();
+
+		// Work of the culling stages for the hardware counters per unit of work. With occluder
+		// waves the near wave sets rasterize part of these triangles
+		gTaskMgr.TraceWork("Xform Vertices", mNumOccluderRasterizedTris);
+		gTaskMgr.TraceWork("Bin Meshes", mNumOccluderRasterizedTris);
+		gTaskMgr.TraceWork("Raster Tris to DB", mNumOccluderRasterizedTris);
+		gTaskMgr.TraceWork("Bin AABBox", mNumOccludees);
+		gTaskMgr.TraceWork("Depth Test AABBox", mNumOccludees);
 		
 		mNumVisible = mNumOccludees - mNumCulled;
 		mNumOccludeeVisibleTris = mNumOccludeeTris - mNumOccludeeCulledTris;
@@ -1327,7 +1431,7 @@ void MySample::Render(double deltaSeconds)
 		swprintf_s(&string[0], CPUT_MAX_STRING_LENGTH, _L("\tTotal Cull time: \t%0.2f ms"), mTotalCullTime * 1000.0f);
 		mpTotalCullTimeText->SetText(string);
 	}
-	else
+	else if(!mEnableCulling)
 	{
 		UINT fCullCount = 0;
 		if(mEnableFCulling)
@@ -37,6 +37,7 @@
 #include "AABBoxRasterizerSSEMT.h"
 
 #include "TaskMgrTBB.h"
+#include "CullingTrace.h"
 
 
 
@@ -54,7 +55,7 @@ private:
 
     CPUTText              *mpFPSCounter;
 	CPUTDropdown		  *mpTypeDropDown;
-	CPUTCamera			   mCameraCopy[2];
+	CPUTCamera			   mCameraCopy[MAX_SLOTS];
 
 	CPUTText			  *mpOccludersText;
 	CPUTText			  *mpNumOccludersText;
@@ -95,7 +96,7 @@ private:
 	CPUTMaterialDX11		 *mpShowDepthBufMtrlSSE;
 	CPUTMaterialDX11		 *mpShowDepthBufMtrl;
 	
-	char					 *mpCPUDepthBuf[2];
+	char					 *mpCPUDepthBuf[MAX_SLOTS];
 	char					 *mpGPUDepthBuf;
 	
 	ID3D11Texture2D          *mpCPURenderTargetScalar[2];
@@ -136,6 +137,7 @@ private:
 	UINT    			mNumOccludeeVisibleTris;
 	double				mDepthTestTime;
 	float				mOccludeeSizeThreshold;
+	CullingStats		mFrameStats;		// counters of the last culled frame
 
 	double				mTotalCullTime;
 
@@ -151,6 +153,20 @@ private:
 	UINT				mCurrId;
 	UINT				mPrevId;
 	bool				mFirstFrame;
+	UINT				mNumFrameSlots;
+	UINT				mNumFramesInFlight;
+	UINT				mNumViews;
+	bool				mCullShadowCasters;
+	bool				mShadowPass;
+	bool				mTileBinnedDepthTest;
+	bool				mOccluderWaves;
+	bool				mOccludeeProxies;
+	bool				mTemporalCache;
+	ShadowReceiverMask	mShadowReceiverMask;
+
+	CullingTrace		mCullingTrace;
+	UINT				mCullFrame;
+	UINT				mSlotFrame[MAX_SLOTS];
 
 public:
     MySample() :
@@ -211,9 +227,21 @@ public:
 		mNumDrawCalls(0),
 		mNumDepthTestTasks(gDepthTestTasks),
 		mCurrId(0),
-		mPrevId(1),
-		mFirstFrame(true)
+		mPrevId(0),
+		mFirstFrame(true),
+		mNumFrameSlots(gFrameSlots < 1 ? 1 : (gFrameSlots > MAX_FRAME_SLOTS ? MAX_FRAME_SLOTS : gFrameSlots)),
+		mNumFramesInFlight(0),
+		mNumViews((gCullShadowView || gCullShadowCasters) ? 2 : 1),
+		mCullShadowCasters(gCullShadowCasters),
+		mShadowPass(gShadowPass || gCullShadowCasters),
+		mTileBinnedDepthTest(gTileBinnedDepthTest),
+		mOccluderWaves(gOccluderWaves),
+		mOccludeeProxies(gOccludeeProxies),
+		mTemporalCache(gTemporalCache),
+		mCullFrame(0)
     {
+		mFrameStats.Reset();
+
 		mpCPURenderTargetScalar[0] = NULL;
 		mpCPURenderTargetScalar[1] = NULL;
 
@@ -238,7 +266,25 @@ public:
 		}
 
 		mpAssetSetSky = NULL;
-		mpCPUDepthBuf[0] = mpCPUDepthBuf[1] = NULL;
+		for(UINT i = 0; i < MAX_SLOTS; i++)
+		{
+			mpCPUDepthBuf[i] = NULL;
+			mSlotFrame[i] = 0;
+
+			gInsideViewFrustum[i] = gTooSmall[i] = gActiveModels[i] = gSplitNearFar[i] = TASKSETHANDLE_INVALID;
+			gXformMesh[i] = gBinMesh[i] = gSortBins[i] = TASKSETHANDLE_INVALID;
+			gXformMeshNear[i] = gBinMeshNear[i] = gSortBinsNear[i] = TASKSETHANDLE_INVALID;
+			gCullFarOccluders[i] = gActiveFarModels[i] = gXformProxies[i] = TASKSETHANDLE_INVALID;
+			gAABBoxBin[i] = gAABBoxSort[i] = gAABBoxDepthTest[i] = TASKSETHANDLE_INVALID;
+			for(UINT band = 0; band < NUM_RASTER_BANDS; band++)
+			{
+				gRasterize[i][band] = gRasterizeNear[i][band] = gRasterizeProxies[i][band] = TASKSETHANDLE_INVALID;
+			}
+			for(UINT bucket = 0; bucket < NUM_OCCLUDEE_BUCKETS; bucket++)
+			{
+				gAABBoxBucketTest[i][bucket] = TASKSETHANDLE_INVALID;
+			}
+		}
 		mpShowDepthBufMtrlScalar = mpShowDepthBufMtrlSSE = mpShowDepthBufMtrl = NULL;
 
 		if((mSOCType == SCALAR_TYPE) && !mEnableTasks)
@@ -280,8 +326,15 @@ public:
         SAFE_RELEASE(mpCamera);
         SAFE_RELEASE(mpShadowCamera);
 
-		SAFE_DELETE_ARRAY(mpCPUDepthBuf[0]);
-		SAFE_DELETE_ARRAY(mpCPUDepthBuf[1]);
+		if(mCullingTrace.IsCapturing())
+		{
+			mCullingTrace.WriteCapture(gCaptureFile);
+		}
+
+		for(UINT i = 0; i < MAX_SLOTS; i++)
+		{
+			SAFE_DELETE_ARRAY(mpCPUDepthBuf[i]);
+		}
 		SAFE_DELETE(mpGPUDepthBuf);
 		SAFE_RELEASE(mpCPURenderTargetScalar[0]);
 		SAFE_RELEASE(mpCPURenderTargetScalar[1]);
@@ -326,6 +379,8 @@ public:
     virtual void Update(double deltaSeconds);
     virtual void ResizeWindow(UINT width, UINT height);
 	virtual void TaskCleanUp();
+	void FinishViews(UINT idx);
+	void RenderShadowMap(CPUTRenderParametersDX &renderParams, bool prevReady);
 	virtual void UpdateGPUDepthBuf(UINT idx);
 
 	// define some controls1
@@ -16,38 +16,112 @@
 //--------------------------------------------------------------------------------------
 
 #include "TransformedAABBoxSSE.h"
+#include "AABBoxSilhouette.h"
+#include "CullingScene.h"
 
-static const UINT sBBIndexList[AABB_INDICES] =
+// 0 = use min corner, 1 = use max corner
+static const UINT sBBxInd[AABB_VERTICES] = { 1, 0, 0, 1, 1, 1, 0, 0 };
+static const UINT sBByInd[AABB_VERTICES] = { 1, 1, 1, 1, 0, 0, 0, 0 };
+static const UINT sBBzInd[AABB_VERTICES] = { 1, 1, 0, 0, 0, 1, 1, 0 };
+
+// Halvings of the binary search for the scale of an occludee's proxy box
+static const UINT PROXY_SCALE_SEARCH_STEPS = 8;
+
+//-----------------------------------------------------------------------------------------
+// Set up the edge functions of a silhouette for the 2x2 pixel quads of the rows starting at
+// (startXx, startYy). sumRow gets them at the first quad, aaInc and bbInc their increments 
+// to the next quad of a row and to the next quad row
+//-----------------------------------------------------------------------------------------
+static void SetupSilhouetteEdges(const int hullX[], const int hullY[], UINT numEdges, int startXx, int startYy,
+								 __m128i sumRow[], __m128i aaInc[], __m128i bbInc[])
 {
-	// index for top 
-	1, 3, 2,
-	0, 3, 1,
+	__m128i colOffset = _mm_setr_epi32(0, 1, 0, 1);
+	__m128i rowOffset = _mm_setr_epi32(0, 0, 1, 1);
 
-	// index for bottom
-	5, 7, 4,
-	6, 7, 5,
+	__m128i col = _mm_add_epi32(colOffset, _mm_set1_epi32(startXx));
+	__m128i row = _mm_add_epi32(rowOffset, _mm_set1_epi32(startYy));
+
+	// Fab(x, y) =     Ax       +       By     +      C              = 0
+	// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
+	for(UINT e = 0; e < numEdges; e++)
+	{
+		int A = hullY[e] - hullY[e + 1];
+		int B = hullX[e + 1] - hullX[e];
+		int C = hullX[e] * hullY[e + 1] - hullX[e + 1] * hullY[e];
+
+		sumRow[e] = _mm_add_epi32(_mm_mullo_epi32(_mm_set1_epi32(A), col), _mm_mullo_epi32(_mm_set1_epi32(B), row));
+		sumRow[e] = _mm_add_epi32(sumRow[e], _mm_set1_epi32(C));
+		aaInc[e] = _mm_set1_epi32(A * 2);
+		bbInc[e] = _mm_set1_epi32(B * 2);
+	}
+}
 
-	// index for left
-	1, 7, 6,
-	2, 7, 1,
+//-----------------------------------------------------------------------------------------
+// Whether the triangle v0 v1 v2, relative to the center of a box of the given half vector,
+// touches the box. Separating axis test over the box axes, the triangle normal and the 
+// cross products of the triangle edges with the box axes
+//-----------------------------------------------------------------------------------------
+static bool TriangleTouchesBox(const float3 &half, const float3 &v0, const float3 &v1, const float3 &v2)
+{
+	if(min(min(v0.x, v1.x), v2.x) > half.x || max(max(v0.x, v1.x), v2.x) < -half.x ||
+	   min(min(v0.y, v1.y), v2.y) > half.y || max(max(v0.y, v1.y), v2.y) < -half.y ||
+	   min(min(v0.z, v1.z), v2.z) > half.z || max(max(v0.z, v1.z), v2.z) < -half.z)
+	{
+		return false;
+	}
 
-	// index for right
-	3, 5, 4,
-	0, 5, 3,
+	float3 edges[3] = {v1 - v0, v2 - v1, v0 - v2};
+	float3 normal = cross3(edges[0], edges[1]);
+	if(fabsf(dot3(normal, v0)) > dot3(half, abs3(normal)))
+	{
+		return false;
+	}
 
-	// index for back
-	2, 4, 7,
-	3, 4, 2,
+	const float3 boxAxes[3] = {float3(1.0f, 0.0f, 0.0f), float3(0.0f, 1.0f, 0.0f), float3(0.0f, 0.0f, 1.0f)};
+	for(UINT e = 0; e < 3; e++)
+	{
+		for(UINT a = 0; a < 3; a++)
+		{
+			float3 axis = cross3(edges[e], boxAxes[a]);
+			float p0 = dot3(axis, v0), p1 = dot3(axis, v1), p2 = dot3(axis, v2);
+			float r = dot3(half, abs3(axis));
+			if(min(min(p0, p1), p2) > r || max(max(p0, p1), p2) < -r)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
 
-	// index for front
-	0, 6, 5,
-	1, 6, 0,
-};
+//-----------------------------------------------------------------------------------------
+// Whether the ray from the origin along dir crosses the triangle v0 v1 v2
+//-----------------------------------------------------------------------------------------
+static bool RayCrossesTriangle(const float3 &dir, const float3 &v0, const float3 &v1, const float3 &v2)
+{
+	float3 e1 = v1 - v0;
+	float3 e2 = v2 - v0;
+	float3 p = cross3(dir, e2);
+	float det = dot3(e1, p);
+	if(det == 0.0f)
+	{
+		return false;
+	}
 
-// 0 = use min corner, 1 = use max corner
-static const UINT sBBxInd[AABB_VERTICES] = { 1, 0, 0, 1, 1, 1, 0, 0 };
-static const UINT sBByInd[AABB_VERTICES] = { 1, 1, 1, 1, 0, 0, 0, 0 };
-static const UINT sBBzInd[AABB_VERTICES] = { 1, 1, 0, 0, 0, 1, 1, 0 };
+	float3 t = float3(-v0.x, -v0.y, -v0.z);
+	float u = dot3(t, p) / det;
+	if(u < 0.0f || u > 1.0f)
+	{
+		return false;
+	}
+	float3 q = cross3(t, e1);
+	float v = dot3(dir, q) / det;
+	if(v < 0.0f || u + v > 1.0f)
+	{
+		return false;
+	}
+	return dot3(e2, q) / det > 0.0f;
+}
 
 //--------------------------------------------------------------------------
 // Get the bounding box center and half vector
@@ -60,67 +134,158 @@ void TransformedAABBoxSSE::CreateAABBVertexIndexList(CPUTModelDX11 *pModel)
 	pModel->GetBoundsObjectSpace(&mBBCenter, &mBBHalf);
 	mRadiusSq = mBBHalf.lengthSq();
 	pModel->GetBoundsWorldSpace(&mBBCenterWS, &mBBHalfWS);
+
+	ComputeProxyScale(pModel);
 }
 
-//----------------------------------------------------------------
-// Determine is model is inside view frustum
-//----------------------------------------------------------------
-bool TransformedAABBoxSSE::IsInsideViewFrustum(CPUTCamera *pCamera)
+void TransformedAABBoxSSE::CreateOccludeeBox(const CullingScene &scene, UINT occludeeId)
 {
-	return pCamera->mFrustum.IsVisible(mBBCenterWS, mBBHalfWS);
+	mWorldMatrix = scene.GetOccludeeWorldMatrix(occludeeId);
+
+	mBBCenter = scene.GetOccludeeCenterOS(occludeeId);
+	mBBHalf = scene.GetOccludeeHalfOS(occludeeId);
+	mRadiusSq = mBBHalf.lengthSq();
+	mBBCenterWS = scene.GetOccludeeCenters()[occludeeId];
+	mBBHalfWS = scene.GetOccludeeHalves()[occludeeId];
+	mProxyScale = scene.GetOccludeeProxyScale(occludeeId);
 }
 
-//----------------------------------------------------------------------------
-// Determine if the occluddee size is too small and if so avoid drawing it
-//----------------------------------------------------------------------------
-bool TransformedAABBoxSSE::IsTooSmall(const BoxTestSetupSSE &setup, __m128 cumulativeMatrix[4])
+// Occluder boxes only take the frustum and size tests, they need no proxy
+void TransformedAABBoxSSE::CreateAABBVertexIndexList(const CullingScene &scene, UINT occluderId)
 {
-	__m128 worldMatrix[4];
-	worldMatrix[0] = _mm_loadu_ps(mWorldMatrix.r0.f);
-	worldMatrix[1] = _mm_loadu_ps(mWorldMatrix.r1.f);
-	worldMatrix[2] = _mm_loadu_ps(mWorldMatrix.r2.f);
-	worldMatrix[3] = _mm_loadu_ps(mWorldMatrix.r3.f);
-	MatrixMultiply(worldMatrix, setup.mViewProjViewport, cumulativeMatrix);
-	
-	float w = mBBCenter.x * cumulativeMatrix[0].m128_f32[3] + 
-		      mBBCenter.y * cumulativeMatrix[1].m128_f32[3] + 
-			  mBBCenter.z * cumulativeMatrix[2].m128_f32[3] + 
-			  cumulativeMatrix[3].m128_f32[3];
+	mWorldMatrix = scene.GetOccluderWorldMatrix(occluderId);
 
-	if( w > 1.0f )
+	mBBCenter = scene.GetOccluderCenterOS(occluderId);
+	mBBHalf = scene.GetOccluderHalfOS(occluderId);
+	mRadiusSq = mBBHalf.lengthSq();
+	mBBCenterWS = scene.GetOccluderCenter(occluderId);
+	mBBHalfWS = scene.GetOccluderHalf(occluderId);
+	mProxyScale = 0.0f;
+}
+
+//-----------------------------------------------------------------------------------------
+// Find the largest copy of the world space AABB, shrunk around its center, that lies inside
+// the model's meshes, so that rasterizing it never hides more than the model does. Its 
+// center must be inside the meshes, the rays from it along the 6 axis directions all cross
+// them an odd number of times, and the box must touch none of their triangles. Models that
+// are not solid around their center (L shapes, arches, foliage, open meshes) get no proxy
+//-----------------------------------------------------------------------------------------
+void TransformedAABBoxSSE::ComputeProxyScale(CPUTModelDX11 *pModel)
+{
+	mProxyScale = 0.0f;
+
+	UINT numTriangles = 0;
+	for(int m = 0; m < pModel->GetMeshCount(); m++)
 	{
-		return mRadiusSq < w * setup.radiusThreshold;
+		CPUTMeshDX11 *pMesh = pModel->GetMesh(m);
+		if(pMesh->GetVertices() == NULL || pMesh->GetIndices() == NULL)
+		{
+			return;
+		}
+		numTriangles += pMesh->GetTriangleCount();
 	}
-	return false;
+	if(numTriangles == 0)
+	{
+		return;
+	}
+
+	// World space corners of the triangles, relative to the box center
+	float3 *pCorners = new float3[3 * numTriangles];
+	UINT numCorners = 0;
+	for(int m = 0; m < pModel->GetMeshCount(); m++)
+	{
+		CPUTMeshDX11 *pMesh = pModel->GetMesh(m);
+		const Vertex *pVertices = pMesh->GetVertices();
+		const UINT *pIndices = pMesh->GetIndices();
+		for(UINT i = 0; i < 3 * pMesh->GetTriangleCount(); i++)
+		{
+			const float4 &pos = pVertices[pIndices[i]].pos;
+			float4 world = float4(pos.x, pos.y, pos.z, 1.0f) * mWorldMatrix;
+			pCorners[numCorners++] = float3(world.x, world.y, world.z) - mBBCenterWS;
+		}
+	}
+
+	const float3 rayDirs[6] = {float3( 1.0f, 0.0f, 0.0f), float3(0.0f,  1.0f, 0.0f), float3(0.0f, 0.0f,  1.0f),
+							   float3(-1.0f, 0.0f, 0.0f), float3(0.0f, -1.0f, 0.0f), float3(0.0f, 0.0f, -1.0f)};
+	bool inside = true;
+	for(UINT d = 0; d < 6 && inside; d++)
+	{
+		UINT numCrossings = 0;
+		for(UINT i = 0; i < numCorners; i += 3)
+		{
+			numCrossings += RayCrossesTriangle(rayDirs[d], pCorners[i], pCorners[i + 1], pCorners[i + 2]) ? 1 : 0;
+		}
+		inside = (numCrossings & 1) != 0;
+	}
+
+	// The box of scale lo touches no triangle, the one of scale hi does or is the whole AABB
+	float lo = 0.0f, hi = 1.0f;
+	for(UINT step = 0; step < PROXY_SCALE_SEARCH_STEPS && inside; step++)
+	{
+		float scale = 0.5f * (lo + hi);
+		float3 half = mBBHalfWS * scale;
+		bool touches = false;
+		for(UINT i = 0; i < numCorners && !touches; i += 3)
+		{
+			touches = TriangleTouchesBox(half, pCorners[i], pCorners[i + 1], pCorners[i + 2]);
+		}
+		if(touches)
+		{
+			hi = scale;
+		}
+		else
+		{
+			lo = scale;
+		}
+	}
+	mProxyScale = inside ? lo : 0.0f;
+
+	delete [] pCorners;
 }
 
 //----------------------------------------------------------------
-// Trasforms the AABB vertices to screen space once every frame
+// Determine is model is inside view frustum
 //----------------------------------------------------------------
-bool TransformedAABBoxSSE::TransformAABBox(__m128 xformedPos[], const __m128 cumulativeMatrix[4])
+bool TransformedAABBoxSSE::IsInsideViewFrustum(CPUTCamera *pCamera)
 {
-	// w ends up being garbage, but it doesn't matter - we ignore it anyway.
-	__m128 vCenter = _mm_loadu_ps(&mBBCenter.x);
-	__m128 vHalf   = _mm_loadu_ps(&mBBHalf.x);
+	return pCamera->mFrustum.IsVisible(mBBCenterWS, mBBHalfWS);
+}
+
+//----------------------------------------------------------------
+// Trasforms the vertices of the world space AABB, with its half 
+// vector scaled by halfScale, to screen space. Returns false if any
+// of the vertices is z-clipped
+//----------------------------------------------------------------
+bool TransformedAABBoxSSE::TransformAABBoxWS(__m128 xformedPos[], const BoxTestSetupSSE &setup, float halfScale)
+{
+	return TransformBoxWS(mBBCenterWS, mBBHalfWS * halfScale, xformedPos, setup);
+}
+
+bool TransformedAABBoxSSE::TransformBoxWS(const float3 &center, const float3 &half, __m128 xformedPos[], const BoxTestSetupSSE &setup)
+{
+	const __m128 *pMatrix = setup.mViewProjViewport;
+
+	__m128 vCenter = _mm_setr_ps(center.x, center.y, center.z, 0.0f);
+	__m128 vHalf   = _mm_setr_ps(half.x, half.y, half.z, 0.0f);
 
 	__m128 vMin    = _mm_sub_ps(vCenter, vHalf);
 	__m128 vMax    = _mm_add_ps(vCenter, vHalf);
 
 	// transforms
 	__m128 xRow[2], yRow[2], zRow[2];
-	xRow[0] = _mm_shuffle_ps(vMin, vMin, 0x00) * cumulativeMatrix[0];
-	xRow[1] = _mm_shuffle_ps(vMax, vMax, 0x00) * cumulativeMatrix[0];
-	yRow[0] = _mm_shuffle_ps(vMin, vMin, 0x55) * cumulativeMatrix[1];
-	yRow[1] = _mm_shuffle_ps(vMax, vMax, 0x55) * cumulativeMatrix[1];
-	zRow[0] = _mm_shuffle_ps(vMin, vMin, 0xaa) * cumulativeMatrix[2];
-	zRow[1] = _mm_shuffle_ps(vMax, vMax, 0xaa) * cumulativeMatrix[2];
+	xRow[0] = _mm_shuffle_ps(vMin, vMin, 0x00) * pMatrix[0];
+	xRow[1] = _mm_shuffle_ps(vMax, vMax, 0x00) * pMatrix[0];
+	yRow[0] = _mm_shuffle_ps(vMin, vMin, 0x55) * pMatrix[1];
+	yRow[1] = _mm_shuffle_ps(vMax, vMax, 0x55) * pMatrix[1];
+	zRow[0] = _mm_shuffle_ps(vMin, vMin, 0xaa) * pMatrix[2];
+	zRow[1] = _mm_shuffle_ps(vMax, vMax, 0xaa) * pMatrix[2];
 
 	__m128 zAllIn = _mm_castsi128_ps(_mm_set1_epi32(~0));
 
 	for(UINT i = 0; i < AABB_VERTICES; i++)
 	{
 		// Transform the vertex
-		__m128 vert = cumulativeMatrix[3];
+		__m128 vert = pMatrix[3];
 		vert += xRow[sBBxInd[i]];
 		vert += yRow[sBByInd[i]];
 		vert += zRow[sBBzInd[i]];
@@ -139,194 +304,251 @@ bool TransformedAABBoxSSE::TransformAABBox(__m128 xformedPos[], const __m128 cum
 	return _mm_movemask_ps(zAllIn) == 0xf;
 }
 
-void TransformedAABBoxSSE::Gather(vFloat4 pOut[3], UINT triId, const __m128 xformedPos[], UINT idx)
+//----------------------------------------------------------------------------
+// Determine if the occluddee size is too small and if so avoid drawing it
+//----------------------------------------------------------------------------
+bool TransformedAABBoxSSE::IsTooSmall(const BoxTestSetupSSE &setup, __m128 cumulativeMatrix[4])
 {
-	for(int i = 0; i < 3; i++)
+	__m128 worldMatrix[4];
+	worldMatrix[0] = _mm_loadu_ps(mWorldMatrix.r0.f);
+	worldMatrix[1] = _mm_loadu_ps(mWorldMatrix.r1.f);
+	worldMatrix[2] = _mm_loadu_ps(mWorldMatrix.r2.f);
+	worldMatrix[3] = _mm_loadu_ps(mWorldMatrix.r3.f);
+	MatrixMultiply(worldMatrix, setup.mViewProjViewport, cumulativeMatrix);
+	
+	float w = mBBCenter.x * cumulativeMatrix[0].m128_f32[3] + 
+		      mBBCenter.y * cumulativeMatrix[1].m128_f32[3] + 
+			  mBBCenter.z * cumulativeMatrix[2].m128_f32[3] + 
+			  cumulativeMatrix[3].m128_f32[3];
+
+	if( w > 1.0f )
 	{
-		UINT ind0 = sBBIndexList[triId*3 + i + 0];
-		UINT ind1 = sBBIndexList[triId*3 + i + 3];
-		UINT ind2 = sBBIndexList[triId*3 + i + 6];
-		UINT ind3 = sBBIndexList[triId*3 + i + 9];
-
-		__m128 v0 = xformedPos[ind0];	// x0 y0 z0 w0
-		__m128 v1 = xformedPos[ind1];	// x1 y1 z1 w1
-		__m128 v2 = xformedPos[ind2];	// x2 y2 z2 w2
-		__m128 v3 = xformedPos[ind3];	// x3 y3 z3 w3
-		_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
-		pOut[i].X = v0;
-		pOut[i].Y = v1;
-		pOut[i].Z = v2;
-		pOut[i].W = v3;
+		return mRadiusSq < w * setup.radiusThreshold;
 	}
+	return false;
 }
 
 //-----------------------------------------------------------------------------------------
-// Rasterize the occludee AABB and depth test it against the CPU rasterized depth buffer
-// If any of the rasterized AABB pixels passes the depth test exit early and mark the occludee
-// as visible. If all rasterized AABB pixels are occluded then the occludee is culled
+// Rasterize the silhouette of the occludee AABB at the depth of its nearest corner and depth 
+// test it against the CPU rasterized depth buffer. That covers the same pixels as the 12 box
+// triangles with a single polygon and no back faces.
+// If any of the rasterized pixels passes the depth test exit early and mark the occludee
+// as visible. If all rasterized pixels are occluded then the occludee is culled
 //-----------------------------------------------------------------------------------------
-bool TransformedAABBoxSSE::RasterizeAndDepthTestAABBox(UINT *pRenderTargetPixels, const __m128 pXformedPos[], UINT idx)
+bool TransformedAABBoxSSE::RasterizeAndDepthTestAABBox(UINT *pRenderTargetPixels, const __m128 pXformedPos[], UINT idx, OccludeeCounters *pCounters)
 {
 	// Set DAZ and FZ MXCSR bits to flush denormals to zero (i.e., make it faster)
 	// Denormal are zero (DAZ) is bit 6 and Flush to zero (FZ) is bit 15. 
 	// so to enable the two to have to set bits 6 and 15 which 1000 0000 0100 0000 = 0x8040
 	_mm_setcsr( _mm_getcsr() | 0x8040 );
 
-	__m128i colOffset = _mm_setr_epi32(0, 1, 0, 1);
-	__m128i rowOffset = _mm_setr_epi32(0, 0, 1, 1);
-
 	float* pDepthBuffer = (float*)pRenderTargetPixels; 
-	
-	// Rasterize the AABB triangles 4 at a time
-	for(UINT i = 0; i < AABB_TRIANGLES; i += SSE)
+
+	// use fixed-point only for X and Y. We have inverted z, the nearest corner has the largest z
+	int fxPtX[AABB_VERTICES], fxPtY[AABB_VERTICES];
+	__m128 zMax = pXformedPos[0];
+	for(UINT i = 0; i < AABB_VERTICES; i++)
 	{
-		vFloat4 xformedPos[3];
-		Gather(xformedPos, i, pXformedPos, idx);
+		__m128i fxPt = _mm_cvtps_epi32(pXformedPos[i]);
+		fxPtX[i] = fxPt.m128i_i32[0];
+		fxPtY[i] = fxPt.m128i_i32[1];
+		zMax = _mm_max_ps(zMax, pXformedPos[i]);
+	}
+	__m128 zz = _mm_shuffle_ps(zMax, zMax, 0xaa);
+
+	// Use bounding box traversal strategy to determine which pixels to rasterize 
+	int minX = fxPtX[0], maxX = fxPtX[0], minY = fxPtY[0], maxY = fxPtY[0];
+	for(UINT i = 1; i < AABB_VERTICES; i++)
+	{
+		minX = min(minX, fxPtX[i]);
+		maxX = max(maxX, fxPtX[i]);
+		minY = min(minY, fxPtY[i]);
+		maxY = max(maxY, fxPtY[i]);
+	}
+	int startXx = max(minX, 0) & ~1;
+	int endXx   = min(maxX, SCREENW - 1);
+	int startYy = max(minY, 0) & ~1;
+	int endYy   = min(maxY, SCREENH - 1);
 
-		// use fixed-point only for X and Y.  Avoid work for Z and W.
-        __m128i fxPtX[3], fxPtY[3];
-		for(int m = 0; m < 3; m++)
+	// Setting up the silhouette edges costs more than it saves for small boxes
+	if((endXx - startXx) * (endYy - startYy) < OCCLUDEE_RECT_TEST_AREA)
+	{
+		return DepthTestRect(pDepthBuffer, startXx, endXx, startYy, endYy, zz, pCounters);
+	}
+
+	int hullX[2 * AABB_VERTICES], hullY[2 * AABB_VERTICES];
+	UINT numEdges = ComputeSilhouette(fxPtX, fxPtY, hullX, hullY);
+
+	// Skip the box if its silhouette has no area
+	if(numEdges < 3)
+	{
+		if(pCounters)
+		{
+			pCounters->AddBoxTest(startYy, startYy, startYy); // no rows
+		}
+		return false;
+	}
+
+	__m128i sumRow[2 * AABB_VERTICES], aaInc[2 * AABB_VERTICES], bbInc[2 * AABB_VERTICES];
+	SetupSilhouetteEdges(hullX, hullY, numEdges, startXx, startYy, sumRow, aaInc, bbInc);
+
+	// Tranverse pixels in 2x2 blocks and store 2x2 pixel quad depths contiguously in memory ==> 2*X
+	int	rowIdx = (startYy * SCREENW + 2 * startXx);
+
+	// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY)
+	for(int r = startYy; r < endYy; r += 2, rowIdx += 2 * SCREENW)
+	{
+		__m128i sum[2 * AABB_VERTICES];
+		for(UINT e = 0; e < numEdges; e++)
 		{
-			fxPtX[m] = _mm_cvtps_epi32(xformedPos[m].X);
-			fxPtY[m] = _mm_cvtps_epi32(xformedPos[m].Y);
+			sum[e] = sumRow[e];
+			sumRow[e] = _mm_add_epi32(sumRow[e], bbInc[e]);
 		}
 
-		// Fab(x, y) =     Ax       +       By     +      C              = 0
-		// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
-		// Compute A = (ya - yb) for the 3 line segments that make up each triangle
-		__m128i A0 = _mm_sub_epi32(fxPtY[1], fxPtY[2]);
-		__m128i A1 = _mm_sub_epi32(fxPtY[2], fxPtY[0]);
-		__m128i A2 = _mm_sub_epi32(fxPtY[0], fxPtY[1]);
-
-		// Compute B = (xb - xa) for the 3 line segments that make up each triangle
-		__m128i B0 = _mm_sub_epi32(fxPtX[2], fxPtX[1]);
-		__m128i B1 = _mm_sub_epi32(fxPtX[0], fxPtX[2]);
-		__m128i B2 = _mm_sub_epi32(fxPtX[1], fxPtX[0]);
-
-		// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
-		__m128i C0 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[1], fxPtY[2]), _mm_mullo_epi32(fxPtX[2], fxPtY[1]));
-		__m128i C1 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[2], fxPtY[0]), _mm_mullo_epi32(fxPtX[0], fxPtY[2]));
-		__m128i C2 = _mm_sub_epi32(_mm_mullo_epi32(fxPtX[0], fxPtY[1]), _mm_mullo_epi32(fxPtX[1], fxPtY[0]));
-
-		// Compute triangle area
-		__m128i triArea = _mm_mullo_epi32(B2, A1);
-		triArea = _mm_sub_epi32(triArea, _mm_mullo_epi32(B1, A2));
-		__m128 oneOverTriArea = _mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(triArea));
-
-		__m128 Z[3];
-		Z[0] = xformedPos[0].Z;
-		Z[1] = _mm_mul_ps(_mm_sub_ps(xformedPos[1].Z, Z[0]), oneOverTriArea);
-		Z[2] = _mm_mul_ps(_mm_sub_ps(xformedPos[2].Z, Z[0]), oneOverTriArea);
-		
-		// Use bounding box traversal strategy to determine which pixels to rasterize 
-		__m128i startX =  _mm_and_si128(Max(Min(Min(fxPtX[0], fxPtX[1]), fxPtX[2]),  _mm_set1_epi32(0)), _mm_set1_epi32(~1));
-		__m128i endX   = Min(Max(Max(fxPtX[0], fxPtX[1]), fxPtX[2]), _mm_set1_epi32(SCREENW - 1));
-
-		__m128i startY = _mm_and_si128(Max(Min(Min(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(0)), _mm_set1_epi32(~1));
-		__m128i endY   = Min(Max(Max(fxPtY[0], fxPtY[1]), fxPtY[2]), _mm_set1_epi32(SCREENH - 1));
-
-		// Now we have 4 triangles set up.  Rasterize them each individually.
-        for(int lane=0; lane < SSE; lane++)
-        {
-			// Skip triangle if area is zero 
-			if(triArea.m128i_i32[lane] <= 0)
+		int index = rowIdx;
+		__m128i anyOut = _mm_setzero_si128();
+		for(int c = startXx; c < endXx; c += 2, index += 4)
+		{
+			//Test Pixel inside the silhouette
+			__m128i mask = sum[0];
+			sum[0] = _mm_add_epi32(sum[0], aaInc[0]);
+			for(UINT e = 1; e < numEdges; e++)
+			{
+				mask = _mm_or_si128(mask, sum[e]);
+				sum[e] = _mm_add_epi32(sum[e], aaInc[e]);
+			}
+
+			__m128 previousDepthValue = _mm_load_ps(&pDepthBuffer[index]);
+			__m128 depthMask  = _mm_cmpge_ps(zz, previousDepthValue);
+			__m128i finalMask = _mm_andnot_si128(mask, _mm_castps_si128(depthMask));
+			anyOut = _mm_or_si128(anyOut, finalMask);
+		}//for each column	
+
+		if(!_mm_testz_si128(anyOut, _mm_set1_epi32(0x80000000)))
+		{
+			if(pCounters)
 			{
-				continue;
+				pCounters->AddBoxTest(startYy, endYy, r);
 			}
+			return true; //early exit
+		}
+	}// for each row
+
+	if(pCounters)
+	{
+		pCounters->AddBoxTest(startYy, endYy, endYy);
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------------------
+// Depth test the screen rectangle of the occludee AABB at the depth of its nearest corner.
+// Conservative since the rectangle covers the silhouette; used for boxes small enough that
+// testing the extra pixels is cheaper than rasterizing the silhouette
+//-----------------------------------------------------------------------------------------
+bool TransformedAABBoxSSE::DepthTestRect(const float *pDepthBuffer, int startXx, int endXx, int startYy, int endYy, __m128 zz, OccludeeCounters *pCounters)
+{
+	// Tranverse pixels in 2x2 blocks and store 2x2 pixel quad depths contiguously in memory ==> 2*X
+	int	rowIdx = (startYy * SCREENW + 2 * startXx);
+	for(int r = startYy; r < endYy; r += 2, rowIdx += 2 * SCREENW)
+	{
+		int index = rowIdx;
+		__m128 anyOut = _mm_setzero_ps();
+		for(int c = startXx; c < endXx; c += 2, index += 4)
+		{
+			__m128 previousDepthValue = _mm_load_ps(&pDepthBuffer[index]);
+			anyOut = _mm_or_ps(anyOut, _mm_cmpge_ps(zz, previousDepthValue));
+		}
 
-			// Extract this triangle's properties from the SIMD versions
-            __m128 zz[3];
-			for(int vv = 0; vv < 3; vv++)
+		if(_mm_movemask_ps(anyOut))
+		{
+			if(pCounters)
 			{
-				zz[vv] = _mm_set1_ps(Z[vv].m128_f32[lane]);
+				pCounters->AddBoxTest(startYy, endYy, r);
 			}
+			return true; //early exit
+		}
+	}
+	if(pCounters)
+	{
+		pCounters->AddBoxTest(startYy, endYy, endYy);
+	}
+	return false;
+}
 
-			int startXx = startX.m128i_i32[lane];
-			int endXx	= endX.m128i_i32[lane];
-			int startYy = startY.m128i_i32[lane];
-			int endYy	= endY.m128i_i32[lane];
-		
-			__m128i aa0 = _mm_set1_epi32(A0.m128i_i32[lane]);
-			__m128i aa1 = _mm_set1_epi32(A1.m128i_i32[lane]);
-			__m128i aa2 = _mm_set1_epi32(A2.m128i_i32[lane]);
-
-			__m128i bb0 = _mm_set1_epi32(B0.m128i_i32[lane]);
-			__m128i bb1 = _mm_set1_epi32(B1.m128i_i32[lane]);
-			__m128i bb2 = _mm_set1_epi32(B2.m128i_i32[lane]);
-
-			__m128i aa0Inc = _mm_slli_epi32(aa0, 1);
-			__m128i aa1Inc = _mm_slli_epi32(aa1, 1);
-			__m128i aa2Inc = _mm_slli_epi32(aa2, 1);
-
-			__m128i bb0Inc = _mm_slli_epi32(bb0, 1);
-			__m128i bb1Inc = _mm_slli_epi32(bb1, 1);
-			__m128i bb2Inc = _mm_slli_epi32(bb2, 1);
-
-			__m128i row, col;
-
-			// Tranverse pixels in 2x2 blocks and store 2x2 pixel quad depths contiguously in memory ==> 2*X
-			// This method provides better perfromance
-			int	rowIdx = (startYy * SCREENW + 2 * startXx);
-
-			col = _mm_add_epi32(colOffset, _mm_set1_epi32(startXx));
-			__m128i aa0Col = _mm_mullo_epi32(aa0, col);
-			__m128i aa1Col = _mm_mullo_epi32(aa1, col);
-			__m128i aa2Col = _mm_mullo_epi32(aa2, col);
-
-			row = _mm_add_epi32(rowOffset, _mm_set1_epi32(startYy));
-			__m128i bb0Row = _mm_add_epi32(_mm_mullo_epi32(bb0, row), _mm_set1_epi32(C0.m128i_i32[lane]));
-			__m128i bb1Row = _mm_add_epi32(_mm_mullo_epi32(bb1, row), _mm_set1_epi32(C1.m128i_i32[lane]));
-			__m128i bb2Row = _mm_add_epi32(_mm_mullo_epi32(bb2, row), _mm_set1_epi32(C2.m128i_i32[lane]));
-
-			__m128i sum0Row = _mm_add_epi32(aa0Col, bb0Row);
-			__m128i sum1Row = _mm_add_epi32(aa1Col, bb1Row);
-			__m128i sum2Row = _mm_add_epi32(aa2Col, bb2Row);
-
-			__m128 zx = _mm_mul_ps(_mm_cvtepi32_ps(aa1Inc), zz[1]);
-			zx = _mm_add_ps(zx, _mm_mul_ps(_mm_cvtepi32_ps(aa2Inc), zz[2]));
-
-			// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY)
-			for(int r = startYy; r < endYy; r += 2,
-											rowIdx += 2 * SCREENW,
-											sum0Row = _mm_add_epi32(sum0Row, bb0Inc),
-											sum1Row = _mm_add_epi32(sum1Row, bb1Inc),
-											sum2Row = _mm_add_epi32(sum2Row, bb2Inc))
+//-----------------------------------------------------------------------------------------
+// Rasterize the silhouette of an occludee proxy box into the part of the depth buffer in 
+// the tile (tileStartX, tileStartY) .. (tileEndX, tileEndY). The silhouette is written at
+// the depth of the box's farthest corner so it never occludes more than the box itself
+//-----------------------------------------------------------------------------------------
+void TransformedAABBoxSSE::RasterizeProxyToDepthBuffer(UINT *pRenderTargetPixels, const __m128 pXformedPos[], int tileStartX, int tileEndX, int tileStartY, int tileEndY)
+{
+	float* pDepthBuffer = (float*)pRenderTargetPixels; 
+
+	// use fixed-point only for X and Y. We have inverted z, the farthest corner has the smallest z
+	int fxPtX[AABB_VERTICES], fxPtY[AABB_VERTICES];
+	__m128 zMin = pXformedPos[0];
+	for(UINT i = 0; i < AABB_VERTICES; i++)
+	{
+		__m128i fxPt = _mm_cvtps_epi32(pXformedPos[i]);
+		fxPtX[i] = fxPt.m128i_i32[0];
+		fxPtY[i] = fxPt.m128i_i32[1];
+		zMin = _mm_min_ps(zMin, pXformedPos[i]);
+	}
+	__m128 zz = _mm_shuffle_ps(zMin, zMin, 0xaa);
+
+	int minX = fxPtX[0], maxX = fxPtX[0], minY = fxPtY[0], maxY = fxPtY[0];
+	for(UINT i = 1; i < AABB_VERTICES; i++)
+	{
+		minX = min(minX, fxPtX[i]);
+		maxX = max(maxX, fxPtX[i]);
+		minY = min(minY, fxPtY[i]);
+		maxY = max(maxY, fxPtY[i]);
+	}
+	int startXx = max(minX, tileStartX) & ~1;
+	int endXx   = min(maxX + 1, tileEndX);
+	int startYy = max(minY, tileStartY) & ~1;
+	int endYy   = min(maxY + 1, tileEndY);
+	if(startXx >= endXx || startYy >= endYy)
+	{
+		return;
+	}
+
+	int hullX[2 * AABB_VERTICES], hullY[2 * AABB_VERTICES];
+	UINT numEdges = ComputeSilhouette(fxPtX, fxPtY, hullX, hullY);
+	if(numEdges < 3)
+	{
+		return;
+	}
+
+	float* pDepthBuffer = (float*)pRenderTargetPixels; 
+
+	// use fixed-point only for X and Y. We have inverted z, the farthest corner has the smallest z
+	int	rowIdx = (startYy * SCREENW + 2 * startXx);
+	for(int r = startYy; r < endYy; r += 2, rowIdx += 2 * SCREENW)
+	{
+		__m128i sum[2 * AABB_VERTICES];
+		for(UINT e = 0; e < numEdges; e++)
+		{
+			sum[e] = sumRow[e];
+			sumRow[e] = _mm_add_epi32(sumRow[e], bbInc[e]);
+		}
+
+		int index = rowIdx;
+		for(int c = startXx; c < endXx; c += 2, index += 4)
+		{
+			// Sign bit set for the pixels outside the silhouette
+			__m128i mask = sum[0];
+			sum[0] = _mm_add_epi32(sum[0], aaInc[0]);
+			for(UINT e = 1; e < numEdges; e++)
 			{
-				// Compute barycentric coordinates 
-				int index = rowIdx;
-				__m128i alpha = sum0Row;
-				__m128i beta = sum1Row;
-				__m128i gama = sum2Row;
-
-				//Compute barycentric-interpolated depth
-				__m128 depth = zz[0];
-				depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(beta), zz[1]));
-				depth = _mm_add_ps(depth, _mm_mul_ps(_mm_cvtepi32_ps(gama), zz[2]));
-				__m128i anyOut = _mm_setzero_si128();
-
-				for(int c = startXx; c < endXx; c += 2,
-												index += 4,
-												alpha = _mm_add_epi32(alpha, aa0Inc),
-												beta  = _mm_add_epi32(beta, aa1Inc),
-												gama  = _mm_add_epi32(gama, aa2Inc),
-												depth = _mm_add_ps(depth, zx))
-				{
-					//Test Pixel inside triangle
-					__m128i mask = _mm_or_si128(_mm_or_si128(alpha, beta), gama);
-					
-					__m128 previousDepthValue = _mm_load_ps(&pDepthBuffer[index]);
-					__m128 depthMask  = _mm_cmpge_ps(depth, previousDepthValue);
-					__m128i finalMask = _mm_andnot_si128(mask, _mm_castps_si128(depthMask));
-					anyOut = _mm_or_si128(anyOut, finalMask);
-				}//for each column	
-				
-				if(!_mm_testz_si128(anyOut, _mm_set1_epi32(0x80000000)))
-				{
-					return true; //early exit
-				}
-			}// for each row
-		}// for each triangle
-	}// for each set of SIMD# triangles
+				mask = _mm_or_si128(mask, sum[e]);
+				sum[e] = _mm_add_epi32(sum[e], aaInc[e]);
+			}
 
-	return false;
-}
\ No newline at end of file
+			__m128 previousDepthValue = _mm_load_ps(&pDepthBuffer[index]);
+			__m128 mergedDepth = _mm_max_ps(zz, previousDepthValue);
+			_mm_store_ps(&pDepthBuffer[index], _mm_blendv_ps(mergedDepth, previousDepthValue, _mm_castsi128_ps(mask)));
+		}//for each column
+	}// for each row
+}
@@ -21,17 +21,35 @@
 
 #include "CPUT_DX11.h"
 #include "Constants.h"
+#include "CullingStats.h"
 #include "HelperSSE.h"
 
+class CullingScene;
+
 class TransformedAABBoxSSE : public HelperSSE
 {
 	public:
 		void CreateAABBVertexIndexList(CPUTModelDX11 *pModel);
+		// Box of an occluder of a scene without CPUT models
+		void CreateAABBVertexIndexList(const CullingScene &scene, UINT occluderId);
+		// Box of an occludee of a scene without CPUT models, with the scene's proxy scale
+		void CreateOccludeeBox(const CullingScene &scene, UINT occludeeId);
 		bool IsInsideViewFrustum(CPUTCamera *pCamera);
-		bool TransformAABBox(__m128 xformedPos[], const __m128 cumulativeMatrix[4]);
-		bool RasterizeAndDepthTestAABBox(UINT *pRenderTargetPixels, const __m128 pXformedPos[], UINT idx);
+		bool TransformAABBoxWS(__m128 xformedPos[], const BoxTestSetupSSE &setup, float halfScale);
+		// Same for any world space box, such as the bounds of a subtree of occludees
+		static bool TransformBoxWS(const float3 &center, const float3 &half, __m128 xformedPos[], const BoxTestSetupSSE &setup);
+		// pCounters, if given, counts the test and the quad rows it visited. Only uses the
+		// screen space corners, so it tests the bounds of a group of occludees as well
+		static bool RasterizeAndDepthTestAABBox(UINT *pRenderTargetPixels, const __m128 pXformedPos[], UINT idx, OccludeeCounters *pCounters = NULL);
+		void RasterizeProxyToDepthBuffer(UINT *pRenderTargetPixels, const __m128 pXformedPos[], int tileStartX, int tileEndX, int tileStartY, int tileEndY);
 
 		bool IsTooSmall(const BoxTestSetupSSE &setup, __m128 cumulativeMatrix[4]);
+
+		inline const float3 &GetCenterWS() const {return mBBCenterWS;}
+		inline const float3 &GetHalfWS() const {return mBBHalfWS;}
+		// Scale of the world space AABB, shrunk around its center, that is inside the
+		// model and can stand in for it as an occluder. 0 if there is no such box
+		inline float GetProxyScale() const {return mProxyScale;}
 		
 	private:
 		CPUTModelDX11 *mpCPUTModel;
@@ -43,8 +61,11 @@ class TransformedAABBoxSSE : public HelperSSE
 		
 		float3 mBBCenterWS;
 		float3 mBBHalfWS;
+		float  mProxyScale;
+
+		void ComputeProxyScale(CPUTModelDX11 *pModel);
 
-		void Gather(vFloat4 pOut[3], UINT triId, const __m128 xformedPos[], UINT idx);
+		static bool DepthTestRect(const float *pDepthBuffer, int startXx, int endXx, int startYy, int endYy, __m128 zz, OccludeeCounters *pCounters);
 };
 
 
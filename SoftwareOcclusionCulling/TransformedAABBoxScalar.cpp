@@ -16,33 +16,8 @@
 //--------------------------------------------------------------------------------------
 
 #include "TransformedAABBoxScalar.h"
-
-static const UINT sBBIndexList[AABB_INDICES] =
-{
-	// index for top 
-	1, 3, 2,
-	0, 3, 1,
-
-	// index for bottom
-	5, 7, 4,
-	6, 7, 5,
-
-	// index for left
-	1, 7, 6,
-	2, 7, 1,
-
-	// index for right
-	3, 5, 4,
-	0, 5, 3,
-
-	// index for back
-	2, 4, 7,
-	3, 4, 2,
-
-	// index for front
-	0, 6, 5,
-	1, 6, 0,
-};
+#include "AABBoxSilhouette.h"
+#include "CullingScene.h"
 
 // 0 = use min corner, 1 = use max corner
 static const UINT sBBxInd[AABB_VERTICES] = { 1, 0, 0, 1, 1, 1, 0, 0 };
@@ -61,6 +36,16 @@ void TransformedAABBoxScalar::CreateAABBVertexIndexList(CPUTModelDX11 *pModel)
 	pModel->GetBoundsWorldSpace(&mBBCenterWS, &mBBHalfWS);	
 }
 
+void TransformedAABBoxScalar::CreateOccludeeBox(const CullingScene &scene, UINT occludeeId)
+{
+	mWorldMatrix = scene.GetOccludeeWorldMatrix(occludeeId);
+	mBBCenter = scene.GetOccludeeCenterOS(occludeeId);
+	mBBHalf = scene.GetOccludeeHalfOS(occludeeId);
+	mRadiusSq = mBBHalf.lengthSq();
+	mBBCenterWS = scene.GetOccludeeCenters()[occludeeId];
+	mBBHalfWS = scene.GetOccludeeHalves()[occludeeId];
+}
+
 //----------------------------------------------------------------
 // Determine is model is inside view frustum
 //----------------------------------------------------------------
@@ -124,121 +109,93 @@ bool TransformedAABBoxScalar::TransformAABBox(float4 xformedPos[], const float4x
 	return zAllIn;
 }
 
-void TransformedAABBoxScalar::Gather(float4 pOut[3], UINT triId, const float4 xformedPos[])
-{
-	for(UINT i = 0; i < 3; i++)
-	{
-		UINT index = sBBIndexList[(triId * 3) + i];
-		pOut[i] = xformedPos[index];	
-	}
-}
-
 //-----------------------------------------------------------------------------------------
-// Rasterize the occludee AABB and depth test it against the CPU rasterized depth buffer
-// If any of the rasterized AABB pixels passes the depth test exit early and mark the occludee
-// as visible. If all rasterized AABB pixels are occluded then the occludee is culled
+// Rasterize the silhouette of the occludee AABB at the depth of its nearest corner and depth 
+// test it against the CPU rasterized depth buffer. That covers the same pixels as the 12 box
+// triangles with a single polygon and no back faces.
+// If any of the rasterized pixels passes the depth test exit early and mark the occludee
+// as visible. If all rasterized pixels are occluded then the occludee is culled
 //-----------------------------------------------------------------------------------------
 bool TransformedAABBoxScalar::RasterizeAndDepthTestAABBox(UINT *pRenderTargetPixels, const float4 pXformedPos[], UINT idx)
 {
 	float* pDepthBuffer = (float*)pRenderTargetPixels; 
-	
-	// Rasterize the AABB triangles
-	for(UINT i = 0; i < AABB_TRIANGLES; i++)
-	{
-		float4 xformedPos[3];
-		Gather(xformedPos, i, pXformedPos);
-
-		int fxPtX[3], fxPtY[3];
-		float Z[3];
-		for(UINT j = 0; j < 3; j++)
-		{
-			fxPtX[j] = (int)(xformedPos[j].x + 0.5);
-			fxPtY[j] = (int)(xformedPos[j].y + 0.5);
-			Z[j] = xformedPos[j].z;
-		}
-
-		// Fab(x, y) =     Ax       +       By     +      C              = 0
-		// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
-		// Compute A = (ya - yb) for the 3 line segments that make up each triangle
-		int A0 = fxPtY[1] - fxPtY[2];
-		int A1 = fxPtY[2] - fxPtY[0];
-		int A2 = fxPtY[0] - fxPtY[1];
 
-		// Compute B = (xb - xa) for the 3 line segments that make up each triangle
-		int B0 = fxPtX[2] - fxPtX[1];
-		int B1 = fxPtX[0] - fxPtX[2];
-		int B2 = fxPtX[1] - fxPtX[0];
-
-		// Compute C = (xa * yb - xb * ya) for the 3 line segments that make up each triangle
-		int C0 = fxPtX[1] * fxPtY[2] - fxPtX[2] * fxPtY[1];
-		int C1 = fxPtX[2] * fxPtY[0] - fxPtX[0] * fxPtY[2];
-		int C2 = fxPtX[0] * fxPtY[1] - fxPtX[1] * fxPtY[0];
+	// We have inverted z, the nearest corner has the largest z
+	int fxPtX[AABB_VERTICES], fxPtY[AABB_VERTICES];
+	float depth = pXformedPos[0].z;
+	for(UINT i = 0; i < AABB_VERTICES; i++)
+	{
+		fxPtX[i] = (int)(pXformedPos[i].x + 0.5);
+		fxPtY[i] = (int)(pXformedPos[i].y + 0.5);
+		depth = max(depth, pXformedPos[i].z);
+	}
 
-		// Compute triangle area
-		int triArea = (fxPtX[1] - fxPtX[0]) * (fxPtY[2] - fxPtY[0]) - (fxPtX[0] - fxPtX[2]) * (fxPtY[0] - fxPtY[1]);
-		float oneOverTriArea = (1.0f/float(triArea));
+	int hullX[2 * AABB_VERTICES], hullY[2 * AABB_VERTICES];
+	UINT numEdges = ComputeSilhouette(fxPtX, fxPtY, hullX, hullY);
 
-		Z[1] = (Z[1] - Z[0]) * oneOverTriArea;
-		Z[2] = (Z[2] - Z[0]) * oneOverTriArea;
+	// Skip the box if its silhouette has no area
+	if(numEdges < 3)
+	{
+		return false;
+	}
 
-		// Use bounding box traversal strategy to determine which pixels to rasterize 
-		int startX = max(min(min(fxPtX[0], fxPtX[1]), fxPtX[2]), 0) & int(0xFFFFFFFE);
-		int endX   = min(max(max(fxPtX[0], fxPtX[1]), fxPtX[2]), SCREENW-1);
+	// Use bounding box traversal strategy to determine which pixels to rasterize 
+	int minX = hullX[0], maxX = hullX[0], minY = hullY[0], maxY = hullY[0];
+	for(UINT e = 1; e < numEdges; e++)
+	{
+		minX = min(minX, hullX[e]);
+		maxX = max(maxX, hullX[e]);
+		minY = min(minY, hullY[e]);
+		maxY = max(maxY, hullY[e]);
+	}
+	int startX = max(minX, 0) & int(0xFFFFFFFE);
+	int endX   = min(maxX, SCREENW-1);
+	int startY = max(minY, 0) & int(0xFFFFFFFE);
+	int endY   = min(maxY, SCREENH-1);
+
+	// Fab(x, y) =     Ax       +       By     +      C              = 0
+	// Fab(x, y) = (ya - yb)x   +   (xb - xa)y + (xa * yb - xb * ya) = 0
+	// for every edge of the silhouette, evaluated at (startX, startY)
+	int A[2 * AABB_VERTICES], B[2 * AABB_VERTICES], sumRow[2 * AABB_VERTICES];
+	for(UINT e = 0; e < numEdges; e++)
+	{
+		A[e] = hullY[e] - hullY[e + 1];
+		B[e] = hullX[e + 1] - hullX[e];
+		int C = hullX[e] * hullY[e + 1] - hullX[e + 1] * hullY[e];
+		sumRow[e] = (A[e] * startX) + (B[e] * startY) + C;
+	}
 
-		int startY = max(min(min(fxPtY[0], fxPtY[1]), fxPtY[2]), 0) & int(0xFFFFFFFE);
-		int endY   = min(max(max(fxPtY[0], fxPtY[1]), fxPtY[2]), SCREENH-1);
+	int rowIdx = (startY * SCREENW + startX);
 
-		//Skip triangle if area is zero 
-		if(triArea <= 0)
+	// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY)
+	for(int r = startY; r < endY; r++, rowIdx = rowIdx + SCREENW)
+	{
+		int sum[2 * AABB_VERTICES];
+		for(UINT e = 0; e < numEdges; e++)
 		{
-			continue;
+			sum[e] = sumRow[e];
+			sumRow[e] += B[e];
 		}
 
-		int rowIdx = (startY * SCREENW + startX);
-		int col = startX;
-		int row = startY;
-		
-		int alpha0 = (A0 * col) + (B0 * row) + C0;
-		int beta0 = (A1 * col) + (B1 * row) + C1;
-		int gama0 = (A2 * col) + (B2 * row) + C2;
-		
-		float zx = A1 * Z[1] + A2 * Z[2];
-
-		// Incrementally compute Fab(x, y) for all the pixels inside the bounding box formed by (startX, endX) and (startY, endY)
-		for(int r = startY; r < endY; r++,
-									  row++,
-									  rowIdx = rowIdx + SCREENW,
-									  alpha0 += B0,
-									  beta0 += B1,
-									  gama0 += B2)									 
+		int index = rowIdx;
+		bool anyOut = false;
+		for(int c = startX; c < endX; c++, index++)
 		{
-			// Compute barycentric coordinates 
-			int index = rowIdx;
-			int alpha = alpha0;
-			int beta = beta0;
-			int gama = gama0;
-			
-			float depth = Z[0] + Z[1] * beta + Z[2] * gama;
-			bool anyOut = false;
-
-			for(int c = startX; c < endX; c++,
-   										  index++,
-										  alpha = alpha + A0,
-										  beta  = beta  + A1,
-										  gama  = gama  + A2,
-										  depth += zx)
-			{
-				//Test Pixel inside triangle
-				int mask = alpha | beta | gama;
-				float previousDepthValue = pDepthBuffer[index];
-				anyOut = (mask > 0 && depth >= previousDepthValue) ? anyOut | true : anyOut | false;
-			}//for each column	
-			
-			if(anyOut)
+			//Test Pixel inside the silhouette
+			int mask = 0;
+			for(UINT e = 0; e < numEdges; e++)
 			{
-				return true;
-			}														
-		}// for each row
-	}// for each triangle
+				mask |= sum[e];
+				sum[e] += A[e];
+			}
+			float previousDepthValue = pDepthBuffer[index];
+			anyOut = (mask > 0 && depth >= previousDepthValue) ? anyOut | true : anyOut | false;
+		}//for each column	
+		
+		if(anyOut)
+		{
+			return true;
+		}														
+	}// for each row
 	return false;
 }
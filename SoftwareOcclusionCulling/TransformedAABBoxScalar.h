@@ -23,10 +23,14 @@
 #include "Constants.h"
 #include "HelperScalar.h"
 
+class CullingScene;
+
 class TransformedAABBoxScalar : public HelperScalar
 {
 	public:
 		void CreateAABBVertexIndexList(CPUTModelDX11 *pModel);
+		// Box of an occludee of a scene without CPUT models
+		void CreateOccludeeBox(const CullingScene &scene, UINT occludeeId);
 		bool IsInsideViewFrustum(CPUTCamera *pcamera);
 		bool TransformAABBox(float4 xformedPos[], const float4x4 &cumulativeMatrix);
 		bool RasterizeAndDepthTestAABBox(UINT *pRenderTargetPixels, const float4 pXformedPos[], UINT idx);
@@ -43,8 +47,6 @@ class TransformedAABBoxScalar : public HelperScalar
 
 		float3  mBBCenterWS;
 		float3  mBBHalfWS;
-
-		void Gather(float4 pOut[3], UINT triId, const float4 xformedPos[]);
 };
 
 
@@ -24,7 +24,10 @@ TransformedMeshSSE::TransformedMeshSSE()
 	  mpVertices(NULL),
 	  mpIndices(NULL)
 {
-	mpXformedPos[0] = mpXformedPos[1] = NULL;
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpXformedPos[i] = NULL;
+	}
 }
 
 TransformedMeshSSE::~TransformedMeshSSE()
@@ -41,6 +44,15 @@ void TransformedMeshSSE::Initialize(CPUTMeshDX11* pMesh)
 	mpIndices    = pMesh->GetIndices();
 }
 
+void TransformedMeshSSE::Initialize(Vertex *pVertices, UINT *pIndices, UINT numVertices, UINT numIndices)
+{
+	mNumVertices = numVertices;
+	mNumIndices  = numIndices;
+	mNumTriangles = numIndices / 3;
+	mpVertices   = pVertices;
+	mpIndices    = pIndices;
+}
+
 //-------------------------------------------------------------------
 // Trasforms the occluder vertices to screen space once every frame
 //-------------------------------------------------------------------
@@ -28,6 +28,8 @@ class TransformedMeshSSE : public HelperSSE
 		TransformedMeshSSE();
 		~TransformedMeshSSE();
 		void Initialize(CPUTMeshDX11* pMesh);
+		// Mesh whose vertices and indices are owned by the caller, e.g. a CullingScene
+		void Initialize(Vertex *pVertices, UINT *pIndices, UINT numVertices, UINT numIndices);
 		void TransformVertices(__m128 *cumulativeMatrix, 
 							   UINT start, 
 							   UINT end,
@@ -59,10 +61,9 @@ class TransformedMeshSSE : public HelperSSE
 
 		inline UINT GetNumTriangles() {return mNumTriangles;}
 		inline UINT GetNumVertices() {return mNumVertices;}
-		inline void SetXformedPos(__m128 *pXformedPos0, __m128 *pXformedPos1)
+		inline void SetXformedPos(__m128 *pXformedPos, UINT idx)
 		{
-			mpXformedPos[0] = pXformedPos0;
-			mpXformedPos[1] = pXformedPos1;
+			mpXformedPos[idx] = pXformedPos;
 		}
 	
 	private:
@@ -71,7 +72,7 @@ class TransformedMeshSSE : public HelperSSE
 		UINT mNumTriangles;
 		Vertex *mpVertices;
 		UINT *mpIndices;
-		__m128 *mpXformedPos[2]; 
+		__m128 *mpXformedPos[MAX_SLOTS]; 
 		
 		void Gather(vFloat4 pOut[3], UINT triId, UINT numLanes, UINT idx);
 };
@@ -28,6 +28,8 @@ class TransformedMeshScalar : public HelperScalar
 		TransformedMeshScalar();
 		~TransformedMeshScalar();
 		void Initialize(CPUTMeshDX11 *pMesh);
+		// Mesh whose vertices and indices are owned by the caller, e.g. a CullingScene
+		void Initialize(Vertex *pVertices, UINT *pIndices, UINT numVertices, UINT numIndices);
 		void TransformVertices(const float4x4& cumulativeMatrix, 
 							   UINT start, 
 							   UINT end,
@@ -59,10 +61,9 @@ class TransformedMeshScalar : public HelperScalar
 
 		inline UINT GetNumTriangles() {return mNumTriangles;}
 		inline UINT GetNumVertices() {return mNumVertices;}
-		inline void SetXformedPos(float4 *pXformedPos0, float4 *pXformedPos1)
+		inline void SetXformedPos(float4 *pXformedPos, UINT idx)
 		{
-			mpXformedPos[0] = pXformedPos0;
-			mpXformedPos[1] = pXformedPos1;
+			mpXformedPos[idx] = pXformedPos;
 		}
 	
 	private:
@@ -71,7 +72,7 @@ class TransformedMeshScalar : public HelperScalar
 		UINT mNumTriangles;
 		Vertex *mpVertices;
 		UINT *mpIndices;
-		float4 *mpXformedPos[2]; 
+		float4 *mpXformedPos[MAX_SLOTS]; 
 		
 		void Gather(float4 pOut[3], UINT triId, UINT idx);
 };
@@ -15,6 +15,7 @@
 //
 //--------------------------------------------------------------------------------------
 #include "TransformedModelSSE.h"
+#include "CullingScene.h"
 
 TransformedModelSSE::TransformedModelSSE()
 	: mpCPUTModel(NULL),
@@ -24,21 +25,22 @@ TransformedModelSSE::TransformedModelSSE()
 	  mNumTriangles(0),
 	  mpMeshes(NULL)
 {
-	mInsideViewFrustum[0] = mInsideViewFrustum[1] = false;
-	mTooSmall[0] = mTooSmall[1] = false;
-
-	mpXformedPos[0] = mpXformedPos[1] = NULL;
 	mWorldMatrix = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mCumulativeMatrix[0] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
-	mCumulativeMatrix[1] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mpXformedPos[i] = NULL;
+		mCumulativeMatrix[i] = (__m128*)_aligned_malloc(sizeof(float) * 4 * 4, 16);
+	}
 }
 
 TransformedModelSSE::~TransformedModelSSE()
 {
 	SAFE_DELETE_ARRAY(mpMeshes);
 	_aligned_free(mWorldMatrix);
-	_aligned_free(mCumulativeMatrix[0]);
-	_aligned_free(mCumulativeMatrix[1]);
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		_aligned_free(mCumulativeMatrix[i]);
+	}
 }
 
 //--------------------------------------------------------------------
@@ -58,7 +60,6 @@ void TransformedModelSSE::CreateTransformedMeshes(CPUTModelDX11 *pModel)
 	float3 center, half;
 	pModel->GetBoundsObjectSpace(&center, &half);
 
-	mBBCenterOS = center;
 	mRadiusSq = half.lengthSq();
 	mpMeshes = new TransformedMeshSSE[mNumMeshes];
 
@@ -73,89 +74,57 @@ void TransformedModelSSE::CreateTransformedMeshes(CPUTModelDX11 *pModel)
 	}
 }
 
-
-void TransformedModelSSE::TooSmall(const BoxTestSetupSSE &setup, UINT idx)
+void TransformedModelSSE::CreateTransformedMeshes(const CullingScene &scene, UINT occluderId)
 {
-	if(mInsideViewFrustum[idx])
-	{
-		MatrixMultiply(mWorldMatrix, setup.mViewProjViewport, mCumulativeMatrix[idx]);
+	mNumMeshes = 1;
 
-		float w = mBBCenterOS.x * mCumulativeMatrix[idx][0].m128_f32[3] +
-				  mBBCenterOS.y * mCumulativeMatrix[idx][1].m128_f32[3] +
-				  mBBCenterOS.z * mCumulativeMatrix[idx][2].m128_f32[3] +
-				  mCumulativeMatrix[idx][3].m128_f32[3]; 
+	const float4x4 &world = scene.GetOccluderWorldMatrix(occluderId);
+	mWorldMatrix[0] = _mm_loadu_ps(world.r0.f);
+	mWorldMatrix[1] = _mm_loadu_ps(world.r1.f);
+	mWorldMatrix[2] = _mm_loadu_ps(world.r2.f);
+	mWorldMatrix[3] = _mm_loadu_ps(world.r3.f);
 
-		if(w > 1.0f)
-		{
-			mTooSmall[idx] = mRadiusSq < w * setup.radiusThreshold;
-		}
-		else
-		{
-			// BB center is behind the near clip plane, making screen-space radius meaningless.
-            // Assume visible.  This should be a safe assumption, as the frustum test says the bbox is visible.
-            mTooSmall[idx] = false;
-        }
-	}
+	mRadiusSq = scene.GetOccluderHalfOS(occluderId).lengthSq();
+	mpMeshes = new TransformedMeshSSE[mNumMeshes];
+	mpMeshes[0].Initialize(scene.GetOccluderVertices(occluderId), scene.GetOccluderIndices(occluderId),
+						   scene.GetOccluderNumVertices(occluderId), scene.GetOccluderNumIndices(occluderId));
+	mNumVertices = mpMeshes[0].GetNumVertices();
+	mNumTriangles = mpMeshes[0].GetNumTriangles();
 }
 
-
 //------------------------------------------------------------------
-// Determine is the occluder model is inside view frustum
+// The occluder passed the frustum and size tests of the view, 
+// combine its world matrix with the view's to transform its meshes
 //------------------------------------------------------------------
-void TransformedModelSSE::InsideViewFrustum(const BoxTestSetupSSE &setup, UINT idx)
+void TransformedModelSSE::ComputeCumulativeMatrix(const BoxTestSetupSSE &setup, UINT idx)
 {
-	mpCPUTModel->GetBoundsWorldSpace(&mBBCenterWS, &mBBHalfWS);
-	mInsideViewFrustum[idx] = setup.mpCamera->mFrustum.IsVisible(mBBCenterWS, mBBHalfWS);
-
-	if(mInsideViewFrustum[idx])
-	{
-		MatrixMultiply(mWorldMatrix, setup.mViewProjViewport, mCumulativeMatrix[idx]);
-
-		float w = mBBCenterOS.x * mCumulativeMatrix[idx][0].m128_f32[3] +
-				  mBBCenterOS.y * mCumulativeMatrix[idx][1].m128_f32[3] +
-				  mBBCenterOS.z * mCumulativeMatrix[idx][2].m128_f32[3] +
-				  mCumulativeMatrix[idx][3].m128_f32[3]; 
-
-		if(w > 1.0f)
-		{
-			mTooSmall[idx] = mRadiusSq < w * setup.radiusThreshold;
-		}
-		else
-		{
-			// BB center is behind the near clip plane, making screen-space radius meaningless.
-            // Assume visible.  This should be a safe assumption, as the frustum test says the bbox is visible.
-            mTooSmall[idx] = false;
-        }
-	}
+	MatrixMultiply(mWorldMatrix, setup.mViewProjViewport, mCumulativeMatrix[idx]);
 }
 
 //---------------------------------------------------------------------------------------------------
-// Determine if the occluder size is sufficiently large enough to occlude other object sin the scene
-// If so transform the occluder to screen space so that it can be rasterized to the cPU depth buffer
+// Transform an occluder that passed the frustum and size tests to screen space so that it 
+// can be rasterized to the cPU depth buffer
 //---------------------------------------------------------------------------------------------------
 void TransformedModelSSE::TransformMeshes(UINT start, 
 										  UINT end,
 										  CPUTCamera* pCamera,
 										  UINT idx)
 {
-	if(mInsideViewFrustum[idx] && !mTooSmall[idx])
+	UINT totalNumVertices = 0;
+	for(UINT meshId = 0; meshId < mNumMeshes; meshId++)
 	{
-		UINT totalNumVertices = 0;
-		for(UINT meshId = 0; meshId < mNumMeshes; meshId++)
-		{
-			totalNumVertices +=  mpMeshes[meshId].GetNumVertices();
-			if(totalNumVertices < start)
-		    {
-				continue;
-			}
-			mpMeshes[meshId].TransformVertices(mCumulativeMatrix[idx], start, end, idx);
+		totalNumVertices +=  mpMeshes[meshId].GetNumVertices();
+		if(totalNumVertices < start)
+	    {
+			continue;
 		}
+		mpMeshes[meshId].TransformVertices(mCumulativeMatrix[idx], start, end, idx);
 	}
 }
 
 //------------------------------------------------------------------------------------
-// If the occluder is sufficiently large enough to occlude other objects in the scene 
-// bin the triangles that make up the occluder into tiles to speed up rateraization
+// Bin the triangles of an occluder that passed the frustum and size tests into tiles
+// to speed up rateraization
 // Single threaded version
 //------------------------------------------------------------------------------------
 void TransformedModelSSE::BinTransformedTrianglesST(UINT taskId,
@@ -168,25 +137,22 @@ void TransformedModelSSE::BinTransformedTrianglesST(UINT taskId,
 												    USHORT* pNumTrisInBin,
 													UINT idx)
 {
-	if(mInsideViewFrustum[idx] && !mTooSmall[idx])
+	UINT totalNumTris = 0;
+	for(UINT meshId = 0; meshId < mNumMeshes; meshId++)
 	{
-		UINT totalNumTris = 0;
-		for(UINT meshId = 0; meshId < mNumMeshes; meshId++)
+		totalNumTris += mpMeshes[meshId].GetNumTriangles();
+		if(totalNumTris < start)
 		{
-			totalNumTris += mpMeshes[meshId].GetNumTriangles();
-			if(totalNumTris < start)
-			{
-				continue;
-			}
-
-			mpMeshes[meshId].BinTransformedTrianglesST(taskId, modelId, meshId, start, end, pBin, pBinModel, pBinMesh, pNumTrisInBin, idx);
+			continue;
 		}
+
+		mpMeshes[meshId].BinTransformedTrianglesST(taskId, modelId, meshId, start, end, pBin, pBinModel, pBinMesh, pNumTrisInBin, idx);
 	}
 }
 
 //------------------------------------------------------------------------------------
-// If the occluder is sufficiently large enough to occlude other objects in the scene 
-// bin the triangles that make up the occluder into tiles to speed up rateraization
+// Bin the triangles of an occluder that passed the frustum and size tests into tiles
+// to speed up rateraization
 // Multi threaded version
 //------------------------------------------------------------------------------------
 void TransformedModelSSE::BinTransformedTrianglesMT(UINT taskId,
@@ -199,19 +165,16 @@ void TransformedModelSSE::BinTransformedTrianglesMT(UINT taskId,
 												    USHORT* pNumTrisInBin,
 													UINT idx)
 {
-	if(mInsideViewFrustum[idx] && !mTooSmall[idx])
+	UINT totalNumTris = 0;
+	for(UINT meshId = 0; meshId < mNumMeshes; meshId++)
 	{
-		UINT totalNumTris = 0;
-		for(UINT meshId = 0; meshId < mNumMeshes; meshId++)
+		totalNumTris += mpMeshes[meshId].GetNumTriangles();
+		if(totalNumTris < start)
 		{
-			totalNumTris += mpMeshes[meshId].GetNumTriangles();
-			if(totalNumTris < start)
-			{
-				continue;
-			}
-
-			mpMeshes[meshId].BinTransformedTrianglesMT(taskId, modelId, meshId, start, end, pBin, pBinModel, pBinMesh, pNumTrisInBin, idx);
+			continue;
 		}
+
+		mpMeshes[meshId].BinTransformedTrianglesMT(taskId, modelId, meshId, start, end, pBin, pBinModel, pBinMesh, pNumTrisInBin, idx);
 	}
 }
 
@@ -23,6 +23,7 @@
 #include "HelperSSE.h"
 
 struct BoxTestSetupSSE;
+class CullingScene;
 
 class TransformedModelSSE : public HelperSSE
 {
@@ -30,11 +31,10 @@ class TransformedModelSSE : public HelperSSE
 		TransformedModelSSE();
 		~TransformedModelSSE();
 		void CreateTransformedMeshes(CPUTModelDX11 *pModel);
-		void InsideViewFrustum(const BoxTestSetupSSE &setup,
-							   UINT idx);
-
-		void TooSmall(const BoxTestSetupSSE &setup,
-					  UINT idx);
+		// Single mesh model of an occluder of a scene without CPUT models
+		void CreateTransformedMeshes(const CullingScene &scene, UINT occluderId);
+		void ComputeCumulativeMatrix(const BoxTestSetupSSE &setup,
+									 UINT idx);
 
 		void TransformMeshes(UINT start, 
 							 UINT end,
@@ -70,47 +70,31 @@ class TransformedModelSSE : public HelperSSE
 
 		inline UINT GetNumTriangles(){return mNumTriangles;}
 
-		inline void SetXformedPos(__m128 *pXformedPos0, __m128 *pXformedPos1, UINT modelStart)
+		inline void SetXformedPos(__m128 *pXformedPos, UINT idx)
 		{
-			mpXformedPos[0] = pXformedPos0;
-			mpXformedPos[1] = pXformedPos1;
+			mpXformedPos[idx] = pXformedPos;
 
-			mpMeshes[0].SetXformedPos(mpXformedPos[0], mpXformedPos[1]);
-					
 			UINT numVertices = 0;
-			numVertices += mpMeshes[0].GetNumVertices();
-			
-			for(UINT i = 1; i < mNumMeshes; i++)
+			for(UINT i = 0; i < mNumMeshes; i++)
 			{
-				mpMeshes[i].SetXformedPos(mpXformedPos[0] + numVertices, mpXformedPos[1] + numVertices);
+				mpMeshes[i].SetXformedPos(mpXformedPos[idx] + numVertices, idx);
 				numVertices += mpMeshes[i].GetNumVertices(); 
 			}
 		}
 		
-		inline void SetInsideFrustum(bool inFrustum, UINT idx){mInsideViewFrustum[idx] = inFrustum;}
-
-		inline bool IsRasterized2DB(UINT idx)
-		{
-			return (mInsideViewFrustum[idx] && !mTooSmall[idx]);
-		}
+		inline float GetRadiusSq(){return mRadiusSq;}
 
 	private:
 		CPUTModelDX11 *mpCPUTModel;
 		UINT mNumMeshes;
 		__m128 *mWorldMatrix;
-		__m128 *mCumulativeMatrix[2];
+		__m128 *mCumulativeMatrix[MAX_SLOTS];
 		UINT mNumVertices;
 		UINT mNumTriangles;
-				
-		float3 mBBCenterWS;
-		float3 mBBHalfWS;
-		bool mInsideViewFrustum[2];
-		bool mTooSmall[2];
 
-		float3 mBBCenterOS;
 		float mRadiusSq;
 		TransformedMeshSSE *mpMeshes;
-		__m128 *mpXformedPos[2];		
+		__m128 *mpXformedPos[MAX_SLOTS];		
 };
 
 #endif
\ No newline at end of file
@@ -15,6 +15,7 @@
 //
 //--------------------------------------------------------------------------------------
 #include "TransformedModelScalar.h"
+#include "CullingScene.h"
 
 TransformedModelScalar::TransformedModelScalar()
 	: mpCPUTModel(NULL),
@@ -23,9 +24,12 @@ TransformedModelScalar::TransformedModelScalar()
 	  mNumTriangles(0),
 	  mpMeshes(NULL)
 {
-	mInsideViewFrustum[0] = mInsideViewFrustum[1] = false;
-	mTooSmall[0] = mTooSmall[1] = false;
-	mpXformedPos[0] = mpXformedPos[1] = NULL;
+	for(UINT i = 0; i < MAX_SLOTS; i++)
+	{
+		mInsideViewFrustum[i] = false;
+		mTooSmall[i] = false;
+		mpXformedPos[i] = NULL;
+	}
 }
 
 TransformedModelScalar::~TransformedModelScalar()
@@ -47,6 +51,7 @@ void TransformedModelScalar::CreateTransformedMeshes(CPUTModelDX11 *pModel)
 
 	mBBCenterOS = center;
 	mRadiusSq = half.lengthSq();
+	pModel->GetBoundsWorldSpace(&mBBCenterWS, &mBBHalfWS);
 
 	mpMeshes = new TransformedMeshScalar[mNumMeshes];
 
@@ -61,6 +66,23 @@ void TransformedModelScalar::CreateTransformedMeshes(CPUTModelDX11 *pModel)
 	}
 }
 
+void TransformedModelScalar::CreateTransformedMeshes(const CullingScene &scene, UINT occluderId)
+{
+	mNumMeshes = 1;
+	mWorldMatrix = scene.GetOccluderWorldMatrix(occluderId);
+
+	mBBCenterOS = scene.GetOccluderCenterOS(occluderId);
+	mRadiusSq = scene.GetOccluderHalfOS(occluderId).lengthSq();
+	mBBCenterWS = scene.GetOccluderCenter(occluderId);
+	mBBHalfWS = scene.GetOccluderHalf(occluderId);
+
+	mpMeshes = new TransformedMeshScalar[mNumMeshes];
+	mpMeshes[0].Initialize(scene.GetOccluderVertices(occluderId), scene.GetOccluderIndices(occluderId),
+						   scene.GetOccluderNumVertices(occluderId), scene.GetOccluderNumIndices(occluderId));
+	mNumVertices = mpMeshes[0].GetNumVertices();
+	mNumTriangles = mpMeshes[0].GetNumTriangles();
+}
+
 void TransformedModelScalar::TooSmall(const BoxTestSetupScalar &setup, UINT idx)
 {
 	if(mInsideViewFrustum[idx])
@@ -88,32 +110,16 @@ void TransformedModelScalar::TooSmall(const BoxTestSetupScalar &setup, UINT idx)
 
 //------------------------------------------------------------------
 // Determine is the occluder model is inside view frustum
+// The world space bounds, fetched when the model was created, are
+// tested against the frustum of every view, the views use slots
+// idx .. idx + numViews - 1
 //------------------------------------------------------------------
-void TransformedModelScalar::InsideViewFrustum(const BoxTestSetupScalar &setup,
-											   UINT idx)
+void TransformedModelScalar::InsideViewFrustum(const BoxTestSetupScalar *pSetup, UINT numViews, UINT idx)
 {
-	mpCPUTModel->GetBoundsWorldSpace(&mBBCenterWS, &mBBHalfWS);
-	mInsideViewFrustum[idx] = setup.mpCamera->mFrustum.IsVisible(mBBCenterWS, mBBHalfWS);
-
-	if(mInsideViewFrustum[idx])
+	for(UINT view = 0; view < numViews; view++)
 	{
-		mCumulativeMatrix[idx] = mWorldMatrix * setup.mViewProjViewport;
-		
-		float w = mBBCenterOS.x * mCumulativeMatrix[idx].r0.w +
-				  mBBCenterOS.y * mCumulativeMatrix[idx].r1.w +
-				  mBBCenterOS.z * mCumulativeMatrix[idx].r2.w +
-				  mCumulativeMatrix[idx].r3.w; 
-	
-		if(w > 1.0f)
-		{
-			mTooSmall[idx] = mRadiusSq < w * setup.radiusThreshold; 
-		}
-		else
-		{
-			// BB center is behind the near clip plane, making screen-space radius meaningless.
-            // Assume visible.  This should be a safe assumption, as the frustum test says the bbox is visible.
-            mTooSmall[idx] = false;
-		}
+		mInsideViewFrustum[idx + view] = pSetup[view].mpCamera->mFrustum.IsVisible(mBBCenterWS, mBBHalfWS);
+		TooSmall(pSetup[view], idx + view);
 	}
 }
 
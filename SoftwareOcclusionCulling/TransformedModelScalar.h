@@ -22,13 +22,18 @@
 #include "TransformedMeshScalar.h"
 #include "HelperScalar.h"
 
+class CullingScene;
+
 class TransformedModelScalar : public HelperScalar
 {
 	public:
 		TransformedModelScalar();
 		~TransformedModelScalar();
 		void CreateTransformedMeshes(CPUTModelDX11 *pModel);
-		void InsideViewFrustum(const BoxTestSetupScalar &setup,
+		// Single mesh model of an occluder of a scene without CPUT models
+		void CreateTransformedMeshes(const CullingScene &scene, UINT occluderId);
+		void InsideViewFrustum(const BoxTestSetupScalar *pSetup,
+							   UINT numViews,
 							   UINT idx);
 
 		void TooSmall(const BoxTestSetupScalar &setup,
@@ -68,23 +73,18 @@ class TransformedModelScalar : public HelperScalar
 
 		inline UINT GetNumTriangles(){return mNumTriangles;}
 
-		inline void SetXformedPos(float4 *pXformedPos0, float4 *pXformedPos1, UINT modelStart)
+		inline void SetXformedPos(float4 *pXformedPos, UINT idx)
 		{
-			mpXformedPos[0] = pXformedPos0;
-			mpXformedPos[1] = pXformedPos1;
+			mpXformedPos[idx] = pXformedPos;
 
-			mpMeshes[0].SetXformedPos(mpXformedPos[0], mpXformedPos[1]);
-					
 			UINT numVertices = 0;
-			numVertices += mpMeshes[0].GetNumVertices();
-			
-			for(UINT i = 1; i < mNumMeshes; i++)
+			for(UINT i = 0; i < mNumMeshes; i++)
 			{
-				mpMeshes[i].SetXformedPos(mpXformedPos[0] + numVertices, mpXformedPos[1] + numVertices);
+				mpMeshes[i].SetXformedPos(mpXformedPos[idx] + numVertices, idx);
 				numVertices += mpMeshes[i].GetNumVertices(); 
 			}
 		}
-
+		
 		inline void SetInsideFrustum(bool inFrustum, UINT idx){mInsideViewFrustum[idx] = inFrustum;}
 
 		inline bool IsRasterized2DB(UINT idx)
@@ -96,20 +96,20 @@ class TransformedModelScalar : public HelperScalar
 		CPUTModelDX11 *mpCPUTModel;
 		UINT mNumMeshes;
 		float4x4 mWorldMatrix;
-		float4x4 mCumulativeMatrix[2];
+		float4x4 mCumulativeMatrix[MAX_SLOTS];
 		UINT mNumVertices;
 		UINT mNumTriangles;
 
 		float3 mBBCenterWS;
 		float3 mBBHalfWS;
-		bool mInsideViewFrustum[2];
-		bool mTooSmall[2];
+		bool mInsideViewFrustum[MAX_SLOTS];
+		bool mTooSmall[MAX_SLOTS];
 		float mOccluderSizeThreshold;
 
 		float3 mBBCenterOS;
 		float mRadiusSq;
 		TransformedMeshScalar *mpMeshes;
-		float4 *mpXformedPos[2];
+		float4 *mpXformedPos[MAX_SLOTS];
 };
 
 #endif
\ No newline at end of file
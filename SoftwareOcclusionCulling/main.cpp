@@ -13,15 +13,85 @@
 // assume any responsibility for any errors which may appear in this software nor any
 // responsibility to update it.
 //--------------------------------------------------------------------------------------
+#include "Constants.h"
+#include "KernelBenchmark.h"
+#include "SceneBenchmark.h"
+#if defined(_WIN32)
 #include "SoftwareOcclusionCulling.h"
+#endif
 
-void ParseCommandLine()
-{
-	LPTSTR commandLine = GetCommandLineW();
-	int numArgs = 0;
-	LPWSTR* argv = CommandLineToArgvW(commandLine, &numArgs);
+// The culling settings of the command line and the task sets of the culling, defined here
+// rather than with the sample so that the device free modes build without it
+SOC_TYPE gSOCType			 = SSE_TYPE;
+float gOccluderSizeThreshold = 1.5f;
+float gOccludeeSizeThreshold = 0.01f;
+UINT  gDepthTestTasks		 = 20;
+UINT  gFrameSlots			 = 2;
+bool  gCullShadowView		 = false;
+bool  gCullShadowCasters	 = false;
+bool  gShadowPass		 = false;
+bool  gTileBinnedDepthTest = false;
+bool  gOccluderWaves		 = false;
+bool  gOccludeeProxies	 = false;
+bool  gTemporalCache		 = false;
+WCHAR gCaptureFile[MAX_PATH] = L"";
+TASKSETHANDLE gInsideViewFrustum[MAX_SLOTS];
+TASKSETHANDLE gTooSmall[MAX_SLOTS];
+TASKSETHANDLE gActiveModels[MAX_SLOTS];
+TASKSETHANDLE gSplitNearFar[MAX_SLOTS];
+TASKSETHANDLE gXformMesh[MAX_SLOTS];
+TASKSETHANDLE gBinMesh[MAX_SLOTS];
+TASKSETHANDLE gSortBins[MAX_SLOTS];
+TASKSETHANDLE gRasterize[MAX_SLOTS][NUM_RASTER_BANDS];
+TASKSETHANDLE gXformMeshNear[MAX_SLOTS];
+TASKSETHANDLE gBinMeshNear[MAX_SLOTS];
+TASKSETHANDLE gSortBinsNear[MAX_SLOTS];
+TASKSETHANDLE gRasterizeNear[MAX_SLOTS][NUM_RASTER_BANDS];
+TASKSETHANDLE gCullFarOccluders[MAX_SLOTS];
+TASKSETHANDLE gActiveFarModels[MAX_SLOTS];
+TASKSETHANDLE gXformProxies[MAX_SLOTS];
+TASKSETHANDLE gRasterizeProxies[MAX_SLOTS][NUM_RASTER_BANDS];
+TASKSETHANDLE gAABBoxBin[MAX_SLOTS];
+TASKSETHANDLE gAABBoxSort[MAX_SLOTS];
+TASKSETHANDLE gAABBoxBucketTest[MAX_SLOTS][NUM_OCCLUDEE_BUCKETS];
+TASKSETHANDLE gAABBoxDepthTest[MAX_SLOTS];
+
+LARGE_INTEGER glFrequency;
 
-	for(int i = 1; i < numArgs; i += 2) 
+// Task trace and its analysis written at exit, see TaskMgrTbb::DumpTrace and AnalyzeTrace
+static WCHAR gTraceFile[MAX_PATH] = L"";
+static WCHAR gTraceReportFile[MAX_PATH] = L"";
+// Hardware counters per culling stage written at exit, see TaskMgrTbb::CounterReport
+static WCHAR gTraceCounterFile[MAX_PATH] = L"";
+// Kernel benchmark results, the sample quits once they are written, see RunKernelBenchmark
+static WCHAR gKernelBenchmarkFile[MAX_PATH] = L"";
+// Synthetic scene benchmark results and the props of its only city, 0 for the whole sweep,
+// the sample quits once they are written, see RunSceneBenchmark
+static WCHAR gSceneBenchmarkFile[MAX_PATH] = L"";
+static UINT gSceneOccludees = 0;
+// Views the scene benchmark culls per frame, up to MAX_VIEWS
+static UINT gSceneViews = 1;
+// Thread scaling study results over the scene benchmark's city, up to -threads threads,
+// the sample quits once they are written, see RunThreadScaling
+static WCHAR gThreadScalingFile[MAX_PATH] = L"";
+// Culling quality results over the scene benchmark's city, the sample quits once they are
+// written, see RunCullingQuality
+static WCHAR gCullingQualityFile[MAX_PATH] = L"";
+// Frame benchmark results over the frames of the synthetic city, along the scene benchmark's
+// camera path for seed 0 or from random views, see RunFrameBenchmark
+static UINT  gBenchmarkFrames = 0;
+static UINT  gBenchmarkSeed = 0;
+static WCHAR gBenchmarkFile[MAX_PATH] = L"benchmark.csv";
+// The frame benchmark culls with the single threaded rasterizers if -tasks is 0
+static bool  gEnableTasks = true;
+// Culling trace the frame benchmark replays instead of the synthetic city, writing its
+// visibility differences to the report, see RunTraceBenchmark
+static WCHAR gReplayFile[MAX_PATH] = L"";
+static WCHAR gReplayReportFile[MAX_PATH] = L"replay.txt";
+
+void ParseCommandLine(int numArgs, WCHAR **argv)
+{
+	for(int i = 1; i + 1 < numArgs; i += 2) 
 	{
 		if(!_wcsicmp(argv[i], L"-dropdown1"))
 		{
@@ -46,14 +116,174 @@ void ParseCommandLine()
 		{
 			gDepthTestTasks = wcstoul(argv[i+1], NULL, 10);
 		}
+		if(!_wcsicmp(argv[i], L"-frameslots"))
+		{
+			gFrameSlots = wcstoul(argv[i+1], NULL, 10);
+		}
+		if(!_wcsicmp(argv[i], L"-shadowview"))
+		{
+			gCullShadowView = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-cullcasters"))
+		{
+			gCullShadowCasters = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-shadows"))
+		{
+			gShadowPass = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-tiledtest"))
+		{
+			gTileBinnedDepthTest = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-occluderwaves"))
+		{
+			gOccluderWaves = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-occludeeproxies"))
+		{
+			gOccludeeProxies = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-temporalcache"))
+		{
+			gTemporalCache = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-benchmark"))
+		{
+			gBenchmarkFrames = wcstoul(argv[i+1], NULL, 10);
+		}
+		if(!_wcsicmp(argv[i], L"-benchmarkseed"))
+		{
+			gBenchmarkSeed = wcstoul(argv[i+1], NULL, 10);
+		}
+		if(!_wcsicmp(argv[i], L"-benchmarkfile"))
+		{
+			wcsncpy_s(gBenchmarkFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-tasks"))
+		{
+			gEnableTasks = wcstoul(argv[i+1], NULL, 10) != 0;
+		}
+		if(!_wcsicmp(argv[i], L"-capture"))
+		{
+			wcsncpy_s(gCaptureFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-replay"))
+		{
+			wcsncpy_s(gReplayFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-replayreport"))
+		{
+			wcsncpy_s(gReplayReportFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-kernelbench"))
+		{
+			wcsncpy_s(gKernelBenchmarkFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-scenebench"))
+		{
+			wcsncpy_s(gSceneBenchmarkFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-sceneoccludees"))
+		{
+			gSceneOccludees = wcstoul(argv[i+1], NULL, 10);
+		}
+		if(!_wcsicmp(argv[i], L"-sceneviews"))
+		{
+			gSceneViews = wcstoul(argv[i+1], NULL, 10);
+		}
+		if(!_wcsicmp(argv[i], L"-threadscaling"))
+		{
+			wcsncpy_s(gThreadScalingFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-cullingquality"))
+		{
+			wcsncpy_s(gCullingQualityFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-threads"))
+		{
+			gTaskMgr.miDemoModeThreadCountOverride = (INT)wcstoul(argv[i+1], NULL, 10);
+		}
+		if(!_wcsicmp(argv[i], L"-tracefile"))
+		{
+			wcsncpy_s(gTraceFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-tracereport"))
+		{
+			wcsncpy_s(gTraceReportFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+		if(!_wcsicmp(argv[i], L"-tracecounters"))
+		{
+			wcsncpy_s(gTraceCounterFile, MAX_PATH, argv[i+1], _TRUNCATE);
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Runs the mode of the command line that needs neither the CPUT scene nor a D3D device,
+// the benchmarks and studies on synthetic inputs. Returns false if the command line asks
+// for none of them, else whether the mode wrote its results to pSuccess
+//--------------------------------------------------------------------------------------
+static bool RunDeviceFreeMode(bool *pSuccess)
+{
+	// The kernel benchmark runs on synthetic inputs, without the scene or a device
+	if(gKernelBenchmarkFile[0] != 0)
+	{
+		*pSuccess = RunKernelBenchmark(gKernelBenchmarkFile);
+		return true;
+	}
+
+	// So do the scene and frame benchmarks, the trace replay and the culling quality sweep,
+	// they only need the task manager
+	if(gSceneBenchmarkFile[0] != 0 || gCullingQualityFile[0] != 0 || gReplayFile[0] != 0 || gBenchmarkFrames > 0)
+	{
+		gTaskMgr.Init();
+		if(gSceneBenchmarkFile[0] != 0)
+		{
+			*pSuccess = RunSceneBenchmark(gSceneBenchmarkFile, gSceneOccludees, gSceneViews);
+		}
+		else if(gCullingQualityFile[0] != 0)
+		{
+			*pSuccess = RunCullingQuality(gCullingQualityFile, gSceneOccludees);
+		}
+		else if(gReplayFile[0] != 0)
+		{
+			*pSuccess = RunTraceBenchmark(gReplayFile, gBenchmarkFile, gReplayReportFile, gEnableTasks);
+		}
+		else
+		{
+			*pSuccess = RunFrameBenchmark(gBenchmarkFile, gSceneOccludees, gBenchmarkFrames, gBenchmarkSeed, gEnableTasks);
+		}
+		gTaskMgr.Shutdown();
+		return true;
+	}
+
+	// The thread scaling study initializes the task manager once per thread count
+	if(gThreadScalingFile[0] != 0)
+	{
+		INT maxThreads = gTaskMgr.miDemoModeThreadCountOverride;
+		*pSuccess = RunThreadScaling(gThreadScalingFile, gSceneOccludees, maxThreads > 0 ? (UINT)maxThreads : 0);
+		return true;
 	}
+	return false;
 }
 
+#if defined(_WIN32)
+
 // Application entry point.  Execution begins here.
 //-----------------------------------------------------------------------------
 int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow )
 {
-	ParseCommandLine();
+	int numArgs = 0;
+	LPWSTR *argv = CommandLineToArgvW(GetCommandLineW(), &numArgs);
+	ParseCommandLine(numArgs, argv);
+	LocalFree(argv);
+
+	bool success = false;
+	if(RunDeviceFreeMode(&success))
+	{
+		return success ? 0 : 1;
+	}
 
     // Prevent unused parameter compiler warnings
     UNREFERENCED_PARAMETER(hInstance);
@@ -100,12 +330,32 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     
 	// initialize the task manager
     gTaskMgr.Init();
+	gTaskMgr.EnableTrace(gTraceFile[0] != 0 || gTraceReportFile[0] != 0 || gTraceCounterFile[0] != 0);
+	gTaskMgr.EnableTraceCounters(gTraceCounterFile[0] != 0);
 
     // start the main message loop
     returnCode = pSample->CPUTMessageLoop();
 
 	pSample->DeviceShutdown();
 
+	// write the task trace of the last frames once all tasks are done
+	if(gTraceFile[0] != 0 || gTraceReportFile[0] != 0 || gTraceCounterFile[0] != 0)
+	{
+		gTaskMgr.WaitForAll();
+		if(gTraceFile[0] != 0)
+		{
+			gTaskMgr.DumpTrace(gTraceFile);
+		}
+		if(gTraceReportFile[0] != 0)
+		{
+			gTaskMgr.AnalyzeTrace(gTraceReportFile);
+		}
+		if(gTraceCounterFile[0] != 0)
+		{
+			gTaskMgr.CounterReport(gTraceCounterFile);
+		}
+	}
+
 	// shutdown task manage
 	gTaskMgr.Shutdown();
 
@@ -115,5 +365,35 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     return returnCode;
 }
 
+#else
+
+// Entry point of the builds without the sample, e.g. the benchmarks on a GPU-less box
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+	WCHAR **wargv = new WCHAR*[argc];
+	for(int i = 0; i < argc; i++)
+	{
+		size_t length = mbstowcs(NULL, argv[i], 0);
+		length = length == (size_t)-1 ? 0 : length;
+		wargv[i] = new WCHAR[length + 1];
+		mbstowcs(wargv[i], argv[i], length + 1);
+		wargv[i][length] = 0;
+	}
+	ParseCommandLine(argc, wargv);
+	for(int i = 0; i < argc; i++)
+	{
+		delete [] wargv[i];
+	}
+	delete [] wargv;
 
+	bool success = false;
+	if(!RunDeviceFreeMode(&success))
+	{
+		fprintf(stderr, "Only -kernelbench, -scenebench, -benchmark, -replay, -threadscaling and -cullingquality run without a D3D device\n");
+		return 1;
+	}
+	return success ? 0 : 1;
+}
 
+#endif